@@ -6,7 +6,11 @@
 
 #include "../driver_map/_drive_mapper.h"
 #include "../signature/_signature_parser.h"
+#include "../threading/_worker_pool.hpp"
 #include "../yara/_yara_scan.hpp"
+#include "mft_index.h"
+#include "regf_hive.h"
+#include "regf_log.h"
 #include "usn_reader.h"
 
 std::string WideToUtf8(const std::wstring& w)
@@ -35,10 +39,39 @@ std::wstring FileTimeToString(const FILETIME& ft)
     return buf;
 }
 
+static FILETIME ToFileTime(uint64_t ticks)
+{
+    FILETIME ft{};
+    ft.dwLowDateTime = static_cast<DWORD>(ticks);
+    ft.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+    return ft;
+}
+
+// NTFS paths are case-insensitive; BAM and the journal often disagree on case.
+static std::wstring PathKey(std::wstring path)
+{
+    CharLowerBuffW(path.data(), static_cast<DWORD>(path.size()));
+    return path;
+}
+
 static std::unordered_map<std::wstring, std::vector<BamReplace>>
 CollectReplacesByPath(const std::wstring& volume)
 {
     USNJournalReader reader(volume);
+
+    // Parents the journal never names are looked up in the MFT directory
+    // index instead of one OpenFileById round trip each. Most runs resolve
+    // everything from the journal, so the index is only read on the first
+    // miss and then kept for the rest of the run. If it cannot be built the
+    // reader falls back to OpenFileById.
+    MftIndex index;
+    enum class IndexState { NotBuilt, Ready, Failed } state = IndexState::NotBuilt;
+    reader.SetPathResolver([&](uint64_t frn, std::wstring& path) {
+        if (state == IndexState::NotBuilt)
+            state = index.BuildFromVolume(L"\\\\.\\" + volume) ? IndexState::Ready : IndexState::Failed;
+        return state == IndexState::Ready && index.Resolve(frn, path);
+        });
+
     auto replaces = reader.Run();
 
     std::unordered_map<std::wstring, std::vector<BamReplace>> map;
@@ -47,39 +80,40 @@ CollectReplacesByPath(const std::wstring& volume)
     {
         BamReplace br{};
         br.type = r.type;
-        br.startTime = r.startTime;
-        br.endTime = r.endTime;
+        br.startTime = ToFileTime(r.startTime);
+        br.endTime = ToFileTime(r.endTime);
         br.lastUsn = r.lastUsn;
 
         for (const auto& ev : r.events)
         {
             br.events.push_back({
-                ev.date,
+                ToFileTime(ev.date),
                 ev.reason
                 });
         }
 
-        map[r.fullPath].push_back(std::move(br));
+        map[PathKey(r.fullPath)].push_back(std::move(br));
     }
 
     return map;
 }
 
-BamResult ReadBAM()
+struct BamRawValue
+{
+    std::wstring rawPath;
+    FILETIME     lastExecution;
+};
+
+static std::vector<BamRawValue> EnumerateBAMValues()
 {
     constexpr auto BAM_KEY =
         L"SYSTEM\\CurrentControlSet\\Services\\bam\\State\\UserSettings";
 
+    std::vector<BamRawValue> values;
+
     HKEY hRoot;
     if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, BAM_KEY, 0, KEY_READ, &hRoot))
-        return {};
-
-    BamResult out;
-
-    InitGenericRules();
-    InitYara();
-
-    auto replacesByPath = CollectReplacesByPath(L"C:");
+        return values;
 
     wchar_t sid[256];
     DWORD sidSize = 256;
@@ -115,53 +149,168 @@ BamResult ReadBAM()
             if (!rawPath.starts_with(L"\\Device\\"))
                 continue;
 
-            BAMEntry e{};
-            memcpy(&e.lastExecution, data, sizeof(FILETIME));
-            e.path = DevicePathToDOSPath(rawPath);
-            e.signature = BamSignature::NotFound;
-
-            if (e.path.size() > 2 && e.path[1] == L':')
-            {
-                auto futureSig = GetSignatureStatusAsync(e.path);
-                auto sig = futureSig.get();
-
-                if (sig == SignatureStatus::Signed)
-                    e.signature = BamSignature::Signed;
-                else if (sig == SignatureStatus::Unsigned)
-                    e.signature = BamSignature::Unsigned;
-                else if (sig == SignatureStatus::Cheat)
-                    e.signature = BamSignature::Cheat;
-                else if (sig == SignatureStatus::Fake)
-                    e.signature = BamSignature::Fake;
-
-                if (e.signature == BamSignature::Unsigned)
-                {
-                    std::vector<std::string> yara;
-                    if (FastScanFile(WideToUtf8(e.path), yara))
-                        e.signature = BamSignature::Cheat;
-                }
-            }
-
-            auto it = replacesByPath.find(e.path);
-            if (it != replacesByPath.end())
-            {
-                e.replaces = it->second;
-            }
-
-            out.emplace_back(std::move(e));
+            BamRawValue v{};
+            v.rawPath = std::move(rawPath);
+            memcpy(&v.lastExecution, data, sizeof(FILETIME));
+            values.emplace_back(std::move(v));
         }
 
         RegCloseKey(hSid);
     }
 
     RegCloseKey(hRoot);
-    FinalizeYara();
+    return values;
+}
+
+static BamSignature ToBamSignature(SignatureStatus sig)
+{
+    if (sig == SignatureStatus::Signed)
+        return BamSignature::Signed;
+    if (sig == SignatureStatus::Unsigned)
+        return BamSignature::Unsigned;
+    if (sig == SignatureStatus::Cheat)
+        return BamSignature::Cheat;
+    if (sig == SignatureStatus::Fake)
+        return BamSignature::Fake;
+    if (sig == SignatureStatus::NotChecked)
+        return BamSignature::NotChecked;
+    return BamSignature::NotFound;
+}
+
+static BamScanTier ToBamScanTier(YaraScanTier tier)
+{
+    if (tier == YaraScanTier::Full)
+        return BamScanTier::Full;
+    if (tier == YaraScanTier::Sections)
+        return BamScanTier::Sections;
+    if (tier == YaraScanTier::Streamed)
+        return BamScanTier::Streamed;
+    return BamScanTier::None;
+}
 
-    std::sort(out.begin(), out.end(),
+// Most recent execution first.
+static void SortByLastExecution(BamResult& out)
+{
+    std::stable_sort(out.begin(), out.end(),
         [](const BAMEntry& a, const BAMEntry& b)
         {
             return CompareFileTime(&a.lastExecution, &b.lastExecution) > 0;
         });
+}
+
+// Resolve path -> signature -> YARA for a single value. Runs on a pool worker.
+static BAMEntry EnrichBAMValue(const BamRawValue& v, size_t worker)
+{
+    BAMEntry e{};
+    e.lastExecution = v.lastExecution;
+    e.path = DevicePathToDOSPath(v.rawPath);
+    e.signature = BamSignature::NotFound;
+    e.yaraTier = BamScanTier::None;
+
+    if (e.path.size() > 2 && e.path[1] == L':')
+    {
+        // One open and one mapping serve the signature checks and YARA.
+        // Files the signature checks could not read are still scanned; YARA
+        // streams them from the handle when there is no mapping.
+        FileProbe probe(e.path);
+        e.signature = ToBamSignature(GetSignatureStatus(probe));
+
+        bool scan = e.signature == BamSignature::Unsigned || e.signature == BamSignature::NotChecked;
+        if (scan && probe.Open())
+        {
+            std::vector<std::string> yara;
+            YaraScanTier tier = YaraScanTier::None;
+            if (ScanTieredOnWorker(worker, probe.Data(), probe.Size(), probe.Handle(), yara, tier))
+                e.signature = BamSignature::Cheat;
+            e.yaraTier = ToBamScanTier(tier);
+        }
+    }
+
+    return e;
+}
+
+static WorkerPool& GetBamWorkerPool()
+{
+    // libyara keeps per-thread scan state in YR_MAX_THREADS slots.
+    static WorkerPool pool(GetHardwareWorkerCount(YR_MAX_THREADS));
+    return pool;
+}
+
+static BamResult EnrichBAMValues(const std::vector<BamRawValue>& values)
+{
+    if (values.empty())
+        return {};
+
+    InitGenericRules();
+    InitYara();
+    InitYaraScanners(GetBamWorkerPool().Size());
+
+    std::filesystem::path yaraProfile = GetYaraProfilePath();
+    if (!yaraProfile.empty())
+        ResetYaraProfile();
+
+    auto replacesFuture = std::async(std::launch::async, CollectReplacesByPath, std::wstring(L"C:"));
+
+    BamResult out(values.size());
+    GetBamWorkerPool().ParallelFor(values.size(),
+        [&](size_t i, size_t worker)
+        {
+            out[i] = EnrichBAMValue(values[i], worker);
+        });
+
+    // Rules and scanners stay loaded for the next scan; ShutdownBAM() frees
+    // them. Workers are idle now; persist this run's signature verdicts.
+    GetVerdictCache().Save();
+
+    if (!yaraProfile.empty())
+        WriteYaraProfile(yaraProfile);
+
+    auto replacesByPath = replacesFuture.get();
+    for (auto& e : out)
+    {
+        auto it = replacesByPath.find(PathKey(e.path));
+        if (it != replacesByPath.end())
+        {
+            e.replaces = it->second;
+        }
+    }
+
+    SortByLastExecution(out);
 
     return out;
+}
+
+BamResult ReadBAM()
+{
+    return EnrichBAMValues(EnumerateBAMValues());
+}
+
+BamResult ReadBAMFromHive(const std::wstring& hivePath)
+{
+    RegfHive hive;
+    if (!hive.Open(hivePath, MapMode::CopyOnWrite))
+        return {};
+
+    // A dirty hive misses the latest writes; they are still in .LOG1/.LOG2.
+    RecoverHiveFromLogs(hive, hivePath);
+
+    BamResult out;
+    for (auto& v : ReadBAMValuesFromHive(hive))
+    {
+        BAMEntry e{};
+        e.path = std::move(v.rawPath);
+        e.lastExecution = ToFileTime(v.lastExecution);
+        e.signature = BamSignature::NotChecked;
+        e.yaraTier = BamScanTier::None;
+        out.emplace_back(std::move(e));
+    }
+
+    SortByLastExecution(out);
+
+    return out;
+}
+
+void ShutdownBAM()
+{
+    FinalizeYara();
 }
\ No newline at end of file
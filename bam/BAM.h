@@ -9,7 +9,19 @@ enum class BamSignature
     Unsigned,
     NotFound,
     Cheat,
-    Fake
+    Fake,
+    // Offline hive paths (another machine's volumes), and local files that
+    // could not be opened or read.
+    NotChecked
+};
+
+// How much of the file the YARA scan covered.
+enum class BamScanTier
+{
+    None,
+    Full,
+    Sections,
+    Streamed
 };
 
 struct BamReplaceEvent
@@ -32,6 +44,7 @@ struct BAMEntry
     std::wstring path;
     FILETIME     lastExecution;
     BamSignature signature;
+    BamScanTier  yaraTier;
 
     std::vector<BamReplace> replaces;
 };
@@ -41,4 +54,11 @@ using BamResult = std::vector<BAMEntry>;
 
 std::string  WideToUtf8(const std::wstring& w);
 std::wstring FileTimeToString(const FILETIME& ft);
-BamResult    ReadBAM();
\ No newline at end of file
+BamResult    ReadBAM();
+// Values from an offline SYSTEM hive file. Their paths refer to the volumes
+// of the machine the hive came from, so they are returned as device paths
+// with NotChecked signatures: no drive mapping, signature, YARA or USN
+// lookups are run against this machine's volumes.
+BamResult    ReadBAMFromHive(const std::wstring& hivePath);
+// Releases the YARA rules and scanners kept loaded between scans.
+void         ShutdownBAM();
\ No newline at end of file
@@ -2,52 +2,60 @@
 #include <winioctl.h>
 #include <vector>
 #include <string>
-#include <unordered_set>
-#include <algorithm>
 #include <cwchar>
 
-inline std::wstring ConvertStringToLowerCase(const std::wstring& input) {
-    std::wstring result = input;
-    std::transform(result.begin(), result.end(), result.begin(), ::towlower);
-    return result;
-}
-
-inline std::wstring ConvertUtf8StringToWstring(const std::string& str) {
-    if (str.empty()) return std::wstring();
-    int size_needed = MultiByteToWideChar(CP_UTF8, 0, str.data(), (int)str.size(), NULL, 0);
-    std::wstring wstrTo(size_needed, 0);
-    MultiByteToWideChar(CP_UTF8, 0, str.data(), (int)str.size(), &wstrTo[0], size_needed);
-    return wstrTo;
-}
+#include "regf_carver.h"
+#include "regf_log.h"
 
-struct FileHandleWrapper { HANDLE handle; };
-struct VolumeHandleWrapper { HANDLE handle; };
+struct FileHandleWrapper {
+    HANDLE handle;
+    ~FileHandleWrapper() { if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle); }
+};
+struct VolumeHandleWrapper {
+    HANDLE handle;
+    ~VolumeHandleWrapper() { if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle); }
+};
 
 bool RetrieveClustersFromFileSequentially(HANDLE fileHandle, std::vector<std::pair<ULONGLONG, ULONGLONG>>& outClusters, ULONGLONG& outStartVCN) {
     BYTE buffer[4096];
     STARTING_VCN_INPUT_BUFFER inputBuffer = { 0 };
-    DWORD returnedBytes = 0;
+    bool first = true;
 
-    if (!DeviceIoControl(fileHandle, FSCTL_GET_RETRIEVAL_POINTERS,
-        &inputBuffer, sizeof(inputBuffer),
-        buffer, sizeof(buffer),
-        &returnedBytes, NULL)) {
-        return false;
-    }
+    for (;;) {
+        DWORD returnedBytes = 0;
+        BOOL ok = DeviceIoControl(fileHandle, FSCTL_GET_RETRIEVAL_POINTERS,
+            &inputBuffer, sizeof(inputBuffer),
+            buffer, sizeof(buffer),
+            &returnedBytes, NULL);
 
-    auto* ptrs = reinterpret_cast<RETRIEVAL_POINTERS_BUFFER*>(buffer);
-    outStartVCN = ptrs->StartingVcn.QuadPart;
+        if (!ok && GetLastError() != ERROR_MORE_DATA) {
+            return false;
+        }
 
-    for (DWORD i = 0; i < ptrs->ExtentCount; ++i) {
-        const auto& extent = ptrs->Extents[i];
-        if (extent.Lcn.QuadPart == static_cast<ULONGLONG>(-1)) return false;
-        ULONGLONG previousVCN = (i == 0) ? outStartVCN : ptrs->Extents[i - 1].NextVcn.QuadPart;
-        outClusters.emplace_back(extent.NextVcn.QuadPart - previousVCN, extent.Lcn.QuadPart);
-    }
+        auto* ptrs = reinterpret_cast<RETRIEVAL_POINTERS_BUFFER*>(buffer);
+        if (first) {
+            outStartVCN = ptrs->StartingVcn.QuadPart;
+            first = false;
+        }
 
-    return true;
+        for (DWORD i = 0; i < ptrs->ExtentCount; ++i) {
+            const auto& extent = ptrs->Extents[i];
+            if (extent.Lcn.QuadPart == static_cast<ULONGLONG>(-1)) return false;
+            ULONGLONG previousVCN = (i == 0) ? ptrs->StartingVcn.QuadPart : ptrs->Extents[i - 1].NextVcn.QuadPart;
+            outClusters.emplace_back(extent.NextVcn.QuadPart - previousVCN, extent.Lcn.QuadPart);
+        }
+
+        if (ok || ptrs->ExtentCount == 0) {
+            return true;
+        }
+
+        // Large hives are fragmented beyond one buffer; continue after the last extent.
+        inputBuffer.StartingVcn = ptrs->Extents[ptrs->ExtentCount - 1].NextVcn;
+    }
 }
 
+// Reads a locked file straight from its clusters into outBuffer. Each extent
+// is read in one sequential pass directly into its final position.
 bool CopyFileRawDataIntoMemorySequentially(const std::wstring& filePath, std::vector<BYTE>& outBuffer) {
     FileHandleWrapper inputFile = { CreateFileW(filePath.c_str(), 0,
         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
@@ -61,6 +69,9 @@ bool CopyFileRawDataIntoMemorySequentially(const std::wstring& filePath, std::ve
     ULONGLONG startVCN = 0;
     if (!RetrieveClustersFromFileSequentially(inputFile.handle, clusters, startVCN)) return false;
 
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(inputFile.handle, &fileSize)) return false;
+
     wchar_t driveLetter = towupper(filePath[0]);
     wchar_t volumePath[] = L"\\\\.\\X:";
     volumePath[4] = driveLetter;
@@ -75,90 +86,46 @@ bool CopyFileRawDataIntoMemorySequentially(const std::wstring& filePath, std::ve
     DWORD clusterSize = sectorsPerCluster * bytesPerSector;
     VolumeHandleWrapper volume = { CreateFileW(volumePath, GENERIC_READ,
         FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-        OPEN_EXISTING, 0, NULL) };
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL) };
 
     if (volume.handle == INVALID_HANDLE_VALUE) {
         return false;
     }
 
-    std::vector<BYTE> localBuffer(clusterSize);
+    ULONGLONG totalBytes = 0;
+    for (const auto& extent : clusters)
+        totalBytes += extent.first * clusterSize;
 
-    for (const auto& extent : clusters) {
-        ULONGLONG count = extent.first;
-        ULONGLONG lcn = extent.second;
+    outBuffer.resize(static_cast<size_t>(totalBytes));
+    size_t written = 0;
+    constexpr DWORD maxChunk = 16 * 1024 * 1024;
 
-        for (ULONGLONG i = 0; i < count; ++i) {
-            LARGE_INTEGER offset;
-            offset.QuadPart = (lcn + i) * clusterSize;
+    for (const auto& extent : clusters) {
+        LARGE_INTEGER offset;
+        offset.QuadPart = extent.second * clusterSize;
 
-            if (!SetFilePointerEx(volume.handle, offset, NULL, FILE_BEGIN)) {
-                CloseHandle(inputFile.handle);
-                CloseHandle(volume.handle);
-                return false;
-            }
+        if (!SetFilePointerEx(volume.handle, offset, NULL, FILE_BEGIN)) {
+            return false;
+        }
 
+        ULONGLONG remaining = extent.first * clusterSize;
+        while (remaining > 0) {
+            DWORD chunk = static_cast<DWORD>(remaining < maxChunk ? remaining : maxChunk);
             DWORD bytesRead = 0;
-            if (!ReadFile(volume.handle, localBuffer.data(), clusterSize, &bytesRead, NULL)) {
-                CloseHandle(inputFile.handle);
-                CloseHandle(volume.handle);
+            if (!ReadFile(volume.handle, outBuffer.data() + written, chunk, &bytesRead, NULL)) {
                 return false;
             }
+            if (bytesRead == 0) break;
 
-            outBuffer.insert(outBuffer.end(), localBuffer.begin(), localBuffer.begin() + bytesRead);
+            written += bytesRead;
+            remaining -= bytesRead;
         }
     }
 
-    CloseHandle(inputFile.handle);
-    CloseHandle(volume.handle);
-
+    outBuffer.resize(written < static_cast<ULONGLONG>(fileSize.QuadPart) ? written : static_cast<size_t>(fileSize.QuadPart));
     return true;
 }
 
-struct BAMEntryStruct { std::wstring path; };
-
-std::vector<BAMEntryStruct> RetrieveBAMEntriesFromRegistry() {
-    std::vector<BAMEntryStruct> entries;
-    HKEY hKey;
-    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE,
-        L"SYSTEM\\CurrentControlSet\\Services\\bam\\State\\UserSettings",
-        0, KEY_READ, &hKey) != ERROR_SUCCESS) return entries;
-
-    DWORD subKeyCount = 0, maxSubKeyLength = 0;
-    RegQueryInfoKeyW(hKey, nullptr, nullptr, nullptr, &subKeyCount, &maxSubKeyLength, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-    maxSubKeyLength++;
-    std::vector<wchar_t> subKeyName(maxSubKeyLength);
-
-    for (DWORD i = 0; i < subKeyCount; i++) {
-        DWORD nameLen = maxSubKeyLength;
-        if (RegEnumKeyExW(hKey, i, subKeyName.data(), &nameLen, nullptr, nullptr, nullptr, nullptr) != ERROR_SUCCESS) continue;
-
-        std::wstring fullSubKeyPath = L"SYSTEM\\CurrentControlSet\\Services\\bam\\State\\UserSettings\\" + std::wstring(subKeyName.data());
-        HKEY hSubKey;
-        if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, fullSubKeyPath.c_str(), 0, KEY_READ, &hSubKey) != ERROR_SUCCESS) continue;
-
-        DWORD valueIndex = 0;
-        WCHAR valueName[512];
-        BYTE dataBuffer[64];
-        DWORD type;
-
-        while (true) {
-            DWORD valueNameLen = 512, dataLen = sizeof(dataBuffer);
-            LONG r = RegEnumValueW(hSubKey, valueIndex, valueName, &valueNameLen, nullptr, &type, dataBuffer, &dataLen);
-            if (r == ERROR_NO_MORE_ITEMS) break;
-            if (r == ERROR_SUCCESS && type == REG_BINARY && dataLen >= sizeof(FILETIME)) {
-                if (wcsncmp(valueName, L"\\Device", 7) == 0)
-                    entries.push_back({ valueName });
-            }
-            valueIndex++;
-        }
-
-        RegCloseKey(hSubKey);
-    }
-
-    RegCloseKey(hKey);
-    return entries;
-}
-
 std::wstring ConvertDevicePathToWindowsDriveLetter(const std::wstring& path) {
     wchar_t drives[MAX_PATH];
     if (GetLogicalDriveStringsW(MAX_PATH, drives)) {
@@ -184,47 +151,69 @@ std::wstring ConvertDevicePathToWindowsDriveLetter(const std::wstring& path) {
     return path;
 }
 
-std::unordered_set<std::wstring> GetBAMPathsAsLowerCaseSet() {
-    std::unordered_set<std::wstring> paths;
-    for (auto& entry : RetrieveBAMEntriesFromRegistry()) {
-        paths.insert(ConvertStringToLowerCase(ConvertDevicePathToWindowsDriveLetter(entry.path)));
-    }
-    return paths;
-}
+struct DeletedBAMEntry {
+    std::wstring path;
+    std::wstring sid;
+    FILETIME lastExecution;
+};
 
 struct DeletedBAMEntriesResult {
-    std::vector<std::wstring> deletedPaths;
+    std::vector<DeletedBAMEntry> entries;
 };
 
-DeletedBAMEntriesResult FindDeletedBAMEntriesInSystemHive() {
+// Device paths are only mapped to drive letters for the live system's hive;
+// those of a collected hive name another machine's volumes.
+DeletedBAMEntriesResult CollectDeletedBAMEntries(const RegfHive& hive, bool mapDriveLetters) {
     DeletedBAMEntriesResult result;
-    std::vector<BYTE> systemHiveData;
 
+    for (auto& carved : CarveDeletedBAMValues(hive)) {
+        DeletedBAMEntry entry;
+        entry.path = mapDriveLetters ? ConvertDevicePathToWindowsDriveLetter(carved.rawPath) : std::move(carved.rawPath);
+        entry.sid = std::move(carved.sid);
+        entry.lastExecution.dwLowDateTime = static_cast<DWORD>(carved.lastExecution);
+        entry.lastExecution.dwHighDateTime = static_cast<DWORD>(carved.lastExecution >> 32);
+        result.entries.push_back(std::move(entry));
+    }
+
+    return result;
+}
+
+// Live system: the hive is locked, so it is read raw from its clusters and
+// carved in place.
+DeletedBAMEntriesResult FindDeletedBAMEntriesInSystemHive() {
+    std::vector<BYTE> systemHiveData;
     if (!CopyFileRawDataIntoMemorySequentially(L"C:\\Windows\\System32\\config\\SYSTEM", systemHiveData)) {
-        return result;
+        return {};
+    }
+
+    RegfHive hive;
+    if (!hive.Adopt(std::move(systemHiveData))) {
+        return {};
     }
 
-    std::string content(systemHiveData.begin(), systemHiveData.end());
-    std::wstring wcontent = ConvertUtf8StringToWstring(content);
-    std::unordered_set<std::wstring> bamPaths = GetBAMPathsAsLowerCaseSet();
+    if (hive.IsDirty()) {
+        std::vector<BYTE> log1, log2;
+        std::vector<std::span<const uint8_t>> logs;
+        if (CopyFileRawDataIntoMemorySequentially(L"C:\\Windows\\System32\\config\\SYSTEM.LOG1", log1))
+            logs.emplace_back(log1.data(), log1.size());
+        if (CopyFileRawDataIntoMemorySequentially(L"C:\\Windows\\System32\\config\\SYSTEM.LOG2", log2))
+            logs.emplace_back(log2.data(), log2.size());
 
-    std::wstring searchString = L"\\Device\\HarddiskVolume";
-    std::wstring extensionString = L".exe";
+        ReplayHiveLogs(hive, logs);
+    }
 
-    size_t pos = 0;
+    return CollectDeletedBAMEntries(hive, true);
+}
 
-    while ((pos = wcontent.find(searchString, pos)) != std::wstring::npos) {
-        size_t endPos = wcontent.find(extensionString, pos);
-        if (endPos == std::wstring::npos) break;
-        endPos += extensionString.size();
-        std::wstring foundPath = wcontent.substr(pos, endPos - pos);
-        std::wstring convertedPath = ConvertDevicePathToWindowsDriveLetter(foundPath);
-        std::wstring lowerPath = ConvertStringToLowerCase(convertedPath);
-        if (bamPaths.find(lowerPath) == bamPaths.end()) {
-            result.deletedPaths.push_back(convertedPath);
-        }
-        pos = endPos;
+// Collected hive file: carved through a single copy-on-write mapped view,
+// after replaying any .LOG1/.LOG2 found next to it. Paths stay device paths.
+DeletedBAMEntriesResult FindDeletedBAMEntriesInHiveFile(const std::wstring& hivePath) {
+    RegfHive hive;
+    if (!hive.Open(hivePath, MapMode::CopyOnWrite)) {
+        return {};
     }
 
-    return result;
-}
\ No newline at end of file
+    RecoverHiveFromLogs(hive, hivePath);
+
+    return CollectDeletedBAMEntries(hive, false);
+}
@@ -0,0 +1,561 @@
+#include "mft_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../io/_mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t   kChunkSize = 4 * 1024 * 1024;
+    constexpr uint32_t kFixupStride = 512;
+    constexpr uint64_t kRootRecord = 5;
+    constexpr uint32_t kMaxAttributeList = 256 * 1024;
+
+    constexpr uint32_t kAttrAttributeList = 0x20;
+    constexpr uint32_t kAttrFileName = 0x30;
+    constexpr uint32_t kAttrData = 0x80;
+    constexpr uint32_t kAttrEnd = 0xFFFFFFFF;
+
+    constexpr uint16_t kRecordInUse = 0x0001;
+    constexpr uint16_t kRecordIsDirectory = 0x0002;
+    constexpr uint32_t kFileNameIsDirectory = 0x10000000;
+    constexpr uint8_t  kNamespaceDos = 2;
+
+    inline uint16_t Le16(const uint8_t* p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint32_t Le32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint64_t Le64(const uint8_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    inline uint64_t RecordNumber(uint64_t frn) { return frn & 0x0000FFFFFFFFFFFFULL; }
+    inline uint16_t SequenceOf(uint64_t frn) { return static_cast<uint16_t>(frn >> 48); }
+
+    // Undoes the update sequence array: the last two bytes of every 512-byte
+    // stride were replaced on disk by the sequence number. A mismatch means
+    // a torn write and the record is skipped.
+    bool ApplyFixups(uint8_t* rec, uint32_t size)
+    {
+        if (size < 0x30 || memcmp(rec, "FILE", 4) != 0)
+            return false;
+
+        uint16_t usaOffset = Le16(rec + 0x04);
+        uint16_t usaCount = Le16(rec + 0x06);
+        if (usaCount < 2 || usaOffset + usaCount * 2u > size || (usaCount - 1u) * kFixupStride > size)
+            return false;
+
+        const uint8_t* usa = rec + usaOffset;
+        for (uint16_t i = 1; i < usaCount; ++i)
+        {
+            uint8_t* tail = rec + i * kFixupStride - 2;
+            if (memcmp(tail, usa, 2) != 0)
+                return false;
+            memcpy(tail, usa + i * 2, 2);
+        }
+        return true;
+    }
+
+    // Calls fn(type, attr, length) for each attribute of a fixed-up record.
+    template <typename Fn>
+    void ForEachAttribute(const uint8_t* rec, uint32_t size, Fn&& fn)
+    {
+        uint32_t used = std::min(Le32(rec + 0x18), size);
+        for (uint32_t off = Le16(rec + 0x14); off + 8 <= used;)
+        {
+            uint32_t type = Le32(rec + off);
+            uint32_t length = Le32(rec + off + 4);
+            if (type == kAttrEnd || length < 0x18 || off + length > used)
+                break;
+
+            if (!fn(type, rec + off, length))
+                break;
+            off += length;
+        }
+    }
+
+    struct DataRun
+    {
+        uint64_t lcn;
+        uint64_t clusters;
+    };
+
+    std::vector<DataRun> DecodeRunList(const uint8_t* p, const uint8_t* end)
+    {
+        std::vector<DataRun> runs;
+        int64_t lcn = 0;
+
+        while (p < end && *p)
+        {
+            uint8_t lenSize = *p & 0x0F;
+            uint8_t offSize = *p >> 4;
+            if (!lenSize || lenSize > 8 || offSize > 8 || p + 1 + lenSize + offSize > end)
+                break;
+            ++p;
+
+            uint64_t clusters = 0;
+            for (uint8_t i = 0; i < lenSize; ++i)
+                clusters |= static_cast<uint64_t>(p[i]) << (8 * i);
+            p += lenSize;
+
+            if (offSize == 0)
+            {
+                // Sparse run; $MFT never has one, but keep the record count right.
+                runs.push_back({ UINT64_MAX, clusters });
+                continue;
+            }
+
+            int64_t delta = 0;
+            for (uint8_t i = 0; i < offSize; ++i)
+                delta |= static_cast<int64_t>(p[i]) << (8 * i);
+            if (p[offSize - 1] & 0x80)
+                delta -= static_cast<int64_t>(1) << (8 * offSize);
+            p += offSize;
+
+            lcn += delta;
+            runs.push_back({ static_cast<uint64_t>(lcn), clusters });
+        }
+        return runs;
+    }
+
+    // One extent of $MFT's unnamed $DATA attribute. A fragmented $MFT keeps
+    // the later extents in extension records named by record 0's attribute
+    // list; each extent's run list starts over from LCN 0.
+    struct DataSegment
+    {
+        uint64_t             firstVcn;
+        std::vector<DataRun> runs;
+    };
+
+    // Adds the unnamed non-resident $DATA extents of a fixed-up record. Only
+    // the extent starting at VCN 0 carries the attribute's data size.
+    void CollectDataSegments(const uint8_t* rec, uint32_t size, std::vector<DataSegment>& segments, uint64_t& dataSize)
+    {
+        ForEachAttribute(rec, size, [&](uint32_t type, const uint8_t* attr, uint32_t length) {
+            if (type != kAttrData || attr[8] != 1 || attr[9] != 0)
+                return true;
+
+            uint16_t runOffset = Le16(attr + 0x20);
+            if (length < 0x40 || runOffset >= length)
+                return true;
+
+            uint64_t firstVcn = Le64(attr + 0x10);
+            if (firstVcn == 0)
+                dataSize = Le64(attr + 0x30);
+            segments.push_back({ firstVcn, DecodeRunList(attr + runOffset, attr + length) });
+            return true;
+        });
+    }
+
+    // LCN of a cluster of the attribute the segments describe, as far as they
+    // are known yet.
+    bool MapVcn(const std::vector<DataSegment>& segments, uint64_t vcn, uint64_t& lcn)
+    {
+        for (const auto& segment : segments)
+        {
+            uint64_t start = segment.firstVcn;
+            for (const auto& run : segment.runs)
+            {
+                if (vcn >= start && vcn - start < run.clusters)
+                {
+                    if (run.lcn == UINT64_MAX)
+                        return false;
+                    lcn = run.lcn + (vcn - start);
+                    return true;
+                }
+                start += run.clusters;
+            }
+        }
+        return false;
+    }
+
+    class RawDevice
+    {
+    public:
+        ~RawDevice()
+        {
+#ifdef _WIN32
+            if (m_handle != INVALID_HANDLE_VALUE)
+                CloseHandle(m_handle);
+#else
+            if (m_fd >= 0)
+                ::close(m_fd);
+#endif
+        }
+
+        bool Open(const std::filesystem::path& path)
+        {
+#ifdef _WIN32
+            m_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                nullptr, OPEN_EXISTING, 0, nullptr);
+            return m_handle != INVALID_HANDLE_VALUE;
+#else
+            m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            return m_fd >= 0;
+#endif
+        }
+
+        // Volume handles need sector-aligned offsets and sizes; every caller
+        // reads whole clusters (or the 4 KiB boot area).
+        bool ReadAt(uint64_t offset, uint8_t* buffer, size_t size)
+        {
+#ifdef _WIN32
+            OVERLAPPED ov{};
+            ov.Offset = static_cast<DWORD>(offset);
+            ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD read = 0;
+            return ReadFile(m_handle, buffer, static_cast<DWORD>(size), &read, &ov) && read == size;
+#else
+            return ::pread(m_fd, buffer, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+        int m_fd = -1;
+#endif
+    };
+
+    // Reads `size` bytes at `offset` of a non-resident attribute, a cluster
+    // at a time since a record may straddle fragments.
+    bool ReadAttributeData(RawDevice& volume, const std::vector<DataSegment>& segments, uint64_t clusterSize,
+        uint64_t offset, uint8_t* out, size_t size)
+    {
+        std::vector<uint8_t> cluster(static_cast<size_t>(clusterSize));
+        while (size)
+        {
+            uint64_t lcn;
+            if (!MapVcn(segments, offset / clusterSize, lcn) || !volume.ReadAt(lcn * clusterSize, cluster.data(), cluster.size()))
+                return false;
+
+            size_t within = static_cast<size_t>(offset % clusterSize);
+            size_t bytes = std::min<size_t>(size, cluster.size() - within);
+            memcpy(out, cluster.data() + within, bytes);
+            out += bytes;
+            offset += bytes;
+            size -= bytes;
+        }
+        return true;
+    }
+
+    // Content of record 0's $ATTRIBUTE_LIST, resident or not; empty when
+    // $MFT has none.
+    std::vector<uint8_t> ReadAttributeList(RawDevice& volume, const uint8_t* rec, uint32_t size, uint64_t clusterSize)
+    {
+        std::vector<uint8_t> list;
+
+        ForEachAttribute(rec, size, [&](uint32_t type, const uint8_t* attr, uint32_t length) {
+            if (type != kAttrAttributeList)
+                return true;
+
+            if (attr[8] == 0)
+            {
+                uint32_t contentSize = Le32(attr + 0x10);
+                uint16_t contentOffset = Le16(attr + 0x14);
+                if (contentOffset + static_cast<uint64_t>(contentSize) <= length)
+                    list.assign(attr + contentOffset, attr + contentOffset + contentSize);
+                return false;
+            }
+
+            uint16_t runOffset = Le16(attr + 0x20);
+            uint64_t dataSize = Le64(attr + 0x30);
+            if (length < 0x40 || runOffset >= length || dataSize > kMaxAttributeList)
+                return false;
+
+            std::vector<DataSegment> segments{ { 0, DecodeRunList(attr + runOffset, attr + length) } };
+            list.resize(static_cast<size_t>(dataSize));
+            if (!ReadAttributeData(volume, segments, clusterSize, 0, list.data(), list.size()))
+                list.clear();
+            return false;
+        });
+
+        return list;
+    }
+}
+
+void MftIndex::AddRecords(const uint8_t* data, size_t size, uint32_t recordSize, uint64_t firstRecord)
+{
+    if (recordSize < 0x200 || recordSize > 0x10000)
+        return;
+
+    std::vector<uint8_t> rec(recordSize);
+
+    for (size_t pos = 0; pos + recordSize <= size; pos += recordSize)
+    {
+        uint64_t recordNumber = firstRecord + pos / recordSize;
+        if (memcmp(data + pos, "FILE", 4) != 0)
+            continue;
+
+        memcpy(rec.data(), data + pos, recordSize);
+        if (!ApplyFixups(rec.data(), recordSize))
+            continue;
+
+        uint16_t flags = Le16(rec.data() + 0x16);
+        if (!(flags & kRecordInUse))
+            continue;
+
+        // Names of a record with an attribute list may sit in an extension
+        // record; they are credited to the base record.
+        uint64_t frn = recordNumber | (static_cast<uint64_t>(Le16(rec.data() + 0x10)) << 48);
+        uint64_t base = Le64(rec.data() + 0x20);
+        if (RecordNumber(base) != 0)
+            frn = base;
+
+        bool isDirectory = RecordNumber(base) == 0 && (flags & kRecordIsDirectory);
+
+        ForEachAttribute(rec.data(), recordSize, [&](uint32_t type, const uint8_t* attr, uint32_t length) {
+            if (type != kAttrFileName || attr[8] != 0)
+                return true;
+
+            uint32_t contentSize = Le32(attr + 0x10);
+            uint16_t contentOffset = Le16(attr + 0x14);
+            if (contentSize < 0x42 || contentOffset + contentSize > length)
+                return true;
+
+            const uint8_t* fn = attr + contentOffset;
+            uint8_t nameLength = fn[0x40];
+            if (0x42u + nameLength * 2u > contentSize)
+                return true;
+
+            bool directory = isDirectory || (Le32(fn + 0x38) & kFileNameIsDirectory);
+            if (!directory)
+                return true;
+
+            Node node{};
+            node.frn = frn;
+            node.parent = Le64(fn);
+            node.nameOffset = static_cast<uint32_t>(m_names.size());
+            node.nameLength = nameLength;
+            node.nameSpace = fn[0x41];
+
+            for (uint8_t i = 0; i < nameLength; ++i)
+                m_names.push_back(static_cast<wchar_t>(Le16(fn + 0x42 + i * 2)));
+
+            m_nodes.push_back(node);
+            return true;
+        });
+    }
+}
+
+void MftIndex::Finish()
+{
+    // One entry per record: a long (Win32/POSIX) name wins over the 8.3 alias.
+    auto rank = [](const Node& n) { return n.nameSpace == kNamespaceDos ? 1 : 0; };
+
+    std::stable_sort(m_nodes.begin(), m_nodes.end(), [&](const Node& a, const Node& b) {
+        uint64_t ra = RecordNumber(a.frn), rb = RecordNumber(b.frn);
+        return ra != rb ? ra < rb : rank(a) < rank(b);
+    });
+    m_nodes.erase(std::unique(m_nodes.begin(), m_nodes.end(),
+        [](const Node& a, const Node& b) { return RecordNumber(a.frn) == RecordNumber(b.frn); }), m_nodes.end());
+    m_nodes.shrink_to_fit();
+
+    m_paths.assign(m_nodes.size(), {});
+    m_pathState.assign(m_nodes.size(), 0);
+}
+
+bool MftIndex::BuildFromMftFile(const std::filesystem::path& mftFile)
+{
+    MappedFile file;
+    if (!file.Open(mftFile) || file.Size() < 0x200 || memcmp(file.Data(), "FILE", 4) != 0)
+        return false;
+
+    uint32_t recordSize = Le32(file.Data() + 0x1C);
+    AddRecords(file.Data(), file.Size(), recordSize, 0);
+    Finish();
+    return !Empty();
+}
+
+bool MftIndex::BuildFromVolume(const std::filesystem::path& device)
+{
+    RawDevice volume;
+    std::vector<uint8_t> boot(4096);
+    if (!volume.Open(device) || !volume.ReadAt(0, boot.data(), boot.size()) || memcmp(boot.data() + 3, "NTFS    ", 8) != 0)
+        return false;
+
+    uint16_t bytesPerSector = Le16(boot.data() + 0x0B);
+    uint8_t rawSectorsPerCluster = boot[0x0D];
+    uint64_t sectorsPerCluster = rawSectorsPerCluster > 0x80 ? 1ULL << (256 - rawSectorsPerCluster) : rawSectorsPerCluster;
+    uint64_t clusterSize = bytesPerSector * sectorsPerCluster;
+    uint64_t mftLcn = Le64(boot.data() + 0x30);
+    int8_t rawRecordSize = static_cast<int8_t>(boot[0x40]);
+    uint64_t recordSize = rawRecordSize < 0 ? 1ULL << -rawRecordSize : rawRecordSize * clusterSize;
+
+    if (!clusterSize || recordSize < 0x200 || recordSize > 0x10000)
+        return false;
+
+    // Record 0 is $MFT itself; its unnamed $DATA attribute maps the table.
+    std::vector<uint8_t> rec(std::max<uint64_t>(recordSize, bytesPerSector));
+    if (!volume.ReadAt(mftLcn * clusterSize, rec.data(), rec.size()) || !ApplyFixups(rec.data(), static_cast<uint32_t>(recordSize)))
+        return false;
+
+    std::vector<DataSegment> segments;
+    uint64_t mftSize = 0;
+    CollectDataSegments(rec.data(), static_cast<uint32_t>(recordSize), segments, mftSize);
+
+    // A fragmented $MFT continues $DATA in extension records listed by its
+    // $ATTRIBUTE_LIST. They live in $MFT too, in extents already known:
+    // visit them in VCN order so each one can be located before it is read.
+    std::vector<uint8_t> list = ReadAttributeList(volume, rec.data(), static_cast<uint32_t>(recordSize), clusterSize);
+    std::vector<std::pair<uint64_t, uint64_t>> extensions; // { first VCN, record number }
+
+    for (size_t off = 0; off + 0x1A <= list.size();)
+    {
+        const uint8_t* entry = list.data() + off;
+        uint16_t entryLength = Le16(entry + 4);
+        if (entryLength < 0x1A || off + entryLength > list.size())
+            break;
+
+        uint64_t record = RecordNumber(Le64(entry + 0x10));
+        if (Le32(entry) == kAttrData && entry[6] == 0 && record != 0)
+            extensions.emplace_back(Le64(entry + 8), record);
+        off += entryLength;
+    }
+    std::sort(extensions.begin(), extensions.end());
+    extensions.erase(std::unique(extensions.begin(), extensions.end(),
+        [](const auto& a, const auto& b) { return a.second == b.second; }), extensions.end());
+
+    std::vector<uint8_t> extension(static_cast<size_t>(recordSize));
+    for (const auto& [firstVcn, record] : extensions)
+    {
+        if (!ReadAttributeData(volume, segments, clusterSize, record * recordSize, extension.data(), extension.size()) ||
+            !ApplyFixups(extension.data(), static_cast<uint32_t>(recordSize)) ||
+            RecordNumber(Le64(extension.data() + 0x20)) != 0)
+            break;
+
+        CollectDataSegments(extension.data(), static_cast<uint32_t>(recordSize), segments, mftSize);
+    }
+
+    // Lay the extents end to end; a hole keeps later records at their offset.
+    std::sort(segments.begin(), segments.end(),
+        [](const DataSegment& a, const DataSegment& b) { return a.firstVcn < b.firstVcn; });
+
+    std::vector<DataRun> runs;
+    uint64_t nextVcn = 0;
+    for (const auto& segment : segments)
+    {
+        if (segment.firstVcn < nextVcn)
+            continue;
+        if (segment.firstVcn > nextVcn)
+            runs.push_back({ UINT64_MAX, segment.firstVcn - nextVcn });
+
+        runs.insert(runs.end(), segment.runs.begin(), segment.runs.end());
+        nextVcn = segment.firstVcn;
+        for (const auto& run : segment.runs)
+            nextVcn += run.clusters;
+    }
+
+    if (runs.empty() || !mftSize)
+        return false;
+
+    size_t chunkClusters = std::max<size_t>(1, kChunkSize / clusterSize);
+    std::vector<uint8_t> buffer(chunkClusters * clusterSize);
+    uint64_t mftOffset = 0;
+
+    for (const auto& run : runs)
+    {
+        for (uint64_t done = 0; done < run.clusters && mftOffset < mftSize;)
+        {
+            uint64_t clusters = std::min<uint64_t>(chunkClusters, run.clusters - done);
+            size_t bytes = static_cast<size_t>(clusters * clusterSize);
+
+            if (run.lcn != UINT64_MAX && volume.ReadAt((run.lcn + done) * clusterSize, buffer.data(), bytes))
+            {
+                size_t usable = static_cast<size_t>(std::min<uint64_t>(bytes, mftSize - mftOffset));
+                AddRecords(buffer.data(), usable, static_cast<uint32_t>(recordSize), mftOffset / recordSize);
+            }
+
+            done += clusters;
+            mftOffset += bytes;
+        }
+    }
+
+    Finish();
+    return !Empty();
+}
+
+const MftIndex::Node* MftIndex::Find(uint64_t frn) const
+{
+    uint64_t record = RecordNumber(frn);
+    auto it = std::lower_bound(m_nodes.begin(), m_nodes.end(), record,
+        [](const Node& n, uint64_t r) { return RecordNumber(n.frn) < r; });
+
+    if (it == m_nodes.end() || RecordNumber(it->frn) != record)
+        return nullptr;
+
+    // A different sequence number means the record was reused since.
+    if (SequenceOf(frn) && SequenceOf(it->frn) && SequenceOf(frn) != SequenceOf(it->frn))
+        return nullptr;
+
+    return &*it;
+}
+
+const std::wstring& MftIndex::PathAt(size_t index)
+{
+    // Walk up until the root or an already resolved ancestor, then fill the
+    // memo on the way back down.
+    std::vector<size_t> chain;
+    std::wstring prefix;
+
+    for (size_t i = index;;)
+    {
+        if (m_pathState[i] == 2)
+        {
+            prefix = m_paths[i];
+            break;
+        }
+
+        const Node& node = m_nodes[i];
+        if (m_pathState[i] == 1 || RecordNumber(node.frn) == kRootRecord)
+            break;
+
+        m_pathState[i] = 1;
+        chain.push_back(i);
+
+        if (RecordNumber(node.parent) == kRootRecord)
+            break;
+
+        const Node* parent = Find(node.parent);
+        if (!parent)
+        {
+            wchar_t unknown[40];
+            swprintf(unknown, 40, L"\\<FRN %llX>", static_cast<unsigned long long>(node.parent));
+            prefix = unknown;
+            break;
+        }
+        i = static_cast<size_t>(parent - m_nodes.data());
+    }
+
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+    {
+        const Node& node = m_nodes[*it];
+        prefix += L'\\';
+        prefix.append(m_names, node.nameOffset, node.nameLength);
+        m_paths[*it] = prefix;
+        m_pathState[*it] = 2;
+    }
+
+    return m_paths[index];
+}
+
+bool MftIndex::Resolve(uint64_t frn, std::wstring& path)
+{
+    if (RecordNumber(frn) == kRootRecord)
+    {
+        path.clear();
+        return true;
+    }
+
+    const Node* node = Find(frn);
+    if (!node)
+        return false;
+
+    path = PathAt(static_cast<size_t>(node - m_nodes.data()));
+    return true;
+}
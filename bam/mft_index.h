@@ -0,0 +1,55 @@
+#pragma once
+
+// Directory index built from the NTFS master file table. Every in-use
+// directory record contributes one {frn, parent, name} entry; names live in
+// a single pool and entries sit in a vector sorted by record number, so a
+// lookup is a binary search and a path is a short walk up that vector.
+// Resolved paths are memoized per entry.
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class MftIndex
+{
+public:
+    // Reads $MFT straight off an NTFS volume or image: the boot sector gives
+    // the location of record 0, whose $DATA runs describe the rest of the
+    // table, continued through its $ATTRIBUTE_LIST when $MFT is fragmented.
+    // On Windows pass the volume device, e.g. L"\\\\.\\C:".
+    bool BuildFromVolume(const std::filesystem::path& device);
+
+    // Parses an extracted $MFT file.
+    bool BuildFromMftFile(const std::filesystem::path& mftFile);
+
+    // Parses a contiguous run of FILE records starting at firstRecord.
+    // Build* call this per chunk; Finish() must follow the last chunk.
+    void AddRecords(const uint8_t* data, size_t size, uint32_t recordSize, uint64_t firstRecord);
+    void Finish();
+
+    bool   Empty() const { return m_nodes.empty(); }
+    size_t DirectoryCount() const { return m_nodes.size(); }
+
+    // Volume-relative path (\dir\sub) of a directory FRN; the root is "".
+    // Matches USNJournalReader::PathResolver. Not thread-safe (memo).
+    bool Resolve(uint64_t frn, std::wstring& path);
+
+private:
+    struct Node
+    {
+        uint64_t frn;        // record number | sequence << 48
+        uint64_t parent;
+        uint32_t nameOffset; // into m_names
+        uint16_t nameLength;
+        uint8_t  nameSpace;  // $FILE_NAME namespace; DOS-only names are replaced
+    };
+
+    const Node* Find(uint64_t frn) const;
+    const std::wstring& PathAt(size_t index);
+
+    std::vector<Node>         m_nodes;
+    std::wstring              m_names;
+    std::vector<std::wstring> m_paths;
+    std::vector<uint8_t>      m_pathState; // 0 = unresolved, 1 = in progress, 2 = done
+};
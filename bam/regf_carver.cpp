@@ -0,0 +1,226 @@
+#include "regf_carver.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace regf;
+
+namespace
+{
+    // Plausible BAM timestamps: 2000-01-01 .. 2100-01-01.
+    constexpr uint64_t kMinFileTime = 125911584000000000ULL;
+    constexpr uint64_t kMaxFileTime = 157766016000000000ULL;
+
+    std::wstring ToLower(std::wstring s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+        return s;
+    }
+
+    std::wstring PathKey(const std::wstring& sid, const std::wstring& path)
+    {
+        return sid + L'|' + ToLower(path);
+    }
+
+    // A vk record left inside free space. `avail` is how many bytes of the
+    // enclosing free cell follow the record start.
+    bool ParseCarvedValue(const RegfHive& hive, const uint8_t* vk, size_t avail, uint32_t offset, CarvedBamValue& out)
+    {
+        if (avail < 0x14 || vk[0] != 'v' || vk[1] != 'k')
+            return false;
+
+        Value v{ offset, vk };
+        if (v.ValueName().bytes == 0 || 0x14u + v.ValueName().bytes > avail)
+            return false;
+
+        if (v.Type() != kRegBinary || v.DataInline() || v.DataSize() < 8 || v.DataSize() > 0x100)
+            return false;
+
+        Name name = v.ValueName();
+        if (!name.StartsWith(L"\\Device\\"))
+            return false;
+
+        // The data cell may be free as well; it just has to still hold a sane FILETIME.
+        auto data = hive.Cell(v.DataOffset());
+        if (!data || data->size < 8)
+            return false;
+
+        uint64_t ft = Le64(data->data);
+        if (ft < kMinFileTime || ft > kMaxFileTime)
+            return false;
+
+        out.rawPath = name.ToWString();
+        out.lastExecution = ft;
+        out.cellOffset = offset;
+        return true;
+    }
+
+    // An nk record left inside free space whose parent is UserSettings.
+    bool ParseCarvedSidKey(const uint8_t* nk, size_t avail, uint32_t settings, std::wstring& sid, uint32_t& valueList, uint32_t& valueCount)
+    {
+        if (avail < 0x4C || nk[0] != 'n' || nk[1] != 'k')
+            return false;
+
+        Key k{ 0, nk };
+        if (k.Parent() != settings || 0x4Cu + k.KeyName().bytes > avail)
+            return false;
+
+        if (!k.KeyName().StartsWith(L"S-1-"))
+            return false;
+
+        sid = k.KeyName().ToWString();
+        valueList = k.ValueList();
+        valueCount = k.ValueCount();
+        return true;
+    }
+}
+
+std::vector<CarvedBamValue> CarveDeletedBAMValues(const RegfHive& hive)
+{
+    std::vector<CarvedBamValue> out;
+    if (!hive.IsOpen())
+        return out;
+
+    const uint8_t* bins = hive.Data() + kBaseBlockSize;
+    Key settings = OpenBamUserSettings(hive);
+
+    std::unordered_map<uint32_t, std::wstring> owner;
+    std::unordered_set<std::wstring> livePaths;
+    std::unordered_set<std::wstring> liveAnySid;
+
+    auto claimValueList = [&](uint32_t listOffset, const std::wstring& sid) {
+        // Slots past the live count still hold offsets of removed values.
+        auto list = hive.Cell(listOffset);
+        if (!list)
+            return;
+
+        for (uint32_t i = 0; i + 4 <= list->size; i += 4)
+        {
+            uint32_t vk = Le32(list->data + i);
+            if ((vk & 7) == 0 && vk < hive.HiveBinsSize())
+                owner.try_emplace(vk, sid);
+        }
+    };
+
+    if (settings)
+    {
+        hive.ForEachSubkey(settings, [&](const Key& sidKey) {
+            std::wstring sid = sidKey.KeyName().ToWString();
+            claimValueList(sidKey.ValueList(), sid);
+
+            hive.ForEachValue(sidKey, [&](const Value& v) {
+                std::wstring path = v.ValueName().ToWString();
+                livePaths.insert(PathKey(sid, path));
+                liveAnySid.insert(ToLower(path));
+            });
+        });
+    }
+
+    struct FreeCell { uint32_t offset; uint32_t size; };
+    std::vector<FreeCell> freeCells;
+
+    ForEachHiveCell(hive, [&](uint32_t off, const CellView& cell) {
+        if (cell.allocated)
+            return;
+
+        freeCells.push_back({ off, cell.size });
+
+        // Adjacent free cells are merged, so records can sit at any 8-byte
+        // boundary inside a free cell, not only at its start.
+        uint32_t end = off + 4 + cell.size;
+        for (uint32_t rec = off; rec + 8 + 4 <= end; rec += 8)
+        {
+            const uint8_t* payload = bins + rec + 4;
+            size_t avail = end - rec - 4;
+
+            CarvedBamValue carved{};
+            if (ParseCarvedValue(hive, payload, avail, rec, carved))
+            {
+                out.push_back(std::move(carved));
+                continue;
+            }
+
+            std::wstring sid;
+            uint32_t valueList = 0, valueCount = 0;
+            if (settings && ParseCarvedSidKey(payload, avail, settings.offset, sid, valueList, valueCount))
+                claimValueList(valueList, sid);
+        }
+    });
+
+    // Values whose list was freed as well: find free cells that still look
+    // like a value list containing both a known and a carved offset.
+    std::unordered_set<uint32_t> unowned;
+    for (const auto& c : out)
+    {
+        if (!owner.contains(c.cellOffset))
+            unowned.insert(c.cellOffset);
+    }
+
+    if (!unowned.empty())
+    {
+        for (const auto& fc : freeCells)
+        {
+            const uint8_t* p = bins + fc.offset + 4;
+            const std::wstring* sid = nullptr;
+            bool ambiguous = false, hasUnowned = false;
+
+            for (uint32_t i = 0; i + 4 <= fc.size; i += 4)
+            {
+                uint32_t slot = Le32(p + i);
+                if (unowned.contains(slot))
+                    hasUnowned = true;
+                else if (auto it = owner.find(slot); it != owner.end())
+                {
+                    if (sid && *sid != it->second)
+                        ambiguous = true;
+                    sid = &it->second;
+                }
+            }
+
+            if (!sid || ambiguous || !hasUnowned)
+                continue;
+
+            std::wstring resolved = *sid;
+            for (uint32_t i = 0; i + 4 <= fc.size; i += 4)
+            {
+                uint32_t slot = Le32(p + i);
+                if (unowned.erase(slot))
+                    owner.emplace(slot, resolved);
+            }
+        }
+    }
+
+    std::unordered_map<std::wstring, size_t> seen;
+    std::vector<CarvedBamValue> result;
+
+    for (auto& c : out)
+    {
+        if (auto it = owner.find(c.cellOffset); it != owner.end())
+            c.sid = it->second;
+
+        bool live = c.sid.empty()
+            ? liveAnySid.contains(ToLower(c.rawPath))
+            : livePaths.contains(PathKey(c.sid, c.rawPath));
+        if (live)
+            continue;
+
+        // Older copies of the same value: keep the most recent execution.
+        auto key = PathKey(c.sid, c.rawPath);
+        if (auto it = seen.find(key); it != seen.end())
+        {
+            if (c.lastExecution > result[it->second].lastExecution)
+                result[it->second] = std::move(c);
+            continue;
+        }
+
+        seen.emplace(std::move(key), result.size());
+        result.push_back(std::move(c));
+    }
+
+    std::sort(result.begin(), result.end(),
+        [](const CarvedBamValue& a, const CarvedBamValue& b) { return a.lastExecution > b.lastExecution; });
+
+    return result;
+}
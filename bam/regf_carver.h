@@ -0,0 +1,54 @@
+#pragma once
+
+// Recovers deleted BAM values from the unallocated (free) cells of a SYSTEM
+// hive. Only free cells are visited; allocated cells are used to attribute
+// carved values to their SID.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "regf_hive.h"
+
+struct CarvedBamValue
+{
+    std::wstring sid;           // empty when the owning key cannot be determined
+    std::wstring rawPath;       // \Device\HarddiskVolumeN\...
+    uint64_t     lastExecution; // FILETIME ticks
+    uint32_t     cellOffset;    // vk record offset inside the hive bins data
+};
+
+// Calls fn(offset, cell) for every cell of every hbin, in file order.
+template <typename Fn>
+void ForEachHiveCell(const RegfHive& hive, Fn&& fn)
+{
+    uint32_t binsSize = hive.HiveBinsSize();
+    const uint8_t* bins = hive.Data() + regf::kBaseBlockSize;
+
+    for (uint32_t hbin = 0; hbin + regf::kHbinHeaderSize <= binsSize;)
+    {
+        const uint8_t* h = bins + hbin;
+        uint32_t hbinSize = regf::Le32(h + 0x08);
+        if (memcmp(h, "hbin", 4) != 0 || hbinSize < 0x1000 || (hbinSize & 0xFFF) != 0)
+        {
+            // Damaged bin header: resync on the next page.
+            hbin += 0x1000;
+            continue;
+        }
+
+        uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(hbin) + hbinSize, binsSize));
+        for (uint32_t off = hbin + regf::kHbinHeaderSize; off + 8 <= end;)
+        {
+            auto cell = hive.Cell(off);
+            if (!cell || off + cell->size + 4 > end)
+                break;
+
+            fn(off, *cell);
+            off += cell->size + 4;
+        }
+
+        hbin += hbinSize;
+    }
+}
+
+std::vector<CarvedBamValue> CarveDeletedBAMValues(const RegfHive& hive);
@@ -0,0 +1,407 @@
+#include "regf_hive.h"
+
+using namespace regf;
+
+bool Name::EqualsIgnoreCase(std::wstring_view other) const
+{
+    if (Length() != other.size())
+        return false;
+
+    for (size_t i = 0; i < other.size(); ++i)
+    {
+        if (UpcaseChar(At(i)) != UpcaseChar(static_cast<char16_t>(other[i])))
+            return false;
+    }
+    return true;
+}
+
+bool Name::StartsWith(std::wstring_view prefix) const
+{
+    if (Length() < prefix.size())
+        return false;
+
+    for (size_t i = 0; i < prefix.size(); ++i)
+    {
+        if (At(i) != static_cast<char16_t>(prefix[i]))
+            return false;
+    }
+    return true;
+}
+
+std::wstring Name::ToWString() const
+{
+    std::wstring out;
+    size_t len = Length();
+    out.reserve(len);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        char16_t c = At(i);
+
+        // wchar_t is UTF-32 outside Windows; join surrogate pairs there.
+        if constexpr (sizeof(wchar_t) == 4)
+        {
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < len)
+            {
+                char16_t lo = At(i + 1);
+                if (lo >= 0xDC00 && lo <= 0xDFFF)
+                {
+                    out.push_back(static_cast<wchar_t>(0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00)));
+                    ++i;
+                    continue;
+                }
+            }
+        }
+
+        out.push_back(static_cast<wchar_t>(c));
+    }
+    return out;
+}
+
+uint32_t regf::LhHash(std::wstring_view name)
+{
+    uint32_t hash = 0;
+    for (wchar_t c : name)
+        hash = hash * 37 + UpcaseChar(static_cast<char16_t>(c));
+    return hash;
+}
+
+bool RegfHive::Open(const std::filesystem::path& path, MapMode mode)
+{
+    m_owned.clear();
+    if (!m_file.Open(path, mode))
+        return false;
+
+    return AttachImage(m_file.Data(), m_file.Size());
+}
+
+bool RegfHive::Adopt(std::vector<uint8_t> image)
+{
+    m_file.Close();
+    m_owned = std::move(image);
+    return AttachImage(m_owned.data(), m_owned.size());
+}
+
+uint8_t* RegfHive::MutableImage(size_t minSize)
+{
+    if (!m_data)
+        return nullptr;
+
+    if (m_file.IsOpen())
+    {
+        uint8_t* view = m_file.MutableData();
+        if (!view)
+            return nullptr;
+        if (minSize <= m_size)
+            return view;
+
+        m_owned.assign(m_data, m_data + m_size);
+        m_file.Close();
+    }
+
+    if (m_owned.size() < minSize)
+        m_owned.resize(minSize);
+
+    m_data = m_owned.data();
+    m_size = m_owned.size();
+    return m_owned.data();
+}
+
+bool RegfHive::AttachImage(const uint8_t* data, size_t size)
+{
+    m_data = nullptr;
+    m_size = 0;
+    m_binsSize = 0;
+
+    if (!data || size < kBaseBlockSize || memcmp(data, "regf", 4) != 0)
+        return false;
+
+    m_data = data;
+    m_size = size;
+
+    // Raw copies can be shorter than the base block claims.
+    size_t available = size - kBaseBlockSize;
+    m_binsSize = static_cast<uint32_t>(std::min<size_t>(Le32(data + 0x28), available));
+    return true;
+}
+
+std::optional<CellView> RegfHive::Cell(uint32_t offset) const
+{
+    if (!m_data || offset == kInvalidOffset || (offset & 7) != 0)
+        return std::nullopt;
+
+    if (static_cast<uint64_t>(offset) + 4 > m_binsSize)
+        return std::nullopt;
+
+    const uint8_t* p = m_data + kBaseBlockSize + offset;
+    int32_t raw = static_cast<int32_t>(Le32(p));
+    uint32_t size = raw < 0 ? static_cast<uint32_t>(-static_cast<int64_t>(raw)) : static_cast<uint32_t>(raw);
+
+    if (size < 8 || static_cast<uint64_t>(offset) + size > m_binsSize)
+        return std::nullopt;
+
+    return CellView{ p + 4, size - 4, raw < 0 };
+}
+
+Key RegfHive::KeyAt(uint32_t offset) const
+{
+    auto cell = Cell(offset);
+    if (!cell || !cell->allocated || cell->size < 0x4C)
+        return {};
+
+    const uint8_t* nk = cell->data;
+    if (nk[0] != 'n' || nk[1] != 'k')
+        return {};
+
+    if (0x4Cu + Le16(nk + 0x48) > cell->size)
+        return {};
+
+    return { offset, nk };
+}
+
+Value RegfHive::ValueAt(uint32_t offset) const
+{
+    auto cell = Cell(offset);
+    if (!cell || !cell->allocated || cell->size < 0x14)
+        return {};
+
+    const uint8_t* vk = cell->data;
+    if (vk[0] != 'v' || vk[1] != 'k')
+        return {};
+
+    if (0x14u + Le16(vk + 0x02) > cell->size)
+        return {};
+
+    return { offset, vk };
+}
+
+Key RegfHive::RootKey() const
+{
+    if (!m_data)
+        return {};
+    return KeyAt(Le32(m_data + 0x24));
+}
+
+Key RegfHive::FindInSubkeyList(uint32_t listOffset, std::wstring_view name, uint32_t hash, int depth) const
+{
+    auto list = Cell(listOffset);
+    if (!list || list->size < 4 || depth > 1)
+        return {};
+
+    const uint8_t* p = list->data;
+    uint16_t count = Le16(p + 2);
+
+    if (p[0] == 'l' && p[1] == 'h')
+    {
+        count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 8));
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            const uint8_t* entry = p + 4 + i * 8;
+            if (Le32(entry + 4) != hash)
+                continue;
+
+            Key k = KeyAt(Le32(entry));
+            if (k && k.KeyName().EqualsIgnoreCase(name))
+                return k;
+        }
+    }
+    else if (p[0] == 'l' && p[1] == 'f')
+    {
+        count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 8));
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            const uint8_t* entry = p + 4 + i * 8;
+
+            // The hint holds the first four name characters, zero padded.
+            bool hintMatches = true;
+            for (size_t c = 0; c < 4 && hintMatches; ++c)
+            {
+                char16_t hint = entry[4 + c];
+                char16_t want = c < name.size() ? static_cast<char16_t>(name[c] & 0xFF) : 0;
+                hintMatches = UpcaseChar(hint) == UpcaseChar(want);
+            }
+            if (!hintMatches)
+                continue;
+
+            Key k = KeyAt(Le32(entry));
+            if (k && k.KeyName().EqualsIgnoreCase(name))
+                return k;
+        }
+    }
+    else if (p[0] == 'l' && p[1] == 'i')
+    {
+        count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 4));
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            Key k = KeyAt(Le32(p + 4 + i * 4));
+            if (k && k.KeyName().EqualsIgnoreCase(name))
+                return k;
+        }
+    }
+    else if (p[0] == 'r' && p[1] == 'i')
+    {
+        count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 4));
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            if (Key k = FindInSubkeyList(Le32(p + 4 + i * 4), name, hash, depth + 1))
+                return k;
+        }
+    }
+
+    return {};
+}
+
+Key RegfHive::FindSubkey(const Key& parent, std::wstring_view name) const
+{
+    if (!parent || parent.SubkeyCount() == 0)
+        return {};
+    return FindInSubkeyList(parent.SubkeyList(), name, LhHash(name), 0);
+}
+
+Key RegfHive::OpenKey(std::wstring_view path) const
+{
+    Key key = RootKey();
+
+    while (key && !path.empty())
+    {
+        size_t sep = path.find(L'\\');
+        std::wstring_view part = path.substr(0, sep);
+        path = sep == std::wstring_view::npos ? std::wstring_view{} : path.substr(sep + 1);
+
+        if (!part.empty())
+            key = FindSubkey(key, part);
+    }
+
+    return key;
+}
+
+Value RegfHive::FindValue(const Key& key, std::wstring_view name) const
+{
+    Value found{};
+    ForEachValue(key, [&](const Value& v) {
+        if (!found && v.ValueName().EqualsIgnoreCase(name))
+            found = v;
+    });
+    return found;
+}
+
+std::span<const uint8_t> RegfHive::ValueData(const Value& value) const
+{
+    if (!value)
+        return {};
+
+    uint32_t size = value.DataSize();
+
+    if (value.DataInline())
+        return { value.vk + 0x08, std::min<uint32_t>(size, 4) };
+
+    if (size > kBigDataSegmentSize && MinorVersion() > 3)
+        return {};
+
+    auto cell = Cell(value.DataOffset());
+    if (!cell)
+        return {};
+
+    return { cell->data, std::min(size, cell->size) };
+}
+
+bool RegfHive::ReadValueData(const Value& value, std::vector<uint8_t>& out) const
+{
+    out.clear();
+    if (!value)
+        return false;
+
+    uint32_t size = value.DataSize();
+
+    if (value.DataInline() || size <= kBigDataSegmentSize || MinorVersion() <= 3)
+    {
+        auto data = ValueData(value);
+        out.assign(data.begin(), data.end());
+        return !data.empty() || size == 0;
+    }
+
+    auto db = Cell(value.DataOffset());
+    if (!db || db->size < 8 || db->data[0] != 'd' || db->data[1] != 'b')
+        return false;
+
+    uint16_t segments = Le16(db->data + 2);
+    auto list = Cell(Le32(db->data + 4));
+    if (!list || list->size / 4 < segments)
+        return false;
+
+    out.reserve(size);
+    for (uint16_t i = 0; i < segments && out.size() < size; ++i)
+    {
+        auto segment = Cell(Le32(list->data + i * 4));
+        if (!segment)
+            return false;
+
+        uint32_t take = std::min<uint32_t>({ size - static_cast<uint32_t>(out.size()), segment->size, kBigDataSegmentSize });
+        out.insert(out.end(), segment->data, segment->data + take);
+    }
+
+    return out.size() == size;
+}
+
+std::wstring GetCurrentControlSetName(const RegfHive& hive)
+{
+    uint32_t current = 1;
+
+    Value v = hive.FindValue(hive.OpenKey(L"Select"), L"Current");
+    auto data = hive.ValueData(v);
+    if (v && v.Type() == kRegDword && data.size() >= 4)
+        current = Le32(data.data());
+
+    std::wstring number = std::to_wstring(current);
+    if (number.size() < 3)
+        number.insert(0, 3 - number.size(), L'0');
+
+    return L"ControlSet" + number;
+}
+
+Key OpenBamUserSettings(const RegfHive& hive)
+{
+    Key bam = hive.OpenKey(GetCurrentControlSetName(hive) + L"\\Services\\bam");
+    if (!bam)
+        bam = hive.OpenKey(L"ControlSet001\\Services\\bam");
+    if (!bam)
+        return {};
+
+    if (Key state = hive.FindSubkey(bam, L"State"))
+    {
+        if (Key settings = hive.FindSubkey(state, L"UserSettings"))
+            return settings;
+    }
+
+    return hive.FindSubkey(bam, L"UserSettings");
+}
+
+std::vector<OfflineBamValue> ReadBAMValuesFromHive(const RegfHive& hive)
+{
+    std::vector<OfflineBamValue> out;
+
+    Key settings = OpenBamUserSettings(hive);
+    if (!settings)
+        return out;
+
+    hive.ForEachSubkey(settings, [&](const Key& sidKey) {
+        std::wstring sid = sidKey.KeyName().ToWString();
+
+        hive.ForEachValue(sidKey, [&](const Value& v) {
+            if (v.Type() != kRegBinary)
+                return;
+
+            Name name = v.ValueName();
+            if (!name.StartsWith(L"\\Device\\"))
+                return;
+
+            auto data = hive.ValueData(v);
+            if (data.size() < sizeof(uint64_t))
+                return;
+
+            out.push_back({ sid, name.ToWString(), Le64(data.data()) });
+        });
+    });
+
+    return out;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+// Read-only parser for registry hive files (regf). Works directly on a
+// mapped view of the hive, so it does not need the live registry API and
+// builds on any platform. Layout follows the regf format as written by
+// Windows 10/11 (base block, hbins, nk/vk/lf/lh/li/ri/db cells).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../io/_mapped_file.h"
+
+namespace regf
+{
+    constexpr uint32_t kBaseBlockSize = 0x1000;
+    constexpr uint32_t kHbinHeaderSize = 0x20;
+    constexpr uint32_t kInvalidOffset = 0xFFFFFFFF;
+    constexpr uint32_t kBigDataSegmentSize = 16344;
+
+    constexpr uint16_t kKeyCompName = 0x0020;
+    constexpr uint16_t kValueCompName = 0x0001;
+    constexpr uint32_t kDataInline = 0x80000000;
+
+    constexpr uint32_t kRegBinary = 3;
+    constexpr uint32_t kRegDword = 4;
+
+    inline uint16_t Le16(const uint8_t* p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint32_t Le32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint64_t Le64(const uint8_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    inline char16_t UpcaseChar(char16_t c)
+    {
+        if (c >= u'a' && c <= u'z')
+            return c - 32;
+        if (c >= 0xE0 && c <= 0xFE && c != 0xF7)
+            return c - 32;
+        return c;
+    }
+
+    // Key/value name as stored in the cell: either Latin-1 (compressed) or
+    // UTF-16LE. Points into the hive image, nothing is copied.
+    struct Name
+    {
+        const uint8_t* data = nullptr;
+        uint16_t bytes = 0;
+        bool compressed = false;
+
+        size_t Length() const { return compressed ? bytes : bytes / 2; }
+        char16_t At(size_t i) const { return compressed ? data[i] : static_cast<char16_t>(Le16(data + i * 2)); }
+
+        bool EqualsIgnoreCase(std::wstring_view other) const;
+        bool StartsWith(std::wstring_view prefix) const;
+        std::wstring ToWString() const;
+    };
+
+    // Hash used by lh subkey lists.
+    uint32_t LhHash(std::wstring_view name);
+
+    struct Key
+    {
+        uint32_t offset = kInvalidOffset;
+        const uint8_t* nk = nullptr;
+
+        explicit operator bool() const { return nk != nullptr; }
+
+        uint16_t Flags() const { return Le16(nk + 0x02); }
+        uint64_t LastWritten() const { return Le64(nk + 0x04); }
+        uint32_t Parent() const { return Le32(nk + 0x10); }
+        uint32_t SubkeyCount() const { return Le32(nk + 0x14); }
+        uint32_t SubkeyList() const { return Le32(nk + 0x1C); }
+        uint32_t ValueCount() const { return Le32(nk + 0x24); }
+        uint32_t ValueList() const { return Le32(nk + 0x28); }
+        Name KeyName() const { return { nk + 0x4C, Le16(nk + 0x48), (Flags() & kKeyCompName) != 0 }; }
+    };
+
+    struct Value
+    {
+        uint32_t offset = kInvalidOffset;
+        const uint8_t* vk = nullptr;
+
+        explicit operator bool() const { return vk != nullptr; }
+
+        uint32_t RawDataSize() const { return Le32(vk + 0x04); }
+        uint32_t DataSize() const { return RawDataSize() & ~kDataInline; }
+        bool DataInline() const { return (RawDataSize() & kDataInline) != 0; }
+        uint32_t DataOffset() const { return Le32(vk + 0x08); }
+        uint32_t Type() const { return Le32(vk + 0x0C); }
+        uint16_t Flags() const { return Le16(vk + 0x10); }
+        Name ValueName() const { return { vk + 0x14, Le16(vk + 0x02), (Flags() & kValueCompName) != 0 }; }
+    };
+
+    // XOR checksum stored at 0x1FC of a base block.
+    inline uint32_t BaseBlockChecksum(const uint8_t* base)
+    {
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < 0x1FC; i += 4)
+            sum ^= Le32(base + i);
+
+        if (sum == 0xFFFFFFFF)
+            return 0xFFFFFFFE;
+        if (sum == 0)
+            return 1;
+        return sum;
+    }
+
+    struct CellView
+    {
+        const uint8_t* data = nullptr; // cell payload, after the size field
+        uint32_t size = 0;             // payload size in bytes
+        bool allocated = false;
+    };
+}
+
+class RegfHive
+{
+public:
+    RegfHive() = default;
+    RegfHive(const RegfHive&) = delete;
+    RegfHive& operator=(const RegfHive&) = delete;
+    RegfHive(RegfHive&&) = default;
+    RegfHive& operator=(RegfHive&&) = default;
+
+    // Maps the hive file. Nothing is read until cells are accessed.
+    // MapMode::CopyOnWrite allows log replay without touching the file.
+    bool Open(const std::filesystem::path& path, MapMode mode = MapMode::ReadOnly);
+    // Takes ownership of an image that was read some other way (raw copy).
+    bool Adopt(std::vector<uint8_t> image);
+
+    bool IsOpen() const { return m_data != nullptr; }
+    const uint8_t* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+    uint32_t PrimarySequence() const { return regf::Le32(m_data + 0x04); }
+    uint32_t SecondarySequence() const { return regf::Le32(m_data + 0x08); }
+    uint32_t MinorVersion() const { return regf::Le32(m_data + 0x18); }
+    uint32_t HiveBinsSize() const { return m_binsSize; }
+    bool IsDirty() const { return PrimarySequence() != SecondarySequence(); }
+
+    // Writable image of at least minSize bytes, or nullptr for read-only
+    // views. Growing a mapped view copies it into owned storage once.
+    uint8_t* MutableImage(size_t minSize);
+    // Re-reads the base block after it was modified through MutableImage.
+    bool Refresh() { return AttachImage(m_data, m_size); }
+
+    // Cell at an offset relative to the start of the hive bins data.
+    std::optional<regf::CellView> Cell(uint32_t offset) const;
+
+    regf::Key KeyAt(uint32_t offset) const;
+    regf::Value ValueAt(uint32_t offset) const;
+
+    regf::Key RootKey() const;
+    regf::Key FindSubkey(const regf::Key& parent, std::wstring_view name) const;
+    // Backslash separated path relative to the root key.
+    regf::Key OpenKey(std::wstring_view path) const;
+    regf::Value FindValue(const regf::Key& key, std::wstring_view name) const;
+
+    template <typename Fn>
+    void ForEachSubkey(const regf::Key& parent, Fn&& fn) const
+    {
+        if (parent)
+            WalkSubkeyList(parent.SubkeyList(), fn, 0);
+    }
+
+    template <typename Fn>
+    void ForEachValue(const regf::Key& key, Fn&& fn) const
+    {
+        if (!key || key.ValueCount() == 0)
+            return;
+
+        auto list = Cell(key.ValueList());
+        if (!list)
+            return;
+
+        uint32_t count = std::min<uint32_t>(key.ValueCount(), list->size / 4);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (auto v = ValueAt(regf::Le32(list->data + i * 4)))
+                fn(v);
+        }
+    }
+
+    // Inline and single-cell data is returned as a view into the image.
+    // Big-data (db) values are split across cells; use ReadValueData.
+    std::span<const uint8_t> ValueData(const regf::Value& value) const;
+    bool ReadValueData(const regf::Value& value, std::vector<uint8_t>& out) const;
+
+protected:
+    bool AttachImage(const uint8_t* data, size_t size);
+
+    template <typename Fn>
+    void WalkSubkeyList(uint32_t listOffset, Fn& fn, int depth) const
+    {
+        auto list = Cell(listOffset);
+        if (!list || list->size < 4 || depth > 1)
+            return;
+
+        const uint8_t* p = list->data;
+        uint16_t count = regf::Le16(p + 2);
+
+        if (p[0] == 'l' && (p[1] == 'f' || p[1] == 'h'))
+        {
+            count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 8));
+            for (uint16_t i = 0; i < count; ++i)
+                if (auto k = KeyAt(regf::Le32(p + 4 + i * 8)))
+                    fn(k);
+        }
+        else if (p[0] == 'l' && p[1] == 'i')
+        {
+            count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 4));
+            for (uint16_t i = 0; i < count; ++i)
+                if (auto k = KeyAt(regf::Le32(p + 4 + i * 4)))
+                    fn(k);
+        }
+        else if (p[0] == 'r' && p[1] == 'i')
+        {
+            count = static_cast<uint16_t>(std::min<uint32_t>(count, (list->size - 4) / 4));
+            for (uint16_t i = 0; i < count; ++i)
+                WalkSubkeyList(regf::Le32(p + 4 + i * 4), fn, depth + 1);
+        }
+    }
+
+    regf::Key FindInSubkeyList(uint32_t listOffset, std::wstring_view name, uint32_t hash, int depth) const;
+
+    MappedFile m_file;
+    std::vector<uint8_t> m_owned;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    uint32_t m_binsSize = 0;
+};
+
+// BAM values read straight out of a SYSTEM hive.
+struct OfflineBamValue
+{
+    std::wstring sid;
+    std::wstring rawPath;     // \Device\HarddiskVolumeN\...
+    uint64_t     lastExecution; // FILETIME ticks
+};
+
+// Resolves Select\Current to the active ControlSet00N key name.
+std::wstring GetCurrentControlSetName(const RegfHive& hive);
+// Returns the bam UserSettings key of the active control set (both the
+// 1809+ "State\UserSettings" and the older "UserSettings" layout).
+regf::Key OpenBamUserSettings(const RegfHive& hive);
+std::vector<OfflineBamValue> ReadBAMValuesFromHive(const RegfHive& hive);
@@ -0,0 +1,195 @@
+#include "regf_log.h"
+
+#include <algorithm>
+
+using namespace regf;
+
+namespace
+{
+    constexpr uint32_t kLogEntriesStart = 0x200;
+    constexpr uint32_t kLogEntryHeaderSize = 0x28;
+    constexpr uint32_t kHivePageSize = 0x1000;
+
+    inline uint32_t Rotl32(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    inline void MarvinBlock(uint32_t& lo, uint32_t& hi)
+    {
+        hi ^= lo; lo = Rotl32(lo, 20);
+        lo += hi; hi = Rotl32(hi, 9);
+        hi ^= lo; lo = Rotl32(lo, 27);
+        lo += hi; hi = Rotl32(hi, 19);
+    }
+
+    // Every dirty page must be whole, page aligned and inside the hive bins
+    // size the entry declares.
+    bool ValidPageRefs(const HiveLogEntry& e)
+    {
+        if ((e.hiveBinsSize % kHivePageSize) != 0)
+            return false;
+
+        for (uint32_t i = 0; i < e.pageCount; ++i)
+        {
+            uint32_t offset = Le32(e.refs + i * 8);
+            uint32_t size = Le32(e.refs + i * 8 + 4);
+            if ((offset % kHivePageSize) != 0 || size == 0 || (size % kHivePageSize) != 0 ||
+                static_cast<uint64_t>(offset) + size > e.hiveBinsSize)
+                return false;
+        }
+        return true;
+    }
+}
+
+uint64_t Marvin32(const uint8_t* data, size_t size, uint64_t seed)
+{
+    uint32_t lo = static_cast<uint32_t>(seed);
+    uint32_t hi = static_cast<uint32_t>(seed >> 32);
+
+    for (; size >= 4; data += 4, size -= 4)
+    {
+        lo += Le32(data);
+        MarvinBlock(lo, hi);
+    }
+
+    uint32_t last = 0x80;
+    if (size == 3) last = (last << 8) | data[2];
+    if (size >= 2) last = (last << 8) | data[1];
+    if (size >= 1) last = (last << 8) | data[0];
+
+    lo += last;
+    MarvinBlock(lo, hi);
+    MarvinBlock(lo, hi);
+
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+std::vector<HiveLogEntry> ParseHiveLog(std::span<const uint8_t> log)
+{
+    std::vector<HiveLogEntry> entries;
+    if (log.size() < kLogEntriesStart || memcmp(log.data(), "regf", 4) != 0)
+        return entries;
+
+    size_t pos = kLogEntriesStart;
+    while (pos + kLogEntryHeaderSize <= log.size())
+    {
+        const uint8_t* e = log.data() + pos;
+        if (memcmp(e, "HvLE", 4) != 0)
+            break;
+
+        uint32_t size = Le32(e + 0x04);
+        if (size < kLogEntryHeaderSize || (size & 0x1FF) != 0 || size > log.size() - pos)
+            break;
+
+        if (Marvin32(e, 0x20) != Le64(e + 0x20) ||
+            Marvin32(e + kLogEntryHeaderSize, size - kLogEntryHeaderSize) != Le64(e + 0x18))
+            break;
+
+        uint32_t count = Le32(e + 0x14);
+        uint64_t refsEnd = kLogEntryHeaderSize + static_cast<uint64_t>(count) * 8;
+        if (refsEnd > size)
+            break;
+
+        uint64_t pagesSize = 0;
+        for (uint32_t i = 0; i < count; ++i)
+            pagesSize += Le32(e + kLogEntryHeaderSize + i * 8 + 4);
+        if (refsEnd + pagesSize > size)
+            break;
+
+        entries.push_back({ Le32(e + 0x0C), Le32(e + 0x10), count,
+            e + kLogEntryHeaderSize, e + refsEnd });
+        pos += size;
+    }
+
+    return entries;
+}
+
+size_t ReplayHiveLogs(RegfHive& hive, std::span<const std::span<const uint8_t>> logs)
+{
+    if (!hive.IsOpen() || !hive.IsDirty())
+        return 0;
+
+    std::vector<HiveLogEntry> entries;
+    for (auto log : logs)
+    {
+        auto parsed = ParseHiveLog(log);
+        entries.insert(entries.end(), parsed.begin(), parsed.end());
+    }
+
+    // LOG1 and LOG2 alternate; order everything by sequence and drop repeats.
+    std::stable_sort(entries.begin(), entries.end(),
+        [](const HiveLogEntry& a, const HiveLogEntry& b) { return a.sequence < b.sequence; });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+        [](const HiveLogEntry& a, const HiveLogEntry& b) { return a.sequence == b.sequence; }), entries.end());
+
+    uint32_t start = hive.SecondarySequence();
+    auto first = std::find_if(entries.begin(), entries.end(),
+        [&](const HiveLogEntry& e) { return e.sequence >= start; });
+
+    // A bad page reference rejects its entry and, since later entries build
+    // on it, ends the replay there.
+    std::vector<HiveLogEntry> run;
+    for (auto it = first; it != entries.end(); ++it)
+    {
+        if (!run.empty() && it->sequence != run.back().sequence + 1)
+            break;
+        if (!ValidPageRefs(*it))
+            break;
+        run.push_back(*it);
+    }
+    if (run.empty())
+        return 0;
+
+    // Size the image once for the largest state the log describes; every
+    // page lies within its entry's hive bins size.
+    uint64_t required = hive.Size();
+    for (const auto& e : run)
+        required = std::max<uint64_t>(required, kBaseBlockSize + static_cast<uint64_t>(e.hiveBinsSize));
+
+    uint8_t* image = hive.MutableImage(static_cast<size_t>(required));
+    if (!image)
+        return 0;
+
+    for (const auto& e : run)
+    {
+        const uint8_t* page = e.pages;
+        for (uint32_t i = 0; i < e.pageCount; ++i)
+        {
+            uint32_t offset = Le32(e.refs + i * 8);
+            uint32_t size = Le32(e.refs + i * 8 + 4);
+            memcpy(image + kBaseBlockSize + offset, page, size);
+            page += size;
+        }
+    }
+
+    uint32_t sequence = run.back().sequence + 1;
+    memcpy(image + 0x04, &sequence, sizeof(sequence));
+    memcpy(image + 0x08, &sequence, sizeof(sequence));
+    memcpy(image + 0x28, &run.back().hiveBinsSize, sizeof(uint32_t));
+
+    uint32_t checksum = BaseBlockChecksum(image);
+    memcpy(image + 0x1FC, &checksum, sizeof(checksum));
+
+    hive.Refresh();
+    return run.size();
+}
+
+size_t RecoverHiveFromLogs(RegfHive& hive, const std::filesystem::path& hivePath)
+{
+    // A clean hive already holds everything the logs do.
+    if (!hive.IsOpen() || !hive.IsDirty())
+        return 0;
+
+    MappedFile log1, log2;
+    std::vector<std::span<const uint8_t>> logs;
+
+    auto addLog = [&](MappedFile& file, const wchar_t* suffix) {
+        std::filesystem::path logPath = hivePath;
+        logPath += suffix;
+        if (file.Open(logPath))
+            logs.emplace_back(file.Data(), file.Size());
+    };
+
+    addLog(log1, L".LOG1");
+    addLog(log2, L".LOG2");
+
+    return ReplayHiveLogs(hive, logs);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Replay of new-format (Windows 8.1+) hive transaction logs. A dirty
+// primary hive is brought up to date by applying the HvLE log entries of
+// SYSTEM.LOG1/SYSTEM.LOG2 in sequence order. Pages are written into the
+// hive's copy-on-write view, so only the replayed pages get private copies.
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "regf_hive.h"
+
+constexpr uint64_t kHvleMarvinSeed = 0x82EF4D887A4E55C5ULL;
+
+uint64_t Marvin32(const uint8_t* data, size_t size, uint64_t seed = kHvleMarvinSeed);
+
+struct HiveLogEntry
+{
+    uint32_t       sequence;
+    uint32_t       hiveBinsSize;
+    uint32_t       pageCount;
+    const uint8_t* refs;  // pageCount x { offset, size } relative to the hive bins data
+    const uint8_t* pages; // page data, in reference order
+};
+
+// Validated entries of one log file, in file order. Parsing stops at the
+// first entry with a bad signature, size or hash, as Windows does.
+std::vector<HiveLogEntry> ParseHiveLog(std::span<const uint8_t> log);
+
+// For a dirty hive only: applies every entry at or after the primary's
+// secondary sequence number, in consecutive order, then marks the base
+// block clean. The replay stops before the first entry with a misaligned
+// or out-of-range page reference. Returns the number of entries applied.
+size_t ReplayHiveLogs(RegfHive& hive, std::span<const std::span<const uint8_t>> logs);
+
+// Maps <hive>.LOG1 and <hive>.LOG2 next to a dirty hive file and replays
+// them; clean hives are left alone without touching the logs.
+// The hive must be opened with MapMode::CopyOnWrite (or be adopted).
+size_t RecoverHiveFromLogs(RegfHive& hive, const std::filesystem::path& hivePath);
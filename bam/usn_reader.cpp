@@ -0,0 +1,557 @@
+#include "usn_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <deque>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t   kChunkSize = 4 * 1024 * 1024;
+    constexpr uint32_t kMinRecordSize = 0x40;
+    constexpr uint32_t kMaxRecordSize = 0x1000;
+    constexpr size_t   kMaxEventsPerReplace = 64;
+
+    inline uint16_t Le16(const uint8_t* p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint32_t Le32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint64_t Le64(const uint8_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    std::wstring DecodeName(const uint8_t* data, uint16_t bytes)
+    {
+        std::wstring out;
+        out.reserve(bytes / 2);
+        for (uint16_t i = 0; i + 1 < bytes; i += 2)
+            out.push_back(static_cast<wchar_t>(Le16(data + i)));
+        return out;
+    }
+
+    std::wstring ToLower(std::wstring s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+        return s;
+    }
+
+    bool IsExecutableName(const uint8_t* name, uint16_t bytes)
+    {
+        static const wchar_t* const extensions[] = { L".exe", L".dll", L".jar", L".bat", L".cmd", L".com", L".scr", L".ps1" };
+
+        if (!name || bytes < 8)
+            return false;
+
+        // Compare the last four UTF-16 characters case-insensitively.
+        wchar_t tail[5] = {};
+        for (int i = 0; i < 4; ++i)
+            tail[i] = static_cast<wchar_t>(std::towlower(Le16(name + bytes - 8 + i * 2)));
+
+        for (auto ext : extensions)
+        {
+            if (wcscmp(tail, ext) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Sequential reader over an extracted $J that can jump over sparse holes.
+    class JournalFile
+    {
+    public:
+        ~JournalFile()
+        {
+#ifdef _WIN32
+            if (m_handle != INVALID_HANDLE_VALUE)
+                CloseHandle(m_handle);
+#else
+            if (m_fd >= 0)
+                ::close(m_fd);
+#endif
+        }
+
+        bool Open(const std::filesystem::path& path)
+        {
+#ifdef _WIN32
+            m_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            return m_handle != INVALID_HANDLE_VALUE;
+#else
+            m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            return m_fd >= 0;
+#endif
+        }
+
+        size_t Read(uint8_t* buffer, size_t size, uint64_t offset)
+        {
+#ifdef _WIN32
+            OVERLAPPED ov{};
+            ov.Offset = static_cast<DWORD>(offset);
+            ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD read = 0;
+            if (!ReadFile(m_handle, buffer, static_cast<DWORD>(size), &read, &ov))
+                return 0;
+            return read;
+#else
+            ssize_t read = ::pread(m_fd, buffer, size, static_cast<off_t>(offset));
+            return read > 0 ? static_cast<size_t>(read) : 0;
+#endif
+        }
+
+        // First offset >= from that holds allocated data. An extracted $J is
+        // mostly one leading hole, which is skipped without reading it.
+        uint64_t NextData(uint64_t from)
+        {
+#ifdef _WIN32
+            FILE_ALLOCATED_RANGE_BUFFER query{}, range{};
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(m_handle, &size))
+                return from;
+
+            query.FileOffset.QuadPart = static_cast<LONGLONG>(from);
+            query.Length.QuadPart = size.QuadPart - static_cast<LONGLONG>(from);
+            DWORD bytes = 0;
+            BOOL ok = DeviceIoControl(m_handle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+                &range, sizeof(range), &bytes, nullptr);
+            if ((ok || GetLastError() == ERROR_MORE_DATA) && bytes >= sizeof(range) &&
+                static_cast<uint64_t>(range.FileOffset.QuadPart) > from)
+                return static_cast<uint64_t>(range.FileOffset.QuadPart);
+            return from;
+#elif defined(SEEK_DATA)
+            off_t data = ::lseek(m_fd, static_cast<off_t>(from), SEEK_DATA);
+            return data < 0 ? from : static_cast<uint64_t>(data);
+#else
+            return from;
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+        int m_fd = -1;
+#endif
+    };
+
+    // Walks the records in buf and returns how many bytes were consumed.
+    // A record cut off at the end of buf is left for the next read.
+    size_t WalkRecords(const uint8_t* buf, size_t size, bool final, const std::function<void(const UsnRecord&)>& fn)
+    {
+        size_t pos = 0;
+        while (pos + 8 <= size)
+        {
+            if (Le64(buf + pos) == 0)
+            {
+                pos += 8;
+                continue;
+            }
+
+            UsnRecord r{};
+            if (uint32_t len = DecodeUsnRecord(buf + pos, size - pos, r))
+            {
+                fn(r);
+                pos += len;
+                continue;
+            }
+
+            uint32_t claimed = Le32(buf + pos);
+            if (!final && claimed >= kMinRecordSize && claimed <= kMaxRecordSize && pos + claimed > size)
+                break;
+
+            pos += 8;
+        }
+        return final ? size : pos;
+    }
+}
+
+uint32_t DecodeUsnRecord(const uint8_t* p, size_t avail, UsnRecord& out)
+{
+    if (avail < 8)
+        return 0;
+
+    uint32_t length = Le32(p);
+    uint16_t major = Le16(p + 4);
+    uint16_t minor = Le16(p + 6);
+
+    if (length < kMinRecordSize || length > kMaxRecordSize || (length & 7) != 0 || length > avail || minor != 0)
+        return 0;
+
+    out = {};
+    out.majorVersion = major;
+
+    uint16_t nameBytes = 0, nameOffset = 0;
+
+    switch (major)
+    {
+    case 2:
+        out.frn = Le64(p + 0x08);
+        out.parentFrn = Le64(p + 0x10);
+        out.usn = static_cast<int64_t>(Le64(p + 0x18));
+        out.timestamp = Le64(p + 0x20);
+        out.reason = Le32(p + 0x28);
+        out.attributes = Le32(p + 0x34);
+        nameBytes = Le16(p + 0x38);
+        nameOffset = Le16(p + 0x3A);
+        break;
+
+    case 3:
+        if (length < 0x4C)
+            return 0;
+        // 128-bit file IDs; NTFS only uses the low 64 bits.
+        out.frn = Le64(p + 0x08);
+        out.parentFrn = Le64(p + 0x18);
+        out.usn = static_cast<int64_t>(Le64(p + 0x28));
+        out.timestamp = Le64(p + 0x30);
+        out.reason = Le32(p + 0x38);
+        out.attributes = Le32(p + 0x44);
+        nameBytes = Le16(p + 0x48);
+        nameOffset = Le16(p + 0x4A);
+        break;
+
+    case 4:
+        // Range-tracking record: no name and no timestamp.
+        out.frn = Le64(p + 0x08);
+        out.parentFrn = Le64(p + 0x18);
+        out.usn = static_cast<int64_t>(Le64(p + 0x28));
+        out.reason = Le32(p + 0x30);
+        return length;
+
+    default:
+        return 0;
+    }
+
+    if (out.usn < 0 || nameBytes == 0 || (nameBytes & 1) != 0 || nameOffset < 0x3C ||
+        static_cast<uint32_t>(nameOffset) + nameBytes > length)
+        return 0;
+
+    out.name = p + nameOffset;
+    out.nameBytes = nameBytes;
+    return length;
+}
+
+std::string UsnReasonToString(uint32_t reason)
+{
+    static const struct { uint32_t flag; const char* name; } names[] = {
+        { 0x00000001, "DATA_OVERWRITE" },
+        { 0x00000002, "DATA_EXTEND" },
+        { 0x00000004, "DATA_TRUNCATION" },
+        { 0x00000010, "NAMED_DATA_OVERWRITE" },
+        { 0x00000020, "NAMED_DATA_EXTEND" },
+        { 0x00000040, "NAMED_DATA_TRUNCATION" },
+        { 0x00000100, "FILE_CREATE" },
+        { 0x00000200, "FILE_DELETE" },
+        { 0x00000400, "EA_CHANGE" },
+        { 0x00000800, "SECURITY_CHANGE" },
+        { 0x00001000, "RENAME_OLD_NAME" },
+        { 0x00002000, "RENAME_NEW_NAME" },
+        { 0x00004000, "INDEXABLE_CHANGE" },
+        { 0x00008000, "BASIC_INFO_CHANGE" },
+        { 0x00010000, "HARD_LINK_CHANGE" },
+        { 0x00020000, "COMPRESSION_CHANGE" },
+        { 0x00040000, "ENCRYPTION_CHANGE" },
+        { 0x00080000, "OBJECT_ID_CHANGE" },
+        { 0x00100000, "REPARSE_POINT_CHANGE" },
+        { 0x00200000, "STREAM_CHANGE" },
+        { 0x00400000, "TRANSACTED_CHANGE" },
+        { 0x00800000, "INTEGRITY_CHANGE" },
+        { 0x80000000, "CLOSE" },
+    };
+
+    std::string out;
+    for (const auto& n : names)
+    {
+        if (reason & n.flag)
+        {
+            if (!out.empty())
+                out += " | ";
+            out += n.name;
+        }
+    }
+    return out;
+}
+
+USNJournalReader::USNJournalReader(std::wstring volume)
+    : m_volume(std::move(volume))
+{
+}
+
+USNJournalReader USNJournalReader::FromJournalFile(std::filesystem::path journal, std::wstring volumePrefix)
+{
+    USNJournalReader reader;
+    reader.m_volume = std::move(volumePrefix);
+    reader.m_journalFile = std::move(journal);
+    return reader;
+}
+
+void USNJournalReader::LearnDirectory(const UsnRecord& r)
+{
+    if (!(r.attributes & usn::kAttributeDirectory) || !r.name)
+        return;
+
+    // FRNs carry a sequence number, so a deleted directory's FRN never
+    // comes back and its entries can go.
+    if ((r.reason & usn::kFileDelete) && (r.reason & usn::kClose))
+    {
+        m_dirs.erase(r.frn);
+        m_dirPaths.erase(r.frn);
+        return;
+    }
+
+    std::wstring name = DecodeName(r.name, r.nameBytes);
+    auto it = m_dirs.find(r.frn);
+    if (it != m_dirs.end())
+    {
+        if (it->second.parent == r.parentFrn && it->second.name == name)
+            return;
+
+        // A directory moved or was renamed; memoized paths below it are stale.
+        m_dirPaths.clear();
+        it->second = { r.parentFrn, std::move(name) };
+        return;
+    }
+
+    m_dirs.emplace(r.frn, DirEntry{ r.parentFrn, std::move(name) });
+}
+
+std::wstring USNJournalReader::ResolveDirectory(uint64_t frn, int depth)
+{
+    if (usn::RecordNumber(frn) == usn::kRootDirectoryRecord)
+        return {};
+
+    if (auto it = m_dirPaths.find(frn); it != m_dirPaths.end())
+        return it->second;
+
+    std::wstring path;
+    auto dir = m_dirs.find(frn);
+
+    if (dir != m_dirs.end() && depth < 64)
+    {
+        DirEntry entry = dir->second;
+        path = ResolveDirectory(entry.parent, depth + 1) + L"\\" + entry.name;
+    }
+    else if (!m_resolver || !m_resolver(frn, path))
+    {
+        wchar_t unknown[40];
+        swprintf(unknown, 40, L"\\<FRN %llX>", static_cast<unsigned long long>(frn));
+        path = unknown;
+    }
+
+    m_dirPaths.emplace(frn, path);
+    return path;
+}
+
+std::wstring USNJournalReader::PathOf(const UsnRecord& r)
+{
+    if (!r.name)
+        return {};
+    return ResolveDirectory(r.parentFrn) + L"\\" + DecodeName(r.name, r.nameBytes);
+}
+
+bool USNJournalReader::StreamFile(const std::function<void(const UsnRecord&)>& fn)
+{
+    JournalFile file;
+    if (!file.Open(m_journalFile))
+        return false;
+
+    std::vector<uint8_t> buffer(kChunkSize + kMaxRecordSize);
+    uint64_t offset = 0;
+    size_t have = 0;
+
+    for (;;)
+    {
+        if (have == 0)
+            offset = file.NextData(offset) & ~7ULL;
+
+        size_t read = file.Read(buffer.data() + have, kChunkSize, offset);
+        offset += read;
+        have += read;
+
+        size_t used = WalkRecords(buffer.data(), have, read == 0, fn);
+        memmove(buffer.data(), buffer.data() + used, have - used);
+        have -= used;
+
+        if (read == 0)
+            break;
+    }
+
+    return true;
+}
+
+bool USNJournalReader::StreamVolume(const std::function<void(const UsnRecord&)>& fn)
+{
+#ifdef _WIN32
+    std::wstring device = L"\\\\.\\" + m_volume;
+    HANDLE volume = CreateFileW(device.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_EXISTING, 0, nullptr);
+    if (volume == INVALID_HANDLE_VALUE)
+        return false;
+
+    USN_JOURNAL_DATA_V0 journal{};
+    DWORD bytes = 0;
+    if (!DeviceIoControl(volume, FSCTL_QUERY_USN_JOURNAL, nullptr, 0, &journal, sizeof(journal), &bytes, nullptr))
+    {
+        CloseHandle(volume);
+        return false;
+    }
+
+    // Directories the journal never mentions, and the caller's resolver
+    // cannot place, are looked up on the volume.
+    PathResolver callerResolver = m_resolver;
+    m_resolver = [volume, callerResolver](uint64_t frn, std::wstring& path) {
+        if (callerResolver && callerResolver(frn, path))
+            return true;
+
+        FILE_ID_DESCRIPTOR id{};
+        id.dwSize = sizeof(id);
+        id.Type = FileIdType;
+        id.FileId.QuadPart = static_cast<LONGLONG>(frn);
+
+        HANDLE h = OpenFileById(volume, &id, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, FILE_FLAG_BACKUP_SEMANTICS);
+        if (h == INVALID_HANDLE_VALUE)
+            return false;
+
+        wchar_t buffer[MAX_PATH * 2];
+        DWORD len = GetFinalPathNameByHandleW(h, buffer, static_cast<DWORD>(std::size(buffer)),
+            FILE_NAME_NORMALIZED | VOLUME_NAME_NONE);
+        CloseHandle(h);
+
+        if (len == 0 || len >= std::size(buffer))
+            return false;
+
+        path.assign(buffer, len);
+        return true;
+    };
+
+    READ_USN_JOURNAL_DATA_V1 read{};
+    read.StartUsn = journal.FirstUsn;
+    read.ReasonMask = 0xFFFFFFFF;
+    read.UsnJournalID = journal.UsnJournalID;
+    read.MinMajorVersion = 2;
+    read.MaxMajorVersion = 4;
+
+    std::vector<uint8_t> buffer(kChunkSize);
+    while (DeviceIoControl(volume, FSCTL_READ_USN_JOURNAL, &read, sizeof(read),
+        buffer.data(), static_cast<DWORD>(buffer.size()), &bytes, nullptr) && bytes > sizeof(USN))
+    {
+        WalkRecords(buffer.data() + sizeof(USN), bytes - sizeof(USN), true, fn);
+        read.StartUsn = *reinterpret_cast<const USN*>(buffer.data());
+    }
+
+    m_resolver = std::move(callerResolver);
+
+    CloseHandle(volume);
+    return true;
+#else
+    (void)fn;
+    return false;
+#endif
+}
+
+bool USNJournalReader::ForEachRecord(const std::function<void(const UsnRecord&)>& fn)
+{
+    return m_journalFile.empty() ? StreamVolume(fn) : StreamFile(fn);
+}
+
+std::vector<UsnReplace> USNJournalReader::Run()
+{
+    // Records of one file accumulate reasons until its CLOSE record; only
+    // open groups and executables deleted within kReplaceWindow are kept in
+    // memory. expiry lists deletions in journal (time) order so old ones are
+    // dropped from the front; an entry whose path was deleted again since is
+    // stale and skipped.
+    struct OpenGroup
+    {
+        std::vector<UsnReplaceEvent> events;
+        uint64_t startTime = 0;
+        uint32_t reasons = 0;
+    };
+
+    std::unordered_map<uint64_t, OpenGroup> open;
+    std::unordered_map<std::wstring, uint64_t> deletedAt;
+    std::deque<std::pair<uint64_t, std::wstring>> expiry;
+    std::vector<UsnReplace> replaces;
+
+    ForEachRecord([&](const UsnRecord& r) {
+        LearnDirectory(r);
+
+        if (r.majorVersion == 4 || (r.attributes & usn::kAttributeDirectory))
+            return;
+
+        while (!expiry.empty() && expiry.front().first + usn::kReplaceWindow < r.timestamp)
+        {
+            auto del = deletedAt.find(expiry.front().second);
+            if (del != deletedAt.end() && del->second == expiry.front().first)
+                deletedAt.erase(del);
+            expiry.pop_front();
+        }
+
+        bool executable = IsExecutableName(r.name, r.nameBytes);
+        auto it = open.find(r.frn);
+        if (it == open.end())
+        {
+            // Non-executables are only followed when they may be renamed into one.
+            if (!executable && !(r.reason & usn::kRenameOldName))
+                return;
+            it = open.emplace(r.frn, OpenGroup{}).first;
+            it->second.startTime = r.timestamp;
+        }
+
+        OpenGroup& g = it->second;
+        g.reasons |= r.reason;
+        if (g.events.size() < kMaxEventsPerReplace)
+            g.events.push_back({ r.timestamp, UsnReasonToString(r.reason) });
+
+        if (!(r.reason & usn::kClose))
+            return;
+
+        OpenGroup group = std::move(g);
+        open.erase(it);
+
+        if (!executable)
+            return;
+
+        std::wstring path = m_volume + PathOf(r);
+        std::wstring key = ToLower(path);
+        const char* type = nullptr;
+
+        if (group.reasons & usn::kFileDelete)
+        {
+            deletedAt[key] = r.timestamp;
+            expiry.emplace_back(r.timestamp, std::move(key));
+            return;
+        }
+
+        if (group.reasons & usn::kFileCreate)
+        {
+            auto del = deletedAt.find(key);
+            if (del == deletedAt.end())
+                return;
+
+            type = "Deleted and recreated";
+            group.events.insert(group.events.begin(), { del->second, "FILE_DELETE (previous file)" });
+            group.startTime = del->second;
+            deletedAt.erase(del);
+        }
+        else if (group.reasons & usn::kRenameNewName)
+        {
+            type = "Renamed into place";
+        }
+        else if (group.reasons & (usn::kDataOverwrite | usn::kDataExtend | usn::kDataTruncation))
+        {
+            type = "Content modified";
+        }
+
+        if (!type)
+            return;
+
+        replaces.push_back({ std::move(path), type, group.startTime, r.timestamp,
+            static_cast<uint64_t>(r.usn), std::move(group.events) });
+    });
+
+    return replaces;
+}
@@ -1 +1,123 @@
-﻿// look in https://github.com/Orbdiff/USNJournal_CLI
\ No newline at end of file
+﻿// look in https://github.com/Orbdiff/USNJournal_CLI
+#pragma once
+
+// Streaming USN change journal reader. Records are parsed straight out of
+// large sequential reads, either from a live NTFS volume or from an
+// extracted $Extend\$UsnJrnl:$J file, so memory use does not depend on
+// the journal size. Parent FRNs are resolved to paths through a cache of
+// directory names learned from the journal itself; deleted directories
+// leave it, so it is bounded by the live directories the journal names.
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace usn
+{
+    // Same values as the USN_REASON_* / FILE_ATTRIBUTE_* macros of winioctl.h.
+    constexpr uint32_t kDataOverwrite = 0x00000001;
+    constexpr uint32_t kDataExtend = 0x00000002;
+    constexpr uint32_t kDataTruncation = 0x00000004;
+    constexpr uint32_t kFileCreate = 0x00000100;
+    constexpr uint32_t kFileDelete = 0x00000200;
+    constexpr uint32_t kRenameOldName = 0x00001000;
+    constexpr uint32_t kRenameNewName = 0x00002000;
+    constexpr uint32_t kClose = 0x80000000;
+
+    constexpr uint32_t kAttributeDirectory = 0x00000010;
+
+    constexpr uint64_t kRootDirectoryRecord = 5;
+
+    // A deleted executable is only paired with a recreation of the same
+    // path within this many FILETIME ticks (one day).
+    constexpr uint64_t kReplaceWindow = 24ULL * 60 * 60 * 10000000;
+    inline uint64_t RecordNumber(uint64_t frn) { return frn & 0x0000FFFFFFFFFFFFULL; }
+}
+
+// One decoded USN_RECORD_V2/V3/V4. The name points into the read buffer
+// and is only valid inside the callback.
+struct UsnRecord
+{
+    uint16_t       majorVersion;
+    uint64_t       frn;
+    uint64_t       parentFrn;
+    int64_t        usn;
+    uint64_t       timestamp;  // FILETIME ticks, 0 for V4
+    uint32_t       reason;
+    uint32_t       attributes;
+    const uint8_t* name;       // UTF-16LE, nullptr for V4
+    uint16_t       nameBytes;
+};
+
+// Decodes the record at p. Returns its length, or 0 if p does not hold a
+// valid record (zero fill, garbage, or truncated by avail).
+uint32_t DecodeUsnRecord(const uint8_t* p, size_t avail, UsnRecord& out);
+
+std::string UsnReasonToString(uint32_t reason);
+
+struct UsnReplaceEvent
+{
+    uint64_t    date;
+    std::string reason;
+};
+
+struct UsnReplace
+{
+    std::wstring fullPath;  // volume + path, e.g. C:\Tools\a.exe
+    std::string  type;
+    uint64_t     startTime;
+    uint64_t     endTime;
+    uint64_t     lastUsn;
+    std::vector<UsnReplaceEvent> events;
+};
+
+class USNJournalReader
+{
+public:
+    // Live journal of a mounted volume, e.g. L"C:". Windows only.
+    explicit USNJournalReader(std::wstring volume);
+    // Extracted $J stream; paths are reported under volumePrefix.
+    static USNJournalReader FromJournalFile(std::filesystem::path journal, std::wstring volumePrefix = L"C:");
+
+    // Fallback for parents the journal never names: fills the
+    // volume-relative path (\dir\sub) of a directory FRN. On a live volume
+    // FRNs it rejects are still tried with OpenFileById.
+    using PathResolver = std::function<bool(uint64_t frn, std::wstring& path)>;
+    void SetPathResolver(PathResolver resolver) { m_resolver = std::move(resolver); }
+
+    // Streams every record in journal order.
+    bool ForEachRecord(const std::function<void(const UsnRecord&)>& fn);
+
+    // Executables that were overwritten, recreated within kReplaceWindow
+    // or renamed into place.
+    std::vector<UsnReplace> Run();
+
+    // Volume-relative path of a directory FRN, memoized.
+    std::wstring ResolveDirectory(uint64_t frn, int depth = 0);
+
+    // Path of a record: parent directory + record name.
+    std::wstring PathOf(const UsnRecord& r);
+
+private:
+    USNJournalReader() = default;
+
+    bool StreamFile(const std::function<void(const UsnRecord&)>& fn);
+    bool StreamVolume(const std::function<void(const UsnRecord&)>& fn);
+    void LearnDirectory(const UsnRecord& r);
+
+    struct DirEntry
+    {
+        uint64_t     parent;
+        std::wstring name;
+    };
+
+    std::wstring m_volume;
+    std::filesystem::path m_journalFile;
+    PathResolver m_resolver;
+
+    std::unordered_map<uint64_t, DirEntry> m_dirs;
+    std::unordered_map<uint64_t, std::wstring> m_dirPaths;
+};
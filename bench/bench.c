@@ -0,0 +1,124 @@
+// Times the scan of every INPUT with each scan configuration of RULES
+// (prefilter levels and compact rows, see harness.h). Inputs are read into
+// memory first, so only the scan is timed; each configuration reports the
+// fastest of REPS runs over all inputs.
+//
+// The regexp DFA has no runtime switch. Compare this tool's output for a
+// regexp rule set with that of bench-nodfa, which is linked against a
+// libyara built with RE_DFA_MAX_STATES=0 (see the Makefile).
+//
+// usage: bench [-n REPS] RULES INPUT...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+static int _callback(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  if (message == CALLBACK_MSG_RULE_MATCHING)
+    (*(int*) user_data)++;
+
+  return CALLBACK_CONTINUE;
+}
+
+int main(int argc, char** argv)
+{
+  YR_RULES* rules;
+  HARNESS_CONFIG configs[HARNESS_MAX_CONFIGS];
+  HARNESS_INPUT* inputs;
+  int num_configs;
+  int num_inputs;
+  int reps = 5;
+  int arg = 1;
+  size_t total = 0;
+
+  if (argc > 2 && strcmp(argv[1], "-n") == 0)
+  {
+    reps = atoi(argv[2]);
+    arg = 3;
+  }
+
+  if (argc - arg < 2 || reps < 1)
+  {
+    fprintf(stderr, "usage: %s [-n REPS] RULES INPUT...\n", argv[0]);
+    return 2;
+  }
+
+  if (yr_initialize() != ERROR_SUCCESS)
+    return 2;
+
+  if (harness_load_rules(argv[arg], &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "%s: cannot load rules\n", argv[arg]);
+    return 2;
+  }
+
+  num_inputs = argc - arg - 1;
+  inputs = (HARNESS_INPUT*) calloc(num_inputs, sizeof(HARNESS_INPUT));
+
+  for (int i = 0; i < num_inputs; i++)
+  {
+    if (harness_load_input(argv[arg + 1 + i], &inputs[i]) != ERROR_SUCCESS)
+    {
+      fprintf(stderr, "%s: cannot read input\n", argv[arg + 1 + i]);
+      return 2;
+    }
+
+    total += inputs[i].size;
+  }
+
+  num_configs = harness_configs(rules, configs);
+
+  printf(
+      "%s: %d inputs, %.1f MiB, best of %d\n",
+      argv[arg],
+      num_inputs,
+      total / 1048576.0,
+      reps);
+
+  for (int c = 0; c < num_configs; c++)
+  {
+    double best = 0;
+    int matches = 0;
+
+    harness_apply(&configs[c]);
+
+    for (int r = 0; r < reps; r++)
+    {
+      double start = harness_now();
+
+      matches = 0;
+
+      for (int i = 0; i < num_inputs; i++)
+        yr_rules_scan_mem(
+            rules, inputs[i].data, inputs[i].size, 0, _callback, &matches, 0);
+
+      double elapsed = harness_now() - start;
+
+      if (r == 0 || elapsed < best)
+        best = elapsed;
+    }
+
+    printf(
+        "  prefilter=%-6s compact=%-3s %9.1f ms %9.1f MiB/s  %d matches\n",
+        harness_prefilter_name(configs[c].prefilter),
+        configs[c].compact ? "on" : "off",
+        best,
+        best > 0 ? total / 1048576.0 / (best / 1e3) : 0,
+        matches);
+  }
+
+  for (int i = 0; i < num_inputs; i++) harness_free_input(&inputs[i]);
+
+  free(inputs);
+  yr_rules_destroy(rules);
+  yr_finalize();
+
+  return 0;
+}
@@ -0,0 +1,293 @@
+// Scans every INPUT with every scan configuration of RULES (prefilter levels
+// and compact rows, see harness.h) and fails if any of them reports a
+// different match set than the reference configuration. A match set is the
+// matching rules with, per string, every match's offset, length and data.
+//
+// Prints one "<input> <matching rules> <digest>" line per input. The digest
+// does not depend on the configuration, so the output of libyara builds
+// with different RE_DFA_* limits can be compared with cmp(1); the Makefile's
+// check target does that to cover the regexp DFA.
+//
+// Each configuration is then run once more over all inputs together with
+// yr_scanner_scan_mem_multi, whose digests must match the single scans.
+//
+// usage: equiv RULES INPUT...
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+typedef struct MATCH_DIGEST
+{
+  uint64_t hash;
+  int rules;
+} MATCH_DIGEST;
+
+// FNV-1a
+static void _digest(MATCH_DIGEST* digest, const void* data, size_t size)
+{
+  const uint8_t* p = (const uint8_t*) data;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    digest->hash ^= p[i];
+    digest->hash *= 0x100000001B3ULL;
+  }
+}
+
+static int _callback(
+    YR_SCAN_CONTEXT* context,
+    int message,
+    void* message_data,
+    void* user_data)
+{
+  MATCH_DIGEST* digest = (MATCH_DIGEST*) user_data;
+  YR_RULE* rule;
+  YR_STRING* string;
+  YR_MATCH* match;
+
+  if (message != CALLBACK_MSG_RULE_MATCHING)
+    return CALLBACK_CONTINUE;
+
+  rule = (YR_RULE*) message_data;
+  digest->rules++;
+
+  _digest(digest, rule->ns->name, strlen(rule->ns->name) + 1);
+  _digest(digest, rule->identifier, strlen(rule->identifier) + 1);
+
+  yr_rule_strings_foreach(rule, string)
+  {
+    _digest(digest, string->identifier, strlen(string->identifier) + 1);
+
+    yr_string_matches_foreach(context, string, match)
+    {
+      _digest(digest, &match->offset, sizeof(match->offset));
+      _digest(digest, &match->match_length, sizeof(match->match_length));
+      _digest(digest, match->data, match->data_length);
+    }
+  }
+
+  return CALLBACK_CONTINUE;
+}
+
+static void _digest_init(MATCH_DIGEST* digest)
+{
+  digest->hash = 0xCBF29CE484222325ULL;
+  digest->rules = 0;
+}
+
+static int _scan(
+    YR_RULES* rules,
+    const HARNESS_INPUT* input,
+    MATCH_DIGEST* digest)
+{
+  _digest_init(digest);
+
+  return yr_rules_scan_mem(
+      rules, input->data, input->size, 0, _callback, digest, 0);
+}
+
+#if !defined(HARNESS_BASELINE)
+
+// Scans all inputs with yr_scanner_scan_mem_multi through MULTI_SCANNERS
+// scanners, fewer than the inputs so that lanes get reused, and compares
+// each digest with the single-scan reference. Returns the failure count.
+#define MULTI_SCANNERS 3
+
+static int _check_multi(
+    YR_RULES* rules,
+    const HARNESS_CONFIG* config,
+    const HARNESS_INPUT* inputs,
+    const MATCH_DIGEST* reference,
+    int num_inputs)
+{
+  YR_SCANNER* scanners[MULTI_SCANNERS];
+  const uint8_t** buffers = malloc(num_inputs * sizeof(*buffers));
+  size_t* sizes = malloc(num_inputs * sizeof(*sizes));
+  void** user_data = malloc(num_inputs * sizeof(*user_data));
+  MATCH_DIGEST* digests = malloc(num_inputs * sizeof(*digests));
+  int* results = malloc(num_inputs * sizeof(*results));
+  int num_scanners = 0;
+  int failures = 0;
+
+  if (!buffers || !sizes || !user_data || !digests || !results)
+  {
+    fprintf(stderr, "multi: out of memory\n");
+    failures++;
+    goto _exit;
+  }
+
+  for (; num_scanners < MULTI_SCANNERS; num_scanners++)
+  {
+    if (yr_scanner_create(rules, &scanners[num_scanners]) != ERROR_SUCCESS)
+    {
+      fprintf(stderr, "multi: cannot create scanner\n");
+      failures++;
+      goto _exit;
+    }
+
+    yr_scanner_set_callback(scanners[num_scanners], _callback, NULL);
+  }
+
+  for (int i = 0; i < num_inputs; i++)
+  {
+    buffers[i] = inputs[i].data;
+    sizes[i] = inputs[i].size;
+    user_data[i] = &digests[i];
+    _digest_init(&digests[i]);
+  }
+
+  if (yr_scanner_scan_mem_multi(
+          scanners,
+          num_scanners,
+          buffers,
+          sizes,
+          user_data,
+          results,
+          num_inputs) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "multi: invalid arguments\n");
+    failures++;
+    goto _exit;
+  }
+
+  for (int i = 0; i < num_inputs; i++)
+  {
+    if (results[i] != ERROR_SUCCESS || digests[i].hash != reference[i].hash ||
+        digests[i].rules != reference[i].rules)
+    {
+      fprintf(
+          stderr,
+          "%s: multi scan with prefilter=%s compact=%d differs from the "
+          "reference: error %d, %d rules %016" PRIx64 " vs %d rules %016" PRIx64
+          "\n",
+          inputs[i].name,
+          harness_prefilter_name(config->prefilter),
+          config->compact,
+          results[i],
+          digests[i].rules,
+          digests[i].hash,
+          reference[i].rules,
+          reference[i].hash);
+      failures++;
+    }
+  }
+
+_exit:
+
+  for (int k = 0; k < num_scanners; k++) yr_scanner_destroy(scanners[k]);
+
+  free(buffers);
+  free(sizes);
+  free(user_data);
+  free(digests);
+  free(results);
+
+  return failures;
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+  YR_RULES* rules;
+  HARNESS_CONFIG configs[HARNESS_MAX_CONFIGS];
+  HARNESS_INPUT* inputs;
+  MATCH_DIGEST* reference;
+  int num_configs;
+  int num_inputs = 0;
+  int failures = 0;
+
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s RULES INPUT...\n", argv[0]);
+    return 2;
+  }
+
+  if (yr_initialize() != ERROR_SUCCESS)
+    return 2;
+
+  if (harness_load_rules(argv[1], &rules) != ERROR_SUCCESS)
+  {
+    fprintf(stderr, "%s: cannot load rules\n", argv[1]);
+    return 2;
+  }
+
+  num_configs = harness_configs(rules, configs);
+
+  inputs = calloc(argc - 2, sizeof(*inputs));
+  reference = calloc(argc - 2, sizeof(*reference));
+
+  if (inputs == NULL || reference == NULL)
+    return 2;
+
+  for (int i = 2; i < argc; i++)
+  {
+    HARNESS_INPUT* input = &inputs[num_inputs];
+    MATCH_DIGEST* ref = &reference[num_inputs];
+
+    if (harness_load_input(argv[i], input) != ERROR_SUCCESS)
+    {
+      fprintf(stderr, "%s: cannot read input\n", argv[i]);
+      failures++;
+      continue;
+    }
+
+    num_inputs++;
+
+    for (int c = 0; c < num_configs; c++)
+    {
+      MATCH_DIGEST digest;
+      int result;
+
+      harness_apply(&configs[c]);
+      result = _scan(rules, input, c == 0 ? ref : &digest);
+
+      if (result != ERROR_SUCCESS)
+      {
+        fprintf(stderr, "%s: scan error %d\n", input->name, result);
+        failures++;
+        break;
+      }
+
+      if (c > 0 && (digest.hash != ref->hash || digest.rules != ref->rules))
+      {
+        fprintf(
+            stderr,
+            "%s: prefilter=%s compact=%d differs from the reference: "
+            "%d rules %016" PRIx64 " vs %d rules %016" PRIx64 "\n",
+            input->name,
+            harness_prefilter_name(configs[c].prefilter),
+            configs[c].compact,
+            digest.rules,
+            digest.hash,
+            ref->rules,
+            ref->hash);
+        failures++;
+      }
+    }
+
+    printf("%s %d %016" PRIx64 "\n", input->name, ref->rules, ref->hash);
+  }
+
+#if !defined(HARNESS_BASELINE)
+  for (int c = 0; c < num_configs; c++)
+  {
+    harness_apply(&configs[c]);
+    failures += _check_multi(rules, &configs[c], inputs, reference, num_inputs);
+  }
+#endif
+
+  for (int i = 0; i < num_inputs; i++) harness_free_input(&inputs[i]);
+
+  free(inputs);
+  free(reference);
+
+  yr_rules_destroy(rules);
+  yr_finalize();
+
+  return failures ? 1 : 0;
+}
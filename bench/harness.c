@@ -0,0 +1,368 @@
+#include "harness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(HARNESS_BASELINE)
+// The baseline engine has neither the prefilter nor the compact rows; only
+// the reference configuration exists there.
+#define YR_AC_PREFILTER_NONE 0
+#else
+#include <yara/ac_compact.h>
+#include <yara/ac_prefilter.h>
+#endif
+
+// Words planted in the synthetic inputs. They cover the strings in rules/
+// and the regexps' interesting prefixes, so every scan path has atoms to
+// confirm and not only root-state bytes to skip.
+#define WORD(s) { s, sizeof(s) - 1 }
+
+static const struct
+{
+  const char* data;
+  size_t length;
+} words[] = {
+    WORD("AutoClicker"),
+    WORD("Click Interval"),
+    WORD("Start Clicking"),
+    WORD("mouse_event"),
+    WORD("mscorlib"),
+    WORD("System.Windows.Forms"),
+    WORD("SendInput"),
+    WORD("ClicksPerSecond"),
+    WORD("vape.gg"),
+    WORD("slinky_library.dll"),
+    WORD("DopeClicker"),
+    WORD("Copyright (c) 2019"),
+    WORD("Copyright Foo Bar Inc 2021"),
+    WORD("Microsoft Corporation"),
+    WORD("Microsystem\tCorpus"),
+    WORD("abaabaababa"),
+    WORD("information"),
+    WORD("0123456789abcdef0011223344556677"),
+    WORD("print"),
+    WORD("printer"),
+    WORD("MZ\x90\x00\x03\x00\x00\x00"),
+    WORD("PE\x00\x00L\x01"),
+    WORD("kernel32.dll"),
+    WORD("GetProcAddress"),
+};
+
+#define NUM_WORDS (sizeof(words) / sizeof(words[0]))
+
+static uint64_t _next(uint64_t* state)
+{
+  // xorshift64*
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Lowercase word of 6 to 11 letters for synthetic rule i.
+static void _synthetic_word(int i, char* out)
+{
+  uint64_t state = 0x9E3779B97F4A7C15ULL ^ (uint64_t) (i + 1);
+  int len = 6 + (int) (_next(&state) % 6);
+
+  for (int j = 0; j < len; j++) out[j] = 'a' + (char) (_next(&state) % 26);
+
+  out[len] = '\0';
+}
+
+static void _compiler_error(
+    int level,
+    const char* file_name,
+    int line_number,
+    const YR_RULE* rule,
+    const char* message,
+    void* user_data)
+{
+  // Rules written to exercise slow paths warn about being slow.
+  if (level != YARA_ERROR_LEVEL_ERROR)
+    return;
+
+  fprintf(
+      stderr,
+      "%s:%d: %s\n",
+      file_name ? file_name : (const char*) user_data,
+      line_number,
+      message);
+}
+
+static int _synthetic_rules(YR_COMPILER* compiler, int count)
+{
+  size_t capacity = (size_t) count * 160 + 1;
+  char* source = (char*) malloc(capacity);
+  size_t len = 0;
+  int result;
+
+  if (source == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  for (int i = 0; i < count; i++)
+  {
+    char word[16];
+    uint64_t state = (uint64_t) i * 0x100000001B3ULL + 1;
+
+    _synthetic_word(i, word);
+
+    len += snprintf(
+        source + len,
+        capacity - len,
+        "rule r%d { strings: $a = \"%s\" ascii wide "
+        "$b = { %02X %02X %02X %02X %02X } condition: any of them }\n",
+        i,
+        word,
+        (unsigned) (_next(&state) & 0xFF),
+        (unsigned) (_next(&state) & 0xFF),
+        (unsigned) (_next(&state) & 0xFF),
+        (unsigned) (_next(&state) & 0xFF),
+        (unsigned) (_next(&state) & 0xFF));
+  }
+
+  result = yr_compiler_add_string(compiler, source, NULL) == 0
+               ? ERROR_SUCCESS
+               : ERROR_INVALID_FILE;
+
+  free(source);
+  return result;
+}
+
+int harness_load_rules(const char* spec, YR_RULES** rules)
+{
+  YR_COMPILER* compiler;
+  int result = ERROR_SUCCESS;
+
+  if (yr_compiler_create(&compiler) != ERROR_SUCCESS)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  yr_compiler_set_callback(compiler, _compiler_error, (void*) spec);
+
+  if (strncmp(spec, "synthetic:", 10) == 0)
+  {
+    result = _synthetic_rules(compiler, atoi(spec + 10));
+  }
+  else
+  {
+    FILE* fh = fopen(spec, "r");
+
+    if (fh == NULL)
+    {
+      result = ERROR_COULD_NOT_OPEN_FILE;
+    }
+    else
+    {
+      if (yr_compiler_add_file(compiler, fh, NULL, spec) != 0)
+        result = ERROR_INVALID_FILE;
+
+      fclose(fh);
+    }
+  }
+
+  if (result == ERROR_SUCCESS)
+  {
+#if !defined(HARNESS_BASELINE)
+    yr_set_configuration_uint32(YR_CONFIG_AC_COMPACT, 1);
+#endif
+    result = yr_compiler_get_rules(compiler, rules);
+  }
+
+  yr_compiler_destroy(compiler);
+  return result;
+}
+
+static size_t _parse_size(const char* s)
+{
+  char* end;
+  size_t size = (size_t) strtoull(s, &end, 10);
+
+  if (*end == 'K' || *end == 'k')
+    size *= 1024;
+  else if (*end == 'M' || *end == 'm')
+    size *= 1024 * 1024;
+
+  return size;
+}
+
+// Random bytes, zero runs and planted words, the latter also as UTF-16 and
+// with flipped case, in runs of random length.
+static void _synthetic_input(uint8_t* data, size_t size, uint64_t seed)
+{
+  uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 0x632BE59BD9B4E019ULL;
+  size_t i = 0;
+
+  while (i < size)
+  {
+    uint64_t r = _next(&state);
+    size_t run = 1 + (size_t) ((r >> 8) % 512);
+    char word[16];
+    const char* w;
+    size_t wlen;
+    int wide;
+
+    switch (r % 8)
+    {
+    case 0:
+    case 1:
+      w = words[(r >> 24) % NUM_WORDS].data;
+      wlen = words[(r >> 24) % NUM_WORDS].length;
+      break;
+    case 2:
+      _synthetic_word((int) ((r >> 24) % 4096), word);
+      w = word;
+      wlen = strlen(w);
+      break;
+    case 3:
+      memset(data + i, 0, run < size - i ? run : size - i);
+      i += run;
+      continue;
+    default:
+      for (size_t j = 0; j < run && i < size; j++, i++)
+        data[i] = (uint8_t) (_next(&state) >> 56);
+      continue;
+    }
+
+    wide = (r >> 40) & 1;
+
+    for (size_t j = 0; j < wlen && i < size; j++)
+    {
+      uint8_t c = (uint8_t) w[j];
+
+      if ((r >> 41) & 1 && c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+
+      data[i++] = c;
+
+      if (wide && i < size)
+        data[i++] = 0;
+    }
+  }
+}
+
+int harness_load_input(const char* spec, HARNESS_INPUT* input)
+{
+  input->name = spec;
+  input->data = NULL;
+  input->size = 0;
+
+  if (strncmp(spec, "random:", 7) == 0)
+  {
+    const char* seed = strchr(spec + 7, ':');
+
+    input->size = _parse_size(spec + 7);
+    input->data = (uint8_t*) malloc(input->size ? input->size : 1);
+
+    if (input->data == NULL)
+      return ERROR_INSUFFICIENT_MEMORY;
+
+    _synthetic_input(
+        input->data, input->size, seed ? strtoull(seed + 1, NULL, 10) : 1);
+
+    return ERROR_SUCCESS;
+  }
+
+  FILE* fh = fopen(spec, "rb");
+
+  if (fh == NULL)
+    return ERROR_COULD_NOT_OPEN_FILE;
+
+  fseek(fh, 0, SEEK_END);
+  long size = ftell(fh);
+  fseek(fh, 0, SEEK_SET);
+
+  if (size < 0)
+  {
+    fclose(fh);
+    return ERROR_COULD_NOT_READ_FILE;
+  }
+
+  input->size = (size_t) size;
+  input->data = (uint8_t*) malloc(input->size ? input->size : 1);
+
+  if (input->data == NULL ||
+      fread(input->data, 1, input->size, fh) != input->size)
+  {
+    fclose(fh);
+    harness_free_input(input);
+    return ERROR_COULD_NOT_READ_FILE;
+  }
+
+  fclose(fh);
+  return ERROR_SUCCESS;
+}
+
+void harness_free_input(HARNESS_INPUT* input)
+{
+  free(input->data);
+  input->data = NULL;
+  input->size = 0;
+}
+
+int harness_configs(YR_RULES* rules, HARNESS_CONFIG* configs)
+{
+#if defined(HARNESS_BASELINE)
+  (void) rules;
+
+  configs[0].prefilter = YR_AC_PREFILTER_NONE;
+  configs[0].compact = 0;
+  return 1;
+#else
+  uint32_t best = yr_ac_prefilter_best_supported();
+  int count = 0;
+
+  for (uint32_t level = YR_AC_PREFILTER_NONE; level <= best; level++)
+  {
+    configs[count].prefilter = level;
+    configs[count].compact = 0;
+    count++;
+
+    if (rules->ac_compact != NULL)
+    {
+      configs[count].prefilter = level;
+      configs[count].compact = 1;
+      count++;
+    }
+  }
+
+  return count;
+#endif
+}
+
+void harness_apply(const HARNESS_CONFIG* config)
+{
+#if defined(HARNESS_BASELINE)
+  (void) config;
+#else
+  yr_set_configuration_uint32(YR_CONFIG_AC_PREFILTER, config->prefilter);
+  yr_set_configuration_uint32(YR_CONFIG_AC_COMPACT, config->compact);
+#endif
+}
+
+const char* harness_prefilter_name(uint32_t level)
+{
+  switch (level)
+  {
+  case YR_AC_PREFILTER_NONE:
+    return "none";
+#if !defined(HARNESS_BASELINE)
+  case YR_AC_PREFILTER_SCALAR:
+    return "scalar";
+  case YR_AC_PREFILTER_SSE42:
+    return "sse42";
+  case YR_AC_PREFILTER_AVX2:
+    return "avx2";
+#endif
+  }
+
+  return "?";
+}
+
+double harness_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
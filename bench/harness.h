@@ -0,0 +1,59 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+// Shared pieces of the libyara benchmark and equivalence tools: rule sets,
+// deterministic synthetic inputs and the scan configurations to compare.
+//
+// A RULES argument is either a rule file or "synthetic:N", N generated
+// rules whose atoms are large enough to give the automaton the compact
+// rows. An INPUT argument is either a file or "random:SIZE:SEED", SIZE
+// bytes (K/M suffixes allowed) of mixed binary and text that contains the
+// words the bundled and synthetic rules look for.
+//
+// HARNESS_BASELINE builds the tools against the upstream libyara of the
+// Makefile's baseline variant, which predates the prefilter, the compact
+// rows and the multi-buffer scan: there is a single configuration and
+// equiv skips the multi-buffer check.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <yara.h>
+
+typedef struct HARNESS_INPUT
+{
+  const char* name;
+  uint8_t* data;
+  size_t size;
+} HARNESS_INPUT;
+
+// One way of scanning: a prefilter level (YR_AC_PREFILTER_*) and whether
+// the compact rows built for the rules are used (YR_CONFIG_AC_COMPACT).
+typedef struct HARNESS_CONFIG
+{
+  uint32_t prefilter;
+  int compact;
+} HARNESS_CONFIG;
+
+#define HARNESS_MAX_CONFIGS 8
+
+// Loads the rules with YR_CONFIG_AC_COMPACT set, so that they get the
+// compact rows if their automaton is large enough.
+int harness_load_rules(const char* spec, YR_RULES** rules);
+
+int harness_load_input(const char* spec, HARNESS_INPUT* input);
+
+void harness_free_input(HARNESS_INPUT* input);
+
+// Every prefilter level the CPU supports, each with and without the compact
+// rows when the rules have them. The first entry is the reference: no
+// prefilter, classic tables.
+int harness_configs(YR_RULES* rules, HARNESS_CONFIG* configs);
+
+// Sets the library configuration for the scans that follow.
+void harness_apply(const HARNESS_CONFIG* config);
+
+const char* harness_prefilter_name(uint32_t level);
+
+double harness_now(void);
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+
+// Files the scanner trusts across runs (signature verdicts, the compiled
+// rule arena, rule packs) decide what gets flagged, so they must not be
+// writable by the account whose machine is being checked. A location is
+// trusted when it is owned by SYSTEM, Administrators or TrustedInstaller
+// and no other account is granted write, delete or permission changes.
+// Loads re-check the directory and the file itself, because a pre-created
+// directory or a planted file keeps whatever DACL its creator gave it.
+
+#include <filesystem>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <aclapi.h>
+#include <sddl.h>
+#include <shlobj.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+namespace admin_store
+{
+    // NT SERVICE\TrustedInstaller owns most of Program Files.
+    constexpr const wchar_t* kTrustedInstallerSid = L"S-1-5-80-956008885-3418522649-1831038044-1853292631-2271478464";
+
+    // SYSTEM and Administrators full control, inherited; no other entries.
+    constexpr const wchar_t* kDirectorySddl = L"O:BAG:BAD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)";
+
+    constexpr ACCESS_MASK kWriteAccess = FILE_WRITE_DATA | FILE_APPEND_DATA | FILE_WRITE_EA | FILE_DELETE_CHILD |
+        DELETE | WRITE_DAC | WRITE_OWNER | GENERIC_WRITE | GENERIC_ALL;
+
+    inline bool IsTrustedSid(PSID sid)
+    {
+        if (IsWellKnownSid(sid, WinLocalSystemSid) || IsWellKnownSid(sid, WinBuiltinAdministratorsSid))
+            return true;
+
+        static PSID trustedInstaller = [] {
+            PSID out = nullptr;
+            ConvertStringSidToSidW(kTrustedInstallerSid, &out);
+            return out;
+        }();
+        return trustedInstaller && EqualSid(sid, trustedInstaller);
+    }
+}
+#endif
+
+inline bool IsAdminOnlyPath(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    PSID owner = nullptr;
+    PACL dacl = nullptr;
+    PSECURITY_DESCRIPTOR sd = nullptr;
+    if (GetNamedSecurityInfoW(path.c_str(), SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION,
+        &owner, nullptr, &dacl, nullptr, &sd) != ERROR_SUCCESS)
+        return false;
+
+    // A null DACL grants everyone everything.
+    bool trusted = owner && admin_store::IsTrustedSid(owner) && dacl;
+    for (DWORD i = 0; trusted && i < dacl->AceCount; ++i)
+    {
+        ACE_HEADER* ace = nullptr;
+        if (!GetAce(dacl, i, reinterpret_cast<LPVOID*>(&ace)))
+        {
+            trusted = false;
+        }
+        else if (ace->AceType == ACCESS_ALLOWED_ACE_TYPE)
+        {
+            // Inherit-only entries do not apply to this object; its children
+            // are checked on their own when they are loaded.
+            auto* allowed = reinterpret_cast<ACCESS_ALLOWED_ACE*>(ace);
+            if (!(ace->AceFlags & INHERIT_ONLY_ACE) && (allowed->Mask & admin_store::kWriteAccess) &&
+                !admin_store::IsTrustedSid(&allowed->SidStart))
+                trusted = false;
+        }
+        else if (ace->AceType != ACCESS_DENIED_ACE_TYPE)
+        {
+            // Object and callback entries are not expected here.
+            trusted = false;
+        }
+    }
+
+    LocalFree(sd);
+    return trusted;
+#else
+    struct stat st{};
+    return stat(path.c_str(), &st) == 0 && st.st_uid == 0 && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+}
+
+// %ProgramData%\BAMReveal, created on first use with a DACL that only
+// admits SYSTEM and Administrators. Empty when the directory cannot be
+// created (the process is not elevated) or fails IsAdminOnlyPath, e.g.
+// because another account created it first; callers then keep their
+// state in memory for this run.
+inline std::filesystem::path GetAdminStoreDirectory()
+{
+#ifdef _WIN32
+    static const std::filesystem::path dir = []() -> std::filesystem::path {
+        PWSTR base = nullptr;
+        if (FAILED(SHGetKnownFolderPath(FOLDERID_ProgramData, 0, nullptr, &base)))
+            return {};
+        std::filesystem::path path = std::filesystem::path(base) / L"BAMReveal";
+        CoTaskMemFree(base);
+
+        PSECURITY_DESCRIPTOR sd = nullptr;
+        if (ConvertStringSecurityDescriptorToSecurityDescriptorW(admin_store::kDirectorySddl, SDDL_REVISION_1, &sd, nullptr))
+        {
+            SECURITY_ATTRIBUTES sa{ sizeof(sa), sd, FALSE };
+            CreateDirectoryW(path.c_str(), &sa);
+            LocalFree(sd);
+        }
+
+        return IsAdminOnlyPath(path) ? path : std::filesystem::path();
+    }();
+    return dir;
+#else
+    return {};
+#endif
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// One open file, shared by everything that inspects a BAM path: the PE
+// check, Authenticode and catalog verification, the fingerprint and the
+// YARA scan. The handle stays open for the APIs that want one
+// (WinVerifyTrust, CryptCATAdminCalcHashFromFileHandle) and the content is
+// mapped once for the ones that only need bytes. Opening is lazy so cache
+// hits by path never touch the disk.
+//
+// A file that opens but cannot be mapped (too large for the address space,
+// mapping refused by a filter driver) keeps its handle: Data() is then null,
+// ReadAt() reads through the handle and YARA streams from it.
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+struct FileIdentity
+{
+    uint64_t volumeSerial = 0;
+    uint8_t  fileId[16] = {};
+    uint64_t size = 0;
+    uint64_t lastWrite = 0;
+    uint64_t contentHash = 0; // filled in by the signature code
+};
+
+class FileProbe
+{
+public:
+    explicit FileProbe(std::wstring path) : m_path(std::move(path)) {}
+    ~FileProbe() { Close(); }
+
+    FileProbe(const FileProbe&) = delete;
+    FileProbe& operator=(const FileProbe&) = delete;
+
+    // Opens and maps the file on first call; later calls return the cached
+    // result. Fails for directories and files that cannot be opened; a
+    // failed mapping only leaves Data() null.
+    bool Open()
+    {
+        if (m_attempted)
+            return m_handle != INVALID_HANDLE_VALUE;
+        m_attempted = true;
+
+        m_handle = CreateFileW(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (m_handle == INVALID_HANDLE_VALUE)
+            return false;
+
+        FILE_ID_INFO idInfo{};
+        FILE_BASIC_INFO basicInfo{};
+        LARGE_INTEGER size{};
+        if (!GetFileInformationByHandleEx(m_handle, FileIdInfo, &idInfo, sizeof(idInfo)) ||
+            !GetFileInformationByHandleEx(m_handle, FileBasicInfo, &basicInfo, sizeof(basicInfo)) ||
+            !GetFileSizeEx(m_handle, &size))
+        {
+            Close();
+            return false;
+        }
+
+        m_identity.volumeSerial = idInfo.VolumeSerialNumber;
+        memcpy(m_identity.fileId, idInfo.FileId.Identifier, sizeof(m_identity.fileId));
+        m_identity.size = static_cast<uint64_t>(size.QuadPart);
+        m_identity.lastWrite = static_cast<uint64_t>(basicInfo.LastWriteTime.QuadPart);
+
+        // Empty files cannot be mapped; they are still a valid (empty) probe.
+        if (m_identity.size == 0 || m_identity.size > SIZE_MAX)
+            return true;
+
+        if (HANDLE mapping = CreateFileMappingW(m_handle, nullptr, PAGE_READONLY, 0, 0, nullptr))
+        {
+            m_view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+
+        return true;
+    }
+
+    // Copies up to `size` bytes at `offset` from the view, or reads them
+    // through the handle when there is none. Returns the bytes copied.
+    size_t ReadAt(uint64_t offset, void* buffer, size_t size) const
+    {
+        if (offset >= m_identity.size)
+            return 0;
+        size = static_cast<size_t>(std::min<uint64_t>(size, m_identity.size - offset));
+
+        if (m_view)
+        {
+            memcpy(buffer, m_view + offset, size);
+            return size;
+        }
+
+        size_t done = 0;
+        while (done < size)
+        {
+            OVERLAPPED ov{};
+            ov.Offset = static_cast<DWORD>(offset + done);
+            ov.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+            DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - done, 1u << 30));
+            DWORD read = 0;
+            if (!ReadFile(m_handle, static_cast<uint8_t*>(buffer) + done, chunk, &read, &ov) || read == 0)
+                break;
+            done += read;
+        }
+        return done;
+    }
+
+    void Close()
+    {
+        if (m_view)
+            UnmapViewOfFile(m_view);
+        if (m_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(m_handle);
+
+        m_view = nullptr;
+        m_handle = INVALID_HANDLE_VALUE;
+    }
+
+    const std::wstring& Path() const { return m_path; }
+    HANDLE Handle() const { return m_handle; }
+    // Null for empty and unmapped files.
+    const uint8_t* Data() const { return m_view; }
+    uint64_t Size() const { return m_identity.size; }
+    const FileIdentity& Identity() const { return m_identity; }
+
+private:
+    std::wstring   m_path;
+    HANDLE         m_handle = INVALID_HANDLE_VALUE;
+    const uint8_t* m_view = nullptr;
+    FileIdentity   m_identity;
+    bool           m_attempted = false;
+};
@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <yara/ac_compact.h>
+#include <yara/ahocorasick.h>
+#include <yara/arena.h>
+#include <yara/compiler.h>
+#include <yara/error.h>
+#include <yara/limits.h>
+#include <yara/mem.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the state the automaton moves to from the root state with byte c,
+// or YR_AC_ROOT_STATE if there's no transition for c.
+//
+static uint32_t _yr_ac_compact_root_child(
+    const YR_AC_TRANSITION* transition_table,
+    int c)
+{
+  YR_AC_TRANSITION transition = transition_table[YR_AC_ROOT_STATE + c + 1];
+
+  if (YR_AC_INVALID_TRANSITION(transition, (uint32_t) c + 1))
+    return YR_AC_ROOT_STATE;
+
+  return YR_AC_NEXT_STATE(transition);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Builds the compact rows for the automaton in rules. *compact is set to
+// NULL when the transition table is small enough to be used as it is, see
+// YR_AC_COMPACT_MIN_SLOTS.
+//
+int yr_ac_compact_create(YR_RULES* rules, YR_AC_COMPACT** compact)
+{
+  const YR_AC_TRANSITION* transition_table = rules->ac_transition_table;
+  const uint32_t* match_table = rules->ac_match_table;
+
+  uint32_t row_of_byte[256];
+  uint32_t num_rows = 1;
+
+  *compact = NULL;
+
+  yr_arena_off_t num_slots = yr_arena_get_current_offset(
+                                 rules->arena, YR_AC_TRANSITION_TABLE) /
+                             sizeof(YR_AC_TRANSITION);
+
+  if (num_slots < YR_AC_COMPACT_MIN_SLOTS)
+    return ERROR_SUCCESS;
+
+  for (int c = 0; c < 256; c++)
+  {
+    if (_yr_ac_compact_root_child(transition_table, c) != YR_AC_ROOT_STATE)
+      row_of_byte[c] = num_rows++;
+    else
+      row_of_byte[c] = 0;
+  }
+
+  YR_AC_COMPACT* new_compact = (YR_AC_COMPACT*) yr_calloc(
+      1, sizeof(YR_AC_COMPACT));
+
+  if (new_compact == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  new_compact->num_rows = num_rows;
+  new_compact->row_slot = (uint32_t*) yr_calloc(num_rows, sizeof(uint32_t));
+  new_compact->rows = (uint32_t*) yr_calloc(
+      (size_t) num_rows * 256, sizeof(uint32_t));
+
+  if (new_compact->row_slot == NULL || new_compact->rows == NULL)
+  {
+    yr_ac_compact_destroy(new_compact);
+    return ERROR_INSUFFICIENT_MEMORY;
+  }
+
+  // Row 0 is the root state. Bytes without a transition out of the root
+  // lead back to it.
+  for (int c = 0; c < 256; c++)
+  {
+    uint32_t row = row_of_byte[c];
+    uint32_t state = _yr_ac_compact_root_child(transition_table, c);
+
+    new_compact->row_slot[row] = state;
+    new_compact->rows[c] = YR_AC_COMPACT_ENTRY(
+        row, match_table[state] != 0 ? YR_AC_COMPACT_MATCHES : 0);
+  }
+
+  // The states at depth 1 fail back to the root, so a byte without a
+  // transition of its own takes the automaton where the root would.
+  for (int b = 0; b < 256; b++)
+  {
+    uint32_t row = row_of_byte[b];
+    uint32_t state = new_compact->row_slot[row];
+
+    if (row == 0)
+      continue;
+
+    for (int c = 0; c < 256; c++)
+    {
+      YR_AC_TRANSITION transition = transition_table[state + c + 1];
+
+      if (YR_AC_INVALID_TRANSITION(transition, (uint32_t) c + 1))
+      {
+        new_compact->rows[row * 256 + c] = new_compact->rows[c];
+      }
+      else
+      {
+        uint32_t next = YR_AC_NEXT_STATE(transition);
+
+        new_compact->rows[row * 256 + c] = YR_AC_COMPACT_ENTRY(
+            next,
+            YR_AC_COMPACT_DEEP |
+                (match_table[next] != 0 ? YR_AC_COMPACT_MATCHES : 0));
+      }
+    }
+  }
+
+  *compact = new_compact;
+
+  return ERROR_SUCCESS;
+}
+
+void yr_ac_compact_destroy(YR_AC_COMPACT* compact)
+{
+  if (compact == NULL)
+    return;
+
+  yr_free(compact->row_slot);
+  yr_free(compact->rows);
+  yr_free(compact);
+}
@@ -0,0 +1,367 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <yara/ac_prefilter.h>
+#include <yara/ahocorasick.h>
+#include <yara/error.h>
+#include <yara/mem.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define YR_AC_PREFILTER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define YR_AC_PREFILTER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define YR_AC_PREFILTER_TARGET(isa)
+#endif
+
+#define _pair_is_set(prefilter, b0, b1) \
+  yr_bitmask_is_set((prefilter)->pairs, ((b0) << 8) | (b1))
+
+////////////////////////////////////////////////////////////////////////////////
+// Index of the lowest set bit in a non-zero mask.
+//
+static inline uint32_t _yr_ac_prefilter_ctz(uint32_t mask)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (uint32_t) index;
+#else
+  return (uint32_t) __builtin_ctz(mask);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds the pair b0 b1 to the candidate set, both to the exact bitmap and to
+// the nibble masks of the bucket that b0 falls in.
+//
+static void _yr_ac_prefilter_add_pair(
+    YR_AC_PREFILTER* prefilter,
+    uint8_t b0,
+    uint8_t b1)
+{
+  uint8_t bucket = 1 << (b0 % YR_AC_PREFILTER_BUCKETS);
+
+  yr_bitmask_set(prefilter->pairs, (b0 << 8) | b1);
+
+  prefilter->lo1[b0 & 0x0F] |= bucket;
+  prefilter->hi1[b0 >> 4] |= bucket;
+  prefilter->lo2[b1 & 0x0F] |= bucket;
+  prefilter->hi2[b1 >> 4] |= bucket;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Builds the prefilter for the Aho-Corasick automaton in rules. A pair b0 b1
+// is a candidate if b0 moves the automaton out of the root state and either
+// the resulting state has matches or b1 moves it one level deeper. Any other
+// pair brings the automaton back to the state it would be in by starting
+// over at b1, so the scanner can skip b0 without changing the result.
+//
+int yr_ac_prefilter_create(YR_RULES* rules, YR_AC_PREFILTER** prefilter)
+{
+  YR_AC_TRANSITION* transition_table = rules->ac_transition_table;
+  uint32_t* match_table = rules->ac_match_table;
+
+  YR_AC_PREFILTER* new_prefilter = (YR_AC_PREFILTER*) yr_calloc(
+      1, sizeof(YR_AC_PREFILTER));
+
+  if (new_prefilter == NULL)
+    return ERROR_INSUFFICIENT_MEMORY;
+
+  new_prefilter->enabled = match_table[YR_AC_ROOT_STATE] == 0;
+
+  for (int b0 = 0; b0 < 256; b0++)
+  {
+    YR_AC_TRANSITION transition = transition_table[YR_AC_ROOT_STATE + b0 + 1];
+
+    if (YR_AC_INVALID_TRANSITION(transition, (uint32_t) b0 + 1))
+      continue;
+
+    uint32_t state = YR_AC_NEXT_STATE(transition);
+    bool has_matches = match_table[state] != 0;
+
+    new_prefilter->first[b0] = 1;
+
+    for (int b1 = 0; b1 < 256; b1++)
+    {
+      if (has_matches ||
+          !YR_AC_INVALID_TRANSITION(
+              transition_table[state + b1 + 1], (uint32_t) b1 + 1))
+      {
+        _yr_ac_prefilter_add_pair(new_prefilter, b0, b1);
+      }
+    }
+  }
+
+  *prefilter = new_prefilter;
+
+  return ERROR_SUCCESS;
+}
+
+void yr_ac_prefilter_destroy(YR_AC_PREFILTER* prefilter)
+{
+  yr_free(prefilter);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the fastest YR_AC_PREFILTER_XXX level supported by the CPU.
+//
+uint32_t yr_ac_prefilter_best_supported(void)
+{
+#if defined(YR_AC_PREFILTER_X86) && defined(_MSC_VER)
+  int info[4];
+
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+
+  __cpuid(info, 1);
+  bool ssse3 = (info[2] & (1 << 9)) != 0;
+  bool sse42 = (info[2] & (1 << 20)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+
+  // AVX2 also needs the OS to save the YMM registers on context switches.
+  if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+  {
+    __cpuidex(info, 7, 0);
+
+    if (info[1] & (1 << 5))
+      return YR_AC_PREFILTER_AVX2;
+  }
+
+  if (ssse3 && sse42)
+    return YR_AC_PREFILTER_SSE42;
+
+  return YR_AC_PREFILTER_SCALAR;
+
+#elif defined(YR_AC_PREFILTER_X86) && defined(__GNUC__)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return YR_AC_PREFILTER_AVX2;
+
+  if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("ssse3"))
+    return YR_AC_PREFILTER_SSE42;
+
+  return YR_AC_PREFILTER_SCALAR;
+
+#else
+  return YR_AC_PREFILTER_SCALAR;
+#endif
+}
+
+static size_t _yr_ac_prefilter_next_scalar(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t start,
+    size_t size)
+{
+  size_t i = start;
+
+  while (i + 1 < size)
+  {
+    if (_pair_is_set(prefilter, data[i], data[i + 1]))
+      return i;
+
+    i++;
+  }
+
+  // The last byte has no successor, any transition out of the root state is
+  // enough for the final match check to see a state other than the root.
+  if (i < size && prefilter->first[data[i]])
+    return i;
+
+  return size;
+}
+
+#if defined(YR_AC_PREFILTER_X86)
+
+////////////////////////////////////////////////////////////////////////////////
+// Teddy-style filter: for 16 positions at a time, looks up the buckets of
+// each byte and its successor through the nibble masks. A position survives
+// only if some bucket is set in all four lookups, and survivors are checked
+// against the exact pair bitmap.
+//
+YR_AC_PREFILTER_TARGET("sse4.2")
+static size_t _yr_ac_prefilter_next_sse42(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t start,
+    size_t size)
+{
+  const __m128i lo1 = _mm_loadu_si128((const __m128i*) prefilter->lo1);
+  const __m128i hi1 = _mm_loadu_si128((const __m128i*) prefilter->hi1);
+  const __m128i lo2 = _mm_loadu_si128((const __m128i*) prefilter->lo2);
+  const __m128i hi2 = _mm_loadu_si128((const __m128i*) prefilter->hi2);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i zero = _mm_setzero_si128();
+
+  size_t i = start;
+
+  // Each iteration reads 17 bytes, the 16 positions plus the successor of
+  // the last one.
+  while (i + 17 <= size)
+  {
+    __m128i b0 = _mm_loadu_si128((const __m128i*) (data + i));
+    __m128i b1 = _mm_loadu_si128((const __m128i*) (data + i + 1));
+
+    __m128i r = _mm_and_si128(
+        _mm_shuffle_epi8(lo1, _mm_and_si128(b0, nibble)),
+        _mm_shuffle_epi8(
+            hi1, _mm_and_si128(_mm_srli_epi16(b0, 4), nibble)));
+
+    r = _mm_and_si128(r, _mm_shuffle_epi8(lo2, _mm_and_si128(b1, nibble)));
+    r = _mm_and_si128(
+        r,
+        _mm_shuffle_epi8(hi2, _mm_and_si128(_mm_srli_epi16(b1, 4), nibble)));
+
+    uint32_t mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(r, zero)) & 0xFFFF;
+
+    while (mask != 0)
+    {
+      size_t j = i + _yr_ac_prefilter_ctz(mask);
+
+      if (_pair_is_set(prefilter, data[j], data[j + 1]))
+        return j;
+
+      mask &= mask - 1;
+    }
+
+    i += 16;
+  }
+
+  return _yr_ac_prefilter_next_scalar(prefilter, data, i, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Same as _yr_ac_prefilter_next_sse42 with 32 positions per iteration. The
+// shuffles work within 128-bit lanes, so the masks are repeated in both.
+//
+YR_AC_PREFILTER_TARGET("avx2")
+static size_t _yr_ac_prefilter_next_avx2(
+    const YR_AC_PREFILTER* prefilter,
+    const uint8_t* data,
+    size_t start,
+    size_t size)
+{
+  const __m256i lo1 = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i*) prefilter->lo1));
+  const __m256i hi1 = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i*) prefilter->hi1));
+  const __m256i lo2 = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i*) prefilter->lo2));
+  const __m256i hi2 = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i*) prefilter->hi2));
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i zero = _mm256_setzero_si256();
+
+  size_t i = start;
+
+  while (i + 33 <= size)
+  {
+    __m256i b0 = _mm256_loadu_si256((const __m256i*) (data + i));
+    __m256i b1 = _mm256_loadu_si256((const __m256i*) (data + i + 1));
+
+    __m256i r = _mm256_and_si256(
+        _mm256_shuffle_epi8(lo1, _mm256_and_si256(b0, nibble)),
+        _mm256_shuffle_epi8(
+            hi1, _mm256_and_si256(_mm256_srli_epi16(b0, 4), nibble)));
+
+    r = _mm256_and_si256(
+        r, _mm256_shuffle_epi8(lo2, _mm256_and_si256(b1, nibble)));
+    r = _mm256_and_si256(
+        r,
+        _mm256_shuffle_epi8(
+            hi2, _mm256_and_si256(_mm256_srli_epi16(b1, 4), nibble)));
+
+    uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(r, zero));
+
+    while (mask != 0)
+    {
+      size_t j = i + _yr_ac_prefilter_ctz(mask);
+
+      if (_pair_is_set(prefilter, data[j], data[j + 1]))
+        return j;
+
+      mask &= mask - 1;
+    }
+
+    i += 32;
+  }
+
+  return _yr_ac_prefilter_next_sse42(prefilter, data, i, size);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the position of the first byte in data[start..size) at which the
+// automaton, sitting at the root state, could leave it for good, or size if
+// there's none. Every position before it can be skipped.
+//
+// Args:
+//   prefilter: Prefilter for the rules being scanned, must be enabled.
+//   level: Any of YR_AC_PREFILTER_SCALAR, YR_AC_PREFILTER_SSE42 or
+//          YR_AC_PREFILTER_AVX2, supported by the CPU.
+//   data: Data being scanned.
+//   start: Position where the automaton is at the root state.
+//   size: Size of data.
+//
+size_t yr_ac_prefilter_next(
+    const YR_AC_PREFILTER* prefilter,
+    uint32_t level,
+    const uint8_t* data,
+    size_t start,
+    size_t size)
+{
+  // Cheap early out, dense data returns here most of the time.
+  if (start + 1 < size && _pair_is_set(prefilter, data[start], data[start + 1]))
+    return start;
+
+  switch (level)
+  {
+#if defined(YR_AC_PREFILTER_X86)
+  case YR_AC_PREFILTER_AVX2:
+    return _yr_ac_prefilter_next_avx2(prefilter, data, start, size);
+  case YR_AC_PREFILTER_SSE42:
+    return _yr_ac_prefilter_next_sse42(prefilter, data, start, size);
+#endif
+  default:
+    return _yr_ac_prefilter_next_scalar(prefilter, data, start, size);
+  }
+}
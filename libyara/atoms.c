@@ -304,6 +304,73 @@ int yr_atoms_table_quality(YR_ATOMS_CONFIG* config, YR_ATOM* atom)
   return YR_MAX_ATOM_QUALITY;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Returns a numeric value indicating the quality of an atom, like
+// yr_atoms_heuristic_quality does, but the points contributed by each byte
+// come from config->byte_quality instead of being fixed. Those points are
+// derived from byte frequencies measured over a corpus of ordinary files
+// (see yr_compiler_set_atom_byte_frequencies), so bytes that are common in
+// the scanned data make the atom worse and rare ones make it better. Masks
+// and unique bytes are scored as in yr_atoms_heuristic_quality, which keeps
+// both functions in the same range and the warning threshold meaningful.
+//
+// Args:
+//    config: Pointer to YR_ATOMS_CONFIG struct.
+//    atom: Pointer to YR_ATOM struct.
+//
+// Returns:
+//    An integer indicating the atom's quality
+//
+int yr_atoms_frequency_quality(YR_ATOMS_CONFIG* config, YR_ATOM* atom)
+{
+  YR_BITMASK seen_bytes[YR_BITMASK_SIZE(256)];
+
+  int quality = 0;
+  int unique_bytes = 0;
+  int last_byte = 0;
+
+  assert(atom->length <= YR_MAX_ATOM_LENGTH);
+
+  yr_bitmask_clear_all(seen_bytes);
+
+  for (int i = 0; i < atom->length; i++)
+  {
+    switch (atom->mask[i])
+    {
+    case 0x00:
+      quality -= 10;
+      break;
+    case 0x0F:
+    case 0xF0:
+      quality += 4;
+      break;
+    case 0xFF:
+      quality += config->byte_quality[atom->bytes[i]];
+      last_byte = atom->bytes[i];
+
+      if (!yr_bitmask_is_set(seen_bytes, atom->bytes[i]))
+      {
+        yr_bitmask_set(seen_bytes, atom->bytes[i]);
+        unique_bytes++;
+      }
+    }
+  }
+
+  // The same byte repeated is penalized heavily if the byte is common, as
+  // in yr_atoms_heuristic_quality.
+  if (unique_bytes == 1 &&
+      config->byte_quality[last_byte] < YR_ATOM_COMMON_BYTE_QUALITY)
+  {
+    quality -= 10 * atom->length;
+  }
+  else
+  {
+    quality += 2 * unique_bytes;
+  }
+
+  return YR_MAX_ATOM_QUALITY - 22 * YR_MAX_ATOM_LENGTH + quality;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Returns the quality for the worst quality atom in a list.
 //
@@ -848,6 +915,78 @@ static int _yr_atoms_wide(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Returns the quality of the worst atom that the string modifiers derive from
+// the given one: the atom itself unless the string is wide only, its wide
+// version for wide strings, and every case combination of those for nocase
+// strings. Atoms for xor strings are rated as they are.
+//
+static int _yr_atoms_emitted_quality(
+    YR_ATOMS_CONFIG* config,
+    YR_ATOM* atom,
+    YR_MODIFIER modifier)
+{
+  YR_ATOM forms[2];
+  YR_ATOM combination;
+
+  uint8_t buffer[CASE_COMBINATIONS_BUFFER_SIZE];
+  uint8_t* atoms_cursor;
+
+  int num_forms = 0;
+  int min_quality = YR_MAX_ATOM_QUALITY;
+  int quality;
+  int i;
+
+  if (!(modifier.flags & STRING_FLAGS_WIDE) ||
+      modifier.flags & STRING_FLAGS_ASCII)
+  {
+    memcpy(&forms[num_forms++], atom, sizeof(YR_ATOM));
+  }
+
+  if (modifier.flags & STRING_FLAGS_WIDE)
+  {
+    YR_ATOM* wide = &forms[num_forms++];
+
+    memset(wide->bytes, 0, YR_MAX_ATOM_LENGTH);
+    memset(wide->mask, 0xFF, YR_MAX_ATOM_LENGTH);
+
+    for (i = 0; i < atom->length && i * 2 < YR_MAX_ATOM_LENGTH; i++)
+      wide->bytes[i * 2] = atom->bytes[i];
+
+    wide->length = yr_min(atom->length * 2, YR_MAX_ATOM_LENGTH);
+  }
+
+  for (i = 0; i < num_forms; i++)
+  {
+    quality = config->get_atom_quality(config, &forms[i]);
+
+    if (quality < min_quality)
+      min_quality = quality;
+
+    if (!(modifier.flags & STRING_FLAGS_NO_CASE))
+      continue;
+
+    _yr_atoms_case_combinations(forms[i].bytes, forms[i].length, 0, buffer);
+
+    memset(combination.mask, 0xFF, YR_MAX_ATOM_LENGTH);
+    atoms_cursor = buffer;
+
+    while (*atoms_cursor != 0)
+    {
+      combination.length = *atoms_cursor++;
+      memcpy(combination.bytes, atoms_cursor, combination.length);
+      atoms_cursor += combination.length;
+
+      quality = config->get_atom_quality(config, &combination);
+
+      if (quality < min_quality)
+        min_quality = quality;
+    }
+  }
+
+  return min_quality;
+}
+
 struct STACK_ITEM
 {
   RE_NODE* re_node;
@@ -1397,25 +1536,60 @@ int yr_atoms_extract_from_string(
     item->atom.mask[i] = 0xFF;
   }
 
-  max_quality = config->get_atom_quality(config, &item->atom);
+  if (config->rate_emitted_atoms)
+  {
+    // A wide atom holds only YR_MAX_ATOM_LENGTH / 2 characters, so for
+    // strings that are wide only the windows can start that close to the
+    // end of the string.
+    int window_length = item->atom.length;
+
+    if (modifier.flags & STRING_FLAGS_WIDE &&
+        !(modifier.flags & STRING_FLAGS_ASCII))
+      window_length = yr_min(window_length, (YR_MAX_ATOM_LENGTH + 1) / 2);
 
-  atom.length = YR_MAX_ATOM_LENGTH;
-  memset(atom.mask, 0xFF, atom.length);
+    max_quality = _yr_atoms_emitted_quality(config, &item->atom, modifier);
 
-  for (i = YR_MAX_ATOM_LENGTH;
-       i < string_length && max_quality < YR_MAX_ATOM_QUALITY;
-       i++)
+    memset(atom.mask, 0xFF, YR_MAX_ATOM_LENGTH);
+
+    for (i = 1; i <= string_length - window_length &&
+                max_quality < YR_MAX_ATOM_QUALITY;
+         i++)
+    {
+      atom.length = yr_min(string_length - i, YR_MAX_ATOM_LENGTH);
+      memcpy(atom.bytes, string + i, atom.length);
+
+      quality = _yr_atoms_emitted_quality(config, &atom, modifier);
+
+      if (quality > max_quality)
+      {
+        memcpy(&item->atom, &atom, sizeof(atom));
+        item->backtrack = i;
+        max_quality = quality;
+      }
+    }
+  }
+  else
   {
-    atom.length = YR_MAX_ATOM_LENGTH;
-    memcpy(atom.bytes, string + i - YR_MAX_ATOM_LENGTH + 1, atom.length);
+    max_quality = config->get_atom_quality(config, &item->atom);
 
-    quality = config->get_atom_quality(config, &atom);
+    atom.length = YR_MAX_ATOM_LENGTH;
+    memset(atom.mask, 0xFF, atom.length);
 
-    if (quality > max_quality)
+    for (i = YR_MAX_ATOM_LENGTH;
+         i < string_length && max_quality < YR_MAX_ATOM_QUALITY;
+         i++)
     {
-      memcpy(&item->atom, &atom, sizeof(atom));
-      item->backtrack = i - YR_MAX_ATOM_LENGTH + 1;
-      max_quality = quality;
+      atom.length = YR_MAX_ATOM_LENGTH;
+      memcpy(atom.bytes, string + i - YR_MAX_ATOM_LENGTH + 1, atom.length);
+
+      quality = config->get_atom_quality(config, &atom);
+
+      if (quality > max_quality)
+      {
+        memcpy(&item->atom, &atom, sizeof(atom));
+        item->backtrack = i - YR_MAX_ATOM_LENGTH + 1;
+        max_quality = quality;
+      }
     }
   }
 
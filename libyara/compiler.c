@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -238,6 +239,8 @@ YR_API int yr_compiler_create(YR_COMPILER** compiler)
   new_compiler->include_free = _yr_compiler_default_include_free;
   new_compiler->re_ast_callback = NULL;
   new_compiler->re_ast_clbk_user_data = NULL;
+  new_compiler->atoms_callback = NULL;
+  new_compiler->atoms_clbk_user_data = NULL;
   new_compiler->last_error = ERROR_SUCCESS;
   new_compiler->last_error_line = 0;
   new_compiler->strict_escape = false;
@@ -357,6 +360,24 @@ YR_API void yr_compiler_set_re_ast_callback(
   compiler->re_ast_clbk_user_data = user_data;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Sets a function that is called for every string after its atoms have been
+// chosen, with the list of atoms that will be added to the Aho-Corasick
+// automaton and the quality of the worst one. This is meant for diagnosing
+// rules that produce too many or too poor atoms; the quality of individual
+// atoms can be obtained with yr_compiler_get_atom_quality. Regular
+// expressions and hex strings split at chaining points produce one call per
+// piece.
+//
+YR_API void yr_compiler_set_atoms_callback(
+    YR_COMPILER* compiler,
+    YR_COMPILER_ATOMS_CALLBACK_FUNC atoms_callback,
+    void* user_data)
+{
+  compiler->atoms_callback = atoms_callback;
+  compiler->atoms_clbk_user_data = user_data;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // This function allows to specify an atom quality table to be used by the
 // compiler for choosing the best atoms from regular expressions and strings.
@@ -393,6 +414,7 @@ YR_API void yr_compiler_set_atom_quality_table(
 {
   compiler->atoms_config.free_quality_table = false;
   compiler->atoms_config.quality_warning_threshold = warning_threshold;
+  compiler->atoms_config.rate_emitted_atoms = false;
   compiler->atoms_config.get_atom_quality = yr_atoms_table_quality;
   compiler->atoms_config.quality_table_entries = entries;
   compiler->atoms_config.quality_table = (YR_ATOM_QUALITY_TABLE_ENTRY*) table;
@@ -453,6 +475,57 @@ YR_API int yr_compiler_load_atom_quality_table(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Makes the compiler rate atoms with yr_atoms_frequency_quality, using the
+// number of times each byte value appears in a corpus of files like the ones
+// that will be scanned. "counts" must point to 256 counters, one per byte
+// value. A byte with frequency p contributes about 2 * -log2(p) points, capped
+// at the 20 points of an ordinary byte in yr_atoms_heuristic_quality, so a
+// byte as frequent as in uniformly random data is worth the same in both.
+//
+// In this mode the atom chosen from a literal string is also the one whose
+// wide and case-insensitive variants, which are what ends up in the
+// automaton, have the best quality.
+//
+// The "warning_threshold" argument has the same meaning as in
+// yr_compiler_set_atom_quality_table.
+//
+YR_API void yr_compiler_set_atom_byte_frequencies(
+    YR_COMPILER* compiler,
+    const uint64_t* counts,
+    unsigned char warning_threshold)
+{
+  double total = 256;
+
+  for (int i = 0; i < 256; i++) total += (double) counts[i];
+
+  for (int i = 0; i < 256; i++)
+  {
+    // Every count is increased by one so unseen bytes don't get an infinite
+    // score.
+    double bits = -log2(((double) counts[i] + 1) / total);
+
+    compiler->atoms_config.byte_quality[i] = (uint8_t) yr_min(
+        20, (int) (2 * bits + 0.5));
+  }
+
+  compiler->atoms_config.quality_warning_threshold = warning_threshold;
+  compiler->atoms_config.get_atom_quality = yr_atoms_frequency_quality;
+  compiler->atoms_config.rate_emitted_atoms = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the quality of an atom as rated by the compiler's current atom
+// quality function.
+//
+YR_API int yr_compiler_get_atom_quality(
+    YR_COMPILER* compiler,
+    const YR_ATOM* atom)
+{
+  return compiler->atoms_config.get_atom_quality(
+      &compiler->atoms_config, (YR_ATOM*) atom);
+}
+
 int _yr_compiler_push_file_name(YR_COMPILER* compiler, const char* file_name)
 {
   char* str;
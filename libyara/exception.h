@@ -224,7 +224,7 @@ static void exception_handler(int sig, siginfo_t * info, void *context)
 // Keep debug output indentation level consistent
 #if 0 == YR_DEBUG_VERBOSITY
 #define YR_DEBUG_INDENT_INITIAL 0
-#define YR_DEBUG_INDENT_SET(x)  ;
+#define YR_DEBUG_INDENT_SET(x)  (void) (x);
 #else
 extern YR_TLS int yr_debug_indent;
 // Ugly, but unfortunately cannot use ifdef macros inside a macro
@@ -443,7 +443,10 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
   YR_OBJECT_FUNCTION* function;
   YR_OBJECT** obj_ptr;
   YR_ARENA* obj_arena;
-  YR_NOTEBOOK* it_notebook;
+
+  // The stack and the iterators are taken from the scanner's notebook, which
+  // is reset when the scan finishes.
+  YR_NOTEBOOK* it_notebook = context->objects_notebook;
 
   char* identifier;
   char* args_fmt;
@@ -461,19 +464,13 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
   yr_get_configuration_uint32(YR_CONFIG_STACK_SIZE, &stack.capacity);
 
   stack.sp = 0;
-  stack.items = (YR_VALUE*) yr_malloc(stack.capacity * sizeof(YR_VALUE));
+  stack.items = (YR_VALUE*) yr_notebook_alloc(
+      it_notebook, stack.capacity * sizeof(YR_VALUE));
 
   if (stack.items == NULL)
     return ERROR_INSUFFICIENT_MEMORY;
 
-  FAIL_ON_ERROR_WITH_CLEANUP(
-      yr_arena_create(1, 512 * sizeof(YR_OBJECT*), &obj_arena),
-      yr_free(stack.items));
-
-  FAIL_ON_ERROR_WITH_CLEANUP(
-      yr_notebook_create(512 * sizeof(YR_ITERATOR), &it_notebook),
-      yr_arena_release(obj_arena);
-      yr_free(stack.items));
+  FAIL_ON_ERROR(yr_arena_create(1, 512 * sizeof(YR_OBJECT*), &obj_arena));
 
 #ifdef YR_PROFILING_ENABLED
   start_time = yr_stopwatch_elapsed_ns(&context->stopwatch);
@@ -1251,6 +1248,17 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
       pop(r1);
       ensure_defined(r1);
 
+      if (object_as_structure(r1.o)->populate != NULL)
+      {
+        result = yr_object_populate(r1.o, identifier);
+
+        if (result != ERROR_SUCCESS)
+        {
+          stop = true;
+          break;
+        }
+      }
+
       r1.o = yr_object_lookup_field(r1.o, identifier);
 
       if (r1.o == NULL)
@@ -2378,9 +2386,7 @@ int yr_execute_code(YR_SCAN_CONTEXT* context)
   for (int i = 0; i < obj_count; i++) yr_object_destroy(obj_ptr[i]);
 
   yr_arena_release(obj_arena);
-  yr_notebook_destroy(it_notebook);
   yr_modules_unload_all(context);
-  yr_free(stack.items);
 
   YR_DEBUG_FPRINTF(
       2,
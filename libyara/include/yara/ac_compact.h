@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef YR_AC_COMPACT_H
+#define YR_AC_COMPACT_H
+
+#include <yara/integers.h>
+#include <yara/types.h>
+
+// Flags in the low bits of YR_AC_COMPACT entries. The rest of the entry is
+// a row index, or the slot of a deeper state if YR_AC_COMPACT_DEEP is set.
+#define YR_AC_COMPACT_MATCHES 0x1
+#define YR_AC_COMPACT_DEEP    0x2
+#define YR_AC_COMPACT_SHIFT   2
+
+#define YR_AC_COMPACT_ENTRY(value, flags) \
+  ((uint32_t) (((value) << YR_AC_COMPACT_SHIFT) | (flags)))
+
+#define YR_AC_COMPACT_VALUE(entry) ((entry) >> YR_AC_COMPACT_SHIFT)
+
+////////////////////////////////////////////////////////////////////////////////
+// YR_AC_COMPACT is an alternative layout for the top of the Aho-Corasick
+// automaton, built when the rules are loaded and the slot-packed transition
+// table is too large to stay in cache. Row 0 is the root state and there's
+// one row for each state at depth 1, each with 256 entries that already
+// account for failure links. While the automaton is at depth 0 or 1 every
+// byte costs a single load from these rows, and the match table is only
+// looked up when the entry says the target state has matches. Deeper
+// states use the slot-packed table as usual.
+//
+// The rows are opt-in: they are only built for rules loaded while
+// YR_CONFIG_AC_COMPACT is non-zero (the default is zero), and only used by
+// scans that start while it still is. Measure first; on some CPUs the extra
+// row loads cost more than the cache misses they save.
+//
+// A state at depth 1 is the one reached from the root with the last byte
+// read, so after a step in the slot-packed table the scanner can tell it's
+// back at depth 0 or 1 by comparing the new state with the root's target
+// for that byte.
+//
+struct YR_AC_COMPACT
+{
+  uint32_t num_rows;
+
+  // Slot in the transition table of the state for each row. Zero for the
+  // root state in row 0.
+  uint32_t* row_slot;
+
+  // num_rows * 256 entries, made with YR_AC_COMPACT_ENTRY.
+  uint32_t* rows;
+};
+
+int yr_ac_compact_create(YR_RULES* rules, YR_AC_COMPACT** compact);
+
+void yr_ac_compact_destroy(YR_AC_COMPACT* compact);
+
+#endif
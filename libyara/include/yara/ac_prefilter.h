@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2026. The YARA Authors. All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef YR_AC_PREFILTER_H
+#define YR_AC_PREFILTER_H
+
+#include <yara/bitmask.h>
+#include <yara/integers.h>
+#include <yara/types.h>
+
+// Values for YR_CONFIG_AC_PREFILTER. Requesting a level the CPU doesn't
+// support selects the best one it does.
+#define YR_AC_PREFILTER_NONE   0
+#define YR_AC_PREFILTER_SCALAR 1
+#define YR_AC_PREFILTER_SSE42  2
+#define YR_AC_PREFILTER_AVX2   3
+
+// Number of buckets in the nibble filter, one bit each in the mask bytes.
+#define YR_AC_PREFILTER_BUCKETS 8
+
+////////////////////////////////////////////////////////////////////////////////
+// YR_AC_PREFILTER is derived from the Aho-Corasick transition table when
+// rules are loaded. While the automaton sits at the root state, a byte pair
+// that can't move it below depth 1 (or hit a 1-byte atom) leaves it at the
+// root again, so the scanner can jump straight to the next position whose
+// pair is in "pairs". The SIMD variants find candidates with a Teddy-style
+// nibble filter (lo/hi masks for the first and second byte, one bit per
+// bucket) and confirm them against "pairs".
+//
+struct YR_AC_PREFILTER
+{
+  // False when the root state has matches of its own (atoms of length 0),
+  // in which case no position can be skipped.
+  bool enabled;
+
+  // Bytes with a transition out of the root state.
+  uint8_t first[256];
+
+  // Bit (b0 << 8 | b1) is set when the pair b0 b1 is a candidate position.
+  YR_BITMASK pairs[YR_BITMASK_SIZE(65536)];
+
+  uint8_t lo1[16];
+  uint8_t hi1[16];
+  uint8_t lo2[16];
+  uint8_t hi2[16];
+};
+
+int yr_ac_prefilter_create(YR_RULES* rules, YR_AC_PREFILTER** prefilter);
+
+void yr_ac_prefilter_destroy(YR_AC_PREFILTER* prefilter);
+
+uint32_t yr_ac_prefilter_best_supported(void);
+
+// Returns the first candidate position in [start, size), or size.
+size_t yr_ac_prefilter_next(
+    const YR_AC_PREFILTER* prefilter,
+    uint32_t level,
+    const uint8_t* data,
+    size_t start,
+    size_t size);
+
+#endif
@@ -102,9 +102,18 @@ struct YR_ATOMS_CONFIG
   YR_ATOMS_QUALITY_FUNC get_atom_quality;
   YR_ATOM_QUALITY_TABLE_ENTRY* quality_table;
 
+  // Points contributed by each byte value in yr_atoms_frequency_quality,
+  // derived from the counts passed to yr_compiler_set_atom_byte_frequencies.
+  uint8_t byte_quality[256];
+
   int quality_warning_threshold;
   int quality_table_entries;
   bool free_quality_table;
+
+  // When true, the atom chosen from a literal string is the one whose wide
+  // and case-insensitive variants have the best quality, instead of the one
+  // with the best plain ASCII quality.
+  bool rate_emitted_atoms;
 };
 
 int yr_atoms_extract_from_re(
@@ -128,6 +137,8 @@ int yr_atoms_heuristic_quality(YR_ATOMS_CONFIG* config, YR_ATOM* atom);
 
 int yr_atoms_table_quality(YR_ATOMS_CONFIG* config, YR_ATOM* atom);
 
+int yr_atoms_frequency_quality(YR_ATOMS_CONFIG* config, YR_ATOM* atom);
+
 int yr_atoms_min_quality(YR_ATOMS_CONFIG* config, YR_ATOM_LIST_ITEM* atom_list);
 
 void yr_atoms_list_destroy(YR_ATOM_LIST_ITEM* list_head);
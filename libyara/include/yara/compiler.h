@@ -151,6 +151,13 @@ typedef void (*YR_COMPILER_RE_AST_CALLBACK_FUNC)(
     const RE_AST* re_ast,
     void* user_data);
 
+typedef void (*YR_COMPILER_ATOMS_CALLBACK_FUNC)(
+    const YR_RULE* rule,
+    const char* string_identifier,
+    const YR_ATOM_LIST_ITEM* atoms,
+    int min_atom_quality,
+    void* user_data);
+
 typedef struct _YR_FIXUP
 {
   YR_ARENA_REF ref;
@@ -307,11 +314,13 @@ typedef struct _YR_COMPILER
   void* user_data;
   void* incl_clbk_user_data;
   void* re_ast_clbk_user_data;
+  void* atoms_clbk_user_data;
 
   YR_COMPILER_CALLBACK_FUNC callback;
   YR_COMPILER_INCLUDE_CALLBACK_FUNC include_callback;
   YR_COMPILER_INCLUDE_FREE_FUNC include_free;
   YR_COMPILER_RE_AST_CALLBACK_FUNC re_ast_callback;
+  YR_COMPILER_ATOMS_CALLBACK_FUNC atoms_callback;
   YR_ATOMS_CONFIG atoms_config;
 
 } YR_COMPILER;
@@ -374,6 +383,11 @@ YR_API void yr_compiler_set_re_ast_callback(
     YR_COMPILER_RE_AST_CALLBACK_FUNC re_ast_callback,
     void* user_data);
 
+YR_API void yr_compiler_set_atoms_callback(
+    YR_COMPILER* compiler,
+    YR_COMPILER_ATOMS_CALLBACK_FUNC atoms_callback,
+    void* user_data);
+
 YR_API void yr_compiler_set_atom_quality_table(
     YR_COMPILER* compiler,
     const void* table,
@@ -385,6 +399,15 @@ YR_API int yr_compiler_load_atom_quality_table(
     const char* filename,
     unsigned char warning_threshold);
 
+YR_API void yr_compiler_set_atom_byte_frequencies(
+    YR_COMPILER* compiler,
+    const uint64_t* counts,
+    unsigned char warning_threshold);
+
+YR_API int yr_compiler_get_atom_quality(
+    YR_COMPILER* compiler,
+    const YR_ATOM* atom);
+
 YR_API int yr_compiler_add_file(
     YR_COMPILER* compiler,
     FILE* rules_file,
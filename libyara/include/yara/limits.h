@@ -84,6 +84,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   YR_MAX_ATOM_QUALITY - 22 * YR_MAX_ATOM_LENGTH + 38
 #endif
 
+// Bytes rated below this quality by yr_atoms_frequency_quality are treated
+// as common, like 0x00, 0x20, 0xCC and 0xFF in yr_atoms_heuristic_quality,
+// and atoms consisting only of one of them repeated are penalized.
+#ifndef YR_ATOM_COMMON_BYTE_QUALITY
+#define YR_ATOM_COMMON_BYTE_QUALITY 12
+#endif
+
 // If a rule generates more than this number of atoms a warning is shown.
 #ifndef YR_ATOMS_PER_RULE_WARNING_THRESHOLD
 #define YR_ATOMS_PER_RULE_WARNING_THRESHOLD 12000
@@ -125,6 +132,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define YR_FILE_SIZE_THRESHOLD 200000
 #endif
 
+// Size in slots of the Aho-Corasick transition table from which the rules
+// also get the dense rows described in ac_compact.h, if YR_CONFIG_AC_COMPACT
+// is set. Smaller tables stay in cache anyway.
+#ifndef YR_AC_COMPACT_MIN_SLOTS
+#define YR_AC_COMPACT_MIN_SLOTS 16384
+#endif
+
+// Number of buffers whose Aho-Corasick scans are interleaved on the same
+// thread by yr_scanner_scan_mem_multi.
+#ifndef YR_MAX_INTERLEAVED_SCANS
+#define YR_MAX_INTERLEAVED_SCANS 8
+#endif
+
+// Maximum amount of memory that a scanner keeps between scans in each of its
+// notebooks (matches and module objects). A scan can use more than that, but
+// the excess is freed once the scan finishes.
+#ifndef YR_SCANNER_MAX_RETAINED_MEMORY
+#define YR_SCANNER_MAX_RETAINED_MEMORY (16 * 1024 * 1024)
+#endif
+
 // Maximum number of argument that a function in a YARA module can have.
 #ifndef YR_MAX_FUNCTION_ARGS
 #define YR_MAX_FUNCTION_ARGS 128
@@ -179,4 +206,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define RE_MAX_FIBERS 1024
 #endif
 
+// Maximum number of positions that yr_re_fast_exec keeps in the stack. Hex
+// strings with more live positions are executed with a list of positions
+// allocated from a pool.
+#ifndef RE_FAST_EXEC_MAX_POSITIONS
+#define RE_FAST_EXEC_MAX_POSITIONS 128
+#endif
+
+// Maximum number of states in the DFA that yr_re_exec builds lazily for each
+// regexp. When the limit is reached the DFA is flushed and the current
+// execution continues with fibers.
+#ifndef RE_DFA_MAX_STATES
+#define RE_DFA_MAX_STATES 512
+#endif
+
+// Maximum number of times a DFA can be flushed before yr_re_exec stops using
+// it for that regexp.
+#ifndef RE_DFA_MAX_FLUSHES
+#define RE_DFA_MAX_FLUSHES 8
+#endif
+
+// Maximum memory used by all the DFAs in a scan context.
+#ifndef RE_DFA_MAX_MEMORY
+#define RE_DFA_MAX_MEMORY (16 * 1024 * 1024)
+#endif
+
 #endif
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef YR_MEM_H
 #define YR_MEM_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <yara/utils.h>
 
@@ -64,4 +65,24 @@ int yr_heap_alloc(void);
 
 int yr_heap_free(void);
 
+#ifdef YR_PROFILING_ENABLED
+
+// Process-wide counters of the calls to the allocation functions above, used
+// for measuring how much heap traffic a scan generates.
+typedef struct YR_ALLOCATION_COUNTERS
+{
+  // Calls to yr_malloc, yr_calloc, yr_realloc, yr_strdup and yr_strndup.
+  uint64_t allocations;
+  // Calls to yr_free with a non-null pointer.
+  uint64_t frees;
+  // Bytes requested by the allocations.
+  uint64_t bytes;
+} YR_ALLOCATION_COUNTERS;
+
+YR_API void yr_get_allocation_counters(YR_ALLOCATION_COUNTERS* counters);
+
+YR_API void yr_reset_allocation_counters(void);
+
+#endif
+
 #endif
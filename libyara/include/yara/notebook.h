@@ -15,4 +15,6 @@ int yr_notebook_destroy(YR_NOTEBOOK* pool);
 
 void* yr_notebook_alloc(YR_NOTEBOOK* notebook, size_t size);
 
+void yr_notebook_reset(YR_NOTEBOOK* notebook, size_t max_size);
+
 #endif  // YR_NOTEBOOK_H
@@ -69,6 +69,12 @@ int yr_object_create(
     YR_OBJECT* parent,
     YR_OBJECT** object);
 
+int yr_object_create_in_notebook(
+    YR_NOTEBOOK* notebook,
+    int8_t type,
+    const char* identifier,
+    YR_OBJECT** object);
+
 void yr_object_set_canary(YR_OBJECT* object, int canary);
 
 int yr_object_function_create(
@@ -144,6 +150,8 @@ int yr_object_structure_set_member(YR_OBJECT* object, YR_OBJECT* member);
 
 YR_OBJECT* yr_object_get_root(YR_OBJECT* object);
 
+YR_API int yr_object_populate(YR_OBJECT* object, const char* field_name);
+
 YR_API void yr_object_print_data(
     YR_OBJECT* object,
     int indent,
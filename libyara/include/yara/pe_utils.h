@@ -48,6 +48,45 @@ typedef struct _IMPORT_FUNCTION
 
 } IMPORT_FUNCTION, *PIMPORT_FUNCTION;
 
+//
+// Open-addressing hash index over a list of imported DLLs, or over the
+// exported functions. The pe module builds one the first time a rule calls
+// pe.imports() or pe.exports(). Each slot points at the parsed names instead
+// of copying them.
+//
+typedef struct _PE_INDEX_SLOT
+{
+  uint32_t hash;
+  uint32_t kind;
+
+  // Number of functions in DLL slots, position in export_details in export
+  // slots.
+  uint32_t value;
+  int64_t ordinal;
+
+  // IMPORTED_DLL* for imports, SIZED_STRING* for exports.
+  const void* name;
+  const IMPORT_FUNCTION* function;
+
+} PE_INDEX_SLOT;
+
+typedef struct _PE_REGEXP_RESULT
+{
+  const void* regexps[2];
+  int64_t result;
+
+  struct _PE_REGEXP_RESULT* next;
+
+} PE_REGEXP_RESULT;
+
+typedef struct _PE_INDEX
+{
+  uint32_t mask;
+  PE_REGEXP_RESULT* regexp_results;
+  PE_INDEX_SLOT slots[1];
+
+} PE_INDEX;
+
 typedef struct _PE
 {
   const uint8_t* data;
@@ -64,9 +103,19 @@ typedef struct _PE
   IMPORTED_DLL* imported_dlls;
   IMPORTED_DLL* delay_imported_dlls;
 
+  // Indexes for pe.imports() and pe.exports(), built on first use.
+  PE_INDEX* imported_dlls_index;
+  PE_INDEX* delay_imported_dlls_index;
+  PE_INDEX* exports_index;
+
   uint32_t resources;
   uint32_t version_infos;
 
+  // Base address of the block holding the PE, and the PE_PART_* flags of
+  // the parts already parsed.
+  uint64_t base_address;
+  int parsed;
+
 } PE;
 
 #define fits_in_pe(pe, pointer, size)                                     \
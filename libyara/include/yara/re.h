@@ -149,6 +149,8 @@ int yr_re_exec(
     void* callback_args,
     int* matches);
 
+void yr_re_dfa_cache_destroy(RE_DFA_CACHE* cache);
+
 int yr_re_fast_exec(
     YR_SCAN_CONTEXT* context,
     const uint8_t* code,
@@ -78,6 +78,15 @@ YR_API int yr_scanner_scan_mem(
     const uint8_t* buffer,
     size_t buffer_size);
 
+YR_API int yr_scanner_scan_mem_multi(
+    YR_SCANNER** scanners,
+    int num_scanners,
+    const uint8_t** buffers,
+    const size_t* buffer_sizes,
+    void** user_data,
+    int* results,
+    int count);
+
 YR_API int yr_scanner_scan_file(YR_SCANNER* scanner, const char* filename);
 
 YR_API int yr_scanner_scan_fd(YR_SCANNER* scanner, YR_FILE_DESCRIPTOR fd);
@@ -159,6 +159,8 @@ typedef struct RE_ERROR RE_ERROR;
 typedef struct RE_FIBER RE_FIBER;
 typedef struct RE_FIBER_LIST RE_FIBER_LIST;
 typedef struct RE_FIBER_POOL RE_FIBER_POOL;
+typedef struct RE_DFA RE_DFA;
+typedef struct RE_DFA_CACHE RE_DFA_CACHE;
 typedef struct RE_FAST_EXEC_POSITION RE_FAST_EXEC_POSITION;
 typedef struct RE_FAST_EXEC_POSITION_LIST RE_FAST_EXEC_POSITION_LIST;
 typedef struct RE_FAST_EXEC_POSITION_POOL RE_FAST_EXEC_POSITION_POOL;
@@ -168,6 +170,8 @@ typedef struct YR_AC_AUTOMATON YR_AC_AUTOMATON;
 typedef struct YR_AC_TABLES YR_AC_TABLES;
 typedef struct YR_AC_MATCH_LIST_ENTRY YR_AC_MATCH_LIST_ENTRY;
 typedef struct YR_AC_MATCH YR_AC_MATCH;
+typedef struct YR_AC_PREFILTER YR_AC_PREFILTER;
+typedef struct YR_AC_COMPACT YR_AC_COMPACT;
 
 typedef struct YR_NAMESPACE YR_NAMESPACE;
 typedef struct YR_META YR_META;
@@ -179,6 +183,7 @@ typedef struct YR_SUMMARY YR_SUMMARY;
 typedef struct YR_RULES_STATS YR_RULES_STATS;
 typedef struct YR_PROFILING_INFO YR_PROFILING_INFO;
 typedef struct YR_RULE_PROFILING_INFO YR_RULE_PROFILING_INFO;
+typedef struct YR_STRING_PROFILING_INFO YR_STRING_PROFILING_INFO;
 typedef struct YR_EXTERNAL_VARIABLE YR_EXTERNAL_VARIABLE;
 typedef struct YR_MATCH YR_MATCH;
 typedef struct YR_SCAN_CONTEXT YR_SCAN_CONTEXT;
@@ -452,6 +457,23 @@ struct RE_FIBER_POOL
   RE_FIBER_LIST fibers;
 };
 
+struct RE_DFA_CACHE
+{
+  // Open addressing table with the lazily built DFAs used by yr_re_exec,
+  // indexed by regexp code and flags. yr_re_exec looks up this table every
+  // time it's called, so it doesn't use YR_HASH_TABLE.
+  RE_DFA** dfas;
+  size_t dfas_size;
+  size_t dfas_count;
+
+  // Bytes currently allocated by all the DFAs in the table.
+  size_t memory;
+
+  // Scratch buffer used while computing DFA transitions.
+  uint32_t* scratch;
+  size_t scratch_capacity;
+};
+
 struct RE_FAST_EXEC_POSITION
 {
   int round;
@@ -630,6 +652,15 @@ struct YR_RULES
 
   // Total number of namespaces.
   uint32_t num_namespaces;
+
+  // Root-state skip tables derived from ac_transition_table, see
+  // ac_prefilter.h.
+  YR_AC_PREFILTER* ac_prefilter;
+
+  // Dense rows for the top of the automaton, see ac_compact.h. NULL unless
+  // YR_CONFIG_AC_COMPACT was set when the rules were loaded and the
+  // transition table is too large to be used as it is.
+  YR_AC_COMPACT* ac_compact;
 };
 
 struct YR_RULES_STATS
@@ -682,6 +713,24 @@ struct YR_PROFILING_INFO
   uint64_t exec_time;
 };
 
+//
+// YR_STRING_PROFILING_INFO contains profiling information for a string.
+//
+struct YR_STRING_PROFILING_INFO
+{
+  // Number of times that some atom belonging to the string matched.
+  uint64_t atom_matches;
+
+  // Number of those atom matches that turned out to be actual matches for
+  // the string.
+  uint64_t verified_matches;
+
+  // Amount of time (in nanoseconds) spent verifying atom matches for the
+  // string. Sampled like YR_PROFILING_INFO.match_time: only 1 out of
+  // YR_MATCH_VERIFICATION_PROFILING_RATE matches is measured.
+  uint64_t match_time;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // YR_RULE_PROFILING_INFO is the structure returned by
 // yr_scanner_get_profiling_info
@@ -720,7 +769,9 @@ YR_API const uint8_t* yr_fetch_block_data(YR_MEMORY_BLOCK* self);
 // function is invoked for retrieving the first memory block, followed by calls
 // to "next" for retrieving the following blocks until "next" returns a NULL
 // pointer. The "file_size" function is called for obtaining the size of the
-// file.
+// file. Unless the scan has SCAN_FLAGS_PROCESS_MEMORY set, the data fetched
+// for the first block must stay valid until the scan finishes, modules may
+// parse it lazily while rules are evaluated.
 struct YR_MEMORY_BLOCK_ITERATOR
 {
   // A pointer that can be used by specific implementations of an iterator for
@@ -792,15 +843,23 @@ struct YR_SCAN_CONTEXT
   YR_HASH_TABLE* objects_table;
 
   // Notebook used for storing YR_MATCH structures associated to the matches
-  // found.
+  // found. It lives as long as the scanner and is reset after each scan.
   YR_NOTEBOOK* matches_notebook;
 
+  // Notebook holding the objects created by modules, the iterators and the
+  // stack used while evaluating conditions. Like matches_notebook, it is
+  // reset after each scan.
+  YR_NOTEBOOK* objects_notebook;
+
   // Stopwatch used for measuring the time elapsed during the scan.
   YR_STOPWATCH stopwatch;
 
   // Fiber pool used by yr_re_exec.
   RE_FIBER_POOL re_fiber_pool;
 
+  // DFAs built by yr_re_exec for the regexps executed in this context.
+  RE_DFA_CACHE re_dfa_cache;
+
   // Pool used by yr_re_fast_exec.
   RE_FAST_EXEC_POSITION_POOL re_fast_exec_position_pool;
 
@@ -835,6 +894,10 @@ struct YR_SCAN_CONTEXT
   // profiling_info is a pointer to an array of YR_PROFILING_INFO structures,
   // one per rule. Entry N has the profiling information for rule with index N.
   YR_PROFILING_INFO* profiling_info;
+
+  // string_profiling_info is like profiling_info but with one entry per
+  // string. Entry N has the profiling information for string with index N.
+  YR_STRING_PROFILING_INFO* string_profiling_info;
 };
 
 union YR_VALUE
@@ -856,11 +919,15 @@ struct YR_VALUE_STACK
   YR_VALUE* items;
 };
 
+// Objects with a notebook are allocated from it together with everything
+// they own (identifier, members, items and string values), and are freed
+// when the notebook is reset, not by yr_object_destroy.
 #define OBJECT_COMMON_FIELDS \
   int canary;                \
   int8_t type;               \
   const char* identifier;    \
   YR_OBJECT* parent;         \
+  YR_NOTEBOOK* notebook;     \
   void* data;
 
 struct YR_OBJECT
@@ -869,10 +936,18 @@ struct YR_OBJECT
   YR_VALUE value;
 };
 
+typedef int (*YR_OBJECT_POPULATE_FUNC)(
+    YR_OBJECT* object,
+    const char* field_name);
+
 struct YR_OBJECT_STRUCTURE
 {
   OBJECT_COMMON_FIELDS
   YR_STRUCTURE_MEMBER* members;
+
+  // Set by modules that fill in parts of their object tree only when a rule
+  // uses them, see yr_object_populate.
+  YR_OBJECT_POPULATE_FUNC populate;
 };
 
 struct YR_OBJECT_ARRAY
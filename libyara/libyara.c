@@ -34,12 +34,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
+#include <yara/ac_prefilter.h>
 #include <yara/error.h>
 #include <yara/globals.h>
 #include <yara/mem.h>
 #include <yara/modules.h>
 #include <yara/re.h>
 #include <yara/threading.h>
+#include <yara/utils.h>
 
 #include "crypto.h"
 
@@ -246,6 +248,8 @@ YR_API int yr_initialize(void)
   uint32_t def_max_strings_per_rule = DEFAULT_MAX_STRINGS_PER_RULE;
   uint32_t def_max_match_data = DEFAULT_MAX_MATCH_DATA;
   uint64_t def_max_process_memory_chunk = DEFAULT_MAX_PROCESS_MEMORY_CHUNK;
+  uint32_t def_ac_prefilter = YR_AC_PREFILTER_AVX2;
+  uint32_t def_ac_compact = 0;
 
   init_count++;
 
@@ -312,6 +316,11 @@ YR_API int yr_initialize(void)
   FAIL_ON_ERROR(
       yr_set_configuration(YR_CONFIG_MAX_MATCH_DATA, &def_max_match_data));
 
+  FAIL_ON_ERROR(
+      yr_set_configuration(YR_CONFIG_AC_PREFILTER, &def_ac_prefilter));
+
+  FAIL_ON_ERROR(yr_set_configuration(YR_CONFIG_AC_COMPACT, &def_ac_compact));
+
   YR_DEBUG_FPRINTF(2, stderr, "} // %s()\n", __FUNCTION__);
 
   return ERROR_SUCCESS;
@@ -385,6 +394,8 @@ YR_API int yr_finalize(void)
 //              YR_CONFIG_MAX_STRINGS_PER_RULE      data type: uint32_t
 //              YR_CONFIG_MAX_MATCH_DATA            data type: uint32_t
 //              YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK  data type: uint64_t
+//              YR_CONFIG_AC_PREFILTER              data type: uint32_t
+//              YR_CONFIG_AC_COMPACT                data type: uint32_t
 //
 //   src: Pointer to the value being set for the option.
 //
@@ -402,9 +413,16 @@ YR_API int yr_set_configuration(YR_CONFIG_NAME name, void *src)
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
+  case YR_CONFIG_AC_COMPACT:
     yr_cfgs[name].ui32 = *(uint32_t *) src;
     break;
 
+  case YR_CONFIG_AC_PREFILTER:
+    // Levels the CPU can't run fall back to the best one it can.
+    yr_cfgs[name].ui32 = yr_min(
+        *(uint32_t *) src, yr_ac_prefilter_best_supported());
+    break;
+
   case YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK:
     yr_cfgs[name].ui64 = *(uint64_t *) src;
     break;
@@ -437,6 +455,12 @@ YR_API int yr_set_configuration_uint32(YR_CONFIG_NAME name, uint32_t value)
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
     return yr_set_configuration(name, &value);
+  // A call of its own, so that GCC doesn't see a uint64_t read of value
+  // among the cases reachable from the one above (-Warray-bounds).
+  case YR_CONFIG_AC_PREFILTER:
+    return yr_set_configuration(YR_CONFIG_AC_PREFILTER, &value);
+  case YR_CONFIG_AC_COMPACT:
+    return yr_set_configuration(YR_CONFIG_AC_COMPACT, &value);
   default:
     return ERROR_INVALID_ARGUMENT;
   }
@@ -475,6 +499,8 @@ YR_API int yr_set_configuration_uint64(YR_CONFIG_NAME name, uint64_t value)
 //              YR_CONFIG_MAX_STRINGS_PER_RULE      data type: uint32_t
 //              YR_CONFIG_MAX_MATCH_DATA            data type: uint32_t
 //              YR_CONFIG_MAX_PROCESS_MEMORY_CHUNK  data type: uint64_t
+//              YR_CONFIG_AC_PREFILTER              data type: uint32_t
+//              YR_CONFIG_AC_COMPACT                data type: uint32_t
 //
 //   dest: Pointer to a variable that will receive the value for the option.
 //
@@ -492,6 +518,8 @@ YR_API int yr_get_configuration(YR_CONFIG_NAME name, void *dest)
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
+  case YR_CONFIG_AC_PREFILTER:
+  case YR_CONFIG_AC_COMPACT:
     *(uint32_t *) dest = yr_cfgs[name].ui32;
     break;
 
@@ -526,6 +554,8 @@ YR_API int yr_get_configuration_uint32(YR_CONFIG_NAME name, uint32_t *dest)
   case YR_CONFIG_STACK_SIZE:
   case YR_CONFIG_MAX_STRINGS_PER_RULE:
   case YR_CONFIG_MAX_MATCH_DATA:
+  case YR_CONFIG_AC_PREFILTER:
+  case YR_CONFIG_AC_COMPACT:
     return yr_get_configuration(name, (void *) dest);
   default:
     return ERROR_INVALID_ARGUMENT;
@@ -30,6 +30,58 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/error.h>
 #include <yara/mem.h>
 
+#ifdef YR_PROFILING_ENABLED
+
+#include <string.h>
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+#include <windows.h>
+#define _yr_counter_add(counter, n) \
+  InterlockedExchangeAdd64((volatile LONG64*) &(counter), (LONG64) (n))
+#else
+#define _yr_counter_add(counter, n) \
+  __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#endif
+
+static YR_ALLOCATION_COUNTERS allocation_counters;
+
+static void _yr_count_allocation(size_t size)
+{
+  _yr_counter_add(allocation_counters.allocations, 1);
+  _yr_counter_add(allocation_counters.bytes, (uint64_t) size);
+}
+
+static void _yr_count_free(void* ptr)
+{
+  if (ptr != NULL)
+    _yr_counter_add(allocation_counters.frees, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Copies the allocation counters into the given structure. The counters keep
+// changing while other threads allocate memory, so the copy is accurate only
+// when nothing else is running.
+//
+YR_API void yr_get_allocation_counters(YR_ALLOCATION_COUNTERS* counters)
+{
+  *counters = allocation_counters;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sets the allocation counters to zero. Must not race with any allocation.
+//
+YR_API void yr_reset_allocation_counters(void)
+{
+  memset(&allocation_counters, 0, sizeof(allocation_counters));
+}
+
+#else
+
+#define _yr_count_allocation(size)
+#define _yr_count_free(ptr)
+
+#endif
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 
 #include <string.h>
@@ -57,16 +109,20 @@ int yr_heap_free(void)
 
 void* yr_calloc(size_t count, size_t size)
 {
+  _yr_count_allocation(count * size);
   return (void*) HeapAlloc(hHeap, HEAP_ZERO_MEMORY, count * size);
 }
 
 void* yr_malloc(size_t size)
 {
+  _yr_count_allocation(size);
   return (void*) HeapAlloc(hHeap, HEAP_ZERO_MEMORY, size);
 }
 
 void* yr_realloc(void* ptr, size_t size)
 {
+  _yr_count_allocation(size);
+
   if (ptr == NULL)
     return (void*) HeapAlloc(hHeap, HEAP_ZERO_MEMORY, size);
 
@@ -103,6 +159,7 @@ char* yr_strndup(const char* str, size_t n)
 
 YR_API void yr_free(void* ptr)
 {
+  _yr_count_free(ptr);
   HeapFree(hHeap, 0, ptr);
 }
 
@@ -128,31 +185,37 @@ int yr_heap_free(void)
 
 void* yr_calloc(size_t count, size_t size)
 {
+  _yr_count_allocation(count * size);
   return calloc(count, size);
 }
 
 void* yr_malloc(size_t size)
 {
+  _yr_count_allocation(size);
   return malloc(size);
 }
 
 void* yr_realloc(void* ptr, size_t size)
 {
+  _yr_count_allocation(size);
   return realloc(ptr, size);
 }
 
 char* yr_strdup(const char* str)
 {
+  _yr_count_allocation(strlen(str) + 1);
   return strdup(str);
 }
 
 char* yr_strndup(const char* str, size_t n)
 {
+  _yr_count_allocation(strnlen(str, n) + 1);
   return strndup(str, n);
 }
 
 YR_API void yr_free(void* ptr)
 {
+  _yr_count_free(ptr);
   free(ptr);
 }
 
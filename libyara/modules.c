@@ -119,8 +119,13 @@ int yr_modules_load(const char* module_name, YR_SCAN_CONTEXT* context)
 
   // not loaded yet
 
-  FAIL_ON_ERROR(yr_object_create(
-      OBJECT_TYPE_STRUCTURE, module_name, NULL, &module_structure));
+  // The module's objects are rebuilt on every scan, so they are taken from
+  // the scanner's notebook instead of the heap.
+  FAIL_ON_ERROR(yr_object_create_in_notebook(
+      context->objects_notebook,
+      OBJECT_TYPE_STRUCTURE,
+      module_name,
+      &module_structure));
 
   // initialize canary for module's top-level structure, every other object
   // within the module inherits the same canary.
@@ -162,6 +167,9 @@ int yr_modules_load(const char* module_name, YR_SCAN_CONTEXT* context)
     }
   }
 
+  // Modules may defer parts of their data until a rule reads them (see
+  // yr_object_populate); callbacks that walk the whole structure should
+  // populate it first.
   result = context->callback(
       context,
       CALLBACK_MSG_MODULE_IMPORTED,
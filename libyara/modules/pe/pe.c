@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <yara/dotnet.h>
 #include <yara/endian.h>
+#include <yara/globals.h>
 #include <yara/limits.h>
 #include <yara/mem.h>
 #include <yara/modules.h>
@@ -90,6 +91,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_IMPORT_DLL_NAME_LENGTH 256
 #define MAX_RESOURCES              65536
 
+// Parts of a PE that are parsed only when a rule first reads one of the
+// fields they fill in. See pe_populate.
+#define PE_PART_RICH_SIGNATURE  0x01
+#define PE_PART_DEBUG_DIRECTORY 0x02
+#define PE_PART_RESOURCES       0x04
+#define PE_PART_CERTIFICATES    0x08
+#define PE_PART_IMPORTS         0x10
+#define PE_PART_DELAYED_IMPORTS 0x20
+#define PE_PART_EXPORTS         0x40
+#define PE_PART_ALL             0x7F
+
+// Kinds of slots in a PE_INDEX. See pe_imports_index and pe_exports_index.
+#define PE_INDEX_EMPTY    0
+#define PE_INDEX_FUNCTION 1
+#define PE_INDEX_ORDINAL  2
+#define PE_INDEX_DLL      3
+#define PE_INDEX_EXPORT   4
+
+// FNV-1a, over lowercased bytes for names.
+#define PE_INDEX_SEED  2166136261U
+#define PE_INDEX_PRIME 16777619U
+
 #define IS_RESOURCE_SUBDIRECTORY(entry) \
   (yr_le32toh((entry)->OffsetToData) & 0x80000000)
 
@@ -1547,6 +1570,7 @@ static void pe_parse_exports(PE* pe)
   DWORD* names = NULL;
   WORD* ordinals = NULL;
   DWORD* function_addrs = NULL;
+  uint32_t* name_indexes = NULL;
 
   // If not a PE file, return YR_UNDEFINED
 
@@ -1666,6 +1690,28 @@ static void pe_parse_exports(PE* pe)
   //
   // If the RVA from the address array is within the export directory it is a
   // forwarder RVA and points to a NULL terminated ASCII string.
+  //
+  // The ordinal array is inverted up front so that finding the name of each
+  // export doesn't walk it again. The first entry wins, as it did when the
+  // array was searched. If the allocation fails it's searched as before.
+
+  if (names != NULL)
+  {
+    name_indexes = (uint32_t*) yr_malloc(number_of_exports * sizeof(uint32_t));
+
+    if (name_indexes != NULL)
+    {
+      for (i = 0; i < number_of_exports; i++) name_indexes[i] = number_of_names;
+
+      for (j = number_of_names; j > 0; j--)
+      {
+        uint16_t ordinal = yr_le16toh(ordinals[j - 1]);
+
+        if (ordinal < number_of_exports)
+          name_indexes[ordinal] = j - 1;
+      }
+    }
+  }
 
   for (i = 0; i < number_of_exports; i++)
   {
@@ -1703,31 +1749,40 @@ static void pe_parse_exports(PE* pe)
 
     if (names != NULL)
     {
-      for (j = 0; j < number_of_exports; j++)
+      if (name_indexes != NULL)
+      {
+        j = name_indexes[i];
+      }
+      else
       {
-        if (yr_le16toh(ordinals[j]) == i && j < number_of_names)
+        for (j = 0; j < number_of_names; j++)
+          if (yr_le16toh(ordinals[j]) == i)
+            break;
+      }
+
+      if (j < number_of_names)
+      {
+        offset = pe_rva_to_offset(pe, yr_le32toh(names[j]));
+
+        if (offset > 0)
         {
-          offset = pe_rva_to_offset(pe, yr_le32toh(names[j]));
+          remaining = pe->data_size - (size_t) offset;
+          name_len = strnlen((char*) (pe->data + offset), remaining);
 
-          if (offset > 0)
-          {
-            remaining = pe->data_size - (size_t) offset;
-            name_len = strnlen((char*) (pe->data + offset), remaining);
-
-            yr_set_sized_string(
-                (char*) (pe->data + offset),
-                yr_min(name_len, MAX_EXPORT_NAME_LENGTH),
-                pe->object,
-                "export_details[%i].name",
-                exp_sz);
-          }
-          break;
+          yr_set_sized_string(
+              (char*) (pe->data + offset),
+              yr_min(name_len, MAX_EXPORT_NAME_LENGTH),
+              pe->object,
+              "export_details[%i].name",
+              exp_sz);
         }
       }
     }
     exp_sz++;
   }
 
+  yr_free(name_indexes);
+
   yr_set_integer(exp_sz, pe->object, "number_of_exports");
 }
 
@@ -2307,12 +2362,6 @@ static void pe_parse_header(PE* pe, uint64_t base_address, int flags)
     data_dir++;
   }
 
-  pe_iterate_resources(
-      pe, (RESOURCE_CALLBACK_FUNC) pe_collect_resources, (void*) pe);
-
-  yr_set_integer(pe->resources, pe->object, "number_of_resources");
-  yr_set_integer(pe->version_infos, pe->object, "number_of_version_infos");
-
   section = IMAGE_FIRST_SECTION(pe->header);
 
   scount = yr_min(
@@ -2527,11 +2576,320 @@ define_function(section_index_name)
   return_integer(YR_UNDEFINED);
 }
 
+static uint32_t pe_index_hash(uint32_t hash, const char* name, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ yr_lowercase[(uint8_t) name[i]]) * PE_INDEX_PRIME;
+
+  return hash;
+}
+
+static uint32_t pe_index_hash_integer(uint32_t hash, int64_t value)
+{
+  hash = (hash ^ (uint32_t) value) * PE_INDEX_PRIME;
+  hash = (hash ^ (uint32_t) ((uint64_t) value >> 32)) * PE_INDEX_PRIME;
+
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates an index with room for the given number of entries. All the slots
+// live in the same allocation, so building an index costs a single malloc
+// no matter how many functions a PE imports.
+//
+static PE_INDEX* pe_index_create(uint32_t entries)
+{
+  uint32_t slots = 16;
+
+  while (slots < entries + entries / 2) slots <<= 1;
+
+  PE_INDEX* index = (PE_INDEX*) yr_calloc(
+      1, sizeof(PE_INDEX) + (slots - 1) * sizeof(PE_INDEX_SLOT));
+
+  if (index != NULL)
+    index->mask = slots - 1;
+
+  return index;
+}
+
+static void pe_index_destroy(PE_INDEX* index)
+{
+  if (index == NULL)
+    return;
+
+  PE_REGEXP_RESULT* regexp_result = index->regexp_results;
+
+  while (regexp_result != NULL)
+  {
+    PE_REGEXP_RESULT* next = regexp_result->next;
+    yr_free(regexp_result);
+    regexp_result = next;
+  }
+
+  yr_free(index);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the first empty slot in the probe sequence for the given hash. The
+// index is created with spare room for every entry it will ever hold, so an
+// empty slot always exists.
+//
+static PE_INDEX_SLOT* pe_index_insert(
+    PE_INDEX* index,
+    uint32_t hash,
+    uint32_t kind)
+{
+  uint32_t i = hash & index->mask;
+
+  while (index->slots[i].kind != PE_INDEX_EMPTY) i = (i + 1) & index->mask;
+
+  index->slots[i].hash = hash;
+  index->slots[i].kind = kind;
+
+  return &index->slots[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Results of lookups with regular expressions can't be indexed, but the
+// compiled RE objects live as long as the rules. The result for a given set
+// of them is kept in the index, so rules that repeat the same call don't
+// evaluate the expressions again.
+//
+static bool pe_index_get_regexp_result(
+    PE_INDEX* index,
+    RE* first,
+    RE* second,
+    int64_t* result)
+{
+  for (PE_REGEXP_RESULT* r = index->regexp_results; r != NULL; r = r->next)
+  {
+    if (r->regexps[0] == first && r->regexps[1] == second)
+    {
+      *result = r->result;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void pe_index_set_regexp_result(
+    PE_INDEX* index,
+    RE* first,
+    RE* second,
+    int64_t result)
+{
+  PE_REGEXP_RESULT* r = (PE_REGEXP_RESULT*) yr_malloc(
+      sizeof(PE_REGEXP_RESULT));
+
+  // The result is just not remembered if there's no memory for it.
+  if (r == NULL)
+    return;
+
+  r->regexps[0] = first;
+  r->regexps[1] = second;
+  r->result = result;
+  r->next = index->regexp_results;
+
+  index->regexp_results = r;
+}
+
+static uint32_t pe_exports_index_find_name(
+    PE_INDEX* index,
+    SIZED_STRING* name)
+{
+  uint32_t hash = pe_index_hash(PE_INDEX_SEED, name->c_string, name->length);
+  uint32_t i = hash & index->mask;
+
+  for (; index->slots[i].kind != PE_INDEX_EMPTY; i = (i + 1) & index->mask)
+  {
+    PE_INDEX_SLOT* slot = &index->slots[i];
+
+    if (slot->hash == hash && slot->kind == PE_INDEX_EXPORT &&
+        ss_icompare((SIZED_STRING*) slot->name, name) == 0)
+      return slot->value;
+  }
+
+  return UINT32_MAX;
+}
+
+static uint32_t pe_exports_index_find_ordinal(PE_INDEX* index, int64_t ordinal)
+{
+  uint32_t hash = pe_index_hash_integer(PE_INDEX_SEED, ordinal);
+  uint32_t i = hash & index->mask;
+
+  for (; index->slots[i].kind != PE_INDEX_EMPTY; i = (i + 1) & index->mask)
+  {
+    PE_INDEX_SLOT* slot = &index->slots[i];
+
+    if (slot->hash == hash && slot->kind == PE_INDEX_ORDINAL &&
+        slot->ordinal == ordinal)
+      return slot->value;
+  }
+
+  return UINT32_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the index for the exported functions, building it on first use.
+// It maps each export name, case-insensitively, and each ordinal to the
+// position of the first export with that name or ordinal in export_details.
+// Returns NULL if the index can't be allocated, callers then search
+// export_details as before.
+//
+static PE_INDEX* pe_exports_index(YR_OBJECT* module, PE* pe)
+{
+  if (pe->exports_index != NULL)
+    return pe->exports_index;
+
+  int n = (int) yr_get_integer(module, "number_of_exports");
+  PE_INDEX* index = pe_index_create(2 * n);
+
+  if (index == NULL)
+    return NULL;
+
+  for (int i = 0; i < n; i++)
+  {
+    SIZED_STRING* function_name = yr_get_string(
+        module, "export_details[%i].name", i);
+    int64_t ordinal = yr_object_get_integer(
+        module, "export_details[%i].ordinal", i);
+
+    if (function_name != NULL && pe_exports_index_find_name(
+                                     index, function_name) == UINT32_MAX)
+    {
+      PE_INDEX_SLOT* slot = pe_index_insert(
+          index,
+          pe_index_hash(
+              PE_INDEX_SEED, function_name->c_string, function_name->length),
+          PE_INDEX_EXPORT);
+
+      slot->name = function_name;
+      slot->value = i;
+    }
+
+    if (pe_exports_index_find_ordinal(index, ordinal) == UINT32_MAX)
+    {
+      PE_INDEX_SLOT* slot = pe_index_insert(
+          index,
+          pe_index_hash_integer(PE_INDEX_SEED, ordinal),
+          PE_INDEX_ORDINAL);
+
+      slot->ordinal = ordinal;
+      slot->value = i;
+    }
+  }
+
+  pe->exports_index = index;
+
+  return index;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Position in export_details of the first export with the given name, or -1.
+//
+static int pe_exports_find_name(
+    YR_OBJECT* module,
+    PE* pe,
+    SIZED_STRING* search_name)
+{
+  PE_INDEX* index = pe_exports_index(module, pe);
+
+  if (index != NULL)
+  {
+    uint32_t i = pe_exports_index_find_name(index, search_name);
+    return i == UINT32_MAX ? -1 : (int) i;
+  }
+
+  int n = (int) yr_get_integer(module, "number_of_exports");
+
+  for (int i = 0; i < n; i++)
+  {
+    SIZED_STRING* function_name = yr_get_string(
+        module, "export_details[%i].name", i);
+
+    if (function_name == NULL)
+      continue;
+
+    if (ss_icompare(function_name, search_name) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Position in export_details of the first export with the given ordinal, or
+// -1.
+//
+static int pe_exports_find_ordinal(YR_OBJECT* module, PE* pe, int64_t ordinal)
+{
+  PE_INDEX* index = pe_exports_index(module, pe);
+
+  if (index != NULL)
+  {
+    uint32_t i = pe_exports_index_find_ordinal(index, ordinal);
+    return i == UINT32_MAX ? -1 : (int) i;
+  }
+
+  int n = (int) yr_get_integer(module, "number_of_exports");
+
+  for (int i = 0; i < n; i++)
+  {
+    int64_t exported_ordinal = yr_object_get_integer(
+        module, "export_details[%i].ordinal", i);
+
+    if (exported_ordinal == ordinal)
+      return i;
+  }
+
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Position in export_details of the first export whose name matches the
+// regular expression, or -1.
+//
+static int pe_exports_find_regexp(
+    YR_SCAN_CONTEXT* context,
+    YR_OBJECT* module,
+    PE* pe,
+    RE* regex)
+{
+  PE_INDEX* index = pe_exports_index(module, pe);
+  int64_t result = -1;
+
+  if (index != NULL &&
+      pe_index_get_regexp_result(index, regex, NULL, &result))
+    return (int) result;
+
+  int n = (int) yr_get_integer(module, "number_of_exports");
+
+  for (int i = 0; i < n; i++)
+  {
+    SIZED_STRING* function_name = yr_get_string(
+        module, "export_details[%i].name", i);
+
+    if (function_name == NULL)
+      continue;
+
+    if (yr_re_match(context, regex, function_name->c_string) != -1)
+    {
+      result = i;
+      break;
+    }
+  }
+
+  if (index != NULL)
+    pe_index_set_regexp_result(index, regex, NULL, result);
+
+  return (int) result;
+}
+
 define_function(exports)
 {
   SIZED_STRING* search_name = sized_string_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = yr_module();
   PE* pe = (PE*) module->data;
 
@@ -2545,25 +2903,13 @@ define_function(exports)
   if (n == 0)
     return_integer(0);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = yr_get_string(module, "export_details[%i].name", i);
-
-    if (function_name == NULL)
-      continue;
-
-    if (ss_icompare(function_name, search_name) == 0)
-      return_integer(1);
-  }
-
-  return_integer(0);
+  return_integer(pe_exports_find_name(module, pe, search_name) >= 0);
 }
 
 define_function(exports_regexp)
 {
   RE* regex = regexp_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = yr_module();
   PE* pe = (PE*) module->data;
 
@@ -2577,17 +2923,8 @@ define_function(exports_regexp)
   if (n == 0)
     return_integer(0);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = yr_get_string(module, "export_details[%i].name", i);
-    if (function_name == NULL)
-      continue;
-
-    if (yr_re_match(yr_scan_context(), regex, function_name->c_string) != -1)
-      return_integer(1);
-  }
-
-  return_integer(0);
+  return_integer(
+      pe_exports_find_regexp(yr_scan_context(), module, pe, regex) >= 0);
 }
 
 define_function(exports_ordinal)
@@ -2610,23 +2947,13 @@ define_function(exports_ordinal)
   if (ordinal == 0 || ordinal > n)
     return_integer(0);
 
-  for (int i = 0; i < n; i++)
-  {
-    int64_t exported_ordinal = yr_object_get_integer(
-        module, "export_details[%i].ordinal", i);
-
-    if (exported_ordinal == ordinal)
-      return_integer(1);
-  }
-
-  return_integer(0);
+  return_integer(pe_exports_find_ordinal(module, pe, ordinal) >= 0);
 }
 
 define_function(exports_index_name)
 {
   SIZED_STRING* search_name = sized_string_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = yr_module();
   PE* pe = (PE*) module->data;
 
@@ -2640,18 +2967,12 @@ define_function(exports_index_name)
   if (n == 0)
     return_integer(YR_UNDEFINED);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = yr_get_string(module, "export_details[%i].name", i);
-
-    if (function_name == NULL)
-      continue;
+  int i = pe_exports_find_name(module, pe, search_name);
 
-    if (ss_icompare(function_name, search_name) == 0)
-      return_integer(i);
-  }
+  if (i < 0)
+    return_integer(YR_UNDEFINED);
 
-  return_integer(YR_UNDEFINED);
+  return_integer(i);
 }
 
 define_function(exports_index_ordinal)
@@ -2674,23 +2995,18 @@ define_function(exports_index_ordinal)
   if (ordinal == 0 || ordinal > n)
     return_integer(YR_UNDEFINED);
 
-  for (int i = 0; i < n; i++)
-  {
-    int64_t exported_ordinal = yr_object_get_integer(
-        module, "export_details[%i].ordinal", i);
+  int i = pe_exports_find_ordinal(module, pe, ordinal);
 
-    if (exported_ordinal == ordinal)
-      return_integer(i);
-  }
+  if (i < 0)
+    return_integer(YR_UNDEFINED);
 
-  return_integer(YR_UNDEFINED);
+  return_integer(i);
 }
 
 define_function(exports_index_regex)
 {
   RE* regex = regexp_argument(1);
 
-  SIZED_STRING* function_name = NULL;
   YR_OBJECT* module = yr_module();
   PE* pe = (PE*) module->data;
 
@@ -2704,19 +3020,12 @@ define_function(exports_index_regex)
   if (n == 0)
     return_integer(YR_UNDEFINED);
 
-  for (int i = 0; i < n; i++)
-  {
-    function_name = yr_get_string(module, "export_details[%i].name", i);
-    if (function_name == NULL)
-      continue;
+  int i = pe_exports_find_regexp(yr_scan_context(), module, pe, regex);
 
-    if (yr_re_match(yr_scan_context(), regex, function_name->c_string) != -1)
-    {
-      return_integer(i);
-    }
-  }
+  if (i < 0)
+    return_integer(YR_UNDEFINED);
 
-  return_integer(YR_UNDEFINED);
+  return_integer(i);
 }
 
 #if defined(HAVE_LIBCRYPTO) || defined(HAVE_WINCRYPT_H) || \
@@ -2848,11 +3157,140 @@ define_function(imphash)
 
 #endif  // defined(HAVE_LIBCRYPTO) || defined(HAVE_WINCRYPT_H)
 
-int64_t pe_imports_dll(IMPORTED_DLL* dll, char* dll_name)
+////////////////////////////////////////////////////////////////////////////////
+// Finds the slot of the given kind for a DLL name and, depending on the kind,
+// a function name or an ordinal. Returns NULL if there's none.
+//
+static PE_INDEX_SLOT* pe_imports_index_find(
+    PE_INDEX* index,
+    uint32_t kind,
+    uint32_t hash,
+    const char* dll_name,
+    const char* fun_name,
+    uint16_t ordinal)
+{
+  uint32_t i = hash & index->mask;
+
+  for (; index->slots[i].kind != PE_INDEX_EMPTY; i = (i + 1) & index->mask)
+  {
+    PE_INDEX_SLOT* slot = &index->slots[i];
+
+    if (slot->hash != hash || slot->kind != kind ||
+        strcasecmp(((IMPORTED_DLL*) slot->name)->name, dll_name) != 0)
+      continue;
+
+    if (kind == PE_INDEX_DLL ||
+        (kind == PE_INDEX_FUNCTION &&
+         strcasecmp(slot->function->name, fun_name) == 0) ||
+        (kind == PE_INDEX_ORDINAL && slot->function->ordinal == ordinal))
+      return slot;
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the index for a list of imported DLLs, building it on first use.
+// It has a slot per (dll, function name) and per (dll, ordinal) pair, and one
+// per distinct DLL name holding its number of imported functions, so that
+// pe.imports() doesn't walk the lists on every call. Names are compared
+// case-insensitively, as before. Returns NULL if the index can't be
+// allocated, callers then walk the lists.
+//
+static PE_INDEX* pe_imports_index(IMPORTED_DLL* dlls, PE_INDEX** index)
+{
+  uint32_t entries = 0;
+
+  if (*index != NULL)
+    return *index;
+
+  for (IMPORTED_DLL* dll = dlls; dll != NULL; dll = dll->next)
+  {
+    entries++;
+
+    for (IMPORT_FUNCTION* fun = dll->functions; fun != NULL; fun = fun->next)
+      entries += 2;
+  }
+
+  PE_INDEX* new_index = pe_index_create(entries);
+
+  if (new_index == NULL)
+    return NULL;
+
+  for (IMPORTED_DLL* dll = dlls; dll != NULL; dll = dll->next)
+  {
+    uint32_t dll_hash = pe_index_hash(
+        PE_INDEX_SEED, dll->name, strlen(dll->name));
+    uint32_t functions = 0;
+
+    for (IMPORT_FUNCTION* fun = dll->functions; fun != NULL; fun = fun->next)
+    {
+      PE_INDEX_SLOT* slot;
+
+      functions++;
+
+      if (fun->name != NULL)
+      {
+        slot = pe_index_insert(
+            new_index,
+            pe_index_hash(dll_hash, fun->name, strlen(fun->name)),
+            PE_INDEX_FUNCTION);
+
+        slot->name = dll;
+        slot->function = fun;
+      }
+
+      if (fun->has_ordinal)
+      {
+        slot = pe_index_insert(
+            new_index,
+            pe_index_hash_integer(dll_hash, fun->ordinal),
+            PE_INDEX_ORDINAL);
+
+        slot->name = dll;
+        slot->function = fun;
+      }
+    }
+
+    // The same DLL can appear in more than one import descriptor, the count
+    // for a name is the sum over all of them.
+    PE_INDEX_SLOT* slot = pe_imports_index_find(
+        new_index, PE_INDEX_DLL, dll_hash, dll->name, NULL, 0);
+
+    if (slot == NULL)
+    {
+      slot = pe_index_insert(new_index, dll_hash, PE_INDEX_DLL);
+      slot->name = dll;
+    }
+
+    slot->value += functions;
+  }
+
+  *index = new_index;
+
+  return new_index;
+}
+
+int64_t pe_imports_dll(IMPORTED_DLL* dll, PE_INDEX** index, char* dll_name)
 {
   if (dll == NULL)
     return 0;
 
+  PE_INDEX* imports_index = pe_imports_index(dll, index);
+
+  if (imports_index != NULL)
+  {
+    PE_INDEX_SLOT* slot = pe_imports_index_find(
+        imports_index,
+        PE_INDEX_DLL,
+        pe_index_hash(PE_INDEX_SEED, dll_name, strlen(dll_name)),
+        dll_name,
+        NULL,
+        0);
+
+    return slot != NULL ? slot->value : 0;
+  }
+
   int64_t result = 0;
 
   for (; dll != NULL; dll = dll->next)
@@ -2870,11 +3308,33 @@ int64_t pe_imports_dll(IMPORTED_DLL* dll, char* dll_name)
   return result;
 }
 
-int64_t pe_imports(IMPORTED_DLL* dll, char* dll_name, char* fun_name)
+int64_t pe_imports(
+    IMPORTED_DLL* dll,
+    PE_INDEX** index,
+    char* dll_name,
+    char* fun_name)
 {
   if (dll == NULL)
     return 0;
 
+  PE_INDEX* imports_index = pe_imports_index(dll, index);
+
+  if (imports_index != NULL)
+  {
+    uint32_t hash = pe_index_hash(
+        pe_index_hash(PE_INDEX_SEED, dll_name, strlen(dll_name)),
+        fun_name,
+        strlen(fun_name));
+
+    return pe_imports_index_find(
+               imports_index,
+               PE_INDEX_FUNCTION,
+               hash,
+               dll_name,
+               fun_name,
+               0) != NULL;
+  }
+
   for (; dll != NULL; dll = dll->next)
   {
     if (strcasecmp(dll->name, dll_name) == 0)
@@ -2894,14 +3354,20 @@ int64_t pe_imports(IMPORTED_DLL* dll, char* dll_name, char* fun_name)
 int64_t pe_imports_regexp(
     YR_SCAN_CONTEXT* context,
     IMPORTED_DLL* dll,
+    PE_INDEX** index,
     RE* dll_name,
     RE* fun_name)
 {
   if (dll == NULL)
     return 0;
 
+  PE_INDEX* imports_index = pe_imports_index(dll, index);
   int64_t result = 0;
 
+  if (imports_index != NULL &&
+      pe_index_get_regexp_result(imports_index, dll_name, fun_name, &result))
+    return result;
+
   for (; dll != NULL; dll = dll->next)
   {
     if (yr_re_match(context, dll_name, dll->name) > 0)
@@ -2915,14 +3381,42 @@ int64_t pe_imports_regexp(
     }
   }
 
+  if (imports_index != NULL)
+    pe_index_set_regexp_result(imports_index, dll_name, fun_name, result);
+
   return result;
 }
 
-int64_t pe_imports_ordinal(IMPORTED_DLL* dll, char* dll_name, uint64_t ordinal)
+int64_t pe_imports_ordinal(
+    IMPORTED_DLL* dll,
+    PE_INDEX** index,
+    char* dll_name,
+    uint64_t ordinal)
 {
   if (dll == NULL)
     return 0;
 
+  PE_INDEX* imports_index = pe_imports_index(dll, index);
+
+  if (imports_index != NULL)
+  {
+    // Ordinals are 16 bits wide, larger values are never imported.
+    if (ordinal > UINT16_MAX)
+      return 0;
+
+    uint32_t hash = pe_index_hash_integer(
+        pe_index_hash(PE_INDEX_SEED, dll_name, strlen(dll_name)),
+        (int64_t) ordinal);
+
+    return pe_imports_index_find(
+               imports_index,
+               PE_INDEX_ORDINAL,
+               hash,
+               dll_name,
+               NULL,
+               (uint16_t) ordinal) != NULL;
+  }
+
   for (; dll != NULL; dll = dll->next)
   {
     if (strcasecmp(dll->name, dll_name) == 0)
@@ -2950,7 +3444,8 @@ define_function(imports_standard)
   if (!pe)
     return_integer(YR_UNDEFINED);
 
-  return_integer(pe_imports(pe->imported_dlls, dll_name, function_name));
+  return_integer(pe_imports(
+      pe->imported_dlls, &pe->imported_dlls_index, dll_name, function_name));
 }
 
 define_function(imports)
@@ -2966,13 +3461,21 @@ define_function(imports)
     return_integer(YR_UNDEFINED);
 
   if (flags & IMPORT_STANDARD &&
-      pe_imports(pe->imported_dlls, dll_name, function_name))
+      pe_imports(
+          pe->imported_dlls,
+          &pe->imported_dlls_index,
+          dll_name,
+          function_name))
   {
     return_integer(1);
   }
 
   if (flags & IMPORT_DELAYED &&
-      pe_imports(pe->delay_imported_dlls, dll_name, function_name))
+      pe_imports(
+          pe->delay_imported_dlls,
+          &pe->delay_imported_dlls_index,
+          dll_name,
+          function_name))
   {
     return_integer(1);
   }
@@ -2991,7 +3494,8 @@ define_function(imports_standard_ordinal)
   if (!pe)
     return_integer(YR_UNDEFINED);
 
-  return_integer(pe_imports_ordinal(pe->imported_dlls, dll_name, ordinal))
+  return_integer(pe_imports_ordinal(
+      pe->imported_dlls, &pe->imported_dlls_index, dll_name, ordinal))
 }
 
 define_function(imports_ordinal)
@@ -3007,13 +3511,18 @@ define_function(imports_ordinal)
     return_integer(YR_UNDEFINED);
 
   if (flags & IMPORT_STANDARD &&
-      pe_imports_ordinal(pe->imported_dlls, dll_name, ordinal))
+      pe_imports_ordinal(
+          pe->imported_dlls, &pe->imported_dlls_index, dll_name, ordinal))
   {
     return_integer(1);
   }
 
   if (flags & IMPORT_DELAYED &&
-      pe_imports_ordinal(pe->delay_imported_dlls, dll_name, ordinal))
+      pe_imports_ordinal(
+          pe->delay_imported_dlls,
+          &pe->delay_imported_dlls_index,
+          dll_name,
+          ordinal))
   {
     return_integer(1);
   }
@@ -3033,7 +3542,11 @@ define_function(imports_standard_regex)
     return_integer(YR_UNDEFINED);
 
   return_integer(pe_imports_regexp(
-      yr_scan_context(), pe->imported_dlls, dll_name, function_name))
+      yr_scan_context(),
+      pe->imported_dlls,
+      &pe->imported_dlls_index,
+      dll_name,
+      function_name))
 }
 
 define_function(imports_regex)
@@ -3052,11 +3565,19 @@ define_function(imports_regex)
 
   if (flags & IMPORT_STANDARD)
     result += pe_imports_regexp(
-        yr_scan_context(), pe->imported_dlls, dll_name, function_name);
+        yr_scan_context(),
+        pe->imported_dlls,
+        &pe->imported_dlls_index,
+        dll_name,
+        function_name);
 
   if (flags & IMPORT_DELAYED)
     result += pe_imports_regexp(
-        yr_scan_context(), pe->delay_imported_dlls, dll_name, function_name);
+        yr_scan_context(),
+        pe->delay_imported_dlls,
+        &pe->delay_imported_dlls_index,
+        dll_name,
+        function_name);
 
   return_integer(result);
 }
@@ -3071,7 +3592,8 @@ define_function(imports_standard_dll)
   if (!pe)
     return_integer(YR_UNDEFINED);
 
-  return_integer(pe_imports_dll(pe->imported_dlls, dll_name));
+  return_integer(pe_imports_dll(
+      pe->imported_dlls, &pe->imported_dlls_index, dll_name));
 }
 
 define_function(imports_dll)
@@ -3088,10 +3610,12 @@ define_function(imports_dll)
   int64_t result = 0;
 
   if (flags & IMPORT_STANDARD)
-    result += pe_imports_dll(pe->imported_dlls, dll_name);
+    result += pe_imports_dll(
+        pe->imported_dlls, &pe->imported_dlls_index, dll_name);
 
   if (flags & IMPORT_DELAYED)
-    result += pe_imports_dll(pe->delay_imported_dlls, dll_name);
+    result += pe_imports_dll(
+        pe->delay_imported_dlls, &pe->delay_imported_dlls_index, dll_name);
 
   return_integer(result);
 }
@@ -4008,6 +4532,117 @@ int module_finalize(YR_MODULE* module)
   return ERROR_SUCCESS;
 }
 
+static void pe_parse_resources(PE* pe)
+{
+  pe_iterate_resources(
+      pe, (RESOURCE_CALLBACK_FUNC) pe_collect_resources, (void*) pe);
+
+  yr_set_integer(pe->resources, pe->object, "number_of_resources");
+  yr_set_integer(pe->version_infos, pe->object, "number_of_version_infos");
+}
+
+static void pe_parse_parts(PE* pe, int parts)
+{
+  parts &= ~pe->parsed;
+  pe->parsed |= parts;
+
+  if (parts & PE_PART_RICH_SIGNATURE)
+    pe_parse_rich_signature(pe, pe->base_address);
+
+  if (parts & PE_PART_DEBUG_DIRECTORY)
+    pe_parse_debug_directory(pe);
+
+  if (parts & PE_PART_RESOURCES)
+    pe_parse_resources(pe);
+
+#if defined(HAVE_LIBCRYPTO) && !defined(BORINGSSL)
+  if (parts & PE_PART_CERTIFICATES)
+    pe_parse_certificates(pe);
+#endif
+
+  if (parts & PE_PART_IMPORTS)
+    pe->imported_dlls = pe_parse_imports(pe);
+
+  if (parts & PE_PART_DELAYED_IMPORTS)
+    pe->delay_imported_dlls = pe_parse_delayed_imports(pe);
+
+  if (parts & PE_PART_EXPORTS)
+    pe_parse_exports(pe);
+}
+
+// Top-level fields, and functions, that depend on a part of the PE other
+// than the headers and sections. Fields not listed here are filled in by
+// pe_parse_header when the module is loaded.
+static const struct
+{
+  const char* field;
+  int parts;
+} pe_deferred_fields[] = {
+    {"rich_signature", PE_PART_RICH_SIGNATURE},
+    {"pdb_path", PE_PART_DEBUG_DIRECTORY},
+    {"number_of_resources", PE_PART_RESOURCES},
+    {"resources", PE_PART_RESOURCES},
+    {"resource_timestamp", PE_PART_RESOURCES},
+    {"resource_version", PE_PART_RESOURCES},
+    {"number_of_version_infos", PE_PART_RESOURCES},
+    {"version_info", PE_PART_RESOURCES},
+    {"version_info_list", PE_PART_RESOURCES},
+    {"locale", PE_PART_RESOURCES},
+    {"language", PE_PART_RESOURCES},
+    {"signatures", PE_PART_CERTIFICATES},
+    {"is_signed", PE_PART_CERTIFICATES},
+    {"number_of_signatures", PE_PART_CERTIFICATES},
+    {"imports", PE_PART_IMPORTS | PE_PART_DELAYED_IMPORTS},
+    {"import_details", PE_PART_IMPORTS},
+    {"number_of_imports", PE_PART_IMPORTS},
+    {"number_of_imported_functions", PE_PART_IMPORTS},
+    {"import_rva", PE_PART_IMPORTS},
+    {"imphash", PE_PART_IMPORTS},
+    {"delayed_import_details", PE_PART_DELAYED_IMPORTS},
+    {"number_of_delayed_imports", PE_PART_DELAYED_IMPORTS},
+    {"number_of_delayed_imported_functions", PE_PART_DELAYED_IMPORTS},
+    {"delayed_import_rva", PE_PART_DELAYED_IMPORTS},
+    {"exports", PE_PART_EXPORTS},
+    {"exports_index", PE_PART_EXPORTS},
+    {"export_details", PE_PART_EXPORTS},
+    {"number_of_exports", PE_PART_EXPORTS},
+    {"dll_name", PE_PART_EXPORTS},
+    {"export_timestamp", PE_PART_EXPORTS},
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Populate function for the module's structure. Called by the executor before
+// a rule reads a top-level field, and with field_name set to NULL by code that
+// needs the whole structure. Rules that only check pe.imports(...) never pay
+// for resources, the rich signature or Authenticode.
+//
+static int pe_populate(YR_OBJECT* module_object, const char* field_name)
+{
+  PE* pe = (PE*) module_object->data;
+
+  if (pe == NULL || pe->parsed == PE_PART_ALL)
+    return ERROR_SUCCESS;
+
+  if (field_name == NULL)
+  {
+    pe_parse_parts(pe, PE_PART_ALL);
+    return ERROR_SUCCESS;
+  }
+
+  for (size_t i = 0;
+       i < sizeof(pe_deferred_fields) / sizeof(pe_deferred_fields[0]);
+       i++)
+  {
+    if (strcmp(pe_deferred_fields[i].field, field_name) == 0)
+    {
+      pe_parse_parts(pe, pe_deferred_fields[i].parts);
+      break;
+    }
+  }
+
+  return ERROR_SUCCESS;
+}
+
 int module_load(
     YR_SCAN_CONTEXT* context,
     YR_OBJECT* module_object,
@@ -4021,6 +4656,8 @@ int module_load(
   const uint8_t* block_data = NULL;
   PE* pe = NULL;
 
+  int blocks_seen = 0;
+
   yr_set_integer(IMPORT_DELAYED, module_object, "IMPORT_DELAYED");
   yr_set_integer(IMPORT_STANDARD, module_object, "IMPORT_STANDARD");
   yr_set_integer(IMPORT_ANY, module_object, "IMPORT_ANY");
@@ -4360,6 +4997,7 @@ int module_load(
 
   foreach_memory_block(iterator, block)
   {
+    blocks_seen++;
     block_data = yr_fetch_block_data(block);
 
     if (block_data == NULL)
@@ -4386,22 +5024,28 @@ int module_load(
         pe->data_size = block->size;
         pe->header = pe_header;
         pe->object = module_object;
+        pe->imported_dlls = NULL;
+        pe->delay_imported_dlls = NULL;
+        pe->imported_dlls_index = NULL;
+        pe->delay_imported_dlls_index = NULL;
+        pe->exports_index = NULL;
         pe->resources = 0;
         pe->version_infos = 0;
+        pe->base_address = block->base;
+        pe->parsed = 0;
 
         module_object->data = pe;
 
         pe_parse_header(pe, block->base, context->flags);
-        pe_parse_rich_signature(pe, block->base);
-        pe_parse_debug_directory(pe);
 
-#if defined(HAVE_LIBCRYPTO) && !defined(BORINGSSL)
-        pe_parse_certificates(pe);
-#endif
-
-        pe->imported_dlls = pe_parse_imports(pe);
-        pe->delay_imported_dlls = pe_parse_delayed_imports(pe);
-        pe_parse_exports(pe);
+        // The rest of the file is parsed on demand, which requires the
+        // block's data to outlive module_load. That is the case for the
+        // first block returned by the iterator, but process memory is read
+        // into a buffer that the next block reuses.
+        if (blocks_seen == 1 && !(context->flags & SCAN_FLAGS_PROCESS_MEMORY))
+          object_as_structure(module_object)->populate = pe_populate;
+        else
+          pe_parse_parts(pe, PE_PART_ALL);
 
         break;
       }
@@ -4451,6 +5095,10 @@ int module_unload(YR_OBJECT* module_object)
     yr_hash_table_destroy(
         pe->hash_table, (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_free);
 
+  pe_index_destroy(pe->imported_dlls_index);
+  pe_index_destroy(pe->delay_imported_dlls_index);
+  pe_index_destroy(pe->exports_index);
+
   free_dlls(pe->imported_dlls);
   free_dlls(pe->delay_imported_dlls);
 
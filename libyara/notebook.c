@@ -45,14 +45,20 @@ typedef struct YR_NOTEBOOK_PAGE YR_NOTEBOOK_PAGE;
 // 4x the size of the buffers you plan to allocate with yr_notebook_alloc().
 //
 // Once the notebook is destroyed all the pages are freed, and consequently
-// all the buffers allocated via yr_notebook_alloc().
+// all the buffers allocated via yr_notebook_alloc(). A notebook can also be
+// reset with yr_notebook_reset(), which invalidates every buffer but keeps
+// the pages for the allocations that follow.
 struct YR_NOTEBOOK
 {
   // The mininum size of each page in the notebook.
   size_t min_page_size;
-  // Pointer to the first page in the book, this is also the most recently
-  // created page, the one that is being filled.
+  // Sum of the sizes of all the pages in the notebook.
+  size_t size;
+  // Pointer to the first page in the book, this is the oldest page.
   YR_NOTEBOOK_PAGE* page_list_head;
+  // Pointer to the page that is being filled. Pages after this one are
+  // empty, they were kept by yr_notebook_reset().
+  YR_NOTEBOOK_PAGE* current_page;
 };
 
 struct YR_NOTEBOOK_PAGE
@@ -99,6 +105,8 @@ int yr_notebook_create(size_t min_page_size, YR_NOTEBOOK** notebook)
   }
 
   new_notebook->min_page_size = min_page_size;
+  new_notebook->size = min_page_size;
+  new_notebook->current_page = new_notebook->page_list_head;
   new_notebook->page_list_head->size = min_page_size;
   new_notebook->page_list_head->used = 0;
   new_notebook->page_list_head->next = NULL;
@@ -153,34 +161,84 @@ void* yr_notebook_alloc(YR_NOTEBOOK* notebook, size_t size)
   // deferrencing pointers to types larger than a byte.
   size = (size + 7) & ~0x7;
 
-  YR_NOTEBOOK_PAGE* current_page = notebook->page_list_head;
+  YR_NOTEBOOK_PAGE* current_page = notebook->current_page;
 
-  // If the requested size doesn't fit in current page's free space, allocate
-  // a new page.
+  // If the requested size doesn't fit in current page's free space, move to
+  // the next page if there's one kept by yr_notebook_reset() that is large
+  // enough, or allocate a new page.
   if (current_page->size - current_page->used < size)
   {
-    size_t min_size = notebook->min_page_size;
+    YR_NOTEBOOK_PAGE* next_page = current_page->next;
+
+    if (next_page == NULL || next_page->size < size)
+    {
+      size_t min_size = notebook->min_page_size;
+
+      // The new page must be able to fit the requested buffer, so find the
+      // multiple of notebook->min_page_size that is larger or equal than than
+      // size.
+      size_t page_size = (size / min_size) * min_size + min_size;
 
-    // The new page must be able to fit the requested buffer, so find the
-    // multiple of notebook->min_page_size that is larger or equal than than
-    // size.
-    size_t page_size = (size / min_size) * min_size + min_size;
+      next_page = yr_malloc(sizeof(YR_NOTEBOOK_PAGE) + page_size);
 
-    YR_NOTEBOOK_PAGE* new_page = yr_malloc(
-        sizeof(YR_NOTEBOOK_PAGE) + page_size);
+      if (next_page == NULL)
+        return NULL;
 
-    if (new_page == NULL)
-      return NULL;
+      next_page->size = page_size;
+      next_page->next = current_page->next;
+      current_page->next = next_page;
+      notebook->size += page_size;
+    }
 
-    new_page->size = page_size;
-    new_page->used = 0;
-    new_page->next = notebook->page_list_head;
-    notebook->page_list_head = new_page;
+    next_page->used = 0;
+    notebook->current_page = next_page;
   }
 
-  void* ptr = notebook->page_list_head->data + notebook->page_list_head->used;
+  void* ptr = notebook->current_page->data + notebook->current_page->used;
 
-  notebook->page_list_head->used += size;
+  notebook->current_page->used += size;
 
   return ptr;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Releases every buffer allocated from a notebook at once. The pages are kept
+// and reused by subsequent calls to yr_notebook_alloc(), except when their
+// total size exceeds max_size. In that case the pages beyond max_size are
+// freed, so that a single large burst of allocations doesn't pin its memory
+// for the lifetime of the notebook.
+//
+// Args:
+//   notebook: Pointer to the notebook.
+//   max_size: Maximum size of the pages kept by the notebook.
+//
+void yr_notebook_reset(YR_NOTEBOOK* notebook, size_t max_size)
+{
+  YR_NOTEBOOK_PAGE* page = notebook->page_list_head;
+
+  if (notebook->size > max_size)
+  {
+    size_t kept = page->size;
+
+    while (page->next != NULL && kept + page->next->size <= max_size)
+    {
+      page = page->next;
+      kept += page->size;
+    }
+
+    YR_NOTEBOOK_PAGE* next = page->next;
+
+    page->next = NULL;
+    notebook->size = kept;
+
+    while (next != NULL)
+    {
+      page = next;
+      next = page->next;
+      yr_free(page);
+    }
+  }
+
+  notebook->current_page = notebook->page_list_head;
+  notebook->current_page->used = 0;
+}
@@ -43,12 +43,90 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/utils.h>
 
 ////////////////////////////////////////////////////////////////////////////////
-// Creates a new object with the given type and identifier. If a parent is
-// specified the new object is owned by the parent and it will be destroyed when
-// the parent is destroyed. You must not call yr_object_destroy on an objected
-// that has a parent, you should destroy the parent instead.
+// Allocates memory for an object or for something owned by the object, from
+// the object's notebook if it has one or from the heap otherwise.
 //
-int yr_object_create(
+static void* _yr_object_alloc(YR_NOTEBOOK* notebook, size_t size)
+{
+  if (notebook != NULL)
+    return yr_notebook_alloc(notebook, size);
+
+  return yr_malloc(size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Frees memory obtained with _yr_object_alloc. Memory taken from a notebook
+// is not freed individually, it's released when the notebook is reset.
+//
+static void _yr_object_free(YR_NOTEBOOK* notebook, void* ptr)
+{
+  if (notebook == NULL)
+    yr_free(ptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Grows a buffer obtained with _yr_object_alloc from old_size to new_size
+// bytes.
+//
+static void* _yr_object_realloc(
+    YR_NOTEBOOK* notebook,
+    void* ptr,
+    size_t old_size,
+    size_t new_size)
+{
+  void* new_ptr;
+
+  if (notebook == NULL)
+    return yr_realloc(ptr, new_size);
+
+  new_ptr = yr_notebook_alloc(notebook, new_size);
+
+  if (new_ptr != NULL)
+    memcpy(new_ptr, ptr, old_size);
+
+  return new_ptr;
+}
+
+static SIZED_STRING* _yr_object_ss_new(
+    YR_NOTEBOOK* notebook,
+    const char* value,
+    size_t len,
+    uint32_t flags)
+{
+  SIZED_STRING* ss = (SIZED_STRING*) _yr_object_alloc(
+      notebook, len + sizeof(SIZED_STRING));
+
+  if (ss == NULL)
+    return NULL;
+
+  ss->length = (uint32_t) len;
+  ss->flags = flags;
+
+  memcpy(ss->c_string, value, len);
+  ss->c_string[len] = '\0';
+
+  return ss;
+}
+
+static char* _yr_object_strdup(YR_NOTEBOOK* notebook, const char* str)
+{
+  char* dup;
+  size_t len;
+
+  if (notebook == NULL)
+    return yr_strdup(str);
+
+  len = strlen(str);
+  dup = (char*) yr_notebook_alloc(notebook, len + 1);
+
+  if (dup != NULL)
+    memcpy(dup, str, len + 1);
+
+  return dup;
+}
+
+static int _yr_object_create(
+    YR_NOTEBOOK* notebook,
     int8_t type,
     const char* identifier,
     YR_OBJECT* parent,
@@ -87,14 +165,15 @@ int yr_object_create(
     assert(false);
   }
 
-  obj = (YR_OBJECT*) yr_malloc(object_size);
+  obj = (YR_OBJECT*) _yr_object_alloc(notebook, object_size);
 
   if (obj == NULL)
     return ERROR_INSUFFICIENT_MEMORY;
 
   obj->type = type;
-  obj->identifier = yr_strdup(identifier);
+  obj->identifier = _yr_object_strdup(notebook, identifier);
   obj->parent = parent;
+  obj->notebook = notebook;
   obj->data = NULL;
 
   switch (type)
@@ -110,6 +189,7 @@ int yr_object_create(
     break;
   case OBJECT_TYPE_STRUCTURE:
     object_as_structure(obj)->members = NULL;
+    object_as_structure(obj)->populate = NULL;
     break;
   case OBJECT_TYPE_ARRAY:
     object_as_array(obj)->items = NULL;
@@ -131,7 +211,7 @@ int yr_object_create(
 
   if (obj->identifier == NULL)
   {
-    yr_free(obj);
+    _yr_object_free(notebook, obj);
     return ERROR_INSUFFICIENT_MEMORY;
   }
 
@@ -150,8 +230,8 @@ int yr_object_create(
     {
     case OBJECT_TYPE_STRUCTURE:
       FAIL_ON_ERROR_WITH_CLEANUP(yr_object_structure_set_member(parent, obj), {
-        yr_free((void*) obj->identifier);
-        yr_free(obj);
+        _yr_object_free(notebook, (void*) obj->identifier);
+        _yr_object_free(notebook, obj);
       });
       break;
 
@@ -175,6 +255,42 @@ int yr_object_create(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Creates a new object with the given type and identifier. If a parent is
+// specified the new object is owned by the parent and it will be destroyed when
+// the parent is destroyed. You must not call yr_object_destroy on an objected
+// that has a parent, you should destroy the parent instead. The new object is
+// allocated from the parent's notebook, if any.
+//
+int yr_object_create(
+    int8_t type,
+    const char* identifier,
+    YR_OBJECT* parent,
+    YR_OBJECT** object)
+{
+  return _yr_object_create(
+      parent != NULL ? parent->notebook : NULL,
+      type,
+      identifier,
+      parent,
+      object);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Creates a new object without parent that is allocated from the given
+// notebook, like all the objects that are created later as its descendants.
+// Such objects are freed when the notebook is reset or destroyed, calling
+// yr_object_destroy on them does nothing.
+//
+int yr_object_create_in_notebook(
+    YR_NOTEBOOK* notebook,
+    int8_t type,
+    const char* identifier,
+    YR_OBJECT** object)
+{
+  return _yr_object_create(notebook, type, identifier, NULL, object);
+}
+
 void yr_object_set_canary(YR_OBJECT* object, int canary)
 {
   object->canary = canary;
@@ -324,7 +440,9 @@ void yr_object_destroy(YR_OBJECT* object)
   YR_ARRAY_ITEMS* array_items;
   YR_DICTIONARY_ITEMS* dict_items;
 
-  if (object == NULL)
+  // Objects allocated from a notebook, and their descendants, are freed
+  // all at once when the notebook is reset.
+  if (object == NULL || object->notebook != NULL)
     return;
 
   switch (object->type)
@@ -412,6 +530,23 @@ YR_OBJECT* yr_object_lookup_field(YR_OBJECT* object, const char* field_name)
   return NULL;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Asks the module that owns a structure to fill in the members it defers
+// until first use. If field_name is NULL every deferred member is filled in,
+// otherwise only those needed for reading that member. Structures without a
+// populate function are always complete and this is a no-op for them.
+//
+YR_API int yr_object_populate(YR_OBJECT* object, const char* field_name)
+{
+  assert(object != NULL);
+  assert(object->type == OBJECT_TYPE_STRUCTURE);
+
+  if (object_as_structure(object)->populate == NULL)
+    return ERROR_SUCCESS;
+
+  return object_as_structure(object)->populate(object, field_name);
+}
+
 static YR_OBJECT* _yr_object_lookup(
     YR_OBJECT* object,
     int flags,
@@ -542,8 +677,8 @@ int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy)
 
   *object_copy = NULL;
 
-  FAIL_ON_ERROR(
-      yr_object_create(object->type, object->identifier, NULL, &copy));
+  FAIL_ON_ERROR(_yr_object_create(
+      object->notebook, object->type, object->identifier, NULL, &copy));
 
   copy->canary = object->canary;
 
@@ -560,7 +695,11 @@ int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy)
   case OBJECT_TYPE_STRING:
 
     if (object->value.ss != NULL)
-      copy->value.ss = ss_dup(object->value.ss);
+      copy->value.ss = _yr_object_ss_new(
+          copy->notebook,
+          object->value.ss->c_string,
+          object->value.ss->length,
+          object->value.ss->flags);
     else
       copy->value.ss = NULL;
 
@@ -593,7 +732,7 @@ int yr_object_copy(YR_OBJECT* object, YR_OBJECT** object_copy)
 
       FAIL_ON_ERROR_WITH_CLEANUP(yr_object_structure_set_member(copy, o),
                                  // cleanup
-                                 yr_free(o);
+                                 yr_object_destroy(o);
                                  yr_object_destroy(copy));
 
       structure_member = structure_member->next;
@@ -641,7 +780,8 @@ int yr_object_structure_set_member(YR_OBJECT* object, YR_OBJECT* member)
   if (yr_object_lookup_field(object, member->identifier) != NULL)
     return ERROR_DUPLICATED_STRUCTURE_MEMBER;
 
-  sm = (YR_STRUCTURE_MEMBER*) yr_malloc(sizeof(YR_STRUCTURE_MEMBER));
+  sm = (YR_STRUCTURE_MEMBER*) _yr_object_alloc(
+      object->notebook, sizeof(YR_STRUCTURE_MEMBER));
 
   if (sm == NULL)
     return ERROR_INSUFFICIENT_MEMORY;
@@ -712,7 +852,8 @@ int yr_object_array_set_item(YR_OBJECT* object, YR_OBJECT* item, int index)
 
     while (capacity <= index) capacity *= 2;
 
-    array->items = (YR_ARRAY_ITEMS*) yr_malloc(
+    array->items = (YR_ARRAY_ITEMS*) _yr_object_alloc(
+        object->notebook,
         sizeof(YR_ARRAY_ITEMS) + capacity * sizeof(YR_OBJECT*));
 
     if (array->items == NULL)
@@ -729,8 +870,11 @@ int yr_object_array_set_item(YR_OBJECT* object, YR_OBJECT* item, int index)
 
     while (capacity <= index) capacity *= 2;
 
-    array->items = (YR_ARRAY_ITEMS*) yr_realloc(
-        array->items, sizeof(YR_ARRAY_ITEMS) + capacity * sizeof(YR_OBJECT*));
+    array->items = (YR_ARRAY_ITEMS*) _yr_object_realloc(
+        object->notebook,
+        array->items,
+        sizeof(YR_ARRAY_ITEMS) + array->items->capacity * sizeof(YR_OBJECT*),
+        sizeof(YR_ARRAY_ITEMS) + capacity * sizeof(YR_OBJECT*));
 
     if (array->items == NULL)
       return ERROR_INSUFFICIENT_MEMORY;
@@ -796,7 +940,8 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
   {
     count = 64;
 
-    dict->items = (YR_DICTIONARY_ITEMS*) yr_malloc(
+    dict->items = (YR_DICTIONARY_ITEMS*) _yr_object_alloc(
+        object->notebook,
         sizeof(YR_DICTIONARY_ITEMS) + count * sizeof(dict->items->objects[0]));
 
     if (dict->items == NULL)
@@ -810,8 +955,11 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
   else if (dict->items->free == 0)
   {
     count = dict->items->used * 2;
-    dict->items = (YR_DICTIONARY_ITEMS*) yr_realloc(
+    dict->items = (YR_DICTIONARY_ITEMS*) _yr_object_realloc(
+        object->notebook,
         dict->items,
+        sizeof(YR_DICTIONARY_ITEMS) +
+            dict->items->used * sizeof(dict->items->objects[0]),
         sizeof(YR_DICTIONARY_ITEMS) + count * sizeof(dict->items->objects[0]));
 
     if (dict->items == NULL)
@@ -828,7 +976,8 @@ int yr_object_dict_set_item(YR_OBJECT* object, YR_OBJECT* item, const char* key)
 
   item->parent = object;
 
-  dict->items->objects[dict->items->used].key = ss_new(key);
+  dict->items->objects[dict->items->used].key = _yr_object_ss_new(
+      object->notebook, key, strlen(key), 0);
   dict->items->objects[dict->items->used].obj = item;
 
   dict->items->used++;
@@ -1034,21 +1183,15 @@ int yr_object_set_string(
   assert(string_obj->type == OBJECT_TYPE_STRING);
 
   if (string_obj->value.ss != NULL)
-    yr_free(string_obj->value.ss);
+    _yr_object_free(string_obj->notebook, string_obj->value.ss);
 
   if (value != NULL)
   {
-    string_obj->value.ss = (SIZED_STRING*) yr_malloc(
-        len + sizeof(SIZED_STRING));
+    string_obj->value.ss = _yr_object_ss_new(
+        string_obj->notebook, value, len, 0);
 
     if (string_obj->value.ss == NULL)
       return ERROR_INSUFFICIENT_MEMORY;
-
-    string_obj->value.ss->length = (uint32_t) len;
-    string_obj->value.ss->flags = 0;
-
-    memcpy(string_obj->value.ss->c_string, value, len);
-    string_obj->value.ss->c_string[len] = '\0';
   }
   else
   {
@@ -1131,6 +1274,8 @@ YR_API void yr_object_print_data(
 
   case OBJECT_TYPE_STRUCTURE:
 
+    yr_object_populate(object, NULL);
+
     member = object_as_structure(object)->members;
 
     while (member != NULL)
@@ -596,6 +596,16 @@ static int _yr_parser_write_string(
 
   string->flags = modifier.flags;
 
+  if (compiler->atoms_callback != NULL)
+  {
+    compiler->atoms_callback(
+        _yr_compiler_get_rule_by_idx(compiler, compiler->current_rule_idx),
+        identifier,
+        atom_list,
+        *min_atom_quality,
+        compiler->atoms_clbk_user_data);
+  }
+
   // Add the string to Aho-Corasick automaton.
   result = yr_ac_add_string(
       compiler->automaton, string, string->idx, atom_list, compiler->arena);
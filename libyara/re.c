@@ -1661,6 +1661,928 @@ static int _yr_re_fiber_sync(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// yr_re_exec runs regexps with a DFA that is built lazily from the fibers.
+//
+// A DFA state is a snapshot of the fiber list at the top of the main loop in
+// yr_re_exec: the (ip, rc, sp, stack) tuples of the live fibers, in priority
+// order and without duplicates. If the regexp has no anchors or word
+// boundaries, the next snapshot depends only on the current one and on the
+// input byte. So it can be computed once, by running the fibers with that
+// byte, and reused afterwards. Bytes that every instruction in the regexp
+// treats the same way are grouped in classes that share their transitions.
+//
+// Repeat counters are part of the state, so regexps like "a{1,1000}" can
+// produce many states. A DFA holds at most RE_DFA_MAX_STATES states. When that
+// limit is reached, the current execution continues with the fibers from the
+// last state and the DFA is flushed.
+//
+// DFAs are keyed by the address of the regexp's code. This is safe because
+// all regexps executed in a scan context live in the arena of its rules.
+//
+
+#define RE_DFA_UNKNOWN_STATE -1
+
+// Regexps with a larger code are executed with fibers only.
+#define RE_DFA_MAX_CODE_SIZE 65536
+
+// Flags that change the outcome of a transition.
+#define RE_DFA_FLAGS_MASK \
+  (RE_FLAGS_NO_CASE | RE_FLAGS_DOT_ALL | RE_FLAGS_EXHAUSTIVE | RE_FLAGS_SCAN)
+
+typedef struct _RE_DFA_STATE
+{
+  uint32_t hash;
+
+  // Position and length of the state's fibers in RE_DFA's words. Each fiber
+  // is encoded as its ip offset, rc, sp and sp + 1 stack items.
+  uint32_t offset;
+  uint32_t length;
+
+  // Number of fibers at RE_OPCODE_MATCH.
+  uint16_t matches;
+
+  // True if no fiber in the state can consume more input.
+  uint16_t final;
+
+} RE_DFA_STATE;
+
+struct RE_DFA
+{
+  const uint8_t* code;
+  int flags;
+
+  // True if the regexp can't be executed with a DFA, or if the DFA was
+  // flushed more than RE_DFA_MAX_FLUSHES times.
+  bool disabled;
+  int flushes;
+
+  // Maps each byte to its class, and each class to one of its bytes. Class
+  // number "num_classes" is used for wide characters with a non-zero high
+  // byte, which don't match any instruction.
+  uint8_t byte_class[256];
+  uint8_t class_byte[256];
+  int num_classes;
+
+  // State 0 is the initial state. Transitions are stored in rows of
+  // num_classes + 1 entries, one row per state.
+  RE_DFA_STATE* states;
+  int32_t* transitions;
+  int32_t num_states;
+  int32_t max_states;
+
+  uint32_t* words;
+  size_t words_used;
+  size_t words_capacity;
+
+  size_t memory;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns true if the instruction at "ip", which must be one that reads a byte
+// from the input, matches "chr". Must be kept in sync with yr_re_exec.
+//
+static bool _yr_re_dfa_char_matches(const uint8_t* ip, uint8_t chr, int flags)
+{
+  uint16_t opcode_args;
+
+  switch (*ip)
+  {
+  case RE_OPCODE_ANY:
+  case RE_OPCODE_REPEAT_ANY_GREEDY:
+  case RE_OPCODE_REPEAT_ANY_UNGREEDY:
+    return (flags & RE_FLAGS_DOT_ALL) || chr != 0x0A;
+
+  case RE_OPCODE_LITERAL:
+    if (flags & RE_FLAGS_NO_CASE)
+      return yr_lowercase[chr] == yr_lowercase[*(ip + 1)];
+    return chr == *(ip + 1);
+
+  case RE_OPCODE_NOT_LITERAL:
+    return chr != *(ip + 1);
+
+  case RE_OPCODE_MASKED_LITERAL:
+    opcode_args = yr_unaligned_u16(ip + 1);
+    return (chr & (opcode_args >> 8)) == (opcode_args & 0xFF);
+
+  case RE_OPCODE_MASKED_NOT_LITERAL:
+    opcode_args = yr_unaligned_u16(ip + 1);
+    return (chr & (opcode_args >> 8)) != (opcode_args & 0xFF);
+
+  case RE_OPCODE_CLASS:
+    return _yr_re_is_char_in_class(
+        (RE_CLASS*) (ip + 1), chr, flags & RE_FLAGS_NO_CASE);
+
+  case RE_OPCODE_WORD_CHAR:
+    return _yr_re_is_word_char(&chr, 1);
+
+  case RE_OPCODE_NON_WORD_CHAR:
+    return !_yr_re_is_word_char(&chr, 1);
+
+  case RE_OPCODE_SPACE:
+  case RE_OPCODE_NON_SPACE:
+    switch (chr)
+    {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+    case '\v':
+    case '\f':
+      return *ip == RE_OPCODE_SPACE;
+    }
+    return *ip == RE_OPCODE_NON_SPACE;
+
+  case RE_OPCODE_DIGIT:
+    return isdigit(chr);
+
+  case RE_OPCODE_NON_DIGIT:
+    return !isdigit(chr);
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns how much a fiber's ip advances after the instruction at "ip" has
+// matched a byte, or -1 if the instruction doesn't read from the input.
+//
+static int _yr_re_dfa_char_advance(const uint8_t* ip)
+{
+  switch (*ip)
+  {
+  case RE_OPCODE_ANY:
+  case RE_OPCODE_WORD_CHAR:
+  case RE_OPCODE_NON_WORD_CHAR:
+  case RE_OPCODE_SPACE:
+  case RE_OPCODE_NON_SPACE:
+  case RE_OPCODE_DIGIT:
+  case RE_OPCODE_NON_DIGIT:
+    return 1;
+
+  case RE_OPCODE_LITERAL:
+  case RE_OPCODE_NOT_LITERAL:
+    return 2;
+
+  case RE_OPCODE_MASKED_LITERAL:
+  case RE_OPCODE_MASKED_NOT_LITERAL:
+    return 3;
+
+  case RE_OPCODE_CLASS:
+    return sizeof(RE_CLASS) + 1;
+
+  // The fiber spins in this instruction, _yr_re_fiber_sync moves it forward.
+  case RE_OPCODE_REPEAT_ANY_GREEDY:
+  case RE_OPCODE_REPEAT_ANY_UNGREEDY:
+    return 0;
+  }
+
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Splits the DFA's byte classes so that all the bytes in a class are either
+// matched or not matched by the instruction at "ip".
+//
+static void _yr_re_dfa_split_classes(RE_DFA* dfa, const uint8_t* ip)
+{
+  int16_t new_class[256][2];
+  int num_classes = 0;
+
+  memset(new_class, 0xFF, sizeof(new_class));
+
+  for (int i = 0; i < 256; i++)
+  {
+    int match = _yr_re_dfa_char_matches(ip, (uint8_t) i, dfa->flags) ? 1 : 0;
+    int16_t* c = &new_class[dfa->byte_class[i]][match];
+
+    if (*c == -1)
+      *c = num_classes++;
+
+    dfa->byte_class[i] = (uint8_t) *c;
+  }
+
+  dfa->num_classes = num_classes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Walks all the instructions reachable from the start of the regexp, checking
+// that the DFA can execute them, and computes the byte classes. Returns true
+// if the regexp can be executed with a DFA.
+//
+static bool _yr_re_dfa_analyze(RE_DFA* dfa)
+{
+  uint8_t* visited;
+  uint32_t* pending;
+  uint32_t* new_pending;
+
+  size_t pending_count = 0;
+  size_t pending_capacity = 64;
+
+  bool eligible = true;
+
+  visited = (uint8_t*) yr_calloc(RE_DFA_MAX_CODE_SIZE / 8, 1);
+  pending = (uint32_t*) yr_malloc(pending_capacity * sizeof(uint32_t));
+
+  if (visited == NULL || pending == NULL)
+  {
+    yr_free(visited);
+    yr_free(pending);
+    return false;
+  }
+
+  memset(dfa->byte_class, 0, sizeof(dfa->byte_class));
+  dfa->num_classes = 1;
+
+  pending[pending_count++] = 0;
+
+  while (eligible && pending_count > 0)
+  {
+    int64_t offset = pending[--pending_count];
+    int64_t next = -1;
+    int64_t branch = -1;
+    bool has_branch = false;
+
+    const uint8_t* ip = dfa->code + offset;
+
+    if (visited[offset / 8] & (1 << (offset % 8)))
+      continue;
+
+    visited[offset / 8] |= 1 << (offset % 8);
+
+    switch (*ip)
+    {
+    case RE_OPCODE_REPEAT_ANY_GREEDY:
+    case RE_OPCODE_REPEAT_ANY_UNGREEDY:
+      _yr_re_dfa_split_classes(dfa, ip);
+      next = offset + 1 + sizeof(RE_REPEAT_ANY_ARGS);
+      break;
+
+    case RE_OPCODE_SPLIT_A:
+    case RE_OPCODE_SPLIT_B:
+      next = offset + 3 + sizeof(RE_SPLIT_ID_TYPE);
+      branch = offset +
+               (int16_t) yr_unaligned_i16(ip + 1 + sizeof(RE_SPLIT_ID_TYPE));
+      has_branch = true;
+      break;
+
+    case RE_OPCODE_JUMP:
+      branch = offset + (int16_t) yr_unaligned_i16(ip + 1);
+      has_branch = true;
+      break;
+
+    case RE_OPCODE_REPEAT_START_GREEDY:
+    case RE_OPCODE_REPEAT_START_UNGREEDY:
+    case RE_OPCODE_REPEAT_END_GREEDY:
+    case RE_OPCODE_REPEAT_END_UNGREEDY:
+      next = offset + 1 + sizeof(RE_REPEAT_ARGS);
+      branch = offset + ((RE_REPEAT_ARGS*) (ip + 1))->offset;
+      has_branch = true;
+      break;
+
+    case RE_OPCODE_MATCH:
+      break;
+
+    default:
+      if (_yr_re_dfa_char_advance(ip) > 0)
+      {
+        _yr_re_dfa_split_classes(dfa, ip);
+        next = offset + _yr_re_dfa_char_advance(ip);
+      }
+      else
+      {
+        // Anchors and word boundaries depend on the position of the fiber
+        // within the input, not only on the input byte.
+        eligible = false;
+      }
+    }
+
+    if (next >= RE_DFA_MAX_CODE_SIZE || branch >= RE_DFA_MAX_CODE_SIZE ||
+        (has_branch && branch < 0))
+      eligible = false;
+
+    if (pending_count + 2 > pending_capacity)
+    {
+      pending_capacity *= 2;
+      new_pending = (uint32_t*) yr_realloc(
+          pending, pending_capacity * sizeof(uint32_t));
+
+      if (new_pending == NULL)
+        eligible = false;
+      else
+        pending = new_pending;
+    }
+
+    if (eligible && next >= 0)
+      pending[pending_count++] = (uint32_t) next;
+
+    if (eligible && has_branch)
+      pending[pending_count++] = (uint32_t) branch;
+  }
+
+  for (int i = 255; i >= 0; i--) dfa->class_byte[dfa->byte_class[i]] = i;
+
+  yr_free(visited);
+  yr_free(pending);
+
+  return eligible;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Releases the DFA's states.
+//
+static void _yr_re_dfa_free_states(RE_DFA_CACHE* cache, RE_DFA* dfa)
+{
+  yr_free(dfa->states);
+  yr_free(dfa->transitions);
+  yr_free(dfa->words);
+
+  cache->memory -= dfa->memory;
+
+  dfa->states = NULL;
+  dfa->transitions = NULL;
+  dfa->words = NULL;
+  dfa->num_states = 0;
+  dfa->max_states = 0;
+  dfa->words_used = 0;
+  dfa->words_capacity = 0;
+  dfa->memory = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the index of the state with the given fibers, adding it to the DFA
+// if it doesn't exist yet. Returns RE_DFA_UNKNOWN_STATE if the state can't be
+// added.
+//
+static int32_t _yr_re_dfa_add_state(
+    RE_DFA_CACHE* cache,
+    RE_DFA* dfa,
+    const uint32_t* words,
+    size_t length,
+    uint16_t matches,
+    uint16_t final)
+{
+  RE_DFA_STATE* state;
+
+  uint32_t hash = yr_hash(0, words, length * sizeof(uint32_t));
+  int row = dfa->num_classes + 1;
+
+  for (int32_t i = 0; i < dfa->num_states; i++)
+  {
+    state = &dfa->states[i];
+
+    if (state->hash == hash && state->length == length &&
+        memcmp(
+            dfa->words + state->offset, words, length * sizeof(uint32_t)) == 0)
+      return i;
+  }
+
+  if (dfa->num_states == RE_DFA_MAX_STATES)
+    return RE_DFA_UNKNOWN_STATE;
+
+  if (dfa->num_states == dfa->max_states)
+  {
+    int32_t max_states = yr_min(
+        yr_max(dfa->max_states * 2, 8), RE_DFA_MAX_STATES);
+
+    size_t growth = (max_states - dfa->max_states) *
+                    (sizeof(RE_DFA_STATE) + row * sizeof(int32_t));
+
+    RE_DFA_STATE* states;
+    int32_t* transitions;
+
+    if (cache->memory + growth > RE_DFA_MAX_MEMORY)
+      return RE_DFA_UNKNOWN_STATE;
+
+    states = (RE_DFA_STATE*) yr_realloc(
+        dfa->states, max_states * sizeof(RE_DFA_STATE));
+
+    if (states == NULL)
+      return RE_DFA_UNKNOWN_STATE;
+
+    dfa->states = states;
+
+    transitions = (int32_t*) yr_realloc(
+        dfa->transitions, max_states * row * sizeof(int32_t));
+
+    if (transitions == NULL)
+      return RE_DFA_UNKNOWN_STATE;
+
+    dfa->transitions = transitions;
+    dfa->max_states = max_states;
+    dfa->memory += growth;
+    cache->memory += growth;
+  }
+
+  if (dfa->words_used + length > dfa->words_capacity)
+  {
+    size_t capacity = yr_max(
+        dfa->words_capacity * 2, dfa->words_used + length + 64);
+
+    size_t growth = (capacity - dfa->words_capacity) * sizeof(uint32_t);
+
+    uint32_t* new_words;
+
+    if (cache->memory + growth > RE_DFA_MAX_MEMORY)
+      return RE_DFA_UNKNOWN_STATE;
+
+    new_words = (uint32_t*) yr_realloc(
+        dfa->words, capacity * sizeof(uint32_t));
+
+    if (new_words == NULL)
+      return RE_DFA_UNKNOWN_STATE;
+
+    dfa->words = new_words;
+    dfa->words_capacity = capacity;
+    dfa->memory += growth;
+    cache->memory += growth;
+  }
+
+  memcpy(dfa->words + dfa->words_used, words, length * sizeof(uint32_t));
+
+  state = &dfa->states[dfa->num_states];
+  state->hash = hash;
+  state->offset = (uint32_t) dfa->words_used;
+  state->length = (uint32_t) length;
+  state->matches = matches;
+  state->final = final;
+
+  dfa->words_used += length;
+
+  for (int i = 0; i < row; i++)
+    dfa->transitions[dfa->num_states * row + i] = RE_DFA_UNKNOWN_STATE;
+
+  return dfa->num_states++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Removes duplicated fibers from the list, exactly like the main loop in
+// yr_re_exec does, and returns the index of the state corresponding to the
+// remaining fibers in "state". If the state can't be added to the DFA "state"
+// is RE_DFA_UNKNOWN_STATE.
+//
+static int _yr_re_dfa_snapshot(
+    YR_SCAN_CONTEXT* context,
+    RE_DFA* dfa,
+    RE_FIBER_LIST* fibers,
+    int32_t* state)
+{
+  RE_DFA_CACHE* cache = &context->re_dfa_cache;
+  RE_FIBER* fiber;
+  RE_FIBER* next_fiber;
+
+  size_t length = 0;
+  uint16_t matches = 0;
+  uint16_t final = !(dfa->flags & RE_FLAGS_SCAN);
+  bool consuming = true;
+
+  fiber = fibers->head;
+
+  while (fiber != NULL)
+  {
+    next_fiber = fiber->next;
+
+    if (_yr_re_fiber_exists(fibers, fiber, fiber->prev))
+      _yr_re_fiber_kill(fibers, &context->re_fiber_pool, fiber);
+
+    fiber = next_fiber;
+  }
+
+  for (fiber = fibers->head; fiber != NULL; fiber = fiber->next)
+  {
+    size_t needed = length + 4 + fiber->sp;
+
+    if (needed > cache->scratch_capacity)
+    {
+      size_t capacity = yr_max(cache->scratch_capacity * 2, needed + 256);
+      uint32_t* scratch = (uint32_t*) yr_realloc(
+          cache->scratch, capacity * sizeof(uint32_t));
+
+      if (scratch == NULL)
+      {
+        *state = RE_DFA_UNKNOWN_STATE;
+        return ERROR_SUCCESS;
+      }
+
+      cache->scratch = scratch;
+      cache->scratch_capacity = capacity;
+    }
+
+    cache->scratch[length++] = (uint32_t) (fiber->ip - dfa->code);
+    cache->scratch[length++] = (uint32_t) fiber->rc;
+    cache->scratch[length++] = (uint32_t) fiber->sp;
+
+    for (int32_t i = 0; i <= fiber->sp; i++)
+      cache->scratch[length++] = fiber->stack[i];
+
+    // Fibers after the first one at RE_OPCODE_MATCH are killed when the
+    // match is not exhaustive, so they don't keep the state alive.
+    if (*fiber->ip == RE_OPCODE_MATCH)
+    {
+      matches++;
+
+      if (!(dfa->flags & RE_FLAGS_EXHAUSTIVE))
+        consuming = false;
+    }
+    else if (consuming)
+    {
+      final = false;
+    }
+  }
+
+  *state = _yr_re_dfa_add_state(
+      cache, dfa, cache->scratch, length, matches, final);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends to "fibers" the fibers in the given state.
+//
+static int _yr_re_dfa_restore(
+    YR_SCAN_CONTEXT* context,
+    RE_DFA* dfa,
+    int32_t state,
+    RE_FIBER_LIST* fibers)
+{
+  const uint32_t* words = dfa->words + dfa->states[state].offset;
+  const uint32_t* end = words + dfa->states[state].length;
+
+  RE_FIBER* fiber;
+
+  while (words < end)
+  {
+    FAIL_ON_ERROR_WITH_CLEANUP(
+        _yr_re_fiber_create(&context->re_fiber_pool, &fiber),
+        _yr_re_fiber_kill_all(fibers, &context->re_fiber_pool));
+
+    fiber->ip = dfa->code + words[0];
+    fiber->rc = (int32_t) words[1];
+    fiber->sp = (int32_t) words[2];
+
+    for (int32_t i = 0; i <= fiber->sp; i++)
+      fiber->stack[i] = (uint16_t) words[3 + i];
+
+    words += 4 + fiber->sp;
+
+    _yr_re_fiber_append(fibers, fiber);
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Computes the transition from "state" with the bytes in class "symbol" by
+// running one iteration of the yr_re_exec loop over the state's fibers. The
+// resulting state is returned in "next_state", which is RE_DFA_UNKNOWN_STATE
+// if the DFA is full.
+//
+static int _yr_re_dfa_transition(
+    YR_SCAN_CONTEXT* context,
+    RE_DFA* dfa,
+    int32_t state,
+    int symbol,
+    int32_t* next_state)
+{
+  RE_FIBER_POOL* fiber_pool = &context->re_fiber_pool;
+  RE_FIBER_LIST fibers;
+  RE_FIBER* fiber;
+  RE_FIBER* next_fiber;
+
+  int result;
+
+  fibers.head = NULL;
+  fibers.tail = NULL;
+
+  FAIL_ON_ERROR(_yr_re_dfa_restore(context, dfa, state, &fibers));
+
+  fiber = fibers.head;
+
+  while (fiber != NULL)
+  {
+    if (*fiber->ip == RE_OPCODE_MATCH)
+    {
+      if (dfa->flags & RE_FLAGS_EXHAUSTIVE)
+      {
+        fiber = _yr_re_fiber_kill(&fibers, fiber_pool, fiber);
+      }
+      else
+      {
+        _yr_re_fiber_kill_tail(&fibers, fiber_pool, fiber);
+        fiber = NULL;
+      }
+    }
+    else if (
+        symbol == dfa->num_classes ||
+        !_yr_re_dfa_char_matches(
+            fiber->ip, dfa->class_byte[symbol], dfa->flags))
+    {
+      fiber = _yr_re_fiber_kill(&fibers, fiber_pool, fiber);
+    }
+    else
+    {
+      fiber->ip += _yr_re_dfa_char_advance(fiber->ip);
+      next_fiber = fiber->next;
+
+      FAIL_ON_ERROR_WITH_CLEANUP(
+          _yr_re_fiber_sync(&fibers, fiber_pool, fiber),
+          _yr_re_fiber_kill_all(&fibers, fiber_pool));
+
+      fiber = next_fiber;
+    }
+  }
+
+  if (dfa->flags & RE_FLAGS_SCAN)
+  {
+    FAIL_ON_ERROR_WITH_CLEANUP(
+        _yr_re_fiber_create(fiber_pool, &fiber),
+        _yr_re_fiber_kill_all(&fibers, fiber_pool));
+
+    fiber->ip = dfa->code;
+    _yr_re_fiber_append(&fibers, fiber);
+
+    FAIL_ON_ERROR_WITH_CLEANUP(
+        _yr_re_fiber_sync(&fibers, fiber_pool, fiber),
+        _yr_re_fiber_kill_all(&fibers, fiber_pool));
+  }
+
+  result = _yr_re_dfa_snapshot(context, dfa, &fibers, next_state);
+
+  _yr_re_fiber_kill_all(&fibers, fiber_pool);
+
+  if (result == ERROR_SUCCESS && *next_state != RE_DFA_UNKNOWN_STATE)
+    dfa->transitions[state * (dfa->num_classes + 1) + symbol] = *next_state;
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Computes the initial state of the DFA. Returns false if the regexp can't be
+// executed with the DFA.
+//
+static bool _yr_re_dfa_start(YR_SCAN_CONTEXT* context, RE_DFA* dfa)
+{
+  RE_FIBER_LIST fibers;
+  RE_FIBER* fiber;
+
+  int32_t state;
+
+  if (_yr_re_fiber_create(&context->re_fiber_pool, &fiber) != ERROR_SUCCESS)
+    return false;
+
+  fiber->ip = dfa->code;
+  fibers.head = fiber;
+  fibers.tail = fiber;
+
+  if (_yr_re_fiber_sync(&fibers, &context->re_fiber_pool, fiber) !=
+          ERROR_SUCCESS ||
+      _yr_re_dfa_snapshot(context, dfa, &fibers, &state) != ERROR_SUCCESS)
+  {
+    state = RE_DFA_UNKNOWN_STATE;
+  }
+
+  _yr_re_fiber_kill_all(&fibers, &context->re_fiber_pool);
+
+  // When scanning, yr_re_exec doesn't start a new fiber after the last byte
+  // of the input, but the DFA does. The extra fiber is harmless unless the
+  // regexp matches the empty string.
+  if (state != RE_DFA_UNKNOWN_STATE && (dfa->flags & RE_FLAGS_SCAN) &&
+      dfa->states[state].matches > 0)
+    state = RE_DFA_UNKNOWN_STATE;
+
+  return state == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Discards all the states in the DFA except the initial one.
+//
+static void _yr_re_dfa_flush(YR_SCAN_CONTEXT* context, RE_DFA* dfa)
+{
+  if (++dfa->flushes > RE_DFA_MAX_FLUSHES)
+  {
+    _yr_re_dfa_free_states(&context->re_dfa_cache, dfa);
+    dfa->disabled = true;
+    return;
+  }
+
+  dfa->num_states = 1;
+  dfa->words_used = dfa->states[0].length;
+
+  for (int i = 0; i <= dfa->num_classes; i++)
+    dfa->transitions[i] = RE_DFA_UNKNOWN_STATE;
+}
+
+static void _yr_re_dfa_destroy(RE_DFA* dfa)
+{
+  yr_free(dfa->states);
+  yr_free(dfa->transitions);
+  yr_free(dfa->words);
+  yr_free(dfa);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the first slot in the cache's table to probe for a DFA.
+//
+static size_t _yr_re_dfa_slot(
+    const uint8_t* code,
+    int flags,
+    size_t dfas_size)
+{
+  uint64_t hash = ((uint64_t) (uintptr_t) code ^ ((uint64_t) flags << 48)) *
+                  0x9E3779B97F4A7C15ULL;
+
+  return (size_t) (hash >> 32) & (dfas_size - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Inserts a DFA in the cache's table, which must have a free slot.
+//
+static void _yr_re_dfa_insert(RE_DFA_CACHE* cache, RE_DFA* dfa)
+{
+  size_t i = _yr_re_dfa_slot(dfa->code, dfa->flags, cache->dfas_size);
+
+  while (cache->dfas[i] != NULL) i = (i + 1) & (cache->dfas_size - 1);
+
+  cache->dfas[i] = dfa;
+  cache->dfas_count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the DFA for the given regexp code and flags, creating it if it
+// doesn't exist yet. Returns NULL if the DFA can't be created.
+//
+static RE_DFA* _yr_re_dfa_get(
+    YR_SCAN_CONTEXT* context,
+    const uint8_t* code,
+    int flags)
+{
+  RE_DFA_CACHE* cache = &context->re_dfa_cache;
+  RE_DFA* dfa;
+
+  size_t i;
+
+  flags &= RE_DFA_FLAGS_MASK;
+
+  if (cache->dfas != NULL)
+  {
+    i = _yr_re_dfa_slot(code, flags, cache->dfas_size);
+
+    while ((dfa = cache->dfas[i]) != NULL)
+    {
+      if (dfa->code == code && dfa->flags == flags)
+        return dfa;
+
+      i = (i + 1) & (cache->dfas_size - 1);
+    }
+  }
+
+  // Keep the table at most half full.
+  if (2 * (cache->dfas_count + 1) > cache->dfas_size)
+  {
+    RE_DFA** old_dfas = cache->dfas;
+    size_t old_size = cache->dfas_size;
+
+    size_t new_size = yr_max(2 * old_size, 64);
+    RE_DFA** new_dfas = (RE_DFA**) yr_calloc(new_size, sizeof(RE_DFA*));
+
+    if (new_dfas == NULL)
+      return NULL;
+
+    cache->dfas = new_dfas;
+    cache->dfas_size = new_size;
+    cache->dfas_count = 0;
+
+    for (i = 0; i < old_size; i++)
+      if (old_dfas[i] != NULL)
+        _yr_re_dfa_insert(cache, old_dfas[i]);
+
+    yr_free(old_dfas);
+  }
+
+  dfa = (RE_DFA*) yr_calloc(1, sizeof(RE_DFA));
+
+  if (dfa == NULL)
+    return NULL;
+
+  dfa->code = code;
+  dfa->flags = flags;
+
+  if (!_yr_re_dfa_analyze(dfa) || !_yr_re_dfa_start(context, dfa))
+  {
+    _yr_re_dfa_free_states(cache, dfa);
+    dfa->disabled = true;
+  }
+
+  _yr_re_dfa_insert(cache, dfa);
+
+  return dfa;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs the DFA over the input. Arguments are the same as in yr_re_exec, plus
+// the position of the first byte ("input" and "bytes_matched") and the
+// maximum number of bytes to read. If the DFA gets full the fibers of the
+// last state are put in "fibers", and "input" and "bytes_matched" are set to
+// the position where yr_re_exec must continue with them.
+//
+static int _yr_re_dfa_exec(
+    YR_SCAN_CONTEXT* context,
+    RE_DFA* dfa,
+    const uint8_t* input_data,
+    int flags,
+    RE_MATCH_CALLBACK_FUNC callback,
+    void* callback_args,
+    int* matches,
+    RE_FIBER_LIST* fibers,
+    const uint8_t** input,
+    int* bytes_matched,
+    int max_bytes_matched)
+{
+  const int row = dfa->num_classes + 1;
+  const int character_size = (flags & RE_FLAGS_WIDE) ? 2 : 1;
+  const int input_incr = (flags & RE_FLAGS_BACKWARDS) ? -character_size
+                                                      : character_size;
+
+  int32_t state = 0;
+  int32_t next_state = RE_DFA_UNKNOWN_STATE;
+  int symbol;
+
+  while (true)
+  {
+    if (*bytes_matched < max_bytes_matched && !dfa->states[state].final)
+    {
+      if (character_size == 2 && *(*input + 1) != 0)
+        symbol = dfa->num_classes;
+      else
+        symbol = dfa->byte_class[**input];
+
+      next_state = dfa->transitions[state * row + symbol];
+
+      if (next_state == RE_DFA_UNKNOWN_STATE)
+      {
+        FAIL_ON_ERROR(
+            _yr_re_dfa_transition(context, dfa, state, symbol, &next_state));
+
+        // The DFA is full, the execution continues with fibers from the
+        // current state, which hasn't been processed yet.
+        if (next_state == RE_DFA_UNKNOWN_STATE)
+        {
+          FAIL_ON_ERROR(_yr_re_dfa_restore(context, dfa, state, fibers));
+          _yr_re_dfa_flush(context, dfa);
+          return ERROR_SUCCESS;
+        }
+      }
+    }
+
+    for (int i = 0; i < dfa->states[state].matches; i++)
+    {
+      if (matches != NULL)
+        *matches = *bytes_matched;
+
+      if ((flags & RE_FLAGS_EXHAUSTIVE) && callback != NULL)
+      {
+        if (flags & RE_FLAGS_BACKWARDS)
+        {
+          FAIL_ON_ERROR(callback(
+              *input + character_size, *bytes_matched, flags, callback_args));
+        }
+        else
+        {
+          FAIL_ON_ERROR(
+              callback(input_data, *bytes_matched, flags, callback_args));
+        }
+      }
+    }
+
+    if (*bytes_matched >= max_bytes_matched || dfa->states[state].final)
+      return ERROR_SUCCESS;
+
+    state = next_state;
+    *input += input_incr;
+    *bytes_matched += character_size;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Releases the DFAs built by yr_re_exec in a scan context.
+//
+void yr_re_dfa_cache_destroy(RE_DFA_CACHE* cache)
+{
+  for (size_t i = 0; i < cache->dfas_size; i++)
+    if (cache->dfas[i] != NULL)
+      _yr_re_dfa_destroy(cache->dfas[i]);
+
+  yr_free(cache->dfas);
+  yr_free(cache->scratch);
+
+  cache->dfas = NULL;
+  cache->dfas_size = 0;
+  cache->dfas_count = 0;
+  cache->memory = 0;
+  cache->scratch = NULL;
+  cache->scratch_capacity = 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Executes a regular expression. The specified regular expression will try to
 // match the data starting at the address specified by "input". The "input"
@@ -1697,6 +2619,10 @@ static int _yr_re_fiber_sync(
 //                                      matches is -1.
 // Returns:
 //    ERROR_SUCCESS or any other error code.
+//
+// Regexps without anchors or word boundaries are executed with a DFA that is
+// built lazily and cached in the scan context, falling back to fibers when
+// the DFA gets too large. See _yr_re_dfa_exec.
 
 int yr_re_exec(
     YR_SCAN_CONTEXT* context,
@@ -1721,6 +2647,8 @@ int yr_re_exec(
   RE_FIBER* fiber;
   RE_FIBER* next_fiber;
 
+  RE_DFA* dfa;
+
   int bytes_matched;
   int max_bytes_matched;
 
@@ -1778,15 +2706,40 @@ int yr_re_exec(
   max_bytes_matched = max_bytes_matched - max_bytes_matched % character_size;
   bytes_matched = 0;
 
-  FAIL_ON_ERROR(_yr_re_fiber_create(&context->re_fiber_pool, &fiber));
+  fibers.head = NULL;
+  fibers.tail = NULL;
 
-  fiber->ip = code;
-  fibers.head = fiber;
-  fibers.tail = fiber;
+  dfa = _yr_re_dfa_get(context, code, flags);
 
-  FAIL_ON_ERROR_WITH_CLEANUP(
-      _yr_re_fiber_sync(&fibers, &context->re_fiber_pool, fiber),
-      _yr_re_fiber_kill_all(&fibers, &context->re_fiber_pool));
+  if (dfa != NULL && !dfa->disabled)
+  {
+    // If the DFA gets full the fibers are left in "fibers", and the loop
+    // below continues from the position where the DFA stopped.
+    FAIL_ON_ERROR(_yr_re_dfa_exec(
+        context,
+        dfa,
+        input_data,
+        flags,
+        callback,
+        callback_args,
+        matches,
+        &fibers,
+        &input,
+        &bytes_matched,
+        max_bytes_matched));
+  }
+  else
+  {
+    FAIL_ON_ERROR(_yr_re_fiber_create(&context->re_fiber_pool, &fiber));
+
+    fiber->ip = code;
+    fibers.head = fiber;
+    fibers.tail = fiber;
+
+    FAIL_ON_ERROR_WITH_CLEANUP(
+        _yr_re_fiber_sync(&fibers, &context->re_fiber_pool, fiber),
+        _yr_re_fiber_kill_all(&fibers, &context->re_fiber_pool));
+  }
 
   while (fibers.head != NULL)
   {
@@ -2162,7 +3115,7 @@ static void _yr_re_fast_exec_destroy_position_list(
 // by the value of the pointer they hold to the input, and it doesn't contain
 // duplicated pointer values.
 //
-int yr_re_fast_exec(
+static int _yr_re_fast_exec_list(
     YR_SCAN_CONTEXT* context,
     const uint8_t* code,
     const uint8_t* input_data,
@@ -2492,6 +3445,343 @@ int yr_re_fast_exec(
   return ERROR_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Executes a RE_FLAGS_FAST_REGEXP regexp like _yr_re_fast_exec_list does, but
+// keeping the positions in a buffer in the stack instead of a linked list of
+// pooled RE_FAST_EXEC_POSITION structures. Most hex strings never have more
+// than a handful of live positions, so this avoids walking and relinking the
+// pool for every candidate atom. The buffer emulates the list operations one
+// by one, so the positions are visited, inserted and removed in exactly the
+// same order, and the callback receives the same matches in the same order.
+//
+// Consecutive RE_OPCODE_LITERAL and RE_OPCODE_ANY instructions are executed
+// in a single round, which doesn't change the outcome because positions only
+// interact with each other in RE_OPCODE_REPEAT_ANY_UNGREEDY.
+//
+// If the positions don't fit in the buffer "overflow" is set to true and the
+// function returns without calling the callback, the callback is only called
+// by RE_OPCODE_MATCH, and all the positions are created before reaching it.
+// The caller must then execute the regexp with _yr_re_fast_exec_list.
+//
+static int _yr_re_fast_exec_buffered(
+    const uint8_t* code,
+    const uint8_t* input_data,
+    size_t input_forwards_size,
+    size_t input_backwards_size,
+    int flags,
+    RE_MATCH_CALLBACK_FUNC callback,
+    void* callback_args,
+    int* matches,
+    bool* overflow)
+{
+  typedef struct
+  {
+    const uint8_t* input;
+    int round;
+  } POSITION;
+
+  POSITION positions[RE_FAST_EXEC_MAX_POSITIONS];
+  RE_REPEAT_ANY_ARGS* repeat_any_args;
+
+  int input_incr = flags & RE_FLAGS_BACKWARDS ? -1 : 1;
+  int bytes_matched;
+  int max_bytes_matched;
+  int count = 1;
+  int round = 0;
+
+  if (flags & RE_FLAGS_BACKWARDS)
+    max_bytes_matched = (int) yr_min(input_backwards_size, YR_RE_SCAN_LIMIT);
+  else
+    max_bytes_matched = (int) yr_min(input_forwards_size, YR_RE_SCAN_LIMIT);
+
+  const uint8_t* ip = code;
+
+  positions[0].input = input_data;
+  positions[0].round = 0;
+
+  if (flags & RE_FLAGS_BACKWARDS)
+    positions[0].input--;
+
+  *overflow = false;
+
+  while (count > 0)
+  {
+    // Number of instructions executed in this round.
+    int run = 1;
+
+    if (*ip == RE_OPCODE_LITERAL)
+    {
+      while (*(ip + 2 * run) == RE_OPCODE_LITERAL) run++;
+    }
+    else if (*ip == RE_OPCODE_ANY)
+    {
+      while (*(ip + run) == RE_OPCODE_ANY) run++;
+    }
+
+    int i = 0;
+
+    while (i < count)
+    {
+      POSITION* current = &positions[i];
+
+      if (current->round != round)
+      {
+        i++;
+        continue;
+      }
+
+      bytes_matched = flags & RE_FLAGS_BACKWARDS
+                          ? (int) (input_data - current->input - 1)
+                          : (int) (current->input - input_data);
+
+      uint16_t opcode_args;
+      uint8_t mask;
+      uint8_t value;
+
+      bool match = false;
+
+      switch (*ip)
+      {
+      case RE_OPCODE_ANY:
+        if (bytes_matched + run > max_bytes_matched)
+          break;
+
+        match = true;
+        current->input += input_incr * run;
+        break;
+
+      case RE_OPCODE_LITERAL:
+        if (bytes_matched + run > max_bytes_matched)
+          break;
+
+        match = true;
+
+        for (int k = 0; k < run; k++)
+        {
+          if (*(current->input + k * input_incr) != *(ip + 2 * k + 1))
+          {
+            match = false;
+            break;
+          }
+        }
+
+        if (match)
+          current->input += input_incr * run;
+        break;
+
+      case RE_OPCODE_NOT_LITERAL:
+        if (bytes_matched >= max_bytes_matched)
+          break;
+
+        if (*current->input != *(ip + 1))
+        {
+          match = true;
+          current->input += input_incr;
+        }
+        break;
+
+      case RE_OPCODE_MASKED_LITERAL:
+        if (bytes_matched >= max_bytes_matched)
+          break;
+
+        opcode_args = yr_unaligned_u16(ip + 1);
+        mask = opcode_args >> 8;
+        value = opcode_args & 0xFF;
+
+        if ((*current->input & mask) == value)
+        {
+          match = true;
+          current->input += input_incr;
+        }
+        break;
+
+      case RE_OPCODE_MASKED_NOT_LITERAL:
+        if (bytes_matched >= max_bytes_matched)
+          break;
+
+        opcode_args = yr_unaligned_u16(ip + 1);
+        mask = opcode_args >> 8;
+        value = opcode_args & 0xFF;
+
+        if ((*current->input & mask) != value)
+        {
+          match = true;
+          current->input += input_incr;
+        }
+        break;
+
+      case RE_OPCODE_REPEAT_ANY_UNGREEDY:
+        repeat_any_args = (RE_REPEAT_ANY_ARGS*) (ip + 1);
+
+        if (bytes_matched + repeat_any_args->min >= max_bytes_matched)
+          break;
+
+        match = true;
+
+        const uint8_t* next_opcode = ip + 1 + sizeof(RE_REPEAT_ANY_ARGS);
+
+        // Index of the position after which new positions are inserted, see
+        // insertion_point in _yr_re_fast_exec_list.
+        int insertion_point = i;
+
+        for (int j = repeat_any_args->min + 1; j <= repeat_any_args->max; j++)
+        {
+          if (bytes_matched + j >= max_bytes_matched)
+            break;
+
+          const uint8_t* next_input = current->input + j * input_incr;
+
+          while (insertion_point + 1 < count &&
+                 positions[insertion_point + 1].input <= next_input)
+          {
+            insertion_point++;
+          }
+
+          if (positions[insertion_point].round == round + 1 &&
+              positions[insertion_point].input == next_input)
+            continue;
+
+          if (*(next_opcode) == RE_OPCODE_LITERAL &&
+              *(next_opcode + 1) != *next_input)
+            continue;
+
+          if (count == RE_FAST_EXEC_MAX_POSITIONS)
+          {
+            *overflow = true;
+            return ERROR_SUCCESS;
+          }
+
+          memmove(
+              &positions[insertion_point + 2],
+              &positions[insertion_point + 1],
+              (count - insertion_point - 1) * sizeof(POSITION));
+
+          positions[insertion_point + 1].input = next_input;
+          positions[insertion_point + 1].round = round + 1;
+          count++;
+        }
+
+        current->input += input_incr * repeat_any_args->min;
+        break;
+
+      case RE_OPCODE_MATCH:
+
+        if (flags & RE_FLAGS_EXHAUSTIVE)
+        {
+          FAIL_ON_ERROR(callback(
+              flags & RE_FLAGS_BACKWARDS
+                  ? yr_max(
+                        current->input + 1, input_data - input_backwards_size)
+                  : input_data,
+              yr_min(bytes_matched, max_bytes_matched),
+              flags,
+              callback_args));
+        }
+        else
+        {
+          if (matches != NULL)
+            *matches = bytes_matched;
+
+          return ERROR_SUCCESS;
+        }
+        break;
+
+      default:
+        assert(false);
+      }
+
+      if (match)
+      {
+        current->round = round + 1;
+        i++;
+      }
+      else
+      {
+        memmove(
+            &positions[i],
+            &positions[i + 1],
+            (count - i - 1) * sizeof(POSITION));
+
+        count--;
+      }
+    }
+
+    switch (*ip)
+    {
+    case RE_OPCODE_ANY:
+      ip += run;
+      break;
+    case RE_OPCODE_LITERAL:
+      ip += 2 * run;
+      break;
+    case RE_OPCODE_NOT_LITERAL:
+      ip += 2;
+      break;
+    case RE_OPCODE_MASKED_LITERAL:
+    case RE_OPCODE_MASKED_NOT_LITERAL:
+      ip += 3;
+      break;
+    case RE_OPCODE_REPEAT_ANY_UNGREEDY:
+      ip += 1 + sizeof(RE_REPEAT_ANY_ARGS);
+      break;
+    case RE_OPCODE_MATCH:
+      break;
+    default:
+      assert(false);
+    }
+
+    round++;
+  }
+
+  if (matches != NULL)
+    *matches = -1;
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Executes a regexp marked with RE_FLAGS_FAST_REGEXP. Arguments are the same
+// as in yr_re_exec.
+//
+int yr_re_fast_exec(
+    YR_SCAN_CONTEXT* context,
+    const uint8_t* code,
+    const uint8_t* input_data,
+    size_t input_forwards_size,
+    size_t input_backwards_size,
+    int flags,
+    RE_MATCH_CALLBACK_FUNC callback,
+    void* callback_args,
+    int* matches)
+{
+  bool overflow;
+
+  FAIL_ON_ERROR(_yr_re_fast_exec_buffered(
+      code,
+      input_data,
+      input_forwards_size,
+      input_backwards_size,
+      flags,
+      callback,
+      callback_args,
+      matches,
+      &overflow));
+
+  if (!overflow)
+    return ERROR_SUCCESS;
+
+  return _yr_re_fast_exec_list(
+      context,
+      code,
+      input_data,
+      input_forwards_size,
+      input_backwards_size,
+      flags,
+      callback,
+      callback_args,
+      matches);
+}
+
 static void _yr_re_print_node(RE_NODE* re_node, uint32_t indent)
 {
   RE_NODE* child;
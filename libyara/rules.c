@@ -30,10 +30,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include <yara/ac_compact.h>
+#include <yara/ac_prefilter.h>
 #include <yara/compiler.h>
 #include <yara/error.h>
 #include <yara/filemap.h>
 #include <yara/globals.h>
+#include <yara/libyara.h>
 #include <yara/mem.h>
 #include <yara/proc.h>
 #include <yara/rules.h>
@@ -382,6 +385,28 @@ int yr_rules_from_arena(YR_ARENA* arena, YR_RULES** rules)
       yr_bitmask_set(new_rules->no_required_strings, i);
   }
 
+  new_rules->ac_prefilter = NULL;
+  new_rules->ac_compact = NULL;
+
+  uint32_t ac_compact;
+
+  yr_get_configuration_uint32(YR_CONFIG_AC_COMPACT, &ac_compact);
+
+  int result = yr_ac_prefilter_create(new_rules, &new_rules->ac_prefilter);
+
+  // The compact rows are opt-in, see YR_CONFIG_AC_COMPACT in ac_compact.h.
+  if (result == ERROR_SUCCESS && ac_compact)
+    result = yr_ac_compact_create(new_rules, &new_rules->ac_compact);
+
+  if (result != ERROR_SUCCESS)
+  {
+    yr_ac_prefilter_destroy(new_rules->ac_prefilter);
+    yr_arena_release(arena);
+    yr_free(new_rules->no_required_strings);
+    yr_free(new_rules);
+    return result;
+  }
+
   *rules = new_rules;
 
   return ERROR_SUCCESS;
@@ -542,6 +567,8 @@ YR_API int yr_rules_destroy(YR_RULES* rules)
     external++;
   }
 
+  yr_ac_prefilter_destroy(rules->ac_prefilter);
+  yr_ac_compact_destroy(rules->ac_compact);
   yr_free(rules->no_required_strings);
   yr_arena_release(rules->arena);
   yr_free(rules);
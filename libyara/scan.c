@@ -1068,11 +1068,20 @@ int yr_scan_verify_match(
 
 #ifdef YR_PROFILING_ENABLED
   uint64_t start_time;
+  YR_STRING_PROFILING_INFO* string_info =
+      &context->string_profiling_info[string->idx];
+
+  int32_t matches_before = context->matches[string->idx].count;
+
   bool sample = context->profiling_info[string->rule_idx].atom_matches %
                     YR_MATCH_VERIFICATION_PROFILING_RATE ==
                 0;
 
-  if (sample)
+  bool sample_string = string_info->atom_matches %
+                           YR_MATCH_VERIFICATION_PROFILING_RATE ==
+                       0;
+
+  if (sample || sample_string)
     start_time = yr_stopwatch_elapsed_ns(&context->stopwatch);
 #endif
 
@@ -1113,13 +1122,24 @@ int yr_scan_verify_match(
   }
 
 #ifdef YR_PROFILING_ENABLED
-  if (sample)
+  if (sample || sample_string)
   {
     uint64_t finish_time = yr_stopwatch_elapsed_ns(&context->stopwatch);
-    context->profiling_info[string->rule_idx].match_time +=
-        (finish_time - start_time);
+
+    if (sample)
+      context->profiling_info[string->rule_idx].match_time +=
+          (finish_time - start_time);
+
+    if (sample_string)
+      string_info->match_time += (finish_time - start_time);
   }
   context->profiling_info[string->rule_idx].atom_matches++;
+
+  string_info->atom_matches++;
+
+  if (context->matches[string->idx].count > matches_before)
+    string_info->verified_matches +=
+        context->matches[string->idx].count - matches_before;
 #endif
 
   if (result != ERROR_SUCCESS)
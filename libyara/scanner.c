@@ -28,6 +28,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdlib.h>
+#include <yara/ac_compact.h>
+#include <yara/ac_prefilter.h>
 #include <yara/ahocorasick.h>
 #include <yara/error.h>
 #include <yara/exec.h>
@@ -36,12 +38,290 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <yara/mem.h>
 #include <yara/object.h>
 #include <yara/proc.h>
+#include <yara/re.h>
 #include <yara/scanner.h>
 #include <yara/strutils.h>
 #include <yara/types.h>
 
 #include "exception.h"
 
+// State of the Aho-Corasick automaton while it walks a memory block. Single
+// blocks are walked by _yr_scanner_scan_mem_block, which keeps the position
+// and state in locals and only syncs them here for the slow paths. Groups
+// of blocks are walked in lockstep by _yr_scanner_scan_mem_blocks_interleaved.
+typedef struct _YR_AC_CURSOR
+{
+  YR_SCANNER* scanner;
+  YR_MEMORY_BLOCK* block;
+  const uint8_t* data;
+  size_t size;
+
+  // Copied from the rules, so that a step only touches the cursor.
+  const YR_AC_TRANSITION* transition_table;
+  const uint32_t* match_table;
+
+  size_t i;
+  size_t next_timeout_check;
+  uint32_t state;
+  uint32_t prefilter;
+  uint32_t compact;
+
+  YR_STRING* report_string;
+  YR_RULE* rule;
+
+} YR_AC_CURSOR;
+
+static void _yr_scanner_ac_init(
+    YR_AC_CURSOR* cursor,
+    YR_SCANNER* scanner,
+    const uint8_t* block_data,
+    YR_MEMORY_BLOCK* block)
+{
+  cursor->scanner = scanner;
+  cursor->block = block;
+  cursor->data = block_data;
+  cursor->size = block->size;
+  cursor->transition_table = scanner->rules->ac_transition_table;
+  cursor->match_table = scanner->rules->ac_match_table;
+  cursor->i = 0;
+  cursor->next_timeout_check = scanner->timeout > 0 ? 0 : SIZE_MAX;
+  cursor->state = YR_AC_ROOT_STATE;
+  cursor->prefilter = YR_AC_PREFILTER_NONE;
+  cursor->compact = 0;
+  cursor->report_string = NULL;
+  cursor->rule = NULL;
+
+  if (scanner->rules->ac_prefilter != NULL &&
+      scanner->rules->ac_prefilter->enabled)
+    yr_get_configuration_uint32(YR_CONFIG_AC_PREFILTER, &cursor->prefilter);
+
+  if (scanner->rules->ac_compact != NULL)
+    yr_get_configuration_uint32(YR_CONFIG_AC_COMPACT, &cursor->compact);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the state the automaton moves to from state when it reads byte.
+//
+static inline uint32_t _yr_scanner_ac_transition(
+    const YR_AC_TRANSITION* transition_table,
+    uint32_t state,
+    uint8_t byte)
+{
+  uint16_t index = byte + 1;
+  YR_AC_TRANSITION transition = transition_table[state + index];
+
+  while (YR_AC_INVALID_TRANSITION(transition, index))
+  {
+    if (state != YR_AC_ROOT_STATE)
+    {
+      state = YR_AC_NEXT_STATE(transition_table[state]);
+      transition = transition_table[state + index];
+    }
+    else
+    {
+      transition = 0;
+      break;
+    }
+  }
+
+  return YR_AC_NEXT_STATE(transition);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Verifies the matches associated to cursor->state, which must have some.
+//
+static int _yr_scanner_ac_verify(YR_AC_CURSOR* cursor)
+{
+  YR_SCANNER* scanner = cursor->scanner;
+  YR_RULES* rules = scanner->rules;
+
+  // If the entry corresponding to state N in the match table is zero, it
+  // means that there's no match associated to the state. If it's non-zero,
+  // its value is the 1-based index within ac_match_pool where the first
+  // match resides.
+  YR_AC_MATCH* match =
+      &rules->ac_match_pool[rules->ac_match_table[cursor->state] - 1];
+
+  if (scanner->matches->count >= YR_SLOW_STRING_MATCHES)
+  {
+    cursor->report_string = match->string;
+    cursor->rule = cursor->report_string
+                       ? &rules->rules_table[cursor->report_string->rule_idx]
+                       : NULL;
+  }
+
+  while (match != NULL)
+  {
+    if (match->backtrack <= cursor->i)
+    {
+      FAIL_ON_ERROR(yr_scan_verify_match(
+          scanner,
+          match,
+          cursor->data,
+          cursor->block->size,
+          cursor->block->base,
+          cursor->i - match->backtrack));
+    }
+
+    match = match->next;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Checks the timeout every 4096 bytes or more. The prefilter makes the
+// position advance in jumps, so it can't rely on hitting multiples of 4096.
+//
+static inline int _yr_scanner_ac_check_timeout(YR_AC_CURSOR* cursor, size_t i)
+{
+  YR_SCANNER* scanner = cursor->scanner;
+
+  if (i >= cursor->next_timeout_check && scanner->timeout > 0)
+  {
+    if (yr_stopwatch_elapsed_ns(&scanner->stopwatch) > scanner->timeout)
+      return ERROR_SCAN_TIMEOUT;
+
+    cursor->next_timeout_check = i + 4096;
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reports the string that was slowing down the scan of the block, if any.
+//
+static int _yr_scanner_ac_report_slow(YR_AC_CURSOR* cursor)
+{
+  YR_SCANNER* scanner = cursor->scanner;
+
+  if (cursor->rule != NULL &&
+      scanner->matches->count >= YR_SLOW_STRING_MATCHES &&
+      scanner->matches->count < YR_MAX_STRING_MATCHES)
+  {
+    if (cursor->rule != NULL && cursor->report_string != NULL)
+    {
+      int result = scanner->callback(
+          scanner,
+          CALLBACK_MSG_TOO_SLOW_SCANNING,
+          (void*) cursor->report_string,
+          scanner->user_data);
+
+      if (result != CALLBACK_CONTINUE)
+        return ERROR_TOO_SLOW_SCANNING;
+    }
+  }
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Verifies the matches for the state reached at the end of the block and
+// reports strings that are slowing down the scan.
+//
+static int _yr_scanner_ac_finish(YR_AC_CURSOR* cursor)
+{
+  if (cursor->match_table[cursor->state] != 0)
+    FAIL_ON_ERROR(_yr_scanner_ac_verify(cursor));
+
+  return _yr_scanner_ac_report_slow(cursor);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Walks the block with the rows in rules->ac_compact while the automaton is
+// at depth 0 or 1, and with the transition table below that. Matches are
+// verified right after moving into a state that has them, which covers the
+// same (state, position) pairs as _yr_scanner_scan_mem_block's checks at
+// the top of each iteration and at the end.
+//
+static int _yr_scanner_scan_mem_block_compact(YR_AC_CURSOR* cursor)
+{
+  YR_RULES* rules = cursor->scanner->rules;
+  const YR_AC_COMPACT* compact = rules->ac_compact;
+  const YR_AC_TRANSITION* transition_table = cursor->transition_table;
+  const uint32_t* match_table = cursor->match_table;
+  const uint32_t* rows = compact->rows;
+  const uint32_t* row_slot = compact->row_slot;
+  const uint8_t* data = cursor->data;
+
+  size_t size = cursor->size;
+  size_t i = 0;
+  uint32_t row = 0;
+  uint32_t state = YR_AC_ROOT_STATE;
+
+  if (match_table[YR_AC_ROOT_STATE] != 0)
+    FAIL_ON_ERROR(_yr_scanner_ac_verify(cursor));
+
+  while (i < size)
+  {
+    uint32_t entry;
+
+    // At depth 0 or 1, the state is row_slot[row].
+    if (row == 0 && cursor->prefilter != YR_AC_PREFILTER_NONE)
+    {
+      i = yr_ac_prefilter_next(
+          rules->ac_prefilter, cursor->prefilter, data, i, size);
+
+      if (i >= size)
+        break;
+    }
+
+    FAIL_ON_ERROR(_yr_scanner_ac_check_timeout(cursor, i));
+
+    entry = rows[(row << 8) | data[i++]];
+
+    if (entry & YR_AC_COMPACT_DEEP)
+    {
+      state = YR_AC_COMPACT_VALUE(entry);
+
+      if (entry & YR_AC_COMPACT_MATCHES)
+      {
+        cursor->i = i;
+        cursor->state = state;
+        FAIL_ON_ERROR(_yr_scanner_ac_verify(cursor));
+      }
+
+      // Below depth 1, until a transition lands on the root's target for
+      // the byte just read.
+      while (i < size)
+      {
+        uint8_t c = data[i++];
+
+        FAIL_ON_ERROR(_yr_scanner_ac_check_timeout(cursor, i - 1));
+
+        state = _yr_scanner_ac_transition(transition_table, state, c);
+
+        if (match_table[state] != 0)
+        {
+          cursor->i = i;
+          cursor->state = state;
+          FAIL_ON_ERROR(_yr_scanner_ac_verify(cursor));
+        }
+
+        entry = rows[c];
+
+        if (state == row_slot[YR_AC_COMPACT_VALUE(entry)])
+          break;
+      }
+
+      row = YR_AC_COMPACT_VALUE(entry);
+    }
+    else
+    {
+      row = YR_AC_COMPACT_VALUE(entry);
+
+      if (entry & YR_AC_COMPACT_MATCHES)
+      {
+        cursor->i = i;
+        cursor->state = row_slot[row];
+        FAIL_ON_ERROR(_yr_scanner_ac_verify(cursor));
+      }
+    }
+  }
+
+  return _yr_scanner_ac_report_slow(cursor);
+}
+
 static int _yr_scanner_scan_mem_block(
     YR_SCANNER* scanner,
     const uint8_t* block_data,
@@ -62,26 +342,34 @@ static int _yr_scanner_scan_mem_block(
   YR_AC_TRANSITION* transition_table = rules->ac_transition_table;
   uint32_t* match_table = rules->ac_match_table;
 
-  YR_AC_MATCH* match;
-  YR_AC_TRANSITION transition;
+  YR_AC_CURSOR cursor;
+
+  _yr_scanner_ac_init(&cursor, scanner, block_data, block);
+
+  if (cursor.compact)
+  {
+    result = _yr_scanner_scan_mem_block_compact(&cursor);
+    goto _exit;
+  }
 
   size_t i = 0;
   uint32_t state = YR_AC_ROOT_STATE;
-  uint16_t index;
-  YR_STRING* report_string = NULL;
-  YR_RULE* rule = NULL;
 
   while (i < block->size)
   {
-    if (i % 4096 == 0 && scanner->timeout > 0)
+    // While at the root state, jump to the next position that can take the
+    // automaton out of it. Skipped bytes would have left it at the root.
+    if (state == YR_AC_ROOT_STATE && cursor.prefilter != YR_AC_PREFILTER_NONE)
     {
-      if (yr_stopwatch_elapsed_ns(&scanner->stopwatch) > scanner->timeout)
-      {
-        result = ERROR_SCAN_TIMEOUT;
-        goto _exit;
-      }
+      i = yr_ac_prefilter_next(
+          rules->ac_prefilter, cursor.prefilter, block_data, i, block->size);
+
+      if (i >= block->size)
+        break;
     }
 
+    GOTO_EXIT_ON_ERROR(_yr_scanner_ac_check_timeout(&cursor, i));
+
 #if 2 == YR_DEBUG_VERBOSITY
     if (0 != state)
       YR_DEBUG_FPRINTF(
@@ -99,96 +387,19 @@ static int _yr_scanner_scan_mem_block(
 
     if (match_table[state] != 0)
     {
-      // If the entry corresponding to state N in the match table is zero, it
-      // means that there's no match associated to the state. If it's non-zero,
-      // its value is the 1-based index within ac_match_pool where the first
-      // match resides.
-
-      match = &rules->ac_match_pool[match_table[state] - 1];
-
-      if (scanner->matches->count >= YR_SLOW_STRING_MATCHES)
-      {
-        report_string = match->string;
-        rule = report_string
-                   ? &scanner->rules->rules_table[report_string->rule_idx]
-                   : NULL;
-      }
-
-      while (match != NULL)
-      {
-        if (match->backtrack <= i)
-        {
-          GOTO_EXIT_ON_ERROR(yr_scan_verify_match(
-              scanner,
-              match,
-              block_data,
-              block->size,
-              block->base,
-              i - match->backtrack));
-        }
+      cursor.i = i;
+      cursor.state = state;
 
-        match = match->next;
-      }
+      GOTO_EXIT_ON_ERROR(_yr_scanner_ac_verify(&cursor));
     }
 
-    index = block_data[i++] + 1;
-    transition = transition_table[state + index];
-
-    while (YR_AC_INVALID_TRANSITION(transition, index))
-    {
-      if (state != YR_AC_ROOT_STATE)
-      {
-        state = YR_AC_NEXT_STATE(transition_table[state]);
-        transition = transition_table[state + index];
-      }
-      else
-      {
-        transition = 0;
-        break;
-      }
-    }
-
-    state = YR_AC_NEXT_STATE(transition);
+    state = _yr_scanner_ac_transition(transition_table, state, block_data[i++]);
   }
 
-  if (match_table[state] != 0)
-  {
-    match = &rules->ac_match_pool[match_table[state] - 1];
+  cursor.i = i;
+  cursor.state = state;
 
-    while (match != NULL)
-    {
-      if (match->backtrack <= i)
-      {
-        GOTO_EXIT_ON_ERROR(yr_scan_verify_match(
-            scanner,
-            match,
-            block_data,
-            block->size,
-            block->base,
-            i - match->backtrack));
-      }
-
-      match = match->next;
-    }
-  }
-
-  if (rule != NULL && scanner->matches->count >= YR_SLOW_STRING_MATCHES &&
-      scanner->matches->count < YR_MAX_STRING_MATCHES)
-  {
-    if (rule != NULL && report_string != NULL)
-    {
-      result = scanner->callback(
-          scanner,
-          CALLBACK_MSG_TOO_SLOW_SCANNING,
-          (void*) report_string,
-          scanner->user_data);
-      if (result != CALLBACK_CONTINUE)
-      {
-        result = ERROR_TOO_SLOW_SCANNING;
-        goto _exit;
-      }
-    }
-  }
+  result = _yr_scanner_ac_finish(&cursor);
 
 _exit:
 
@@ -203,6 +414,92 @@ _exit:
   return result;
 }
 
+// A scanner taking part in yr_scanner_scan_mem_multi, together with the
+// buffer it is currently walking.
+typedef struct _YR_AC_LANE
+{
+  YR_AC_CURSOR cursor;
+  YR_MEMORY_BLOCK block;
+  YR_MEMORY_BLOCK_ITERATOR iterator;
+
+  // Index of the buffer being scanned, or -1 if the lane is idle.
+  int buffer;
+
+  // Set once the automaton has walked the whole buffer or failed, with the
+  // outcome in result.
+  bool done;
+  int result;
+
+} YR_AC_LANE;
+
+////////////////////////////////////////////////////////////////////////////////
+// Walks several blocks at once, one byte from each in turn, until at least
+// one of them is done. A single walk is a chain of dependent loads from the
+// transition table that stalls on every cache miss; independent walks
+// interleaved on the same thread keep several of those misses in flight.
+// Each step does exactly what _yr_scanner_scan_mem_block does for a byte.
+//
+static void _yr_scanner_scan_mem_blocks_interleaved(
+    YR_AC_LANE** lanes,
+    int num_lanes)
+{
+  bool any_done = false;
+
+  while (!any_done)
+  {
+    for (int k = 0; k < num_lanes; k++)
+    {
+      YR_AC_CURSOR* cursor = &lanes[k]->cursor;
+
+      size_t i = cursor->i;
+      uint32_t state = cursor->state;
+      int result = ERROR_SUCCESS;
+
+      if (lanes[k]->done)
+        continue;
+
+      if (state == YR_AC_ROOT_STATE &&
+          cursor->prefilter != YR_AC_PREFILTER_NONE)
+      {
+        i = yr_ac_prefilter_next(
+            cursor->scanner->rules->ac_prefilter,
+            cursor->prefilter,
+            cursor->data,
+            i,
+            cursor->size);
+
+        cursor->i = i;
+      }
+
+      if (i < cursor->size)
+      {
+        if (i >= cursor->next_timeout_check)
+          result = _yr_scanner_ac_check_timeout(cursor, i);
+
+        if (result == ERROR_SUCCESS && cursor->match_table[state] != 0)
+          result = _yr_scanner_ac_verify(cursor);
+
+        if (result == ERROR_SUCCESS)
+        {
+          cursor->state = _yr_scanner_ac_transition(
+              cursor->transition_table, state, cursor->data[i]);
+          cursor->i = ++i;
+
+          if (i < cursor->size)
+            continue;
+        }
+      }
+
+      if (result == ERROR_SUCCESS)
+        result = _yr_scanner_ac_finish(cursor);
+
+      lanes[k]->result = result;
+      lanes[k]->done = true;
+      any_done = true;
+    }
+  }
+}
+
 static void _yr_scanner_clean_matches(YR_SCANNER* scanner)
 {
   YR_DEBUG_FPRINTF(2, stderr, "- %s() {} \n", __FUNCTION__);
@@ -298,8 +595,18 @@ YR_API int yr_scanner_create(YR_RULES* rules, YR_SCANNER** scanner)
     yr_scanner_destroy(new_scanner);
     return ERROR_INSUFFICIENT_MEMORY;
   }
+
+  new_scanner->string_profiling_info = yr_calloc(
+      rules->num_strings, sizeof(YR_STRING_PROFILING_INFO));
+
+  if (new_scanner->string_profiling_info == NULL && rules->num_strings > 0)
+  {
+    yr_scanner_destroy(new_scanner);
+    return ERROR_INSUFFICIENT_MEMORY;
+  }
 #else
   new_scanner->profiling_info = NULL;
+  new_scanner->string_profiling_info = NULL;
 #endif
 
   external = rules->ext_vars_table;
@@ -344,6 +651,8 @@ YR_API void yr_scanner_destroy(YR_SCANNER* scanner)
     fiber = next;
   }
 
+  yr_re_dfa_cache_destroy(&scanner->re_dfa_cache);
+
   RE_FAST_EXEC_POSITION* position = scanner->re_fast_exec_position_pool.head;
 
   while (position != NULL)
@@ -360,8 +669,15 @@ YR_API void yr_scanner_destroy(YR_SCANNER* scanner)
         (YR_HASH_TABLE_FREE_VALUE_FUNC) yr_object_destroy);
   }
 
+  if (scanner->matches_notebook != NULL)
+    yr_notebook_destroy(scanner->matches_notebook);
+
+  if (scanner->objects_notebook != NULL)
+    yr_notebook_destroy(scanner->objects_notebook);
+
 #ifdef YR_PROFILING_ENABLED
   yr_free(scanner->profiling_info);
+  yr_free(scanner->string_profiling_info);
 #endif
 
   yr_free(scanner->rule_matches_flags);
@@ -462,17 +778,149 @@ YR_API int yr_scanner_define_string_variable(
   return yr_object_set_string(value, strlen(value), obj, NULL);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Prepares the scanner for a new scan: creates the notebooks on the first
+// scan, marks the rules that must be evaluated in any case and starts the
+// clock.
+//
+static int _yr_scanner_begin(YR_SCANNER* scanner)
+{
+  // Create the notebook that will hold the YR_MATCH structures representing
+  // each match found. This notebook will also contain snippets of the
+  // matching data (the "data" field in YR_MATCH points to the snippet
+  // corresponding to the match). Each notebook's page can store up to 1024
+  // matches.
+  if (scanner->matches_notebook == NULL)
+  {
+    uint32_t max_match_data;
+
+    FAIL_ON_ERROR(yr_get_configuration_uint32(
+        YR_CONFIG_MAX_MATCH_DATA, &max_match_data));
+
+    FAIL_ON_ERROR(yr_notebook_create(
+        1024 * (sizeof(YR_MATCH) + max_match_data),
+        &scanner->matches_notebook));
+  }
+
+  // The objects notebook must fit the stack used by yr_execute_code in a
+  // single page, plus some room for the objects created by modules.
+  if (scanner->objects_notebook == NULL)
+  {
+    uint32_t stack_size;
+
+    FAIL_ON_ERROR(
+        yr_get_configuration_uint32(YR_CONFIG_STACK_SIZE, &stack_size));
+
+    FAIL_ON_ERROR(yr_notebook_create(
+        stack_size * sizeof(YR_VALUE) + 64 * 1024,
+        &scanner->objects_notebook));
+  }
+
+  // Every rule that doesn't require a matching string must be evaluated
+  // regardless of whether a string matched or not.
+  memcpy(
+      scanner->required_eval,
+      scanner->rules->no_required_strings,
+      sizeof(YR_BITMASK) * YR_BITMASK_SIZE(scanner->rules->num_rules));
+
+  yr_stopwatch_start(&scanner->stopwatch);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluates the rule conditions once every block in scanner->iterator has
+// gone through the Aho-Corasick automaton, and reports the results.
+//
+static int _yr_scanner_evaluate(YR_SCANNER* scanner)
+{
+  YR_MEMORY_BLOCK_ITERATOR* iterator = scanner->iterator;
+  YR_RULES* rules = scanner->rules;
+  YR_RULE* rule;
+
+  int i;
+
+  // Assigned between sigsetjmp and a possible siglongjmp, so it must not be
+  // cached in a register.
+  volatile int result = ERROR_SUCCESS;
+
+  // If the iterator has a file_size function, ask the function for the file's
+  // size, if not file size is undefined.
+  if (iterator->file_size != NULL)
+    scanner->file_size = iterator->file_size(iterator);
+  else
+    scanner->file_size = YR_UNDEFINED;
+
+  YR_TRYCATCH(
+      !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
+      { result = yr_execute_code(scanner); },
+      { result = ERROR_COULD_NOT_MAP_FILE; });
+
+  if (result != ERROR_SUCCESS)
+    return result;
+
+  for (i = 0, rule = rules->rules_table; !RULE_IS_NULL(rule); i++, rule++)
+  {
+    int message = 0;
+
+    if (yr_bitmask_is_set(scanner->rule_matches_flags, i) &&
+        yr_bitmask_is_not_set(scanner->ns_unsatisfied_flags, rule->ns->idx))
+    {
+      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_MATCHING)
+        message = CALLBACK_MSG_RULE_MATCHING;
+    }
+    else
+    {
+      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_NOT_MATCHING)
+        message = CALLBACK_MSG_RULE_NOT_MATCHING;
+    }
+
+    if (message != 0 && !RULE_IS_PRIVATE(rule))
+    {
+      switch (scanner->callback(scanner, message, rule, scanner->user_data))
+      {
+      case CALLBACK_ABORT:
+        return ERROR_SUCCESS;
+
+      case CALLBACK_ERROR:
+        return ERROR_CALLBACK_ERROR;
+      }
+    }
+  }
+
+  scanner->callback(
+      scanner, CALLBACK_MSG_SCAN_FINISHED, NULL, scanner->user_data);
+
+  return ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Releases the matches found by the last scan and the objects created while
+// evaluating the conditions. The notebooks keep their pages for the next scan.
+//
+static void _yr_scanner_end(YR_SCANNER* scanner)
+{
+  _yr_scanner_clean_matches(scanner);
+
+  if (scanner->matches_notebook != NULL)
+    yr_notebook_reset(
+        scanner->matches_notebook, YR_SCANNER_MAX_RETAINED_MEMORY);
+
+  if (scanner->objects_notebook != NULL)
+    yr_notebook_reset(
+        scanner->objects_notebook, YR_SCANNER_MAX_RETAINED_MEMORY);
+}
+
 YR_API int yr_scanner_scan_mem_blocks(
     YR_SCANNER* scanner,
     YR_MEMORY_BLOCK_ITERATOR* iterator)
 {
   YR_DEBUG_FPRINTF(2, stderr, "+ %s() {\n", __FUNCTION__);
 
-  YR_RULES* rules;
-  YR_RULE* rule;
   YR_MEMORY_BLOCK* block;
 
-  int i, result = ERROR_SUCCESS;
+  // Set inside YR_TRYCATCH, see _yr_scanner_evaluate.
+  volatile int result = ERROR_SUCCESS;
 
   if (scanner->callback == NULL)
   {
@@ -481,7 +929,6 @@ YR_API int yr_scanner_scan_mem_blocks(
   }
 
   scanner->iterator = iterator;
-  rules = scanner->rules;
 
   if (iterator->last_error == ERROR_BLOCK_NOT_READY)
   {
@@ -491,31 +938,11 @@ YR_API int yr_scanner_scan_mem_blocks(
   }
   else
   {
-    // Create the notebook that will hold the YR_MATCH structures representing
-    // each match found. This notebook will also contain snippets of the
-    // matching data (the "data" field in YR_MATCH points to the snippet
-    // corresponding to the match). Each notebook's page can store up to 1024
-    // matches.
-    uint32_t max_match_data;
-
-    FAIL_ON_ERROR(
-        yr_get_configuration_uint32(YR_CONFIG_MAX_MATCH_DATA, &max_match_data));
-
-    result = yr_notebook_create(
-        1024 * (sizeof(YR_MATCH) + max_match_data), &scanner->matches_notebook);
+    result = _yr_scanner_begin(scanner);
 
     if (result != ERROR_SUCCESS)
       goto _exit;
 
-    // Every rule that doesn't require a matching string must be evaluated
-    // regardless of whether a string matched or not.
-    memcpy(
-        scanner->required_eval,
-        scanner->rules->no_required_strings,
-        sizeof(YR_BITMASK) * YR_BITMASK_SIZE(rules->num_rules));
-
-    yr_stopwatch_start(&scanner->stopwatch);
-
     block = iterator->first(iterator);
   }
 
@@ -560,54 +987,7 @@ YR_API int yr_scanner_scan_mem_blocks(
   if (result != ERROR_SUCCESS)
     goto _exit;
 
-  // If the iterator has a file_size function, ask the function for the file's
-  // size, if not file size is undefined.
-  if (iterator->file_size != NULL)
-    scanner->file_size = iterator->file_size(iterator);
-  else
-    scanner->file_size = YR_UNDEFINED;
-
-  YR_TRYCATCH(
-      !(scanner->flags & SCAN_FLAGS_NO_TRYCATCH),
-      { result = yr_execute_code(scanner); },
-      { result = ERROR_COULD_NOT_MAP_FILE; });
-
-  if (result != ERROR_SUCCESS)
-    goto _exit;
-
-  for (i = 0, rule = rules->rules_table; !RULE_IS_NULL(rule); i++, rule++)
-  {
-    int message = 0;
-
-    if (yr_bitmask_is_set(scanner->rule_matches_flags, i) &&
-        yr_bitmask_is_not_set(scanner->ns_unsatisfied_flags, rule->ns->idx))
-    {
-      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_MATCHING)
-        message = CALLBACK_MSG_RULE_MATCHING;
-    }
-    else
-    {
-      if (scanner->flags & SCAN_FLAGS_REPORT_RULES_NOT_MATCHING)
-        message = CALLBACK_MSG_RULE_NOT_MATCHING;
-    }
-
-    if (message != 0 && !RULE_IS_PRIVATE(rule))
-    {
-      switch (scanner->callback(scanner, message, rule, scanner->user_data))
-      {
-      case CALLBACK_ABORT:
-        result = ERROR_SUCCESS;
-        goto _exit;
-
-      case CALLBACK_ERROR:
-        result = ERROR_CALLBACK_ERROR;
-        goto _exit;
-      }
-    }
-  }
-
-  scanner->callback(
-      scanner, CALLBACK_MSG_SCAN_FINISHED, NULL, scanner->user_data);
+  result = _yr_scanner_evaluate(scanner);
 
 _exit:
 
@@ -615,15 +995,7 @@ _exit:
   // destroy the notebook yet. ERROR_BLOCK_NOT_READY is not a permament error,
   // the caller can still call this function again for a retry.
   if (result != ERROR_BLOCK_NOT_READY)
-  {
-    _yr_scanner_clean_matches(scanner);
-
-    if (scanner->matches_notebook != NULL)
-    {
-      yr_notebook_destroy(scanner->matches_notebook);
-      scanner->matches_notebook = NULL;
-    }
-  }
+    _yr_scanner_end(scanner);
 
   YR_DEBUG_FPRINTF(
       2,
@@ -702,6 +1074,54 @@ YR_API const uint8_t* yr_fetch_block_data(YR_MEMORY_BLOCK* block)
   return data;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Sets up an iterator that returns buffer as its only block.
+//
+static void _yr_scanner_init_mem_iterator(
+    YR_MEMORY_BLOCK_ITERATOR* iterator,
+    YR_MEMORY_BLOCK* block,
+    const uint8_t* buffer,
+    size_t buffer_size)
+{
+  block->size = buffer_size;
+  block->base = 0;
+  block->fetch_data = _yr_fetch_block_data;
+  block->context = (void*) buffer;
+
+  iterator->context = block;
+  iterator->first = _yr_get_first_block;
+  iterator->next = _yr_get_next_block;
+  iterator->file_size = _yr_get_file_size;
+  iterator->last_error = ERROR_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Detect cases where every byte of input is checked for match and input size
+// is bigger then 0.2 MB, and give the callback a chance to abort the scan.
+//
+static int _yr_scanner_check_root_matches(
+    YR_SCANNER* scanner,
+    size_t buffer_size)
+{
+  if (scanner->rules->ac_match_table[YR_AC_ROOT_STATE] != 0 &&
+      buffer_size > YR_FILE_SIZE_THRESHOLD)
+  {
+    YR_STRING* report_string =
+        scanner->rules->ac_match_pool[YR_AC_ROOT_STATE].string;
+
+    int result = scanner->callback(
+        scanner,
+        CALLBACK_MSG_TOO_SLOW_SCANNING,
+        (void*) report_string,
+        scanner->user_data);
+
+    if (result != CALLBACK_CONTINUE)
+      return ERROR_TOO_SLOW_SCANNING;
+  }
+
+  return ERROR_SUCCESS;
+}
+
 YR_API int yr_scanner_scan_mem(
     YR_SCANNER* scanner,
     const uint8_t* buffer,
@@ -717,36 +1137,13 @@ YR_API int yr_scanner_scan_mem(
 
   YR_MEMORY_BLOCK block;
   YR_MEMORY_BLOCK_ITERATOR iterator;
-  int result;
 
-  block.size = buffer_size;
-  block.base = 0;
-  block.fetch_data = _yr_fetch_block_data;
-  block.context = (void*) buffer;
+  _yr_scanner_init_mem_iterator(&iterator, &block, buffer, buffer_size);
 
-  iterator.context = &block;
-  iterator.first = _yr_get_first_block;
-  iterator.next = _yr_get_next_block;
-  iterator.file_size = _yr_get_file_size;
-  iterator.last_error = ERROR_SUCCESS;
+  int result = _yr_scanner_check_root_matches(scanner, buffer_size);
 
-  // Detect cases where every byte of input is checked for match and input size
-  // is bigger then 0.2 MB
-  if (scanner->rules->ac_match_table[YR_AC_ROOT_STATE] != 0 &&
-      buffer_size > YR_FILE_SIZE_THRESHOLD)
-  {
-    YR_STRING* report_string =
-        scanner->rules->ac_match_pool[YR_AC_ROOT_STATE].string;
-    result = scanner->callback(
-        scanner,
-        CALLBACK_MSG_TOO_SLOW_SCANNING,
-        (void*) report_string,
-        scanner->user_data);
-    if (result != CALLBACK_CONTINUE)
-      return ERROR_TOO_SLOW_SCANNING;
-  }
-
-  result = yr_scanner_scan_mem_blocks(scanner, &iterator);
+  if (result == ERROR_SUCCESS)
+    result = yr_scanner_scan_mem_blocks(scanner, &iterator);
 
   YR_DEBUG_FPRINTF(
       2,
@@ -759,6 +1156,258 @@ YR_API int yr_scanner_scan_mem(
   return result;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Starts scanning buffers[n] in an idle lane. Returns false if the scan
+// finished right away, with its result in results[n].
+//
+static bool _yr_scanner_start_lane(
+    YR_AC_LANE* lane,
+    YR_SCANNER* scanner,
+    const uint8_t** buffers,
+    const size_t* buffer_sizes,
+    void** user_data,
+    int* results,
+    int n)
+{
+  if (user_data != NULL)
+    scanner->user_data = user_data[n];
+
+  _yr_scanner_init_mem_iterator(
+      &lane->iterator, &lane->block, buffers[n], buffer_sizes[n]);
+
+  if (scanner->callback == NULL)
+  {
+    results[n] = ERROR_CALLBACK_REQUIRED;
+    return false;
+  }
+
+  results[n] = _yr_scanner_check_root_matches(scanner, buffer_sizes[n]);
+
+  if (results[n] != ERROR_SUCCESS)
+    return false;
+
+  scanner->iterator = &lane->iterator;
+  results[n] = _yr_scanner_begin(scanner);
+
+  if (results[n] != ERROR_SUCCESS)
+  {
+    _yr_scanner_end(scanner);
+    return false;
+  }
+
+  _yr_scanner_ac_init(&lane->cursor, scanner, buffers[n], &lane->block);
+
+  lane->buffer = n;
+  lane->done = false;
+  lane->result = ERROR_SUCCESS;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Walks the live lanes under a single exception handler. Returns true if a
+// memory fault interrupted the walk, which leaves every lane unfinished.
+//
+static bool _yr_scanner_walk_lanes(
+    YR_AC_LANE** live,
+    int num_live,
+    const uint8_t* memfault_from,
+    const uint8_t* memfault_to,
+    bool trycatch)
+{
+  volatile bool faulted = false;
+
+  YR_TRYCATCH(
+      trycatch,
+      {
+        jumpinfo* info = (jumpinfo*) yr_thread_storage_get_value(
+            &yr_trycatch_trampoline_tls);
+
+        if (info != NULL)
+        {
+          info->memfault_from = (void*) memfault_from;
+          info->memfault_to = (void*) memfault_to;
+        }
+
+        for (int k = 0; k < num_live; k++)
+        {
+          YR_SCANNER* scanner = live[k]->cursor.scanner;
+          YR_MEMORY_BLOCK* block = &live[k]->block;
+
+          if (scanner->entry_point == YR_UNDEFINED)
+          {
+            if (scanner->flags & SCAN_FLAGS_PROCESS_MEMORY)
+              scanner->entry_point = yr_get_entry_point_address(
+                  live[k]->cursor.data, block->size, block->base);
+            else
+              scanner->entry_point = yr_get_entry_point_offset(
+                  live[k]->cursor.data, block->size);
+          }
+        }
+
+        _yr_scanner_scan_mem_blocks_interleaved(live, num_live);
+      },
+      { faulted = true; });
+
+  return faulted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scans count buffers with the same outcome as calling yr_scanner_scan_mem
+// for each of them. Up to YR_MAX_INTERLEAVED_SCANS scanners walk their
+// buffers through the Aho-Corasick automaton in lockstep, which pays off
+// when scanning many small files with a large automaton. As soon as a
+// scanner is done with a buffer its rules are evaluated, the callback is
+// invoked and the scanner moves on to the next pending buffer, so short
+// buffers don't leave the others walking alone.
+//
+// This is an opt-in entry point: nothing in libyara routes scans through it,
+// and for small buffers or small automata it is slower than scanning them
+// one by one. Callers should measure before switching.
+//
+// Args:
+//   scanners: Array of num_scanners scanners, all of them different. They
+//             may use different rules.
+//   num_scanners: Number of scanners, only the first
+//                 YR_MAX_INTERLEAVED_SCANS are used.
+//   buffers: Array of count buffers to scan.
+//   buffer_sizes: Size of each buffer.
+//   user_data: If not NULL, user_data[n] is passed to the callback while
+//              buffers[n] is being scanned instead of the scanner's own
+//              user data, which is restored afterwards.
+//   results: Array that receives the result of each scan, as
+//            yr_scanner_scan_mem would have returned it.
+//   count: Number of buffers.
+//
+// Returns:
+//   ERROR_SUCCESS
+//   ERROR_INVALID_ARGUMENT
+//
+YR_API int yr_scanner_scan_mem_multi(
+    YR_SCANNER** scanners,
+    int num_scanners,
+    const uint8_t** buffers,
+    const size_t* buffer_sizes,
+    void** user_data,
+    int* results,
+    int count)
+{
+  YR_DEBUG_FPRINTF(
+      2,
+      stderr,
+      "+ %s(num_scanners=%d count=%d) {\n",
+      __FUNCTION__,
+      num_scanners,
+      count);
+
+  YR_AC_LANE lanes[YR_MAX_INTERLEAVED_SCANS];
+  YR_AC_LANE* live[YR_MAX_INTERLEAVED_SCANS];
+  void* saved_user_data[YR_MAX_INTERLEAVED_SCANS];
+
+  const uint8_t* memfault_from = NULL;
+  const uint8_t* memfault_to = NULL;
+
+  bool trycatch = false;
+  int next = 0;
+
+  if (scanners == NULL || num_scanners <= 0 || count < 0 ||
+      (count > 0 && (buffers == NULL || buffer_sizes == NULL ||
+                     results == NULL)))
+    return ERROR_INVALID_ARGUMENT;
+
+  num_scanners = yr_min(num_scanners, YR_MAX_INTERLEAVED_SCANS);
+
+  for (int k = 0; k < num_scanners; k++)
+  {
+    lanes[k].buffer = -1;
+    saved_user_data[k] = scanners[k]->user_data;
+
+    if (!(scanners[k]->flags & SCAN_FLAGS_NO_TRYCATCH))
+      trycatch = true;
+  }
+
+  // Faults can't be attributed to a single buffer while the walks are
+  // interleaved, so the range covers all of them.
+  for (int n = 0; n < count; n++)
+  {
+    if (buffer_sizes[n] == 0)
+      continue;
+
+    if (memfault_from == NULL || buffers[n] < memfault_from)
+      memfault_from = buffers[n];
+
+    if (memfault_to == NULL || buffers[n] + buffer_sizes[n] > memfault_to)
+      memfault_to = buffers[n] + buffer_sizes[n];
+  }
+
+  for (;;)
+  {
+    int num_live = 0;
+    bool faulted;
+
+    for (int k = 0; k < num_scanners; k++)
+    {
+      while (lanes[k].buffer < 0 && next < count)
+      {
+        _yr_scanner_start_lane(
+            &lanes[k],
+            scanners[k],
+            buffers,
+            buffer_sizes,
+            user_data,
+            results,
+            next++);
+      }
+
+      if (lanes[k].buffer >= 0)
+        live[num_live++] = &lanes[k];
+    }
+
+    if (num_live == 0)
+      break;
+
+    faulted = _yr_scanner_walk_lanes(
+        live, num_live, memfault_from, memfault_to, trycatch);
+
+    for (int k = 0; k < num_live; k++)
+    {
+      YR_AC_LANE* lane = live[k];
+      YR_SCANNER* scanner = lane->cursor.scanner;
+
+      if (faulted)
+      {
+        // Start over with each buffer on its own, that tells apart the one
+        // that faulted.
+        _yr_scanner_end(scanner);
+        results[lane->buffer] = yr_scanner_scan_mem_blocks(
+            scanner, &lane->iterator);
+      }
+      else if (lane->done)
+      {
+        results[lane->buffer] = lane->result;
+
+        if (lane->result == ERROR_SUCCESS)
+          results[lane->buffer] = _yr_scanner_evaluate(scanner);
+
+        _yr_scanner_end(scanner);
+      }
+      else
+      {
+        continue;
+      }
+
+      lane->buffer = -1;
+    }
+  }
+
+  for (int k = 0; k < num_scanners; k++)
+    scanners[k]->user_data = saved_user_data[k];
+
+  YR_DEBUG_FPRINTF(2, stderr, "} // %s()\n", __FUNCTION__);
+
+  return ERROR_SUCCESS;
+}
+
 YR_API int yr_scanner_scan_file(YR_SCANNER* scanner, const char* filename)
 {
   YR_MAPPED_FILE mfile;
@@ -885,6 +1534,11 @@ YR_API void yr_scanner_reset_profiling_info(YR_SCANNER* scanner)
       scanner->profiling_info,
       0,
       scanner->rules->num_rules * sizeof(YR_PROFILING_INFO));
+
+  memset(
+      scanner->string_profiling_info,
+      0,
+      scanner->rules->num_strings * sizeof(YR_STRING_PROFILING_INFO));
 #endif
 }
 
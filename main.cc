@@ -37,6 +37,9 @@ using Microsoft::WRL::ComPtr;
 
 std::atomic<bool> g_Loading = false;
 std::vector<BAMEntryUI> g_BamUI;
+// Set by --hive <path>: entries come from that SYSTEM hive file instead of
+// the live registry.
+static std::wstring g_offlineHive;
 static BamThreadInfo g_cachedBamInfo{};
 
 struct IconDataDX11
@@ -118,8 +121,13 @@ void InitD3D(HWND hwnd)
 void LoadBAMAsync()
 {
     g_Loading = true;
-    auto raw = ReadBAM();
-    g_BamUI = ConvertToUI(raw);
+    try {
+        auto raw = g_offlineHive.empty() ? ReadBAM() : ReadBAMFromHive(g_offlineHive);
+        g_BamUI = ConvertToUI(raw);
+    }
+    catch (const std::exception& e) {
+        MessageBoxA(nullptr, e.what(), "Failed to read BAM", MB_OK | MB_ICONERROR);
+    }
     g_Loading = false;
 }
 
@@ -285,9 +293,24 @@ int WINAPI WinMain
 
     RegisterClassExW(&wc);
 
+    int argc = 0;
+    if (LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc))
+    {
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            if (wcscmp(argv[i], L"--hive") == 0)
+                g_offlineHive = argv[++i];
+        }
+        LocalFree(argv);
+    }
+
+    std::wstring title = L"BAMReveal made by Diff";
+    if (!g_offlineHive.empty())
+        title += L" - offline hive " + g_offlineHive;
+
     HWND hwnd = CreateWindowW(
         wc.lpszClassName,
-        L"BAMReveal made by Diff",
+        title.c_str(),
         WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, CW_USEDEFAULT,
         1280, 720,
@@ -588,7 +611,9 @@ int WINAPI WinMain
                 fadeAlphaDeletedBam = 0.0f;
 
                 std::thread([] {
-                    DeletedBAMEntriesResult result = FindDeletedBAMEntriesInSystemHive();
+                    DeletedBAMEntriesResult result = g_offlineHive.empty()
+                        ? FindDeletedBAMEntriesInSystemHive()
+                        : FindDeletedBAMEntriesInHiveFile(g_offlineHive);
 
                     {
                         std::lock_guard<std::mutex> lock(deletedBamMutex);
@@ -708,6 +733,7 @@ int WINAPI WinMain
                     case BamSignature::Unsigned: sigLower = "unsigned"; break;
                     case BamSignature::Cheat:    sigLower = "cheat"; break;
                     case BamSignature::Fake:     sigLower = "fake"; break;
+                    case BamSignature::NotChecked: sigLower = "not checked"; break;
                     default:                     sigLower = "not found"; break;
                     }
 
@@ -820,10 +846,10 @@ int WINAPI WinMain
             {
                 ImGui::SetWindowSize(ImVec2(800, 320), ImGuiCond_Once);
 
-                std::vector<std::wstring> deletedPathsCopy;
+                std::vector<DeletedBAMEntry> deletedEntriesCopy;
                 {
                     std::lock_guard<std::mutex> lock(deletedBamMutex);
-                    deletedPathsCopy = deletedBamPopupResultLocal.deletedPaths;
+                    deletedEntriesCopy = deletedBamPopupResultLocal.entries;
                 }
 
                 if (isReadingDeletedBam)
@@ -834,7 +860,7 @@ int WINAPI WinMain
                     );
                     ImGui::TextColored(ImVec4(0.6f, 0.6f, 0.6f, 1.0f), "Reading SYSTEM hive...");
                 }
-                else if (deletedPathsCopy.empty())
+                else if (deletedEntriesCopy.empty())
                 {
                     ImGui::Dummy(ImVec2(0, ImGui::GetWindowSize().y * 0.35f));
                     ImGui::SetCursorPosX(
@@ -844,16 +870,22 @@ int WINAPI WinMain
                 }
                 else
                 {
-                    if (ImGui::BeginTable("DeletedBAMTable", 1, ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+                    if (ImGui::BeginTable("DeletedBAMTable", 3, ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
                     {
                         ImGui::TableSetupColumn("Deleted BAM Paths", ImGuiTableColumnFlags_WidthStretch);
+                        ImGui::TableSetupColumn("SID", ImGuiTableColumnFlags_WidthFixed, 200.0f);
+                        ImGui::TableSetupColumn("Last Execution", ImGuiTableColumnFlags_WidthFixed, 150.0f);
                         ImGui::TableHeadersRow();
 
-                        for (const auto& path : deletedPathsCopy)
+                        for (const auto& entry : deletedEntriesCopy)
                         {
                             ImGui::TableNextRow();
                             ImGui::TableNextColumn();
-                            ImGui::TextUnformatted(ws2s(path).c_str());
+                            ImGui::TextUnformatted(ws2s(entry.path).c_str());
+                            ImGui::TableNextColumn();
+                            ImGui::TextUnformatted(entry.sid.empty() ? "Unknown" : ws2s(entry.sid).c_str());
+                            ImGui::TableNextColumn();
+                            ImGui::TextUnformatted(FileTimeToStringUI(entry.lastExecution).c_str());
                         }
                         ImGui::EndTable();
                     }
@@ -954,6 +986,7 @@ int WINAPI WinMain
                     case BamSignature::Unsigned: sigText = "Unsigned"; break;
                     case BamSignature::Cheat: sigText = "Cheat"; break;
                     case BamSignature::Fake: sigText = "Fake"; break;
+                    case BamSignature::NotChecked: sigText = "Not Checked"; break;
                     default: sigText = "Not Found"; break;
                     }
                     col2Width = std::max(col2Width, ImGui::CalcTextSize(sigText).x);
@@ -1076,6 +1109,10 @@ int WINAPI WinMain
                             sigText = "Fake Signature";
                             sigColor = ImVec4(1, 0.6f, 0, 1);
                             break;
+                        case BamSignature::NotChecked:
+                            sigText = "Not Checked";
+                            sigColor = ImVec4(0.6f, 0.6f, 0.6f, 1);
+                            break;
                         default:
                             sigText = "Not Found";
                             sigColor = ImVec4(1, 0.85f, 0, 1);
@@ -1084,6 +1121,18 @@ int WINAPI WinMain
 
                         ImGui::TextColored(sigColor, "%s", sigText);
 
+                        if (e.yaraTier == BamScanTier::Sections || e.yaraTier == BamScanTier::Streamed)
+                        {
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("(partial)");
+                            if (ImGui::IsItemHovered())
+                            {
+                                ImGui::SetTooltip(e.yaraTier == BamScanTier::Sections
+                                    ? "Large file: YARA scanned the headers, the start of each section and the file tail"
+                                    : "Huge file: YARA scanned the first 60 MB and the last 4 MB, with a time limit");
+                            }
+                        }
+
                         ImGui::PopID();
                     }
                 }
@@ -1108,6 +1157,10 @@ int WINAPI WinMain
     g_iconThreadExit = true;
     g_iconCv.notify_all();
 
+    // A scan still running owns the YARA scanners; let process exit clean up.
+    if (!g_Loading)
+        ShutdownBAM();
+
     ImGui_ImplDX11_Shutdown();
     ImGui_ImplWin32_Shutdown();
     ImGui::DestroyContext();
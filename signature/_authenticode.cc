@@ -0,0 +1,125 @@
+#include "_authenticode.hpp"
+
+#include <mutex>
+
+#if defined(HAVE_LIBCRYPTO)
+namespace
+{
+    std::string CopyString(const char* s)
+    {
+        return s ? std::string(s) : std::string();
+    }
+
+    std::vector<uint8_t> CopyBytes(const ByteArray& b)
+    {
+        if (!b.data || b.len <= 0)
+            return {};
+        return std::vector<uint8_t>(b.data, b.data + b.len);
+    }
+
+    void CopyChain(const CertificateArray* chain, std::vector<AuthenticodeCertificate>& out)
+    {
+        if (!chain)
+            return;
+
+        for (size_t i = 0; i < chain->count; ++i)
+        {
+            const Certificate* cert = chain->certs[i];
+            if (!cert)
+                continue;
+
+            AuthenticodeCertificate c;
+            c.subject = CopyString(cert->subject);
+            c.issuer = CopyString(cert->issuer);
+            c.serial = CopyString(cert->serial);
+            c.notBefore = cert->not_before;
+            c.notAfter = cert->not_after;
+            out.push_back(std::move(c));
+        }
+    }
+}
+#endif
+
+bool AuthenticodeAvailable()
+{
+#if defined(HAVE_LIBCRYPTO)
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::vector<AuthenticodeSignature> ParseAuthenticodeSignatures(const uint8_t* data, size_t size)
+{
+    std::vector<AuthenticodeSignature> out;
+
+#if defined(HAVE_LIBCRYPTO)
+    if (!data || size == 0)
+        return out;
+
+    // Registers the Authenticode OIDs with OpenSSL; the pe module does the
+    // same inside yr_initialize, but this engine must not depend on it.
+    static std::once_flag once;
+    std::call_once(once, [] { initialize_authenticode_parser(); });
+
+    AuthenticodeArray* auth = parse_authenticode(data, size);
+    if (!auth)
+        return out;
+
+    for (size_t i = 0; i < auth->count; ++i)
+    {
+        const Authenticode* sig = auth->signatures[i];
+        if (!sig)
+            continue;
+
+        AuthenticodeSignature s;
+        s.verifyFlags = sig->verify_flags;
+        s.digestAlgorithm = CopyString(sig->digest_alg);
+        s.digest = CopyBytes(sig->digest);
+        s.fileDigest = CopyBytes(sig->file_digest);
+
+        if (sig->signer)
+        {
+            s.programName = CopyString(sig->signer->program_name);
+            CopyChain(sig->signer->chain, s.chain);
+        }
+
+        if (sig->countersigs)
+        {
+            for (size_t j = 0; j < sig->countersigs->count; ++j)
+            {
+                const Countersignature* cs = sig->countersigs->counters[j];
+                if (cs && cs->verify_flags == COUNTERSIGNATURE_VFY_VALID)
+                {
+                    s.signingTime = cs->sign_time;
+                    break;
+                }
+            }
+        }
+
+        out.push_back(std::move(s));
+    }
+
+    authenticode_array_free(auth);
+#else
+    (void)data;
+    (void)size;
+#endif
+
+    return out;
+}
+
+SignatureStatus EvaluateAuthenticode(const std::vector<AuthenticodeSignature>& signatures)
+{
+    if (signatures.empty())
+        return SignatureStatus::Unsigned;
+
+    for (const auto& s : signatures)
+    {
+        if (!s.chain.empty() && IsCheatSigner(s.chain.front().subject))
+            return SignatureStatus::Cheat;
+    }
+
+    const AuthenticodeSignature& primary = signatures.front();
+    return primary.IsValid() && primary.DigestMatches() ? SignatureStatus::Signed : SignatureStatus::Fake;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Portable Authenticode verification on top of libyara's vendored
+// authenticode-parser. Works on a PE image in memory and makes no Win32
+// calls, so verdicts can also be produced on non-Windows workers;
+// bench/authenticode is such a batch front end (`make -C bench authenticode`
+// builds libyara with HAVE_LIBCRYPTO and links OpenSSL).
+//
+// "Signed" here means the PKCS#7 signature is intact and the recomputed
+// image digest matches the signed one. The chain is not anchored to a
+// trusted root and catalog signing is not visible at this level; both
+// still need WinVerifyTrust on Windows.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Only the AUTHENTICODE_VFY_* codes and structures; the parser itself is
+// compiled into libyara only with OpenSSL (HAVE_LIBCRYPTO).
+#include <authenticode-parser/authenticode.h>
+
+#include "_signature_status.hpp"
+
+struct AuthenticodeCertificate
+{
+    std::string subject;
+    std::string issuer;
+    std::string serial;
+    int64_t     notBefore = 0;
+    int64_t     notAfter = 0;
+};
+
+struct AuthenticodeSignature
+{
+    int                  verifyFlags = 0; // AUTHENTICODE_VFY_*
+    std::string          digestAlgorithm;
+    std::vector<uint8_t> digest;          // digest stored in the signature
+    std::vector<uint8_t> fileDigest;      // digest recomputed over the image
+    std::string          programName;
+    std::vector<AuthenticodeCertificate> chain; // signer certificate first
+    int64_t              signingTime = 0; // first valid timestamp countersignature, 0 if none
+
+    bool IsValid() const { return verifyFlags == AUTHENTICODE_VFY_VALID; }
+    // The image was modified after signing.
+    bool IsTampered() const { return verifyFlags == AUTHENTICODE_VFY_WRONG_FILE_DIGEST; }
+    bool DigestMatches() const { return !digest.empty() && digest == fileDigest; }
+};
+
+// False when libyara was built without OpenSSL (HAVE_LIBCRYPTO); every
+// other function then reports no signatures.
+bool AuthenticodeAvailable();
+
+// Primary signature first, followed by nested ones.
+std::vector<AuthenticodeSignature> ParseAuthenticodeSignatures(const uint8_t* data, size_t size);
+
+// Same rules as GetSignatureStatus: no embedded signature is Unsigned, a
+// known cheat signer is Cheat, a broken signature or digest is Fake.
+SignatureStatus EvaluateAuthenticode(const std::vector<AuthenticodeSignature>& signatures);
+
+inline SignatureStatus VerifyAuthenticode(const uint8_t* data, size_t size)
+{
+    return EvaluateAuthenticode(ParseAuthenticodeSignatures(data, size));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// Content fingerprint for the WinVerifyTrust cache, and the PE header checks
+// that decide which trust checks apply. The fingerprint is bounded: the
+// header page, the security directory (the Authenticode blob) and fixed
+// samples across the body, so a multi-GB installer costs a few dozen pages.
+// It is only computed for PE files whose persisted verdict missed, and only
+// ever combined with the file's identity (see WinTrustKey), never used to
+// share a verdict between two different files.
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../io/_file_probe.hpp"
+#include "_xxh64.hpp"
+
+constexpr DWORD    kFingerprintHeaderSize = 4096;
+constexpr DWORD    kFingerprintSampleSize = 4096;
+constexpr uint32_t kFingerprintSampleCount = 16;
+constexpr DWORD    kFingerprintMaxSecurityDir = 1024 * 1024;
+
+// MZ/PE signature and a sane section count inside the first `read` bytes.
+inline bool IsPEHeader(const BYTE* buf, DWORD read)
+{
+    if (read < 0x40 || buf[0] != 'M' || buf[1] != 'Z')
+        return false;
+
+    DWORD e_lfanew = *reinterpret_cast<const DWORD*>(buf + 0x3C);
+    if (static_cast<uint64_t>(e_lfanew) + 0x18 + sizeof(IMAGE_FILE_HEADER) > read)
+        return false;
+
+    const BYTE* peHeader = buf + e_lfanew;
+    if (!(peHeader[0] == 'P' && peHeader[1] == 'E' && peHeader[2] == 0 && peHeader[3] == 0))
+        return false;
+
+    auto* fileHeader = reinterpret_cast<const IMAGE_FILE_HEADER*>(peHeader + 4);
+    return fileHeader->NumberOfSections > 0 && fileHeader->NumberOfSections <= 96;
+}
+
+// File range of IMAGE_DIRECTORY_ENTRY_SECURITY; its VirtualAddress is a
+// file offset, not an RVA.
+inline bool GetSecurityDirectory(const BYTE* buf, DWORD read, DWORD& offset, DWORD& size)
+{
+    DWORD e_lfanew = *reinterpret_cast<const DWORD*>(buf + 0x3C);
+    DWORD optional = e_lfanew + 4 + sizeof(IMAGE_FILE_HEADER);
+    if (optional + 2 > read)
+        return false;
+
+    WORD magic = *reinterpret_cast<const WORD*>(buf + optional);
+    DWORD dirs = optional + (magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ? 112 : 96);
+    DWORD entry = dirs + IMAGE_DIRECTORY_ENTRY_SECURITY * sizeof(IMAGE_DATA_DIRECTORY);
+    if (entry + sizeof(IMAGE_DATA_DIRECTORY) > read)
+        return false;
+
+    auto* dir = reinterpret_cast<const IMAGE_DATA_DIRECTORY*>(buf + entry);
+    offset = dir->VirtualAddress;
+    size = dir->Size;
+    return offset != 0 && size != 0;
+}
+
+// Small files are hashed whole; larger ones at evenly spaced samples,
+// always including the last page. Reads through the probe, so unmapped
+// files are fingerprinted the same way.
+inline uint64_t ComputeFileFingerprint(const FileProbe& probe)
+{
+    uint64_t size = probe.Size();
+    std::vector<BYTE> buffer(kFingerprintHeaderSize);
+
+    DWORD header = static_cast<DWORD>(probe.ReadAt(0, buffer.data(), buffer.size()));
+    uint64_t hash = XXH64(buffer.data(), header, size);
+
+    DWORD secOffset = 0, secSize = 0;
+    if (IsPEHeader(buffer.data(), header) && GetSecurityDirectory(buffer.data(), header, secOffset, secSize) &&
+        static_cast<uint64_t>(secOffset) + secSize <= size)
+    {
+        buffer.resize(std::min(secSize, kFingerprintMaxSecurityDir));
+        size_t got = probe.ReadAt(secOffset, buffer.data(), buffer.size());
+        hash = XXH64(buffer.data(), got, hash ^ secSize);
+    }
+
+    buffer.resize(kFingerprintSampleSize);
+    if (size <= static_cast<uint64_t>(kFingerprintSampleSize) * kFingerprintSampleCount)
+    {
+        for (uint64_t offset = header; offset < size; offset += kFingerprintSampleSize)
+        {
+            size_t got = probe.ReadAt(offset, buffer.data(), buffer.size());
+            hash = XXH64(buffer.data(), got, hash);
+        }
+        return hash;
+    }
+
+    uint64_t stride = size / kFingerprintSampleCount;
+    for (uint32_t i = 1; i <= kFingerprintSampleCount; ++i)
+    {
+        uint64_t offset = i == kFingerprintSampleCount ? size - kFingerprintSampleSize : i * stride;
+        size_t got = probe.ReadAt(offset, buffer.data(), buffer.size());
+        hash = XXH64(buffer.data(), got, hash);
+    }
+    return hash;
+}
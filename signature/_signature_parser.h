@@ -15,109 +15,77 @@
 #include <string_view>
 #include <future>
 
+#include "../io/_file_probe.hpp"
+#include "_authenticode.hpp"
+#include "_file_fingerprint.hpp"
 #include "_filtered_signatures.hh"
-
-enum class SignatureStatus {
-    Signed,
-    Unsigned,
-    NotFound,
-    Cheat,
-    Fake
-};
-
-inline bool operator==(SignatureStatus lhs, SignatureStatus rhs) { return static_cast<int>(lhs) == static_cast<int>(rhs); }
-inline bool operator!=(SignatureStatus lhs, SignatureStatus rhs) { return !(lhs == rhs); }
+#include "_signature_status.hpp"
+#include "_verdict_cache.hpp"
 
 static std::unordered_map<std::wstring, SignatureStatus> g_signatureCache;
 static std::shared_mutex g_signatureMutex;
-static std::unordered_map<std::string, SignatureStatus> g_winTrustCache;
+static std::unordered_map<std::string, SignatureStatus> g_winTrustCache; // keyed by WinTrustKey()
 static std::shared_mutex g_winTrustMutex;
 
-static bool ReadFileHeader(const std::wstring& path, BYTE* buffer, DWORD bytesToRead, DWORD& outRead)
+// The file itself (volume, file ID, size, write time) plus its bounded
+// fingerprint. Another path to the same file (hard link, short name) reuses
+// the result; a different file never does, however alike their samples.
+static std::string WinTrustKey(const FileIdentity& id)
 {
-    outRead = 0;
-    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
-        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-
-    if (h == INVALID_HANDLE_VALUE)
-        return false;
-
-    DWORD read = 0;
-    BOOL ok = ReadFile(h, buffer, bytesToRead, &read, nullptr);
-    CloseHandle(h);
-
-    if (!ok || read == 0)
-        return false;
-
-    outRead = read;
-    return true;
+    std::string key(reinterpret_cast<const char*>(&id.volumeSerial), sizeof(id.volumeSerial));
+    key.append(reinterpret_cast<const char*>(id.fileId), sizeof(id.fileId));
+    key.append(reinterpret_cast<const char*>(&id.size), sizeof(id.size));
+    key.append(reinterpret_cast<const char*>(&id.lastWrite), sizeof(id.lastWrite));
+    key.append(reinterpret_cast<const char*>(&id.contentHash), sizeof(id.contentHash));
+    return key;
 }
 
-std::string ComputeFileHeaderHash(const std::wstring& path) {
-    BYTE buf[1024] = { 0 };
-    DWORD read = 0;
-    if (!ReadFileHeader(path, buf, sizeof(buf), read) || read == 0) return "";
-
-    HCRYPTPROV hProv = 0;
-    HCRYPTHASH hHash = 0;
-    if (!CryptAcquireContext(&hProv, nullptr, nullptr, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT)) return "";
-    if (!CryptCreateHash(hProv, CALG_SHA1, 0, 0, &hHash)) {
-        CryptReleaseContext(hProv, 0);
-        return "";
-    }
-    if (!CryptHashData(hHash, buf, read, 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProv, 0);
-        return "";
-    }
-    DWORD hashLen = 20;
-    BYTE hash[20];
-    if (!CryptGetHashParam(hHash, HP_HASHVAL, hash, &hashLen, 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProv, 0);
-        return "";
-    }
-    CryptDestroyHash(hHash);
-    CryptReleaseContext(hProv, 0);
-
-    std::string hashStr;
-    hashStr.reserve(40);
-    for (BYTE b : hash) {
-        char hex[3];
-        sprintf_s(hex, "%02x", b);
-        hashStr += hex;
-    }
-    return hashStr;
-}
+// Largest security directory read into memory for an unmapped file.
+constexpr DWORD kMaxUnmappedSecurityDir = 16 * 1024 * 1024;
 
-bool IsPEFile(const std::wstring& path)
+// The PKCS#7 SignedData of the first WIN_CERTIFICATE. Points into the
+// mapped image, or into `storage` when the probe has no view.
+static bool GetEmbeddedSignature(const FileProbe& probe, std::vector<BYTE>& storage, CRYPT_DATA_BLOB& blob)
 {
-    BYTE buf[0x200] = { 0 };
-    DWORD read = 0;
-    if (!ReadFileHeader(path, buf, sizeof(buf), read) || read < 0x40)
-        return false;
-
-    if (buf[0] != 'M' || buf[1] != 'Z')
+    BYTE header[kFingerprintHeaderSize];
+    DWORD read = static_cast<DWORD>(probe.ReadAt(0, header, sizeof(header)));
+    DWORD offset = 0, size = 0;
+    if (!IsPEHeader(header, read) || !GetSecurityDirectory(header, read, offset, size))
         return false;
 
-    DWORD e_lfanew = *reinterpret_cast<DWORD*>(buf + 0x3C);
-    if (e_lfanew + 0x18 + sizeof(IMAGE_FILE_HEADER) > read)
+    if (static_cast<uint64_t>(offset) + size > probe.Size() || size < 8)
         return false;
 
-    BYTE* peHeader = buf + e_lfanew;
-    if (!(peHeader[0] == 'P' && peHeader[1] == 'E' && peHeader[2] == 0 && peHeader[3] == 0))
+    const BYTE* cert = probe.Data() ? probe.Data() + offset : nullptr;
+    if (!cert) {
+        if (size > kMaxUnmappedSecurityDir)
+            return false;
+        storage.resize(size);
+        if (probe.ReadAt(offset, storage.data(), size) != size)
+            return false;
+        cert = storage.data();
+    }
+    DWORD length = *reinterpret_cast<const DWORD*>(cert);
+    WORD type = *reinterpret_cast<const WORD*>(cert + 6);
+    if (length < 8 || length > size || type != WIN_CERT_TYPE_PKCS_SIGNED_DATA)
         return false;
 
-    auto* fileHeader = reinterpret_cast<IMAGE_FILE_HEADER*>(peHeader + 4);
-    return fileHeader->NumberOfSections > 0 && fileHeader->NumberOfSections <= 96;
+    blob.pbData = const_cast<BYTE*>(cert + 8);
+    blob.cbData = length - 8;
+    return true;
 }
 
-std::optional<PCCERT_CONTEXT> GetSignerCertificate(const std::wstring& filePath)
+std::optional<PCCERT_CONTEXT> GetSignerCertificate(const FileProbe& probe)
 {
+    std::vector<BYTE> storage;
+    CRYPT_DATA_BLOB blob{};
+    if (!GetEmbeddedSignature(probe, storage, blob))
+        return std::nullopt;
+
     HCERTSTORE hStore = nullptr;
     HCRYPTMSG hMsg = nullptr;
-    if (!CryptQueryObject(CERT_QUERY_OBJECT_FILE, filePath.c_str(),
-        CERT_QUERY_CONTENT_FLAG_PKCS7_SIGNED_EMBED, CERT_QUERY_FORMAT_FLAG_BINARY, 0,
+    if (!CryptQueryObject(CERT_QUERY_OBJECT_BLOB, &blob,
+        CERT_QUERY_CONTENT_FLAG_PKCS7_SIGNED, CERT_QUERY_FORMAT_FLAG_BINARY, 0,
         nullptr, nullptr, nullptr, &hStore, &hMsg, nullptr)) return std::nullopt;
 
     DWORD signerInfoSize = 0;
@@ -143,32 +111,33 @@ std::optional<PCCERT_CONTEXT> GetSignerCertificate(const std::wstring& filePath)
     return std::nullopt;
 }
 
-bool VerifyFileViaCatalog(const std::wstring& filePath)
+// The probe's handle is positioned at 0 before every API that reads through it.
+static HANDLE RewindProbe(const FileProbe& probe)
+{
+    LARGE_INTEGER zero{};
+    SetFilePointerEx(probe.Handle(), zero, nullptr, FILE_BEGIN);
+    return probe.Handle();
+}
+
+bool VerifyFileViaCatalog(const FileProbe& probe)
 {
+    const std::wstring& filePath = probe.Path();
+
     HANDLE hCatAdmin = nullptr;
     if (!CryptCATAdminAcquireContext(&hCatAdmin, nullptr, 0))
         return false;
 
-    HANDLE hFile = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        CryptCATAdminReleaseContext(hCatAdmin, 0);
-        return false;
-    }
-
     DWORD dwHashSize = 0;
-    if (!CryptCATAdminCalcHashFromFileHandle(hFile, &dwHashSize, nullptr, 0)) {
-        CloseHandle(hFile);
+    if (!CryptCATAdminCalcHashFromFileHandle(RewindProbe(probe), &dwHashSize, nullptr, 0)) {
         CryptCATAdminReleaseContext(hCatAdmin, 0);
         return false;
     }
 
     std::vector<BYTE> pbHash(dwHashSize);
-    if (!CryptCATAdminCalcHashFromFileHandle(hFile, &dwHashSize, pbHash.data(), 0)) {
-        CloseHandle(hFile);
+    if (!CryptCATAdminCalcHashFromFileHandle(RewindProbe(probe), &dwHashSize, pbHash.data(), 0)) {
         CryptCATAdminReleaseContext(hCatAdmin, 0);
         return false;
     }
-    CloseHandle(hFile);
 
     CATALOG_INFO catInfo = { sizeof(CATALOG_INFO) };
     HANDLE hCatInfo = CryptCATAdminEnumCatalogFromHash(hCatAdmin, pbHash.data(), dwHashSize, 0, nullptr);
@@ -248,8 +217,10 @@ bool IsPathForcedSigned(const std::wstring& rawPath)
     return g_forcedSignedPaths.find(norm) != g_forcedSignedPaths.end();
 }
 
-SignatureStatus GetSignatureStatus(const std::wstring& path)
+SignatureStatus GetSignatureStatus(FileProbe& probe)
 {
+    const std::wstring& path = probe.Path();
+
     {
         std::shared_lock readLock(g_signatureMutex);
         if (auto it = g_signatureCache.find(path); it != g_signatureCache.end())
@@ -259,90 +230,127 @@ SignatureStatus GetSignatureStatus(const std::wstring& path)
     if (IsPathForcedSigned(path))
         return SignatureStatus::Signed;
 
-    static std::wstring exePath;
-    if (exePath.empty()) {
+    static const std::wstring exePath = [] {
         wchar_t buffer[MAX_PATH] = { 0 };
-        if (GetModuleFileNameW(nullptr, buffer, MAX_PATH))
-            exePath = buffer;
-    }
+        GetModuleFileNameW(nullptr, buffer, MAX_PATH);
+        return std::wstring(buffer);
+    }();
     if (_wcsicmp(path.c_str(), exePath.c_str()) == 0)
         return SignatureStatus::Signed;
 
-    DWORD attr = GetFileAttributesW(path.c_str());
-    if (attr == INVALID_FILE_ATTRIBUTES || (attr & FILE_ATTRIBUTE_DIRECTORY)) {
+    if (!probe.Open()) {
+        // Existing files we may not open (in use, access denied) were not
+        // checked; they must not pass for signed.
+        DWORD attr = GetFileAttributesW(path.c_str());
+        SignatureStatus status = (attr == INVALID_FILE_ATTRIBUTES || (attr & FILE_ATTRIBUTE_DIRECTORY))
+            ? SignatureStatus::NotFound
+            : SignatureStatus::NotChecked;
+
         std::unique_lock writeLock(g_signatureMutex);
-        g_signatureCache[path] = SignatureStatus::NotFound;
-        return SignatureStatus::NotFound;
+        g_signatureCache[path] = status;
+        return status;
+    }
+
+    // Metadata only: a warm hit must not read the file.
+    FileIdentity identity = probe.Identity();
+    if (auto stored = GetVerdictCache().Lookup(identity)) {
+        SignatureStatus status = static_cast<SignatureStatus>(*stored);
+        std::unique_lock writeLock(g_signatureMutex);
+        g_signatureCache[path] = status;
+        return status;
+    }
+
+    // Read through the probe: files too large to map still have a handle.
+    BYTE header[kFingerprintHeaderSize];
+    DWORD headerSize = static_cast<DWORD>(probe.ReadAt(0, header, sizeof(header)));
+    if (headerSize == 0 && probe.Size() != 0) {
+        std::unique_lock writeLock(g_signatureMutex);
+        g_signatureCache[path] = SignatureStatus::NotChecked;
+        return SignatureStatus::NotChecked;
     }
 
+    // Non-PE files are reported Signed without a trust check, so only PE
+    // files are fingerprinted.
+    bool isPE = IsPEHeader(header, headerSize);
+    if (isPE)
+        identity.contentHash = ComputeFileFingerprint(probe);
+
+    bool persist = true;
+
     SignatureStatus status = SignatureStatus::Signed;
     try {
-        if (IsPEFile(path)) {
-            auto signingCertOpt = GetSignerCertificate(path);
+        // The portable parser settles cheat signers and tampered images
+        // without touching CryptoAPI; anything it calls intact still goes
+        // through WinVerifyTrust for the chain of trust. It needs the whole
+        // image in memory, so unmapped files go straight to WinVerifyTrust.
+        SignatureStatus portable = SignatureStatus::Unsigned;
+        if (isPE && probe.Data() && AuthenticodeAvailable()) {
+            auto signatures = ParseAuthenticodeSignatures(probe.Data(), static_cast<size_t>(probe.Size()));
+            if (!signatures.empty() && signatures.front().IsTampered())
+                portable = SignatureStatus::Fake;
+            else if (EvaluateAuthenticode(signatures) == SignatureStatus::Cheat)
+                portable = SignatureStatus::Cheat;
+        }
+
+        if (portable != SignatureStatus::Unsigned) {
+            status = portable;
+        }
+        else if (isPE) {
+            auto signingCertOpt = GetSignerCertificate(probe);
             if (signingCertOpt.has_value()) {
                 PCCERT_CONTEXT signingCert = *signingCertOpt;
 
                 char subjectName[256];
                 CertNameToStrA(signingCert->dwCertEncodingType, &signingCert->pCertInfo->Subject, CERT_X500_NAME_STR, subjectName, sizeof(subjectName));
-                std::string_view subject(subjectName);
-                std::string lowerSubject(subject);
-                std::transform(lowerSubject.begin(), lowerSubject.end(), lowerSubject.begin(), ::tolower);
-                static const std::string_view cheats[] = { "manthe industries, llc", "slinkware", "amstion limited", "newfakeco", "faked signatures inc" };
-                bool isCheat = false;
-                for (auto c : cheats) {
-                    if (lowerSubject.find(c) != std::string::npos) {
-                        isCheat = true;
-                        break;
-                    }
-                }
-
-                if (isCheat) {
+                if (IsCheatSigner(subjectName)) {
                     status = SignatureStatus::Cheat;
                 }
                 else {
-                    std::string headerHash = ComputeFileHeaderHash(path);
-                    if (!headerHash.empty()) {
-                        std::unique_lock winTrustLock(g_winTrustMutex);
-                        if (auto it = g_winTrustCache.find(headerHash); it != g_winTrustCache.end()) {
-                            status = it->second;
+                    std::optional<SignatureStatus> cached;
+                    {
+                        std::shared_lock winTrustLock(g_winTrustMutex);
+                        if (auto it = g_winTrustCache.find(WinTrustKey(identity)); it != g_winTrustCache.end())
+                            cached = it->second;
+                    }
+
+                    if (cached.has_value()) {
+                        status = *cached;
+                    }
+                    else {
+                        WINTRUST_FILE_INFO fileInfo = { sizeof(WINTRUST_FILE_INFO) };
+                        fileInfo.pcwszFilePath = path.c_str();
+                        fileInfo.hFile = RewindProbe(probe);
+
+                        WINTRUST_DATA winTrustData = { sizeof(WINTRUST_DATA) };
+                        winTrustData.dwUIChoice = WTD_UI_NONE;
+                        winTrustData.fdwRevocationChecks = WTD_REVOKE_NONE;
+                        winTrustData.dwUnionChoice = WTD_CHOICE_FILE;
+                        winTrustData.dwProvFlags = WTD_CACHE_ONLY_URL_RETRIEVAL;
+                        winTrustData.dwStateAction = WTD_STATEACTION_VERIFY;
+                        winTrustData.pFile = &fileInfo;
+
+                        GUID action = WINTRUST_ACTION_GENERIC_VERIFY_V2;
+                        LONG res = WinVerifyTrust(nullptr, &action, &winTrustData);
+
+                        winTrustData.dwStateAction = WTD_STATEACTION_CLOSE;
+                        WinVerifyTrust(nullptr, &action, &winTrustData);
+
+                        if (res == ERROR_SUCCESS) {
+                            status = SignatureStatus::Signed;
                         }
                         else {
-                            WINTRUST_FILE_INFO fileInfo = { sizeof(WINTRUST_FILE_INFO) };
-                            fileInfo.pcwszFilePath = path.c_str();
-
-                            WINTRUST_DATA winTrustData = { sizeof(WINTRUST_DATA) };
-                            winTrustData.dwUIChoice = WTD_UI_NONE;
-                            winTrustData.fdwRevocationChecks = WTD_REVOKE_NONE;
-                            winTrustData.dwUnionChoice = WTD_CHOICE_FILE;
-                            winTrustData.dwProvFlags = WTD_CACHE_ONLY_URL_RETRIEVAL;
-                            winTrustData.dwStateAction = WTD_STATEACTION_VERIFY;
-                            winTrustData.pFile = &fileInfo;
-
-                            GUID action = WINTRUST_ACTION_GENERIC_VERIFY_V2;
-                            LONG res = WinVerifyTrust(nullptr, &action, &winTrustData);
-
-                            winTrustData.dwStateAction = WTD_STATEACTION_CLOSE;
-                            WinVerifyTrust(nullptr, &action, &winTrustData);
-
-                            if (res == ERROR_SUCCESS) {
-                                status = SignatureStatus::Signed;
-                            }
-                            else {
-                                status = SignatureStatus::Fake;
-                            }
-
-                            g_winTrustCache[headerHash] = status;
+                            status = SignatureStatus::Fake;
                         }
-                    }
-                    else {
-                        status = SignatureStatus::Fake;
+
+                        std::unique_lock winTrustLock(g_winTrustMutex);
+                        g_winTrustCache[WinTrustKey(identity)] = status;
                     }
                 }
 
                 CertFreeCertificateContext(signingCert);
             }
             else {
-                if (VerifyFileViaCatalog(path)) {
+                if (VerifyFileViaCatalog(probe)) {
                     status = SignatureStatus::Signed;
                 }
                 else {
@@ -355,9 +363,13 @@ SignatureStatus GetSignatureStatus(const std::wstring& path)
         }
     }
     catch (...) {
-        status = SignatureStatus::Signed;
+        status = SignatureStatus::NotChecked;
+        persist = false;
     }
 
+    if (persist)
+        GetVerdictCache().Store(identity, static_cast<uint32_t>(status));
+
     {
         std::unique_lock writeLock(g_signatureMutex);
         g_signatureCache[path] = status;
@@ -366,6 +378,13 @@ SignatureStatus GetSignatureStatus(const std::wstring& path)
     return status;
 }
 
+SignatureStatus GetSignatureStatus(const std::wstring& path)
+{
+    FileProbe probe(path);
+    return GetSignatureStatus(probe);
+}
+
 std::future<SignatureStatus> GetSignatureStatusAsync(const std::wstring& path) {
-    return std::async(std::launch::async, GetSignatureStatus, path);
+    // GetSignatureStatus is overloaded, so it can't be passed by name.
+    return std::async(std::launch::async, [path] { return GetSignatureStatus(path); });
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <string_view>
+
+enum class SignatureStatus {
+    Signed,
+    Unsigned,
+    NotFound,
+    Cheat,
+    Fake,
+    // The file exists but could not be opened or read.
+    NotChecked
+};
+
+inline bool operator==(SignatureStatus lhs, SignatureStatus rhs) { return static_cast<int>(lhs) == static_cast<int>(rhs); }
+inline bool operator!=(SignatureStatus lhs, SignatureStatus rhs) { return !(lhs == rhs); }
+
+// Signer subjects used by known cheat vendors. Shared by the WinTrust and
+// the portable Authenticode engines.
+inline bool IsCheatSigner(std::string_view subject)
+{
+    std::string lowerSubject(subject);
+    std::transform(lowerSubject.begin(), lowerSubject.end(), lowerSubject.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    static const std::string_view cheats[] = { "manthe industries, llc", "slinkware", "amstion limited", "newfakeco", "faked signatures inc" };
+    for (auto c : cheats) {
+        if (lowerSubject.find(c) != std::string::npos)
+            return true;
+    }
+    return false;
+}
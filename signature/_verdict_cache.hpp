@@ -0,0 +1,236 @@
+#pragma once
+
+// Persistent signature verdicts. Trust checks are by far the slowest part of
+// a scan and the same System32 / Program Files binaries come back on every
+// run, so verdicts are kept in verdicts.bin in the admin store (see
+// _admin_store.hpp). A verdict file the checked account can write would let
+// it mark its own binaries Signed, so the file is only used when it and its
+// directory are admin-only, and nothing is persisted otherwise.
+//
+// The file is a sorted array of fixed-size records keyed by (volume serial,
+// file ID). It is memory-mapped read-only on first use and binary-searched
+// without locking; a record only counts if size and last-write time still
+// match, so a warm hit reads nothing from the file itself. That catches
+// updates and rebuilds, not a file patched in place with its write time set
+// back; the records are only as trustworthy as the admin-only store. New
+// verdicts are collected in memory and merged into a fresh file by Save(),
+// which replaces the old one atomically.
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../io/_admin_store.hpp"
+#include "../io/_mapped_file.h"
+#include "../io/_file_probe.hpp"
+
+constexpr uint32_t kVerdictCacheMagic = 0x43565242; // "BRVC"
+constexpr uint32_t kVerdictCacheVersion = 4;
+constexpr uint64_t kVerdictMaxAge = 30ULL * 24 * 3600 * 10000000; // FILETIME ticks; catalogs and CRLs change
+
+#pragma pack(push, 1)
+struct VerdictCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+};
+
+struct VerdictRecord
+{
+    uint64_t volumeSerial;
+    uint8_t  fileId[16];
+    uint64_t size;
+    uint64_t lastWrite;
+    uint64_t verifiedAt;
+    uint32_t status;
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(VerdictRecord) == 56);
+
+inline bool VerdictKeyLess(const VerdictRecord& a, const VerdictRecord& b)
+{
+    if (a.volumeSerial != b.volumeSerial)
+        return a.volumeSerial < b.volumeSerial;
+    return memcmp(a.fileId, b.fileId, sizeof(a.fileId)) < 0;
+}
+
+class VerdictCache
+{
+public:
+    bool Load(const std::filesystem::path& file)
+    {
+        m_path = file;
+        if (!IsAdminOnlyPath(file.parent_path()) || !IsAdminOnlyPath(file) ||
+            !m_file.Open(file) || m_file.Size() < sizeof(VerdictCacheHeader))
+            return false;
+
+        VerdictCacheHeader header;
+        memcpy(&header, m_file.Data(), sizeof(header));
+        if (header.magic != kVerdictCacheMagic || header.version != kVerdictCacheVersion ||
+            header.count > (m_file.Size() - sizeof(header)) / sizeof(VerdictRecord))
+        {
+            m_file.Close();
+            return false;
+        }
+
+        m_records = reinterpret_cast<const VerdictRecord*>(m_file.Data() + sizeof(header));
+        m_count = static_cast<size_t>(header.count);
+        return true;
+    }
+
+    std::optional<uint32_t> Lookup(const FileIdentity& id) const
+    {
+        VerdictRecord key = MakeKey(id);
+
+        {
+            std::shared_lock lock(m_pendingMutex);
+            if (auto it = m_pending.find(KeyString(key)); it != m_pending.end())
+                return Validate(it->second, id);
+        }
+
+        const VerdictRecord* end = m_records + m_count;
+        const VerdictRecord* it = std::lower_bound(m_records, end, key, VerdictKeyLess);
+        if (it == end || VerdictKeyLess(key, *it))
+            return std::nullopt;
+
+        return Validate(*it, id);
+    }
+
+    void Store(const FileIdentity& id, uint32_t status)
+    {
+        VerdictRecord r = MakeKey(id);
+        r.size = id.size;
+        r.lastWrite = id.lastWrite;
+        r.verifiedAt = Now();
+        r.status = status;
+
+        std::unique_lock lock(m_pendingMutex);
+        m_pending[KeyString(r)] = r;
+    }
+
+    // Merges pending verdicts into the mapped set and replaces the file.
+    // Must not race with Lookup(); call it after a scan has finished.
+    bool Save()
+    {
+        std::unique_lock lock(m_pendingMutex);
+        if (m_pending.empty() || m_path.empty())
+            return true;
+
+        uint64_t now = Now();
+        std::vector<VerdictRecord> merged;
+        merged.reserve(m_count + m_pending.size());
+
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            if (!m_pending.contains(KeyString(m_records[i])) && now - m_records[i].verifiedAt < kVerdictMaxAge)
+                merged.push_back(m_records[i]);
+        }
+        for (const auto& [key, r] : m_pending)
+            merged.push_back(r);
+
+        std::sort(merged.begin(), merged.end(), VerdictKeyLess);
+
+        // The new file inherits the store's admin-only DACL.
+        if (!IsAdminOnlyPath(m_path.parent_path()))
+            return false;
+
+        std::filesystem::path temp = m_path;
+        temp += L".tmp";
+
+        HANDLE h = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (h == INVALID_HANDLE_VALUE)
+            return false;
+
+        VerdictCacheHeader header{ kVerdictCacheMagic, kVerdictCacheVersion, merged.size() };
+        DWORD written = 0;
+        bool ok = WriteFile(h, &header, sizeof(header), &written, nullptr) &&
+            WriteFile(h, merged.data(), static_cast<DWORD>(merged.size() * sizeof(VerdictRecord)), &written, nullptr) &&
+            FlushFileBuffers(h);
+        CloseHandle(h);
+
+        // The old file cannot be replaced while it is mapped.
+        m_records = nullptr;
+        m_count = 0;
+        m_file.Close();
+
+        if (!ok || !MoveFileExW(temp.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            DeleteFileW(temp.c_str());
+            Load(m_path);
+            return false;
+        }
+
+        m_pending.clear();
+        Load(m_path);
+        return true;
+    }
+
+private:
+    static VerdictRecord MakeKey(const FileIdentity& id)
+    {
+        VerdictRecord r{};
+        r.volumeSerial = id.volumeSerial;
+        memcpy(r.fileId, id.fileId, sizeof(r.fileId));
+        return r;
+    }
+
+    static std::string KeyString(const VerdictRecord& r)
+    {
+        return std::string(reinterpret_cast<const char*>(&r.volumeSerial), sizeof(r.volumeSerial) + sizeof(r.fileId));
+    }
+
+    static uint64_t Now()
+    {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    }
+
+    static std::optional<uint32_t> Validate(const VerdictRecord& r, const FileIdentity& id)
+    {
+        if (r.size != id.size || r.lastWrite != id.lastWrite)
+            return std::nullopt;
+        if (Now() - r.verifiedAt >= kVerdictMaxAge)
+            return std::nullopt;
+        return r.status;
+    }
+
+    std::filesystem::path m_path;
+    MappedFile            m_file;
+    const VerdictRecord*  m_records = nullptr;
+    size_t                m_count = 0;
+
+    mutable std::shared_mutex m_pendingMutex;
+    std::unordered_map<std::string, VerdictRecord> m_pending;
+};
+
+// Empty when there is no trusted admin store; verdicts then last one run.
+inline std::filesystem::path GetVerdictCachePath()
+{
+    std::filesystem::path dir = GetAdminStoreDirectory();
+    return dir.empty() ? dir : dir / L"verdicts.bin";
+}
+
+// Process-wide store, mapped on first use.
+inline VerdictCache& GetVerdictCache()
+{
+    static VerdictCache cache;
+    static const bool loaded = [] {
+        if (auto path = GetVerdictCachePath(); !path.empty())
+            cache.Load(path);
+        return true;
+    }();
+    (void)loaded;
+    return cache;
+}
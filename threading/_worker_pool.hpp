@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+inline size_t GetHardwareWorkerCount(size_t cap = 0)
+{
+    size_t n = std::thread::hardware_concurrency();
+    if (n == 0)
+        n = 4;
+    if (cap && n > cap)
+        n = cap;
+    return n;
+}
+
+// Fixed set of threads that run one ParallelFor job at a time. Every call
+// to the body receives the item index and a stable worker id in [0, Size()),
+// so callers can keep per-worker state (buffers, scanners) without locking.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(size_t threads)
+    {
+        if (threads == 0)
+            threads = 1;
+
+        m_threads.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            m_threads.emplace_back(&WorkerPool::WorkerLoop, this, i);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_exit = true;
+        }
+        m_cv.notify_all();
+
+        for (auto& t : m_threads)
+            t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t Size() const { return m_threads.size(); }
+
+    // Runs fn(index, worker) for every index in [0, count) and blocks until
+    // all of them finished. Must not be called from inside a pool worker.
+    // If a call throws, the remaining indices are skipped and the first
+    // exception is rethrown here once every worker is idle again.
+    template <typename Fn>
+    void ParallelFor(size_t count, Fn&& fn)
+    {
+        if (count == 0)
+            return;
+
+        std::lock_guard jobLock(m_jobMutex);
+
+        std::function<void(size_t, size_t)> body =
+            [&fn](size_t index, size_t worker) { fn(index, worker); };
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_body = &body;
+            m_count = count;
+            m_next = 0;
+            m_error = nullptr;
+            m_active = m_threads.size();
+            ++m_generation;
+        }
+        m_cv.notify_all();
+
+        std::exception_ptr error;
+        {
+            std::unique_lock lock(m_mutex);
+            m_doneCv.wait(lock, [this] { return m_active == 0; });
+            m_body = nullptr;
+            error = std::exchange(m_error, nullptr);
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    void WorkerLoop(size_t worker)
+    {
+        uint64_t seen = 0;
+
+        for (;;)
+        {
+            const std::function<void(size_t, size_t)>* body = nullptr;
+            size_t count = 0;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [&] { return m_exit || m_generation != seen; });
+                if (m_exit)
+                    return;
+
+                seen = m_generation;
+                body = m_body;
+                count = m_count;
+            }
+
+            for (size_t i; (i = m_next.fetch_add(1, std::memory_order_relaxed)) < count;)
+            {
+                try {
+                    (*body)(i, worker);
+                }
+                catch (...) {
+                    std::lock_guard lock(m_mutex);
+                    if (!m_error)
+                        m_error = std::current_exception();
+                    m_next.store(count, std::memory_order_relaxed);
+                }
+            }
+
+            {
+                std::lock_guard lock(m_mutex);
+                if (--m_active == 0)
+                    m_doneCv.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_jobMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_doneCv;
+
+    const std::function<void(size_t, size_t)>* m_body = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next{ 0 };
+    size_t m_active = 0;
+    std::exception_ptr m_error;
+    uint64_t m_generation = 0;
+    bool m_exit = false;
+};
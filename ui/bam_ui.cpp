@@ -39,6 +39,7 @@ std::vector<BAMEntryUI> ConvertToUI(const BamResult& in)
         oss << std::put_time(&tmStruct, "%Y-%m-%d %H:%M:%S");
         ui.time = oss.str();
         ui.signature = e.signature;
+        ui.yaraTier = e.yaraTier;
 
         for (const auto& r : e.replaces)
         {
@@ -25,6 +25,7 @@ struct BAMEntryUI
     time_t execTime;
     std::string time;
     BamSignature signature;
+    BamScanTier yaraTier;
     std::vector<BAMReplaceUI> replaces;
 };
 
@@ -0,0 +1,413 @@
+#pragma once
+
+// Size-aware scan plans. Small files are scanned whole; larger ones only
+// over the ranges where detections live (PE headers, the start of every
+// section, the overlay / file tail), and huge ones over a fixed byte budget
+// under a timeout. Ranges are fed to libyara through YR_MEMORY_BLOCK
+// iterators: over the file mapping, so pages outside the plan are never
+// touched, or streamed from the file handle in overlapping windows, so
+// memory stays bounded by the window size however large the file is.
+//
+// Block 0 always starts at offset 0 and reaches through the section that
+// holds the import directory: the pe module parses the first block only, so
+// pe.imports keeps working on partial scans. `filesize` reports the real
+// file size. Plans only need the first kYaraHeaderProbe bytes of the file.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+#include <yara.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+using YaraFileHandle = HANDLE;
+#else
+#include <unistd.h>
+using YaraFileHandle = int;
+#endif
+
+enum class YaraScanTier {
+    None,
+    Full,
+    Sections,
+    Streamed
+};
+
+constexpr size_t kYaraFullScanLimit = 32ull * 1024 * 1024;
+constexpr size_t kYaraSectionScanLimit = 512ull * 1024 * 1024;
+constexpr size_t kYaraPrefixLimit = 16ull * 1024 * 1024;
+constexpr size_t kYaraSectionLimit = 4ull * 1024 * 1024;
+constexpr size_t kYaraTailSize = 4ull * 1024 * 1024;
+constexpr size_t kYaraStreamBudget = 64ull * 1024 * 1024;
+constexpr int    kYaraStreamTimeout = 10; // seconds
+constexpr size_t kYaraHeaderProbe = 64 * 1024;
+constexpr size_t kYaraStreamWindow = 4ull * 1024 * 1024;
+constexpr size_t kYaraStreamOverlap = 64 * 1024; // strings up to this long still match across a window edge
+
+struct YaraBlockRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+inline YaraScanTier ChooseYaraScanTier(uint64_t size) {
+    if (size <= kYaraFullScanLimit)
+        return YaraScanTier::Full;
+    if (size <= kYaraSectionScanLimit)
+        return YaraScanTier::Sections;
+    return YaraScanTier::Streamed;
+}
+
+namespace yara_blocks {
+    inline uint16_t Read16(const uint8_t* p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+    inline uint32_t Read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    struct PeSection {
+        uint32_t virtualAddress;
+        uint32_t virtualSize;
+        uint32_t rawOffset;
+        uint32_t rawSize;
+    };
+
+    struct PeLayout {
+        uint32_t headersSize = 0;
+        uint32_t importRva = 0;
+        std::vector<PeSection> sections;
+    };
+
+    // Headers and section table only, from the first `size` bytes of the
+    // file; anything malformed means "not a PE".
+    inline bool ParsePeLayout(const uint8_t* data, uint64_t size, PeLayout& pe) {
+        if (size < 0x40 || data[0] != 'M' || data[1] != 'Z')
+            return false;
+
+        uint64_t nt = Read32(data + 0x3C);
+        if (nt + 24 > size || memcmp(data + nt, "PE\0\0", 4) != 0)
+            return false;
+
+        uint16_t sectionCount = Read16(data + nt + 6);
+        uint16_t optionalSize = Read16(data + nt + 20);
+        uint64_t optional = nt + 24;
+        if (optional + optionalSize > size || optionalSize < 64)
+            return false;
+
+        uint16_t magic = Read16(data + optional);
+        uint64_t dirCountOffset = magic == 0x20B ? 108 : 92;
+        if (magic != 0x10B && magic != 0x20B)
+            return false;
+
+        pe.headersSize = Read32(data + optional + 60);
+        if (dirCountOffset + 4 <= optionalSize && Read32(data + optional + dirCountOffset) > 1 &&
+            dirCountOffset + 4 + 2 * 8 <= optionalSize)
+            pe.importRva = Read32(data + optional + dirCountOffset + 4 + 8);
+
+        uint64_t table = optional + optionalSize;
+        if (sectionCount > 96 || table + static_cast<uint64_t>(sectionCount) * 40 > size)
+            return false;
+
+        for (uint16_t i = 0; i < sectionCount; ++i) {
+            const uint8_t* s = data + table + i * 40ull;
+            pe.sections.push_back({ Read32(s + 12), Read32(s + 8), Read32(s + 20), Read32(s + 16) });
+        }
+        return true;
+    }
+
+    inline void AddRange(std::vector<YaraBlockRange>& ranges, uint64_t offset, uint64_t size, uint64_t fileSize) {
+        if (offset >= fileSize || size == 0)
+            return;
+        ranges.push_back({ offset, std::min(size, fileSize - offset) });
+    }
+
+    // Sorted, with overlapping and touching ranges merged so no string is
+    // split at a needless block boundary.
+    inline std::vector<YaraBlockRange> Normalize(std::vector<YaraBlockRange> ranges) {
+        std::sort(ranges.begin(), ranges.end(), [](const YaraBlockRange& a, const YaraBlockRange& b) {
+            return a.offset < b.offset;
+        });
+
+        std::vector<YaraBlockRange> merged;
+        for (const auto& r : ranges) {
+            if (!merged.empty() && r.offset <= merged.back().offset + merged.back().size) {
+                uint64_t end = std::max(merged.back().offset + merged.back().size, r.offset + r.size);
+                merged.back().size = end - merged.back().offset;
+            }
+            else {
+                merged.push_back(r);
+            }
+        }
+        return merged;
+    }
+
+    // Offset 0 through the headers and the section holding the import
+    // directory, capped at kYaraPrefixLimit.
+    inline uint64_t PrefixEnd(uint64_t size, const PeLayout* pe) {
+        uint64_t end = std::min<uint64_t>(size, 4096);
+        if (pe) {
+            end = std::max<uint64_t>(end, pe->headersSize);
+            for (const auto& s : pe->sections) {
+                uint32_t span = std::max(s.virtualSize, s.rawSize);
+                if (pe->importRva >= s.virtualAddress && pe->importRva - s.virtualAddress < span)
+                    end = std::max<uint64_t>(end, static_cast<uint64_t>(s.rawOffset) + s.rawSize);
+            }
+        }
+        return std::min<uint64_t>({ end, size, kYaraPrefixLimit });
+    }
+}
+
+// Headers, the first kYaraSectionLimit bytes of every section and the last
+// kYaraTailSize bytes (the overlay, when there is one). Non-PE files get the
+// prefix and the tail.
+inline std::vector<YaraBlockRange> PlanSectionBlocks(const uint8_t* header, size_t headerSize, uint64_t size) {
+    using namespace yara_blocks;
+
+    PeLayout pe;
+    bool isPE = ParsePeLayout(header, headerSize, pe);
+
+    std::vector<YaraBlockRange> ranges;
+    AddRange(ranges, 0, PrefixEnd(size, isPE ? &pe : nullptr), size);
+    if (isPE) {
+        for (const auto& s : pe.sections)
+            AddRange(ranges, s.rawOffset, std::min<uint64_t>(s.rawSize, kYaraSectionLimit), size);
+    }
+    else {
+        AddRange(ranges, 0, kYaraPrefixLimit, size);
+    }
+    AddRange(ranges, size - std::min<uint64_t>(size, kYaraTailSize), kYaraTailSize, size);
+    return Normalize(std::move(ranges));
+}
+
+// Size of block 0 for a plan over this file; see PrefixEnd.
+inline uint64_t PlanFirstBlock(const uint8_t* header, size_t headerSize, uint64_t size) {
+    using namespace yara_blocks;
+
+    PeLayout pe;
+    bool isPE = ParsePeLayout(header, headerSize, pe);
+    return PrefixEnd(size, isPE ? &pe : nullptr);
+}
+
+// The file front up to kYaraStreamBudget minus the tail, then the tail.
+inline std::vector<YaraBlockRange> PlanStreamBlocks(const uint8_t* header, size_t headerSize, uint64_t size) {
+    using namespace yara_blocks;
+
+    PeLayout pe;
+    bool isPE = ParsePeLayout(header, headerSize, pe);
+    uint64_t front = std::max(PrefixEnd(size, isPE ? &pe : nullptr), kYaraStreamBudget - kYaraTailSize);
+
+    std::vector<YaraBlockRange> ranges;
+    AddRange(ranges, 0, front, size);
+    AddRange(ranges, size - std::min<uint64_t>(size, kYaraTailSize), kYaraTailSize, size);
+    return Normalize(std::move(ranges));
+}
+
+// YR_MEMORY_BLOCK_ITERATOR over planned ranges of a mapped file. Must stay
+// at a fixed address while a scan uses it.
+class YaraMappedBlocks {
+public:
+    YaraMappedBlocks(const uint8_t* data, uint64_t fileSize, std::vector<YaraBlockRange> ranges)
+        : m_data(data), m_fileSize(fileSize), m_ranges(std::move(ranges)) {
+        m_iterator.context = this;
+        m_iterator.first = First;
+        m_iterator.next = Next;
+        m_iterator.file_size = FileSize;
+        m_iterator.last_error = ERROR_SUCCESS;
+    }
+
+    YaraMappedBlocks(const YaraMappedBlocks&) = delete;
+    YaraMappedBlocks& operator=(const YaraMappedBlocks&) = delete;
+
+    YR_MEMORY_BLOCK_ITERATOR* Iterator() { return &m_iterator; }
+
+private:
+    static YR_MEMORY_BLOCK* First(YR_MEMORY_BLOCK_ITERATOR* it) {
+        static_cast<YaraMappedBlocks*>(it->context)->m_next = 0;
+        return Next(it);
+    }
+
+    static YR_MEMORY_BLOCK* Next(YR_MEMORY_BLOCK_ITERATOR* it) {
+        auto* self = static_cast<YaraMappedBlocks*>(it->context);
+        if (self->m_next >= self->m_ranges.size())
+            return nullptr;
+
+        const YaraBlockRange& r = self->m_ranges[self->m_next++];
+        self->m_block.base = r.offset;
+        self->m_block.size = static_cast<size_t>(r.size);
+        self->m_block.context = const_cast<uint8_t*>(self->m_data + r.offset);
+        self->m_block.fetch_data = FetchData;
+        return &self->m_block;
+    }
+
+    static const uint8_t* FetchData(YR_MEMORY_BLOCK* block) {
+        return static_cast<const uint8_t*>(block->context);
+    }
+
+    static uint64_t FileSize(YR_MEMORY_BLOCK_ITERATOR* it) {
+        return static_cast<YaraMappedBlocks*>(it->context)->m_fileSize;
+    }
+
+    const uint8_t*              m_data;
+    uint64_t                    m_fileSize;
+    std::vector<YaraBlockRange> m_ranges;
+    size_t                      m_next = 0;
+    YR_MEMORY_BLOCK             m_block{};
+    YR_MEMORY_BLOCK_ITERATOR    m_iterator{};
+};
+
+// Positional read that leaves short reads only at end of file.
+inline bool YaraReadAt(YaraFileHandle file, uint64_t offset, uint8_t* buffer, size_t size, size_t& read) {
+    read = 0;
+    while (read < size) {
+#ifdef _WIN32
+        OVERLAPPED position{};
+        position.Offset = static_cast<DWORD>(offset + read);
+        position.OffsetHigh = static_cast<DWORD>((offset + read) >> 32);
+
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - read, 1u << 30));
+        DWORD got = 0;
+        if (!ReadFile(file, buffer + read, chunk, &got, &position))
+            return GetLastError() == ERROR_HANDLE_EOF;
+#else
+        ssize_t got = pread(file, buffer + read, size - read, static_cast<off_t>(offset + read));
+        if (got < 0)
+            return false;
+#endif
+        if (got == 0)
+            break;
+        read += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// YR_MEMORY_BLOCK_ITERATOR that reads planned ranges from a file handle in
+// kYaraStreamWindow windows overlapping by kYaraStreamOverlap. The next
+// window is read in the background while libyara scans the current one.
+// Block 0 gets its own buffer that lives as long as the iterator, because
+// the pe module keeps pointing into it while conditions are evaluated.
+// Must stay at a fixed address while a scan uses it.
+class YaraStreamBlocks {
+public:
+    YaraStreamBlocks(YaraFileHandle file, uint64_t fileSize, const std::vector<YaraBlockRange>& ranges, uint64_t firstBlock)
+        : m_file(file), m_fileSize(fileSize) {
+        for (const auto& r : ranges) {
+            uint64_t end = r.offset + r.size;
+            for (uint64_t pos = r.offset; pos < end;) {
+                uint64_t len = pos == 0 ? std::max<uint64_t>(firstBlock, kYaraStreamWindow) : kYaraStreamWindow;
+                len = std::min(len, end - pos);
+                m_windows.push_back({ pos, len });
+                if (pos + len >= end)
+                    break;
+                pos += len - kYaraStreamOverlap;
+            }
+        }
+
+        m_iterator.context = this;
+        m_iterator.first = First;
+        m_iterator.next = Next;
+        m_iterator.file_size = FileSize;
+        m_iterator.last_error = ERROR_SUCCESS;
+    }
+
+    ~YaraStreamBlocks() { Wait(); }
+
+    YaraStreamBlocks(const YaraStreamBlocks&) = delete;
+    YaraStreamBlocks& operator=(const YaraStreamBlocks&) = delete;
+
+    YR_MEMORY_BLOCK_ITERATOR* Iterator() { return &m_iterator; }
+
+private:
+    // libyara restarts the iteration for every module that walks the
+    // blocks, so First() must be able to rewind at any point.
+    static YR_MEMORY_BLOCK* First(YR_MEMORY_BLOCK_ITERATOR* it) {
+        auto* self = static_cast<YaraStreamBlocks*>(it->context);
+        self->Wait();
+        self->m_next = 0;
+        return Next(it);
+    }
+
+    static YR_MEMORY_BLOCK* Next(YR_MEMORY_BLOCK_ITERATOR* it) {
+        auto* self = static_cast<YaraStreamBlocks*>(it->context);
+        if (self->m_next >= self->m_windows.size())
+            return nullptr;
+
+        size_t index = self->m_next++;
+        const YaraBlockRange& w = self->m_windows[index];
+        std::vector<uint8_t>* buffer = nullptr;
+        size_t read = 0;
+        bool ok = true;
+
+        if (index == 0 && w.offset == 0) {
+            buffer = &self->m_first;
+            if (self->m_firstSize == 0) {
+                buffer->resize(static_cast<size_t>(w.size));
+                ok = YaraReadAt(self->m_file, 0, buffer->data(), buffer->size(), self->m_firstSize);
+            }
+            read = self->m_firstSize;
+        }
+        else if (self->m_pending.valid() && self->m_pendingIndex == index) {
+            ok = self->m_pending.get();
+            std::swap(self->m_current, self->m_ahead);
+            buffer = &self->m_current;
+            read = self->m_aheadSize;
+        }
+        else {
+            self->Wait();
+            buffer = &self->m_current;
+            buffer->resize(static_cast<size_t>(w.size));
+            ok = YaraReadAt(self->m_file, w.offset, buffer->data(), buffer->size(), read);
+        }
+
+        if (!ok || read == 0) {
+            it->last_error = ERROR_COULD_NOT_READ_FILE;
+            return nullptr;
+        }
+
+        self->Prefetch(index + 1);
+
+        self->m_block.base = w.offset;
+        self->m_block.size = read;
+        self->m_block.context = buffer->data();
+        self->m_block.fetch_data = FetchData;
+        return &self->m_block;
+    }
+
+    static const uint8_t* FetchData(YR_MEMORY_BLOCK* block) {
+        return static_cast<const uint8_t*>(block->context);
+    }
+
+    static uint64_t FileSize(YR_MEMORY_BLOCK_ITERATOR* it) {
+        return static_cast<YaraStreamBlocks*>(it->context)->m_fileSize;
+    }
+
+    void Prefetch(size_t index) {
+        if (index >= m_windows.size())
+            return;
+
+        const YaraBlockRange w = m_windows[index];
+        m_ahead.resize(static_cast<size_t>(w.size));
+        m_pendingIndex = index;
+        m_pending = std::async(std::launch::async, [this, w] {
+            return YaraReadAt(m_file, w.offset, m_ahead.data(), m_ahead.size(), m_aheadSize);
+        });
+    }
+
+    void Wait() {
+        if (m_pending.valid())
+            m_pending.get();
+    }
+
+    YaraFileHandle              m_file;
+    uint64_t                    m_fileSize;
+    std::vector<YaraBlockRange> m_windows;
+    size_t                      m_next = 0;
+
+    std::vector<uint8_t>        m_first;
+    size_t                      m_firstSize = 0;
+    std::vector<uint8_t>        m_current;
+    std::vector<uint8_t>        m_ahead;
+    size_t                      m_aheadSize = 0;
+    std::future<bool>           m_pending;
+    size_t                      m_pendingIndex = 0;
+
+    YR_MEMORY_BLOCK             m_block{};
+    YR_MEMORY_BLOCK_ITERATOR    m_iterator{};
+};
@@ -1,25 +1,96 @@
 ﻿#pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
 #include <yara.h>
 #include <filesystem>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../io/_admin_store.hpp"
+#include "../signature/_xxh64.hpp"
+#include "_yara_blocks.hpp"
+
 struct YaraRuleDef {
     std::string name;
     std::string source;
 };
 
+// One published generation of rules: the built-in rules and every .yar/.yara
+// pack compiled together, plus one YR_RULES per precompiled .yarc pack.
+// Scans hold a reference for their duration, so a reload never waits for
+// them; the old generation is freed by whoever drops it last. Scanner slot i
+// (one YR_SCANNER per YR_RULES) belongs to worker i and is created on first
+// use.
+struct YaraRuleSet {
+    std::vector<YR_RULES*> rules;
+    uint64_t stamp = 0;
+    mutable std::vector<std::vector<YR_SCANNER*>> scanners;
+    mutable std::vector<std::vector<std::string>> matches;
+
+    YaraRuleSet() : scanners(YR_MAX_THREADS), matches(YR_MAX_THREADS) {}
+    YaraRuleSet(const YaraRuleSet&) = delete;
+    YaraRuleSet& operator=(const YaraRuleSet&) = delete;
+
+    ~YaraRuleSet() {
+        for (auto& slot : scanners)
+            for (YR_SCANNER* scanner : slot)
+                if (scanner)
+                    yr_scanner_destroy(scanner);
+        for (YR_RULES* r : rules)
+            yr_rules_destroy(r);
+    }
+};
+
 std::vector<YaraRuleDef> globalRules;
-YR_RULES* compiledRules = nullptr;
-std::mutex yaraMutex;
+
+static std::atomic<std::shared_ptr<const YaraRuleSet>> activeRules;
+static bool yaraInitialized = false;
+
+// Serializes rebuilds (InitYara and the watcher). Scans never take it.
+static std::mutex yaraBuildMutex;
+static uint64_t failedRulesStamp = 0;
+
+// Polls the rule-pack directory and publishes a new generation on change.
+static std::thread yaraWatcher;
+static std::mutex yaraWatcherMutex;
+static std::condition_variable yaraWatcherCv;
+static bool yaraWatcherStop = false;
+
+constexpr uint32_t kCompiledRulesMagic = 0x43595242; // "BRYC"
+constexpr auto kRulePackPollInterval = std::chrono::seconds(2);
+constexpr uint64_t kAtomCorpusFileBytes = 256 * 1024;
+constexpr uint64_t kAtomCorpusBytes = 64ULL * 1024 * 1024;
 
 void AddYaraRule(const std::string& name, const std::string& ruleSource) {
     globalRules.push_back({ name, ruleSource });
 }
 
 void InitGenericRules() {
+    static bool registered = false;
+    if (registered)
+        return;
+    registered = true;
+
     AddYaraRule("STRINGS", R"(
 import "pe"
 rule STRINGS {
@@ -134,52 +205,961 @@ int YaraMatchCallback(YR_SCAN_CONTEXT* context, int message, void* message_data,
 }
 
 void YaraCompilerError(int level, const char* file, int line, const YR_RULE* rule, const char* msg, void* user_data) {
-    fprintf(stderr, "[YARA ERROR] %s:%d - %s\n", file ? file : "N/A", line, msg);
+    const char* source = file ? file : user_data ? static_cast<const char*>(user_data) : "N/A";
+    fprintf(stderr, "[YARA ERROR] %s:%d - %s\n", source, line, msg);
 }
 
-bool InitYara() {
-    if (yr_initialize() != ERROR_SUCCESS) return false;
+static std::filesystem::path GetExecutablePath() {
+#ifdef _WIN32
+    wchar_t buffer[MAX_PATH] = { 0 };
+    DWORD len = GetModuleFileNameW(nullptr, buffer, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH)
+        return {};
+    return std::filesystem::path(buffer);
+#else
+    char buffer[4096] = { 0 };
+    ssize_t len = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+    if (len <= 0)
+        return {};
+    return std::filesystem::path(std::string(buffer, static_cast<size_t>(len)));
+#endif
+}
+
+// rules.yarc in the admin store. The arena decides what gets flagged, so it
+// is never read from a location the checked account can write; without a
+// store the rules are compiled on every start and kept in memory only.
+static std::filesystem::path GetCompiledRulesPath() {
+    std::filesystem::path dir = GetAdminStoreDirectory();
+    return dir.empty() ? dir : dir / "rules.yarc";
+}
+
+// %BAMREVEAL_RULES% if set, otherwise "rules" next to the executable.
+std::filesystem::path GetRulePackPath() {
+#ifdef _WIN32
+    wchar_t buffer[MAX_PATH] = { 0 };
+    DWORD len = GetEnvironmentVariableW(L"BAMREVEAL_RULES", buffer, MAX_PATH);
+    if (len > 0 && len < MAX_PATH)
+        return std::filesystem::path(buffer);
+#else
+    if (const char* env = getenv("BAMREVEAL_RULES"); env && *env)
+        return std::filesystem::path(env);
+#endif
+    std::filesystem::path exe = GetExecutablePath();
+    return exe.empty() ? exe : exe.parent_path() / "rules";
+}
+
+static bool HasExtension(const std::filesystem::path& path, const char* ext) {
+    auto native = path.extension().native();
+    size_t len = strlen(ext);
+    if (native.size() != len)
+        return false;
+
+    for (size_t i = 0; i < len; ++i) {
+        auto c = native[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != ext[i])
+            return false;
+    }
+    return true;
+}
+
+static bool IsCompiledPack(const std::filesystem::path& path) {
+    return HasExtension(path, ".yarc");
+}
+
+// Sorted so the compile order, and with it the cache key, is stable.
+// Packs are only taken from an admin-only directory, and each pack file must
+// be admin-only too: a .yarc is loaded as is, so a pack the checked account
+// could write would let it replace detections. Refusals are reported once
+// per directory / file, not on every poll. Runs under yaraBuildMutex.
+static std::vector<std::filesystem::path> ListRulePacks() {
+    static std::filesystem::path refusedDir;
+    static std::vector<std::filesystem::path> refusedPacks;
+
+    std::vector<std::filesystem::path> packs;
+    std::filesystem::path dir = GetRulePackPath();
+
+    std::error_code ec;
+    if (dir.empty() || !std::filesystem::is_directory(dir, ec))
+        return packs;
+
+    if (!IsAdminOnlyPath(dir)) {
+        if (refusedDir != dir)
+            fprintf(stderr, "[YARA ERROR] rule pack directory %s is writable by non-administrators; packs ignored\n",
+                reinterpret_cast<const char*>(dir.u8string().c_str()));
+        refusedDir = dir;
+        return packs;
+    }
+    refusedDir.clear();
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        const auto& path = entry.path();
+        if (!entry.is_regular_file(ec) ||
+            !(HasExtension(path, ".yar") || HasExtension(path, ".yara") || IsCompiledPack(path)))
+            continue;
+
+        auto refused = std::find(refusedPacks.begin(), refusedPacks.end(), path);
+        if (IsAdminOnlyPath(path)) {
+            if (refused != refusedPacks.end())
+                refusedPacks.erase(refused);
+            packs.push_back(path);
+        } else if (refused == refusedPacks.end()) {
+            fprintf(stderr, "[YARA ERROR] rule pack %s is writable by non-administrators; ignored\n",
+                reinterpret_cast<const char*>(path.u8string().c_str()));
+            refusedPacks.push_back(path);
+        }
+    }
+
+    std::sort(packs.begin(), packs.end());
+    return packs;
+}
+
+// Change detector for the watcher: built-in rules plus pack names, sizes and
+// write times. Cheap enough to run on every poll.
+static uint64_t StampRulePacks(const std::vector<std::filesystem::path>& packs) {
+    uint64_t stamp = XXH64(YR_VERSION, sizeof(YR_VERSION) - 1, globalRules.size());
+    for (const auto& rule : globalRules)
+        stamp = XXH64(rule.source.data(), rule.source.size(), stamp);
+
+    for (const auto& pack : packs) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(pack, ec);
+        auto written = std::filesystem::last_write_time(pack, ec).time_since_epoch().count();
+
+        const auto& name = pack.native();
+        stamp = XXH64(name.data(), name.size() * sizeof(name[0]), stamp);
+        stamp = XXH64(&size, sizeof(size), stamp);
+        stamp = XXH64(&written, sizeof(written), stamp);
+    }
+    return stamp ? stamp : 1;
+}
+
+static bool ReadRulePack(const std::filesystem::path& path, YaraRuleDef& pack) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    std::ostringstream source;
+    source << in.rdbuf();
+    pack.source = source.str();
+
+    // The file name becomes the namespace, so equally named rules in two
+    // packs do not clash.
+    auto stem = path.stem().u8string();
+    pack.name.assign(reinterpret_cast<const char*>(stem.data()), stem.size());
+    return true;
+}
+
+static std::filesystem::path GetEnvironmentPath(const char* name) {
+#ifdef _WIN32
+    wchar_t wideName[64] = { 0 };
+    for (size_t i = 0; name[i] && i + 1 < std::size(wideName); ++i)
+        wideName[i] = static_cast<wchar_t>(name[i]);
+
+    wchar_t buffer[MAX_PATH] = { 0 };
+    DWORD len = GetEnvironmentVariableW(wideName, buffer, MAX_PATH);
+    if (len > 0 && len < MAX_PATH)
+        return std::filesystem::path(buffer);
+#else
+    if (const char* env = getenv(name); env && *env)
+        return std::filesystem::path(env);
+#endif
+    return {};
+}
+
+// Byte counts for the frequency-based atom choice (see
+// yr_compiler_set_atom_byte_frequencies), one per byte value.
+using AtomByteCounts = std::array<uint64_t, 256>;
+
+// %BAMREVEAL_YARA_ATOM_BYTES%; the frequency-based atom choice is off when
+// it is not set.
+static std::filesystem::path GetAtomByteCountsPath() {
+    return GetEnvironmentPath("BAMREVEAL_YARA_ATOM_BYTES");
+}
+
+// %BAMREVEAL_YARA_ATOM_REPORT%: where CompileRules writes the atoms chosen
+// for every string, worst first.
+static std::filesystem::path GetAtomReportPath() {
+    return GetEnvironmentPath("BAMREVEAL_YARA_ATOM_REPORT");
+}
+
+// Counts bytes over the binaries that make up most of a BAM scan: the first
+// kAtomCorpusFileBytes of each executable in the system directory, up to
+// kAtomCorpusBytes in total.
+static AtomByteCounts LearnAtomByteCounts() {
+    AtomByteCounts counts{};
+    std::filesystem::path corpus;
+#ifdef _WIN32
+    wchar_t system[MAX_PATH] = { 0 };
+    UINT len = GetSystemDirectoryW(system, MAX_PATH);
+    if (len > 0 && len < MAX_PATH)
+        corpus = system;
+#else
+    corpus = "/usr/bin";
+#endif
+
+    std::error_code ec;
+    if (corpus.empty() || !std::filesystem::is_directory(corpus, ec))
+        return counts;
+
+    std::vector<char> buffer(kAtomCorpusFileBytes);
+    uint64_t total = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus, ec)) {
+        const auto& path = entry.path();
+#ifdef _WIN32
+        if (!HasExtension(path, ".dll") && !HasExtension(path, ".exe"))
+            continue;
+#endif
+        if (!entry.is_regular_file(ec))
+            continue;
+
+        std::ifstream in(path, std::ios::binary);
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        for (std::streamsize i = 0; i < in.gcount(); ++i)
+            counts[static_cast<uint8_t>(buffer[i])]++;
+
+        total += static_cast<uint64_t>(in.gcount());
+        if (total >= kAtomCorpusBytes)
+            break;
+    }
+    return counts;
+}
+
+// The counts stored at GetAtomByteCountsPath(), learned and stored there
+// first if the file does not exist yet.
+static std::optional<AtomByteCounts> LoadAtomByteCounts() {
+    std::filesystem::path path = GetAtomByteCountsPath();
+    if (path.empty())
+        return std::nullopt;
 
+    AtomByteCounts counts{};
+    std::ifstream in(path, std::ios::binary);
+    if (in && in.read(reinterpret_cast<char*>(counts.data()), sizeof(counts)) && in.peek() == EOF)
+        return counts;
+    in.close();
+
+    counts = LearnAtomByteCounts();
+
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+
+    std::error_code ec;
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    bool ok = out && out.write(reinterpret_cast<const char*>(counts.data()), sizeof(counts));
+    out.close();
+    if (ok && !out.fail())
+        std::filesystem::rename(temp, path, ec);
+    else
+        std::filesystem::remove(temp, ec);
+
+    return counts;
+}
+
+// Cache key for the compiled arena: everything that goes into the compiler.
+static uint64_t HashRuleSources(const std::vector<YaraRuleDef>& packs, const std::optional<AtomByteCounts>& atomBytes) {
+    uint64_t hash = XXH64(YR_VERSION, sizeof(YR_VERSION) - 1);
+    auto add = [&hash](const std::vector<YaraRuleDef>& rules) {
+        for (const auto& rule : rules) {
+            hash = XXH64(rule.name.data(), rule.name.size(), hash);
+            hash = XXH64(rule.source.data(), rule.source.size(), hash);
+        }
+    };
+    add(globalRules);
+    add(packs);
+    if (atomBytes)
+        hash = XXH64(atomBytes->data(), sizeof(*atomBytes), hash);
+    return hash;
+}
+
+static size_t ReadRulesStream(void* ptr, size_t size, size_t count, void* user_data) {
+    return fread(ptr, size, count, static_cast<FILE*>(user_data));
+}
+
+static size_t WriteRulesStream(const void* ptr, size_t size, size_t count, void* user_data) {
+    return fwrite(ptr, size, count, static_cast<FILE*>(user_data));
+}
+
+static FILE* OpenRulesFile(const std::filesystem::path& path, bool write) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+// A .yarc pack as written by yarac / yr_rules_save.
+static YR_RULES* LoadRulePack(const std::filesystem::path& path) {
+    FILE* f = OpenRulesFile(path, false);
+    if (!f)
+        return nullptr;
+
+    YR_RULES* rules = nullptr;
+    YR_STREAM stream{ f, ReadRulesStream, nullptr };
+    if (yr_rules_load_stream(&stream, &rules) != ERROR_SUCCESS)
+        rules = nullptr;
+
+    fclose(f);
+    return rules;
+}
+
+// Header { magic, source hash } followed by the yr_rules_save_stream arena.
+static YR_RULES* LoadCompiledRules(const std::filesystem::path& path, uint64_t hash) {
+    // The stored hash only detects stale arenas; a planted one would carry a
+    // matching hash, so the file must also be admin-only.
+    if (!IsAdminOnlyPath(path))
+        return nullptr;
+
+    FILE* f = OpenRulesFile(path, false);
+    if (!f)
+        return nullptr;
+
+    uint32_t magic = 0;
+    uint64_t storedHash = 0;
+    YR_RULES* rules = nullptr;
+    if (fread(&magic, sizeof(magic), 1, f) == 1 && fread(&storedHash, sizeof(storedHash), 1, f) == 1 &&
+        magic == kCompiledRulesMagic && storedHash == hash) {
+        YR_STREAM stream{ f, ReadRulesStream, nullptr };
+        if (yr_rules_load_stream(&stream, &rules) != ERROR_SUCCESS)
+            rules = nullptr;
+    }
+
+    fclose(f);
+    return rules;
+}
+
+static void SaveCompiledRules(const std::filesystem::path& path, uint64_t hash, YR_RULES* rules) {
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+
+    FILE* f = OpenRulesFile(temp, true);
+    if (!f)
+        return;
+
+    YR_STREAM stream{ f, nullptr, WriteRulesStream };
+    bool ok = fwrite(&kCompiledRulesMagic, sizeof(kCompiledRulesMagic), 1, f) == 1 &&
+        fwrite(&hash, sizeof(hash), 1, f) == 1 &&
+        yr_rules_save_stream(rules, &stream) == ERROR_SUCCESS;
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(temp, path, ec);
+    if (!ok || ec)
+        std::filesystem::remove(temp, ec);
+}
+
+static std::string JsonString(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + "\"";
+}
+
+struct YaraAtomReportEntry {
+    std::string pack;
+    std::string rule;
+    std::string string;
+    int quality = 0;
+    std::vector<std::pair<std::string, int>> atoms;
+};
+
+struct YaraAtomReport {
     YR_COMPILER* compiler = nullptr;
-    if (yr_compiler_create(&compiler) != ERROR_SUCCESS) {
-        yr_finalize();
+    const char* pack = "";
+    std::vector<YaraAtomReportEntry> entries;
+};
+
+// Atom bytes in hex-string notation: "??" for unknown bytes, "?X" / "X?"
+// for unknown nibbles.
+static std::string FormatAtom(const YR_ATOM& atom) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string out;
+    for (int i = 0; i < atom.length; ++i) {
+        if (i)
+            out += ' ';
+        out += atom.mask[i] & 0xF0 ? digits[atom.bytes[i] >> 4] : '?';
+        out += atom.mask[i] & 0x0F ? digits[atom.bytes[i] & 0x0F] : '?';
+    }
+    return out;
+}
+
+static void CollectAtoms(const YR_RULE* rule, const char* string, const YR_ATOM_LIST_ITEM* atoms, int quality, void* user_data) {
+    auto* report = static_cast<YaraAtomReport*>(user_data);
+
+    YaraAtomReportEntry entry{ report->pack, rule ? rule->identifier : "", string ? string : "", quality };
+    for (const YR_ATOM_LIST_ITEM* atom = atoms; atom; atom = atom->next)
+        entry.atoms.emplace_back(FormatAtom(atom->atom), yr_compiler_get_atom_quality(report->compiler, &atom->atom));
+
+    report->entries.push_back(std::move(entry));
+}
+
+// Strings ranked by the quality of their worst atom, lowest first. The ones
+// below the compiler's warning threshold are the ones it also warned about
+// ("may slow down scanning") and are flagged "slow".
+static bool WriteAtomReport(const std::filesystem::path& path, YaraAtomReport& report, bool byteFrequencies) {
+    std::stable_sort(report.entries.begin(), report.entries.end(), [](const YaraAtomReportEntry& a, const YaraAtomReportEntry& b) {
+        return a.quality < b.quality;
+    });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
         return false;
+
+    int threshold = report.compiler->atoms_config.quality_warning_threshold;
+    out << "{\n  \"quality\": " << JsonString(byteFrequencies ? "byte_frequency" : "heuristic")
+        << ",\n  \"warning_threshold\": " << threshold << ",\n  \"strings\": [";
+
+    for (size_t i = 0; i < report.entries.size(); ++i) {
+        const auto& e = report.entries[i];
+        out << (i ? ",\n" : "\n") << "    { \"pack\": " << JsonString(e.pack) << ", \"rule\": " << JsonString(e.rule)
+            << ", \"string\": " << JsonString(e.string) << ", \"quality\": " << e.quality
+            << ", \"slow\": " << (e.quality < threshold ? "true" : "false") << ", \"atoms\": [";
+        for (size_t j = 0; j < e.atoms.size(); ++j)
+            out << (j ? ", " : "") << "{ \"bytes\": " << JsonString(e.atoms[j].first) << ", \"quality\": " << e.atoms[j].second << " }";
+        out << "] }";
     }
+    out << "\n  ]\n}\n";
+
+    return static_cast<bool>(out);
+}
+
+// Built-in rules go to the default namespace, each source pack to its own.
+// With atom byte counts, atoms are chosen by yr_atoms_frequency_quality
+// instead of the built-in heuristic.
+static YR_RULES* CompileRules(const std::vector<YaraRuleDef>& packs, const std::optional<AtomByteCounts>& atomBytes) {
+    YR_COMPILER* compiler = nullptr;
+    if (yr_compiler_create(&compiler) != ERROR_SUCCESS)
+        return nullptr;
 
     yr_compiler_set_callback(compiler, YaraCompilerError, nullptr);
+    if (atomBytes)
+        yr_compiler_set_atom_byte_frequencies(compiler, atomBytes->data(), YR_ATOM_QUALITY_WARNING_THRESHOLD);
 
+    YaraAtomReport report{ compiler };
+    std::filesystem::path reportPath = GetAtomReportPath();
+    if (!reportPath.empty())
+        yr_compiler_set_atoms_callback(compiler, CollectAtoms, &report);
+
+    bool ok = true;
     for (const auto& rule : globalRules) {
         if (yr_compiler_add_string(compiler, rule.source.c_str(), nullptr) != 0) {
-            yr_compiler_destroy(compiler);
-            yr_finalize();
+            ok = false;
+            break;
+        }
+    }
+
+    for (size_t i = 0; ok && i < packs.size(); ++i) {
+        report.pack = packs[i].name.c_str();
+        yr_compiler_set_callback(compiler, YaraCompilerError, const_cast<char*>(packs[i].name.c_str()));
+        ok = yr_compiler_add_string(compiler, packs[i].source.c_str(), packs[i].name.c_str()) == 0;
+    }
+
+    if (!reportPath.empty())
+        WriteAtomReport(reportPath, report, atomBytes.has_value());
+
+    YR_RULES* rules = nullptr;
+    if (ok && yr_compiler_get_rules(compiler, &rules) != ERROR_SUCCESS)
+        rules = nullptr;
+
+    yr_compiler_destroy(compiler);
+    return rules;
+}
+
+// The source rules come from the arena cache in the admin store when the
+// sources are unchanged, and are compiled (and the cache rewritten)
+// otherwise. Packs that do not compile fail the build so the current
+// generation stays in place, unless there is none yet; then the built-in
+// rules are used alone.
+static std::shared_ptr<YaraRuleSet> BuildRuleSet(const std::vector<std::filesystem::path>& packs, uint64_t stamp, bool haveCurrent) {
+    std::vector<YaraRuleDef> sources;
+    for (const auto& pack : packs) {
+        YaraRuleDef def;
+        if (IsCompiledPack(pack))
+            continue;
+        if (ReadRulePack(pack, def))
+            sources.push_back(std::move(def));
+        else
+            fprintf(stderr, "[YARA ERROR] cannot read rule pack %s\n", reinterpret_cast<const char*>(pack.u8string().c_str()));
+    }
+
+    auto atomBytes = LoadAtomByteCounts();
+    uint64_t hash = HashRuleSources(sources, atomBytes);
+    std::filesystem::path cachePath = GetCompiledRulesPath();
+
+    // The atom report is only produced by a real compile.
+    YR_RULES* rules = cachePath.empty() || !GetAtomReportPath().empty() ? nullptr : LoadCompiledRules(cachePath, hash);
+    if (!rules) {
+        rules = CompileRules(sources, atomBytes);
+        if (!rules && !sources.empty() && !haveCurrent) {
+            sources.clear();
+            hash = HashRuleSources(sources, atomBytes);
+            rules = CompileRules(sources, atomBytes);
+        }
+        if (!rules)
+            return nullptr;
+        if (!cachePath.empty())
+            SaveCompiledRules(cachePath, hash, rules);
+    }
+
+    auto set = std::make_shared<YaraRuleSet>();
+    set->stamp = stamp;
+    set->rules.push_back(rules);
+
+    for (const auto& pack : packs) {
+        if (!IsCompiledPack(pack))
+            continue;
+        if (YR_RULES* compiled = LoadRulePack(pack))
+            set->rules.push_back(compiled);
+        else
+            fprintf(stderr, "[YARA ERROR] cannot load compiled rule pack %s\n", reinterpret_cast<const char*>(pack.u8string().c_str()));
+    }
+
+    return set;
+}
+
+// Publishes a new generation if the built-in rules or the packs changed. A
+// pack set that failed to build is not retried until it changes again.
+static bool RefreshRules() {
+    std::lock_guard<std::mutex> lock(yaraBuildMutex);
+
+    auto packs = ListRulePacks();
+    uint64_t stamp = StampRulePacks(packs);
+
+    auto current = activeRules.load();
+    if (current && current->stamp == stamp)
+        return true;
+    if (stamp == failedRulesStamp)
+        return current != nullptr;
+
+    auto set = BuildRuleSet(packs, stamp, current != nullptr);
+    if (!set) {
+        failedRulesStamp = stamp;
+        return current != nullptr;
+    }
+
+    activeRules.store(std::move(set));
+    return true;
+}
+
+static void YaraWatcherLoop() {
+    std::unique_lock<std::mutex> lock(yaraWatcherMutex);
+    while (!yaraWatcherCv.wait_for(lock, kRulePackPollInterval, [] { return yaraWatcherStop; })) {
+        lock.unlock();
+        RefreshRules();
+        lock.lock();
+    }
+}
+
+// Cheap when nothing changed: only the pack directory is listed. Starts the
+// watcher that hot-reloads packs from then on.
+bool InitYara() {
+    if (!yaraInitialized) {
+        if (yr_initialize() != ERROR_SUCCESS)
             return false;
+        yaraInitialized = true;
+    }
+
+    bool ok = RefreshRules();
+
+    if (!yaraWatcher.joinable()) {
+        yaraWatcherStop = false;
+        yaraWatcher = std::thread(YaraWatcherLoop);
+    }
+    return ok;
+}
+
+// No scan may be running: yr_finalize must come after the last generation
+// is gone.
+void FinalizeYara() {
+    if (yaraWatcher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(yaraWatcherMutex);
+            yaraWatcherStop = true;
         }
+        yaraWatcherCv.notify_all();
+        yaraWatcher.join();
     }
 
-    if (yr_compiler_get_rules(compiler, &compiledRules) != ERROR_SUCCESS) {
-        yr_compiler_destroy(compiler);
+    activeRules.store(nullptr);
+    failedRulesStamp = 0;
+
+    if (yaraInitialized) {
         yr_finalize();
+        yaraInitialized = false;
+    }
+}
+
+bool FastScanMemory(const uint8_t* data, size_t size, std::vector<std::string>& matchedRules) {
+    auto set = activeRules.load();
+    if (!set || !data)
         return false;
+
+    matchedRules.clear();
+    for (YR_RULES* rules : set->rules)
+        yr_rules_scan_mem(rules, data, size, SCAN_FLAGS_FAST_MODE, YaraMatchCallback, &matchedRules, 0);
+
+    return !matchedRules.empty();
+}
+
+// Scanner `index` of worker `worker` in `set`, created on first use. Only
+// that worker ever touches its slot.
+static YR_SCANNER* GetWorkerScanner(const YaraRuleSet& set, size_t worker, size_t index) {
+    auto& slot = set.scanners[worker];
+    if (slot.size() != set.rules.size())
+        slot.resize(set.rules.size(), nullptr);
+
+    if (!slot[index]) {
+        if (yr_scanner_create(set.rules[index], &slot[index]) != ERROR_SUCCESS) {
+            slot[index] = nullptr;
+            return nullptr;
+        }
+        yr_scanner_set_flags(slot[index], SCAN_FLAGS_FAST_MODE);
+        yr_scanner_set_callback(slot[index], YaraMatchCallback, &set.matches[worker]);
     }
+    return slot[index];
+}
 
-    yr_compiler_destroy(compiler);
+bool InitYaraScanners(size_t workers) {
+    auto set = activeRules.load();
+    if (!set)
+        return false;
+
+    workers = std::min<size_t>(workers, YR_MAX_THREADS);
+    for (size_t worker = 0; worker < workers; ++worker) {
+        for (size_t i = 0; i < set->rules.size(); ++i) {
+            if (!GetWorkerScanner(*set, worker, i))
+                return false;
+        }
+    }
     return true;
 }
 
-void FinalizeYara() {
-    if (compiledRules) {
-        yr_rules_destroy(compiledRules);
-        compiledRules = nullptr;
+bool ScanMemoryOnWorker(size_t worker, const uint8_t* data, size_t size, std::vector<std::string>& matchedRules) {
+    auto set = activeRules.load();
+    if (!set || worker >= set->scanners.size())
+        return FastScanMemory(data, size, matchedRules);
+
+    matchedRules.clear();
+    if (!data)
+        return false;
+
+    std::vector<std::string>& buffer = set->matches[worker];
+    buffer.clear();
+
+    for (size_t i = 0; i < set->rules.size(); ++i) {
+        if (YR_SCANNER* scanner = GetWorkerScanner(*set, worker, i))
+            yr_scanner_scan_mem(scanner, data, size);
     }
-    yr_finalize();
+
+    matchedRules.swap(buffer);
+    return !matchedRules.empty();
 }
+// Runs every YR_RULES of the set over the blocks, on the worker's scanners
+// when it has them.
+static bool ScanBlocksOnWorker(const YaraRuleSet& set, size_t worker, YR_MEMORY_BLOCK_ITERATOR* blocks, int timeout, std::vector<std::string>& matchedRules) {
+    matchedRules.clear();
 
-bool FastScanFile(const std::string& filePath, std::vector<std::string>& matchedRules) {
-    if (!compiledRules)
+    if (worker >= set.scanners.size()) {
+        for (YR_RULES* rules : set.rules)
+            yr_rules_scan_mem_blocks(rules, blocks, SCAN_FLAGS_FAST_MODE, YaraMatchCallback, &matchedRules, timeout);
+        return !matchedRules.empty();
+    }
+
+    std::vector<std::string>& buffer = set.matches[worker];
+    buffer.clear();
+
+    for (size_t i = 0; i < set.rules.size(); ++i) {
+        YR_SCANNER* scanner = GetWorkerScanner(set, worker, i);
+        if (!scanner)
+            continue;
+
+        // The scanner is reused for full scans, which run without a timeout.
+        yr_scanner_set_timeout(scanner, timeout);
+        yr_scanner_scan_mem_blocks(scanner, blocks);
+        yr_scanner_set_timeout(scanner, 0);
+    }
+
+    matchedRules.swap(buffer);
+    return !matchedRules.empty();
+}
+
+static bool IsValidYaraFile(YaraFileHandle file) {
+#ifdef _WIN32
+    return file != nullptr && file != INVALID_HANDLE_VALUE;
+#else
+    return file >= 0;
+#endif
+}
+
+// Streams `ranges` of the file through the worker's scanners.
+static bool StreamBlocksOnWorker(const YaraRuleSet& set, size_t worker, YaraFileHandle file, uint64_t size,
+    const uint8_t* header, size_t headerSize, const std::vector<YaraBlockRange>& ranges, int timeout, std::vector<std::string>& matchedRules) {
+    YaraStreamBlocks blocks(file, size, ranges, PlanFirstBlock(header, headerSize, size));
+    return ScanBlocksOnWorker(set, worker, blocks.Iterator(), timeout, matchedRules);
+}
+
+bool ScanTieredOnWorker(size_t worker, const uint8_t* data, uint64_t size, YaraFileHandle file, std::vector<std::string>& matchedRules, YaraScanTier& tier) {
+    matchedRules.clear();
+
+    bool streamable = IsValidYaraFile(file);
+    tier = data || streamable ? ChooseYaraScanTier(size) : YaraScanTier::None;
+    if (tier == YaraScanTier::None || size == 0) {
+        tier = YaraScanTier::None;
         return false;
+    }
+    if (tier == YaraScanTier::Full && data)
+        return ScanMemoryOnWorker(worker, data, static_cast<size_t>(size), matchedRules);
+
+    auto set = activeRules.load();
+    if (!set) {
+        tier = YaraScanTier::None;
+        return false;
+    }
+
+    // Plans need the headers only; without a mapping they are read from
+    // the handle.
+    std::vector<uint8_t> headerBuffer;
+    const uint8_t* header = data;
+    size_t headerSize = static_cast<size_t>(std::min<uint64_t>(size, kYaraHeaderProbe));
+    if (!data) {
+        headerBuffer.resize(headerSize);
+        if (!YaraReadAt(file, 0, headerBuffer.data(), headerSize, headerSize)) {
+            tier = YaraScanTier::None;
+            return false;
+        }
+        header = headerBuffer.data();
+    }
+
+    std::vector<YaraBlockRange> ranges;
+    if (tier == YaraScanTier::Full)
+        ranges.push_back({ 0, size });
+    else if (tier == YaraScanTier::Sections)
+        ranges = PlanSectionBlocks(header, headerSize, size);
+    else
+        ranges = PlanStreamBlocks(header, headerSize, size);
+
+    int timeout = tier == YaraScanTier::Streamed ? kYaraStreamTimeout : 0;
+
+    // Huge files are read through the handle instead of being faulted in
+    // from the mapping, so memory stays bounded by the stream window.
+    if (data && (tier == YaraScanTier::Sections || !streamable)) {
+        YaraMappedBlocks blocks(data, size, std::move(ranges));
+        return ScanBlocksOnWorker(*set, worker, blocks.Iterator(), timeout, matchedRules);
+    }
+    return StreamBlocksOnWorker(*set, worker, file, size, header, headerSize, ranges, timeout, matchedRules);
+}
 
+// Streams the whole file in windows instead of mapping it the way
+// yr_rules_scan_file does.
+bool FastScanFile(const std::string& filePath, std::vector<std::string>& matchedRules) {
     matchedRules.clear();
 
-    return (yr_rules_scan_file(compiledRules, filePath.c_str(), SCAN_FLAGS_FAST_MODE, YaraMatchCallback, &matchedRules, 0) == ERROR_SUCCESS)
-        && !matchedRules.empty();
+    auto set = activeRules.load();
+    if (!set)
+        return false;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER fileSize{};
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+    uint64_t size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+    int file = open(filePath.c_str(), O_RDONLY);
+    struct stat st {};
+    if (file < 0)
+        return false;
+    if (fstat(file, &st) != 0) {
+        close(file);
+        return false;
+    }
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+#endif
+
+    std::vector<uint8_t> header(static_cast<size_t>(std::min<uint64_t>(size, kYaraHeaderProbe)));
+    size_t headerSize = 0;
+    if (size > 0 && YaraReadAt(file, 0, header.data(), header.size(), headerSize))
+        StreamBlocksOnWorker(*set, SIZE_MAX, file, size, header.data(), headerSize, { { 0, size } }, 0, matchedRules);
+
+#ifdef _WIN32
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+    return !matchedRules.empty();
+}
+
+// %BAMREVEAL_YARA_PROFILE% in profiling builds, empty otherwise.
+std::filesystem::path GetYaraProfilePath() {
+#ifdef YR_PROFILING_ENABLED
+#ifdef _WIN32
+    wchar_t buffer[MAX_PATH] = { 0 };
+    DWORD len = GetEnvironmentVariableW(L"BAMREVEAL_YARA_PROFILE", buffer, MAX_PATH);
+    if (len > 0 && len < MAX_PATH)
+        return std::filesystem::path(buffer);
+#else
+    if (const char* env = getenv("BAMREVEAL_YARA_PROFILE"); env && *env)
+        return std::filesystem::path(env);
+#endif
+#endif
+    return {};
+}
+
+void ResetYaraProfile() {
+#ifdef YR_PROFILING_ENABLED
+    if (auto set = activeRules.load()) {
+        for (const auto& slot : set->scanners)
+            for (YR_SCANNER* scanner : slot)
+                if (scanner)
+                    yr_scanner_reset_profiling_info(scanner);
+    }
+    yr_reset_allocation_counters();
+#endif
+}
+
+#ifdef YR_PROFILING_ENABLED
+struct YaraRuleCost {
+    std::string ns;
+    std::string rule;
+    uint64_t atomMatches = 0;
+    uint64_t verifyTime = 0;
+    uint64_t execTime = 0;
+};
+
+struct YaraStringCost {
+    std::string rule;
+    std::string string;
+    uint64_t atomMatches = 0;
+    uint64_t verifiedMatches = 0;
+    uint64_t verifyTime = 0;
+};
+
+// Only one in YR_MATCH_VERIFICATION_PROFILING_RATE verifications is timed;
+// scale the sampled time up to all of them.
+static uint64_t EstimateVerifyTime(uint64_t sampledTime, uint64_t atomMatches) {
+    uint64_t samples = (atomMatches + YR_MATCH_VERIFICATION_PROFILING_RATE - 1) / YR_MATCH_VERIFICATION_PROFILING_RATE;
+    return samples ? sampledTime * atomMatches / samples : 0;
+}
+#endif
+
+// Sums the counters of every worker scanner of the current set and writes
+// three rankings: rules by total cost, strings by atom hits (each hit is an
+// Aho-Corasick match of one of the string's atoms) and strings by
+// verification time. Scans that fell back to yr_rules_scan_mem, or that ran
+// on a set replaced during the run, are not included.
+bool WriteYaraProfile(const std::filesystem::path& path) {
+#ifdef YR_PROFILING_ENABLED
+    constexpr size_t kTopStrings = 50;
+
+    auto set = activeRules.load();
+    if (!set || path.empty())
+        return false;
+
+    std::vector<YaraRuleCost> rules;
+    std::vector<YaraStringCost> strings;
+
+    for (size_t r = 0; r < set->rules.size(); ++r) {
+        const YR_RULES* compiled = set->rules[r];
+        size_t ruleBase = rules.size();
+        size_t stringBase = strings.size();
+
+        for (uint32_t i = 0; i < compiled->num_rules; ++i) {
+            const YR_RULE& rule = compiled->rules_table[i];
+            rules.push_back({ rule.ns->name, rule.identifier });
+        }
+        for (uint32_t i = 0; i < compiled->num_strings; ++i) {
+            const YR_STRING& string = compiled->strings_table[i];
+            strings.push_back({ compiled->rules_table[string.rule_idx].identifier, string.identifier });
+        }
+
+        for (const auto& slot : set->scanners) {
+            if (slot.size() <= r || !slot[r])
+                continue;
+
+            const YR_SCANNER* scanner = slot[r];
+            for (uint32_t i = 0; i < compiled->num_rules; ++i) {
+                const YR_PROFILING_INFO& info = scanner->profiling_info[i];
+                YaraRuleCost& cost = rules[ruleBase + i];
+                cost.atomMatches += info.atom_matches;
+                cost.verifyTime += EstimateVerifyTime(info.match_time, info.atom_matches);
+                cost.execTime += info.exec_time;
+            }
+            for (uint32_t i = 0; i < compiled->num_strings; ++i) {
+                const YR_STRING_PROFILING_INFO& info = scanner->string_profiling_info[i];
+                YaraStringCost& cost = strings[stringBase + i];
+                cost.atomMatches += info.atom_matches;
+                cost.verifiedMatches += info.verified_matches;
+                cost.verifyTime += EstimateVerifyTime(info.match_time, info.atom_matches);
+            }
+        }
+    }
+
+    std::sort(rules.begin(), rules.end(), [](const YaraRuleCost& a, const YaraRuleCost& b) {
+        return a.verifyTime + a.execTime > b.verifyTime + b.execTime;
+    });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    out << "{\n  \"verification_sample_rate\": " << YR_MATCH_VERIFICATION_PROFILING_RATE << ",\n";
+
+    // libyara heap traffic of the whole process since the last reset, to
+    // check that scans stay on the scanners' notebooks.
+    YR_ALLOCATION_COUNTERS allocs;
+    yr_get_allocation_counters(&allocs);
+    out << "  \"allocations\": { \"calls\": " << allocs.allocations << ", \"frees\": " << allocs.frees
+        << ", \"bytes\": " << allocs.bytes << " },\n";
+
+    out << "  \"rules\": [";
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const auto& c = rules[i];
+        out << (i ? ",\n" : "\n") << "    { \"namespace\": " << JsonString(c.ns) << ", \"rule\": " << JsonString(c.rule)
+            << ", \"cost_ns\": " << c.verifyTime + c.execTime << ", \"verify_ns\": " << c.verifyTime
+            << ", \"condition_ns\": " << c.execTime << ", \"atom_matches\": " << c.atomMatches << " }";
+    }
+    out << "\n  ],\n";
+
+    // Strings that never cost anything are left out.
+    auto writeStrings = [&](const char* name, uint64_t YaraStringCost::* key) {
+        std::sort(strings.begin(), strings.end(), [key](const YaraStringCost& a, const YaraStringCost& b) {
+            return a.*key > b.*key;
+        });
+
+        out << "  " << JsonString(name) << ": [";
+        for (size_t i = 0; i < strings.size() && i < kTopStrings && strings[i].*key; ++i) {
+            const auto& c = strings[i];
+            out << (i ? ",\n" : "\n") << "    { \"rule\": " << JsonString(c.rule) << ", \"string\": " << JsonString(c.string)
+                << ", \"atom_matches\": " << c.atomMatches << ", \"verified_matches\": " << c.verifiedMatches
+                << ", \"verify_ns\": " << c.verifyTime << " }";
+        }
+        out << "\n  ]";
+    };
+
+    writeStrings("atom_hits", &YaraStringCost::atomMatches);
+    out << ",\n";
+    writeStrings("verification", &YaraStringCost::verifyTime);
+    out << "\n}\n";
+
+    return static_cast<bool>(out);
+#else
+    (void)path;
+    return false;
+#endif
 }
\ No newline at end of file
@@ -6,19 +6,54 @@
 #include <yara.h>
 #include <filesystem>
 
+#include "_yara_blocks.hpp"
+
 struct YaraRuleDef {
     std::string name;
     std::string source;
 };
 
 extern std::vector<YaraRuleDef> globalRules;
-extern YR_RULES* compiledRules;
-extern std::mutex yaraMutex;
 
 void AddYaraRule(const std::string& name, const std::string& ruleSource);
 void InitGenericRules();
 int YaraMatchCallback(YR_SCAN_CONTEXT* context, int message, void* message_data, void* user_data);
 void YaraCompilerError(int level, const char* file, int line, const YR_RULE* rule, const char* msg, void* user_data);
+// Built-in rules plus the packs in GetRulePackPath(): *.yar / *.yara sources
+// and *.yarc precompiled rules. The directory and every pack must be owned by
+// and writable only by administrators (IsAdminOnlyPath); others are ignored.
+// InitYara publishes the current set and starts a watcher that recompiles
+// in the background when packs change; scans already running finish on the
+// set they started with.
+// Source rules pick their atoms with the built-in heuristic unless
+// %BAMREVEAL_YARA_ATOM_BYTES% names a byte-count file (learned from the
+// system directory when missing), and %BAMREVEAL_YARA_ATOM_REPORT% receives
+// a JSON ranking of every string's atoms by quality on each compile.
+std::filesystem::path GetRulePackPath();
 bool InitYara();
+// No scan may be running.
 void FinalizeYara();
-bool FastScanFile(const std::string& filePath, std::vector<std::string>& matchedRules);
\ No newline at end of file
+bool FastScanFile(const std::string& filePath, std::vector<std::string>& matchedRules);
+bool FastScanMemory(const uint8_t* data, size_t size, std::vector<std::string>& matchedRules);
+
+// One reusable YR_SCANNER per worker (at most YR_MAX_THREADS) and rule set,
+// created on the worker's first scan; InitYaraScanners creates them up front
+// for the current set and must not race with scans. A scanner must only ever
+// be used by the worker that owns its index.
+bool InitYaraScanners(size_t workers);
+bool ScanMemoryOnWorker(size_t worker, const uint8_t* data, size_t size, std::vector<std::string>& matchedRules);
+// Like ScanMemoryOnWorker, but only files up to kYaraFullScanLimit are
+// scanned whole; see _yara_blocks.hpp. `tier` reports the coverage used.
+// Huge files are streamed from `file` when it is valid rather than read
+// through the mapping; `data` may be null for files that could not be
+// mapped at all.
+bool ScanTieredOnWorker(size_t worker, const uint8_t* data, uint64_t size, YaraFileHandle file, std::vector<std::string>& matchedRules, YaraScanTier& tier);
+
+// Profiling builds (YR_PROFILING_ENABLED for libyara and this file) collect
+// per-rule and per-string cost in the worker scanners, plus libyara's heap
+// allocation counters. When GetYaraProfilePath() is non-empty, a run resets
+// the counters first and writes a ranked JSON report there at the end. Both calls do nothing in
+// regular builds and must not race with scans.
+std::filesystem::path GetYaraProfilePath();
+void ResetYaraProfile();
+bool WriteYaraProfile(const std::filesystem::path& path);
\ No newline at end of file